@@ -0,0 +1,44 @@
+#include "boot_phases.h"
+#include "hal.h"
+#include <stdatomic.h>
+
+static uint32_t phase_times[BOOT_PHASE_COUNT];
+static _Atomic bool phase_reached[BOOT_PHASE_COUNT];
+
+static const char *const phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_CONFIG_LOADED] = "config loaded",
+    [BOOT_PHASE_PIPELINE_START] = "pipeline start",
+    [BOOT_PHASE_CRSF_READY] = "CRSF UART ready",
+    [BOOT_PHASE_FIRST_FRAME] = "first CRSF frame",
+    [BOOT_PHASE_FIRST_SENSOR_FRAME] = "first sensor frame",
+    [BOOT_PHASE_USB_READY] = "USB ready",
+};
+
+void boot_phases_reset(void) {
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        atomic_store(&phase_reached[i], false);
+        phase_times[i] = 0;
+    }
+}
+
+// The time is published before the flag, so a reader on the other core
+// never sees a reached phase without its time
+void boot_phase_mark(boot_phase_t phase) {
+    if (atomic_load_explicit(&phase_reached[phase], memory_order_relaxed)) {
+        return;
+    }
+    phase_times[phase] = hal_time_us();
+    atomic_store_explicit(&phase_reached[phase], true, memory_order_release);
+}
+
+bool boot_phase_reached(boot_phase_t phase) {
+    return atomic_load_explicit(&phase_reached[phase], memory_order_acquire);
+}
+
+uint32_t boot_phase_time_us(boot_phase_t phase) {
+    return boot_phase_reached(phase) ? phase_times[phase] : 0;
+}
+
+const char *boot_phase_name(boot_phase_t phase) {
+    return phase < BOOT_PHASE_COUNT ? phase_names[phase] : "unknown";
+}
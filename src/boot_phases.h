@@ -0,0 +1,27 @@
+#ifndef BOOT_PHASES_H
+#define BOOT_PHASES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Boot phase timestamps in hal_time_us, which starts at zero with the
+// target. Each phase keeps the time it was first reached and is marked by
+// one core only, so no locking is needed.
+typedef enum {
+    BOOT_PHASE_CONFIG_LOADED,
+    BOOT_PHASE_PIPELINE_START,      // Core1 running
+    BOOT_PHASE_CRSF_READY,          // CRSF UART initialized
+    BOOT_PHASE_FIRST_FRAME,         // First CRSF transfer started
+    BOOT_PHASE_FIRST_SENSOR_FRAME,  // First transfer with converted sensor data
+    BOOT_PHASE_USB_READY,           // USB stdio initialized
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+// Function prototypes
+void boot_phases_reset(void);
+void boot_phase_mark(boot_phase_t phase);
+bool boot_phase_reached(boot_phase_t phase);
+uint32_t boot_phase_time_us(boot_phase_t phase);
+const char *boot_phase_name(boot_phase_t phase);
+
+#endif // BOOT_PHASES_H
@@ -7,6 +7,11 @@
 #define FRSKY_RX_PIN 1
 #define FRSKY_BAUD_RATE 57600
 
+// Additional S.PORT inputs on PIO UART receivers, one pin per extra bus
+#define FRSKY_BUS_COUNT 1
+#define FRSKY_PIO_ID pio0
+#define FRSKY_PIO_RX_PINS { 2, 3, 6, 7 }
+
 #define CRSF_UART_ID uart1
 #define CRSF_TX_PIN 4
 #define CRSF_RX_PIN 5
@@ -15,13 +20,32 @@
 #define LED_PIN 25
 
 // Protocol Configuration
-#define FRSKY_BUFFER_SIZE 256
+#define FRSKY_BUFFER_SIZE_BITS 9
+#define FRSKY_BUFFER_SIZE (1u << FRSKY_BUFFER_SIZE_BITS)
 #define CRSF_MAX_PACKET_SIZE 64
+#define CRSF_TX_BUFFER_SIZE 256
+#define CRSF_TX_QUEUE_DEPTH 16
+#define CRSF_TX_MAX_BATCH 8
+#define CRSF_TX_RESERVE_SIZE 32
+#define CRSF_TX_DROP_POLICY CRSF_TX_DROP_OLDEST
 
 // Timing Configuration
 #define HEARTBEAT_INTERVAL_US 100000
 #define LED_BLINK_INTERVAL_US 500000
 #define TELEMETRY_TIMEOUT_US 5000000
+#define PIPELINE_STATS_INTERVAL_US 250000
+#define PIPELINE_LATENCY_TYPES 8
+
+// A sensor unheard for TELEMETRY_TIMEOUT_US is lost. Timeouts run on a wheel
+// of FRESHNESS_TICK_US ticks, so they end up to one tick late; the timeout
+// may span at most 63 ticks.
+#define FRESHNESS_TICK_US 100000
+
+// Both cores sleep between events until their next task is due. Core1 still
+// looks at inputs without a receive interrupt every PIPELINE_IDLE_MAX_US,
+// core0 at the USB console every CORE0_IDLE_MAX_US.
+#define PIPELINE_IDLE_MAX_US 250
+#define CORE0_IDLE_MAX_US 10000
 
 // Debug Configuration
 #define DEBUG_ENABLED 1
@@ -29,6 +53,50 @@
 #define DEBUG_CRSF_PACKETS 0
 #define DEBUG_CONVERSIONS 1
 
+// Active S.PORT master on bus 0 (off by default): one poll every
+// SPORT_MASTER_SLOT_US, IDs that answered within SPORT_MASTER_ACTIVE_US
+// share the slots and every SPORT_MASTER_PROBE_EVERY-th slot probes a
+// silent ID. Achieved rates are measured over SPORT_MASTER_RATE_WINDOW_US.
+#define SPORT_MASTER_ENABLED 0
+#define SPORT_MASTER_SLOT_US 12000
+#define SPORT_MASTER_ACTIVE_US 1000000
+#define SPORT_MASTER_PROBE_EVERY 4
+#define SPORT_MASTER_RATE_WINDOW_US 1000000
+
+// Raw S.PORT capture and telemetry mirror over USB: core1 encodes received
+// runs or mirror records into chunks that core0 writes out; chunks are
+// dropped when USB falls behind
+#define SPORT_CAPTURE_CHUNK_SIZE 128
+#define SPORT_CAPTURE_QUEUE_DEPTH 32
+
+// Configuration record log: sectors from the config flash offset on, and
+// how long a save waits for the pipeline to reach a quiet moment
+#define CONFIG_STORE_SECTORS 4
+#define CONFIG_FLASH_WINDOW_TIMEOUT_US 20000
+
+// Receive error rates are computed from cause totals sampled every
+// RX_STATS_SAMPLE_INTERVAL_US, kept for RX_STATS_WINDOW_SAMPLES intervals
+#define RX_STATS_SAMPLE_INTERVAL_US 1000000
+#define RX_STATS_WINDOW_SAMPLES 61
+
+// Stage profiler: TRACE_BEGIN/TRACE_END record cycle counts into an
+// in-RAM ring per core, dumped over USB. Off by default, the macros then
+// compile to nothing; the CMake option FRSKY_TRACE turns it on.
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+#define TRACE_RING_SIZE 2048
+
+// Deferred log (src/deferred_log.h): DLOG records go into a ring of
+// DEFERRED_LOG_RING_SIZE records per core, which core0 drains every
+// DEFERRED_LOG_DRAIN_INTERVAL_US. With DEFERRED_LOG_ENABLED 0 the calls
+// compile to nothing.
+#ifndef DEFERRED_LOG_ENABLED
+#define DEFERRED_LOG_ENABLED 1
+#endif
+#define DEFERRED_LOG_RING_SIZE 128
+#define DEFERRED_LOG_DRAIN_INTERVAL_US 20000
+
 // Feature Configuration
 #define ENABLE_GPS_CONVERSION 1
 #define ENABLE_BATTERY_CONVERSION 1
@@ -36,6 +104,17 @@
 #define ENABLE_VARIO_CONVERSION 1
 #define ENABLE_TEMPERATURE_CONVERSION 1
 #define ENABLE_RPM_CONVERSION 1
+#define ENABLE_CELLS_CONVERSION 1
+
+// Derived sensors: consumed capacity integrated from the current and, with
+// no VSPD sensor, vertical speed from the filtered altitude. Samples further
+// apart than the gaps are not integrated, or restart the vario filter. The
+// filter corrects its altitude by 1/2^ALPHA_SHIFT of the error and its
+// rate by 1/2^BETA_SHIFT of the error per second.
+#define DERIVED_CAPACITY_MAX_GAP_US 1000000
+#define DERIVED_VARIO_MAX_GAP_US 500000
+#define DERIVED_VARIO_ALPHA_SHIFT 2
+#define DERIVED_VARIO_BETA_SHIFT 5
 
 // CRSF Configuration
 #define CRSF_DEVICE_ADDRESS CRSF_ADDRESS_FLIGHT_CONTROLLER
@@ -45,4 +124,38 @@
 #define ENABLE_CRSF_BARO_ALT 1
 #define ENABLE_CRSF_HEARTBEAT 1
 
+// CRSF frame scheduling: lower priority values are sent first, changed data
+// is sent at most once per MIN_INTERVAL and unchanged data every KEEPALIVE
+#define CRSF_GPS_PRIORITY 1
+#define CRSF_GPS_MIN_INTERVAL_US 200000
+#define CRSF_GPS_KEEPALIVE_US 2000000
+#define CRSF_BATTERY_PRIORITY 2
+#define CRSF_BATTERY_MIN_INTERVAL_US 500000
+#define CRSF_BATTERY_KEEPALIVE_US 2000000
+#define CRSF_VARIO_PRIORITY 0
+#define CRSF_VARIO_MIN_INTERVAL_US 100000
+#define CRSF_VARIO_KEEPALIVE_US 1000000
+#define CRSF_BARO_ALT_PRIORITY 1
+#define CRSF_BARO_ALT_MIN_INTERVAL_US 200000
+#define CRSF_BARO_ALT_KEEPALIVE_US 2000000
+#define CRSF_RPM_PRIORITY 2
+#define CRSF_RPM_MIN_INTERVAL_US 200000
+#define CRSF_RPM_KEEPALIVE_US 2000000
+#define CRSF_TEMPERATURE_PRIORITY 3
+#define CRSF_TEMPERATURE_MIN_INTERVAL_US 1000000
+#define CRSF_TEMPERATURE_KEEPALIVE_US 5000000
+#define CRSF_CELLS_PRIORITY 2
+#define CRSF_CELLS_MIN_INTERVAL_US 500000
+#define CRSF_CELLS_KEEPALIVE_US 2000000
+
+// Downlink pacing to the receiver's frame interval, taken from its timing
+// frames or the spacing of its RC frames: one telemetry frame per
+// CRSF_PACING_INTERVALS_PER_FRAME intervals, bursts of up to
+// CRSF_PACING_BURST frames. Unpaced while the receiver is silent for
+// CRSF_PACING_TIMEOUT_US.
+#define CRSF_PACING_ENABLED 1
+#define CRSF_PACING_INTERVALS_PER_FRAME 2
+#define CRSF_PACING_BURST 3
+#define CRSF_PACING_TIMEOUT_US 500000
+
 #endif // CONFIG_H
@@ -0,0 +1,171 @@
+#include "config_store.h"
+#include "hal.h"
+#include <string.h>
+
+#define SLOTS_PER_SECTOR (HAL_FLASH_SECTOR_SIZE / CONFIG_STORE_RECORD_SIZE)
+
+static uint32_t get_u32(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+// Bitwise CRC-32 (IEEE), records are too rare to justify a table
+uint32_t config_store_crc32(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static const uint8_t *record_at(const config_store_t *store, uint8_t sector, uint8_t slot) {
+    return hal_flash_read(store->offset + sector * HAL_FLASH_SECTOR_SIZE + slot * CONFIG_STORE_RECORD_SIZE);
+}
+
+static uint16_t record_length(const uint8_t *record) {
+    return (uint16_t)(record[10] | (record[11] << 8));
+}
+
+static bool record_valid(const uint8_t *record) {
+    if (get_u32(record) != CONFIG_STORE_RECORD_MAGIC) {
+        return false;
+    }
+    uint16_t length = record_length(record);
+    if (length > CONFIG_STORE_MAX_PAYLOAD) {
+        return false;
+    }
+    return config_store_crc32(record, CONFIG_STORE_HEADER_SIZE + length) ==
+           get_u32(&record[CONFIG_STORE_HEADER_SIZE + length]);
+}
+
+static bool slot_erased(const config_store_t *store, uint8_t sector, uint8_t slot) {
+    const uint8_t *record = record_at(store, sector, slot);
+    for (uint32_t i = 0; i < CONFIG_STORE_RECORD_SIZE; i++) {
+        if (record[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// First erased slot at or after the append position in its sector, or
+// SLOTS_PER_SECTOR if the sector is full. Slots holding torn or foreign
+// data are skipped rather than reused.
+static uint8_t free_slot(const config_store_t *store) {
+    uint8_t slot = store->slot;
+    while (slot < SLOTS_PER_SECTOR && !slot_erased(store, store->sector, slot)) {
+        slot++;
+    }
+    return slot;
+}
+
+// Scan all records for the newest one. The CRC is only checked for records
+// that would become the newest, so boot costs little more than reading the
+// headers. sector_count must be at least 2.
+void config_store_init(config_store_t *store, uint32_t offset, uint8_t sector_count) {
+    memset(store, 0, sizeof(*store));
+    store->offset = offset;
+    store->sector_count = sector_count;
+
+    for (uint8_t sector = 0; sector < sector_count; sector++) {
+        for (uint8_t slot = 0; slot < SLOTS_PER_SECTOR; slot++) {
+            const uint8_t *record = record_at(store, sector, slot);
+            if (get_u32(record) != CONFIG_STORE_RECORD_MAGIC) {
+                continue;
+            }
+            uint32_t sequence = get_u32(&record[4]);
+            if ((!store->found || sequence > store->sequence) && record_valid(record)) {
+                store->found = true;
+                store->sequence = sequence;
+                store->newest_sector = sector;
+                store->newest_slot = slot;
+            }
+        }
+    }
+
+    if (store->found) {
+        store->sector = store->newest_sector;
+        store->slot = store->newest_slot + 1;
+    }
+}
+
+// Copy the newest payload, returns false if there is none or it does not
+// fit into capacity
+bool config_store_load(const config_store_t *store, void *payload, size_t capacity, uint16_t *schema,
+                       size_t *length) {
+    if (!store->found) {
+        return false;
+    }
+    const uint8_t *record = record_at(store, store->newest_sector, store->newest_slot);
+    uint16_t payload_length = record_length(record);
+    if (payload_length > capacity) {
+        return false;
+    }
+    memcpy(payload, &record[CONFIG_STORE_HEADER_SIZE], payload_length);
+    *schema = (uint16_t)(record[8] | (record[9] << 8));
+    *length = payload_length;
+    return true;
+}
+
+bool config_store_next_save_erases(const config_store_t *store) {
+    return free_slot(store) >= SLOTS_PER_SECTOR;
+}
+
+// Append a record. The written record is read back, so a failed program
+// leaves the previous configuration current and the next save tries the
+// following slot.
+bool config_store_save(config_store_t *store, uint16_t schema, const void *payload, size_t length) {
+    if (length > CONFIG_STORE_MAX_PAYLOAD) {
+        return false;
+    }
+
+    uint8_t record[CONFIG_STORE_RECORD_SIZE];
+    memset(record, 0xFF, sizeof(record));
+    put_u32(record, CONFIG_STORE_RECORD_MAGIC);
+    put_u32(&record[4], store->sequence + 1);
+    record[8] = (uint8_t)schema;
+    record[9] = (uint8_t)(schema >> 8);
+    record[10] = (uint8_t)length;
+    record[11] = (uint8_t)(length >> 8);
+    memcpy(&record[CONFIG_STORE_HEADER_SIZE], payload, length);
+    put_u32(&record[CONFIG_STORE_HEADER_SIZE + length],
+            config_store_crc32(record, CONFIG_STORE_HEADER_SIZE + length));
+
+    store->slot = free_slot(store);
+    if (store->slot >= SLOTS_PER_SECTOR) {
+        uint8_t next = (uint8_t)((store->sector + 1) % store->sector_count);
+        if (store->found && next == store->newest_sector) {
+            return false;
+        }
+        store->sector = next;
+        store->slot = 0;
+        store->erases++;
+        if (!hal_flash_erase(store->offset + store->sector * HAL_FLASH_SECTOR_SIZE, HAL_FLASH_SECTOR_SIZE)) {
+            return false;
+        }
+    }
+
+    uint8_t sector = store->sector;
+    uint8_t slot = store->slot++;
+    bool programmed = hal_flash_program(store->offset + sector * HAL_FLASH_SECTOR_SIZE +
+                                        slot * CONFIG_STORE_RECORD_SIZE, record, sizeof(record));
+    if (!programmed || !record_valid(record_at(store, sector, slot))) {
+        return false;
+    }
+
+    store->found = true;
+    store->sequence++;
+    store->newest_sector = sector;
+    store->newest_slot = slot;
+    store->saves++;
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Log-structured configuration store on the HAL flash. Every save appends a
+// page-sized record with the whole configuration to the current sector:
+// magic, sequence number, schema version, payload length, payload, CRC-32.
+// Only when a sector is full is the next one erased, so a save is usually a
+// single page program and the sectors wear evenly. The newest record with a
+// good CRC wins; a record torn by a power failure fails its CRC and the one
+// before it stays current, as does the sector being erased never holding the
+// newest record.
+#define CONFIG_STORE_RECORD_SIZE 256u
+#define CONFIG_STORE_HEADER_SIZE 12u
+#define CONFIG_STORE_MAX_PAYLOAD (CONFIG_STORE_RECORD_SIZE - CONFIG_STORE_HEADER_SIZE - 4u)
+#define CONFIG_STORE_RECORD_MAGIC 0x52474643u // "CFGR"
+
+typedef struct {
+    uint32_t offset;
+    uint8_t sector_count;
+    uint8_t sector;           // Sector and slot of the next append
+    uint8_t slot;
+    bool found;               // A valid record exists
+    uint8_t newest_sector;
+    uint8_t newest_slot;
+    uint32_t sequence;        // Sequence number of the newest record
+    uint32_t saves;
+    uint32_t erases;
+} config_store_t;
+
+// Function prototypes
+void config_store_init(config_store_t *store, uint32_t offset, uint8_t sector_count);
+bool config_store_load(const config_store_t *store, void *payload, size_t capacity, uint16_t *schema,
+                       size_t *length);
+bool config_store_save(config_store_t *store, uint16_t schema, const void *payload, size_t length);
+bool config_store_next_save_erases(const config_store_t *store);
+uint32_t config_store_crc32(const uint8_t *data, size_t length);
+
+#endif // CONFIG_STORE_H
@@ -0,0 +1,88 @@
+#ifndef CORE_RING_H
+#define CORE_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "hal.h"
+
+// Slot bookkeeping for a ring that one core fills from any of its contexts,
+// used by the stage profiler and the deferred log. The caller owns the
+// records and indexes them with the slot numbers given here; head and tail
+// are free-running counters and the size must be a power of two. A ring
+// either overwrites its oldest slot or, when it has a consumer, refuses a
+// slot while full and counts the drop. All of it is inline, as every DLOG
+// and trace event goes through the producer side.
+typedef struct {
+    uint32_t mask;
+    bool overwrite;
+    uint32_t irq_state;
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t dropped;
+} core_ring_t;
+
+static inline bool core_ring_init(core_ring_t *ring, uint32_t size, bool overwrite) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return false;
+    }
+
+    ring->mask = size - 1;
+    ring->overwrite = overwrite;
+    atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->dropped, 0, memory_order_relaxed);
+    return true;
+}
+
+// Producer side, on the ring's own core. Nothing else moves the head, so a plain load finds
+// the slot; interrupts stay masked from here until core_ring_publish so a
+// handler cannot claim the same one. Returns false, with interrupts
+// restored, when a ring that keeps its records is full; an overwriting ring
+// always has a slot.
+static inline bool core_ring_claim(core_ring_t *ring, uint32_t *slot) {
+    uint32_t state = hal_irq_save();
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (!ring->overwrite && head - atomic_load_explicit(&ring->tail, memory_order_acquire) > ring->mask) {
+        atomic_store_explicit(&ring->dropped, atomic_load_explicit(&ring->dropped, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        hal_irq_restore(state);
+        return false;
+    }
+    ring->irq_state = state;
+    *slot = head & ring->mask;
+    return true;
+}
+
+// The record is written before the head moves with release order, so a
+// reader never sees a partially written slot
+static inline void core_ring_publish(core_ring_t *ring) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    hal_irq_restore(ring->irq_state);
+}
+
+// Consumer side: the oldest unread slot, left in place until released
+static inline bool core_ring_peek(core_ring_t *ring, uint32_t *slot) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire)) {
+        return false;
+    }
+    *slot = tail & ring->mask;
+    return true;
+}
+
+static inline void core_ring_release(core_ring_t *ring) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static inline uint32_t core_ring_head(core_ring_t *ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire);
+}
+
+static inline uint32_t core_ring_dropped(core_ring_t *ring) {
+    return atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+}
+
+#endif // CORE_RING_H
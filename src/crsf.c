@@ -1,4 +1,5 @@
 #include "crsf.h"
+#include "trace.h"
 #include <string.h>
 
 // CRC8 lookup table for CRSF
@@ -25,11 +26,15 @@ void crsf_init(void) {
     // Nothing specific to initialize
 }
 
+// Frames built with crsf_writer_t fold the CRC into writing the fields, its
+// cost shows up in the crsf_build stage instead
 uint8_t crsf_crc8(const uint8_t *data, uint8_t length) {
+    TRACE_BEGIN(TRACE_STAGE_CRSF_CRC);
     uint8_t crc = 0;
     for (uint8_t i = 0; i < length; i++) {
         crc = crc8_table[crc ^ data[i]];
     }
+    TRACE_END(TRACE_STAGE_CRSF_CRC);
     return crc;
 }
 
@@ -53,22 +58,180 @@ bool crsf_create_packet(uint8_t type, const void *payload, uint8_t payload_size,
     return true;
 }
 
+// Frame layout: sync, length, type, payload, CRC. The length byte counts
+// type, payload and CRC; the CRC covers type and payload.
+static inline void put_byte(crsf_writer_t *writer, uint8_t value) {
+    if (writer->length >= writer->capacity - 1) {
+        writer->overflow = true;
+        return;
+    }
+    writer->frame[writer->length++] = value;
+    writer->crc = crc8_table[writer->crc ^ value];
+}
+
+void crsf_writer_begin(crsf_writer_t *writer, uint8_t *buffer, uint8_t capacity, uint8_t type) {
+    writer->frame = buffer;
+    writer->capacity = capacity < CRSF_MAX_PACKET_SIZE ? capacity : CRSF_MAX_PACKET_SIZE;
+    writer->overflow = writer->capacity < 4;
+    if (writer->overflow) {
+        writer->length = 0;
+        return;
+    }
+    buffer[0] = CRSF_ADDRESS_FLIGHT_CONTROLLER;
+    writer->length = 2;
+    writer->crc = 0;
+    put_byte(writer, type);
+}
+
+void crsf_writer_put_u8(crsf_writer_t *writer, uint8_t value) {
+    put_byte(writer, value);
+}
+
+void crsf_writer_put_u16(crsf_writer_t *writer, uint16_t value) {
+    put_byte(writer, (uint8_t)(value >> 8));
+    put_byte(writer, (uint8_t)value);
+}
+
+void crsf_writer_put_u24(crsf_writer_t *writer, uint32_t value) {
+    put_byte(writer, (uint8_t)(value >> 16));
+    put_byte(writer, (uint8_t)(value >> 8));
+    put_byte(writer, (uint8_t)value);
+}
+
+void crsf_writer_put_u32(crsf_writer_t *writer, uint32_t value) {
+    put_byte(writer, (uint8_t)(value >> 24));
+    put_byte(writer, (uint8_t)(value >> 16));
+    put_byte(writer, (uint8_t)(value >> 8));
+    put_byte(writer, (uint8_t)value);
+}
+
+// Fill in the length byte and CRC, returns the frame length or 0 if the
+// fields did not fit into the buffer
+uint8_t crsf_writer_finish(crsf_writer_t *writer) {
+    if (writer->overflow) {
+        return 0;
+    }
+    writer->frame[1] = writer->length - 1;
+    writer->frame[writer->length] = writer->crc;
+    return writer->length + 1;
+}
+
+uint8_t crsf_write_gps(uint8_t *buffer, uint8_t capacity, const crsf_gps_t *gps) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, buffer, capacity, CRSF_FRAMETYPE_GPS);
+    crsf_writer_put_u32(&writer, (uint32_t)gps->latitude);
+    crsf_writer_put_u32(&writer, (uint32_t)gps->longitude);
+    crsf_writer_put_u16(&writer, gps->groundspeed);
+    crsf_writer_put_u16(&writer, gps->heading);
+    crsf_writer_put_u16(&writer, gps->altitude);
+    crsf_writer_put_u8(&writer, gps->satellites);
+    return crsf_writer_finish(&writer);
+}
+
+uint8_t crsf_write_vario(uint8_t *buffer, uint8_t capacity, const crsf_vario_t *vario) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, buffer, capacity, CRSF_FRAMETYPE_VARIO);
+    crsf_writer_put_u16(&writer, (uint16_t)vario->vertical_speed);
+    return crsf_writer_finish(&writer);
+}
+
+// The capacity field is 24 bits on the wire
+uint8_t crsf_write_battery(uint8_t *buffer, uint8_t capacity, const crsf_battery_t *battery) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, buffer, capacity, CRSF_FRAMETYPE_BATTERY_SENSOR);
+    crsf_writer_put_u16(&writer, battery->voltage);
+    crsf_writer_put_u16(&writer, battery->current);
+    crsf_writer_put_u24(&writer, battery->capacity > 0xFFFFFF ? 0xFFFFFF : battery->capacity);
+    crsf_writer_put_u8(&writer, battery->remaining);
+    return crsf_writer_finish(&writer);
+}
+
+uint8_t crsf_write_baro_alt(uint8_t *buffer, uint8_t capacity, const crsf_baro_alt_t *baro) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, buffer, capacity, CRSF_FRAMETYPE_BARO_ALT);
+    crsf_writer_put_u16(&writer, baro->altitude);
+    crsf_writer_put_u16(&writer, (uint16_t)baro->vertical_speed);
+    return crsf_writer_finish(&writer);
+}
+
+uint8_t crsf_write_heartbeat(uint8_t *buffer, uint8_t capacity) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, buffer, capacity, CRSF_FRAMETYPE_HEARTBEAT);
+    return crsf_writer_finish(&writer);
+}
+
+uint8_t crsf_write_rpm(uint8_t *buffer, uint8_t capacity, const crsf_rpm_t *rpm) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, buffer, capacity, CRSF_FRAMETYPE_RPM);
+    crsf_writer_put_u8(&writer, rpm->source_id);
+    for (uint8_t i = 0; i < rpm->count && i < CRSF_MAX_RPM_VALUES; i++) {
+        crsf_writer_put_u24(&writer, (uint32_t)rpm->values[i] & 0xFFFFFF);
+    }
+    return crsf_writer_finish(&writer);
+}
+
+uint8_t crsf_write_temperature(uint8_t *buffer, uint8_t capacity, const crsf_temperature_t *temperature) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, buffer, capacity, CRSF_FRAMETYPE_TEMPERATURE);
+    crsf_writer_put_u8(&writer, temperature->source_id);
+    for (uint8_t i = 0; i < temperature->count && i < CRSF_MAX_TEMPERATURE_VALUES; i++) {
+        crsf_writer_put_u16(&writer, (uint16_t)temperature->values[i]);
+    }
+    return crsf_writer_finish(&writer);
+}
+
+uint8_t crsf_write_cells(uint8_t *buffer, uint8_t capacity, const crsf_cells_t *cells) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, buffer, capacity, CRSF_FRAMETYPE_CELLS);
+    crsf_writer_put_u8(&writer, cells->source_id);
+    for (uint8_t i = 0; i < cells->count && i < CRSF_MAX_CELL_VALUES; i++) {
+        crsf_writer_put_u16(&writer, cells->values[i]);
+    }
+    return crsf_writer_finish(&writer);
+}
+
+// Extended frame: destination and origin, the NUL-terminated name, serial
+// number, hardware and software IDs, then no parameters to configure
+uint8_t crsf_write_device_info(uint8_t *buffer, uint8_t capacity, uint8_t destination) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, buffer, capacity, CRSF_FRAMETYPE_DEVICE_INFO);
+    crsf_writer_put_u8(&writer, destination);
+    crsf_writer_put_u8(&writer, CRSF_ADDRESS_FLIGHT_CONTROLLER);
+    for (const char *c = CRSF_DEVICE_NAME; ; c++) {
+        crsf_writer_put_u8(&writer, (uint8_t)*c);
+        if (*c == '\0') {
+            break;
+        }
+    }
+    crsf_writer_put_u32(&writer, 0);
+    crsf_writer_put_u32(&writer, 0);
+    crsf_writer_put_u32(&writer, CRSF_DEVICE_SOFTWARE_VERSION);
+    crsf_writer_put_u8(&writer, 0);
+    crsf_writer_put_u8(&writer, 0);
+    return crsf_writer_finish(&writer);
+}
+
 bool crsf_create_gps_packet(const crsf_gps_t *gps, crsf_packet_t *packet) {
-    return crsf_create_packet(CRSF_FRAMETYPE_GPS, gps, sizeof(crsf_gps_t), packet);
+    packet->length = crsf_write_gps(packet->data, sizeof(packet->data), gps);
+    return packet->length > 0;
 }
 
 bool crsf_create_vario_packet(const crsf_vario_t *vario, crsf_packet_t *packet) {
-    return crsf_create_packet(CRSF_FRAMETYPE_VARIO, vario, sizeof(crsf_vario_t), packet);
+    packet->length = crsf_write_vario(packet->data, sizeof(packet->data), vario);
+    return packet->length > 0;
 }
 
 bool crsf_create_battery_packet(const crsf_battery_t *battery, crsf_packet_t *packet) {
-    return crsf_create_packet(CRSF_FRAMETYPE_BATTERY_SENSOR, battery, sizeof(crsf_battery_t), packet);
+    packet->length = crsf_write_battery(packet->data, sizeof(packet->data), battery);
+    return packet->length > 0;
 }
 
 bool crsf_create_baro_alt_packet(const crsf_baro_alt_t *baro, crsf_packet_t *packet) {
-    return crsf_create_packet(CRSF_FRAMETYPE_BARO_ALT, baro, sizeof(crsf_baro_alt_t), packet);
+    packet->length = crsf_write_baro_alt(packet->data, sizeof(packet->data), baro);
+    return packet->length > 0;
 }
 
 bool crsf_create_heartbeat(crsf_packet_t *packet) {
-    return crsf_create_packet(CRSF_FRAMETYPE_HEARTBEAT, NULL, 0, packet);
+    packet->length = crsf_write_heartbeat(packet->data, sizeof(packet->data));
+    return packet->length > 0;
 }
@@ -13,15 +13,51 @@
 #define CRSF_FRAMETYPE_BATTERY_SENSOR 0x08
 #define CRSF_FRAMETYPE_BARO_ALT 0x09
 #define CRSF_FRAMETYPE_HEARTBEAT 0x0B
+#define CRSF_FRAMETYPE_RPM 0x0C
+#define CRSF_FRAMETYPE_TEMPERATURE 0x0D
+#define CRSF_FRAMETYPE_CELLS 0x0E
+#define CRSF_FRAMETYPE_LINK_STATISTICS 0x14
+#define CRSF_FRAMETYPE_RC_CHANNELS_PACKED 0x16
+#define CRSF_FRAMETYPE_DEVICE_PING 0x28
+#define CRSF_FRAMETYPE_DEVICE_INFO 0x29
+#define CRSF_FRAMETYPE_RADIO_ID 0x3A
+
+// Types from CRSF_FRAMETYPE_DEVICE_PING on carry destination and origin
+// addresses before the payload
+#define CRSF_FRAMETYPE_EXTENDED_FIRST 0x28
+#define CRSF_RADIO_ID_TIMING 0x10
 
 // CRSF addresses
+#define CRSF_ADDRESS_BROADCAST 0x00
 #define CRSF_ADDRESS_FLIGHT_CONTROLLER 0xC8
+#define CRSF_ADDRESS_RADIO_TRANSMITTER 0xEA
+#define CRSF_ADDRESS_RECEIVER 0xEC
+#define CRSF_ADDRESS_TRANSMITTER_MODULE 0xEE
+
+// Device info reported in answer to a device ping
+#define CRSF_DEVICE_NAME "FrSky-CRSF"
+#define CRSF_DEVICE_SOFTWARE_VERSION 0x00010000u
 
 typedef struct {
     uint8_t data[CRSF_MAX_PACKET_SIZE];
     uint8_t length;
 } crsf_packet_t;
 
+// In-place frame serializer. Fields are written big-endian directly into
+// the destination buffer and the CRC is accumulated while writing.
+typedef struct {
+    uint8_t *frame;
+    uint8_t capacity;
+    uint8_t length;
+    uint8_t crc;
+    bool overflow;
+} crsf_writer_t;
+
+// Value counts that fit a CRSF_TX_RESERVE_SIZE frame after the source ID
+#define CRSF_MAX_RPM_VALUES 8
+#define CRSF_MAX_TEMPERATURE_VALUES 12
+#define CRSF_MAX_CELL_VALUES 12
+
 // CRSF telemetry structures
 typedef struct {
     int32_t latitude;   // degrees * 1e7
@@ -48,6 +84,26 @@ typedef struct {
     int16_t vertical_speed; // cm/s
 } __attribute__((packed)) crsf_baro_alt_t;
 
+// RPM, temperature and cell frames carry a source ID and a variable number
+// of values; they are only built with the writer, never copied raw
+typedef struct {
+    uint8_t source_id;
+    uint8_t count;
+    int32_t values[CRSF_MAX_RPM_VALUES];        // RPM, 24 bits on the wire
+} crsf_rpm_t;
+
+typedef struct {
+    uint8_t source_id;
+    uint8_t count;
+    int16_t values[CRSF_MAX_TEMPERATURE_VALUES]; // deci-degrees Celsius
+} crsf_temperature_t;
+
+typedef struct {
+    uint8_t source_id;
+    uint8_t count;
+    uint16_t values[CRSF_MAX_CELL_VALUES];      // mV
+} crsf_cells_t;
+
 // Function prototypes
 void crsf_init(void);
 uint8_t crsf_crc8(const uint8_t *data, uint8_t length);
@@ -58,4 +114,20 @@ bool crsf_create_battery_packet(const crsf_battery_t *battery, crsf_packet_t *pa
 bool crsf_create_baro_alt_packet(const crsf_baro_alt_t *baro, crsf_packet_t *packet);
 bool crsf_create_heartbeat(crsf_packet_t *packet);
 
+void crsf_writer_begin(crsf_writer_t *writer, uint8_t *buffer, uint8_t capacity, uint8_t type);
+void crsf_writer_put_u8(crsf_writer_t *writer, uint8_t value);
+void crsf_writer_put_u16(crsf_writer_t *writer, uint16_t value);
+void crsf_writer_put_u24(crsf_writer_t *writer, uint32_t value);
+void crsf_writer_put_u32(crsf_writer_t *writer, uint32_t value);
+uint8_t crsf_writer_finish(crsf_writer_t *writer);
+uint8_t crsf_write_gps(uint8_t *buffer, uint8_t capacity, const crsf_gps_t *gps);
+uint8_t crsf_write_vario(uint8_t *buffer, uint8_t capacity, const crsf_vario_t *vario);
+uint8_t crsf_write_battery(uint8_t *buffer, uint8_t capacity, const crsf_battery_t *battery);
+uint8_t crsf_write_baro_alt(uint8_t *buffer, uint8_t capacity, const crsf_baro_alt_t *baro);
+uint8_t crsf_write_heartbeat(uint8_t *buffer, uint8_t capacity);
+uint8_t crsf_write_rpm(uint8_t *buffer, uint8_t capacity, const crsf_rpm_t *rpm);
+uint8_t crsf_write_temperature(uint8_t *buffer, uint8_t capacity, const crsf_temperature_t *temperature);
+uint8_t crsf_write_cells(uint8_t *buffer, uint8_t capacity, const crsf_cells_t *cells);
+uint8_t crsf_write_device_info(uint8_t *buffer, uint8_t capacity, uint8_t destination);
+
 #endif // CRSF_H
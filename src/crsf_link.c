@@ -0,0 +1,201 @@
+#include "crsf_link.h"
+#include <string.h>
+
+#define CRSF_MIN_FRAME_LENGTH 2
+#define CRSF_LINK_MAX_INTERVAL_US 100000u
+#define CRSF_LINK_MIN_INTERVAL_US 1000u
+
+void crsf_link_init(crsf_link_t *link, uint32_t baud_rate, uint32_t now) {
+    memset(link, 0, sizeof(*link));
+    crsf_link_set_baud_rate(link, baud_rate);
+    link->last_credit_us = now;
+}
+
+void crsf_link_set_baud_rate(crsf_link_t *link, uint32_t baud_rate) {
+    link->byte_time_ns = baud_rate ? 10000000000ull / baud_rate : 0;
+}
+
+static bool is_address(uint8_t byte) {
+    return byte == CRSF_ADDRESS_FLIGHT_CONTROLLER || byte == CRSF_ADDRESS_BROADCAST ||
+           byte == CRSF_ADDRESS_RADIO_TRANSMITTER || byte == CRSF_ADDRESS_RECEIVER ||
+           byte == CRSF_ADDRESS_TRANSMITTER_MODULE;
+}
+
+static uint32_t get_u32_be(const uint8_t *data) {
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+// RC frames arrive once per packet of the radio link; their spacing gives
+// the interval unless the receiver sends timing frames
+static void track_rc_frame(crsf_link_t *link, uint32_t time_us) {
+    uint32_t sample = time_us - link->last_rc_us;
+    bool first = link->rx.rc_frames++ == 0;
+    link->last_rc_us = time_us;
+    if (first || link->interval_from_timing || sample < CRSF_LINK_MIN_INTERVAL_US / 4 ||
+        sample > CRSF_LINK_MAX_INTERVAL_US) {
+        return;
+    }
+    if (link->interval_us == 0) {
+        link->interval_us = sample;
+    } else {
+        link->interval_us = (uint32_t)((int32_t)link->interval_us + ((int32_t)sample - (int32_t)link->interval_us) / 8);
+    }
+}
+
+// Timing: subtype, then the packet interval in units of 0.1 us and the
+// phase offset
+static void handle_timing(crsf_link_t *link, const uint8_t *payload, uint8_t length) {
+    if (length < 9 || payload[0] != CRSF_RADIO_ID_TIMING) {
+        link->rx.other++;
+        return;
+    }
+    link->rx.timing_frames++;
+    uint32_t interval_us = get_u32_be(&payload[1]) / 10u;
+    if (interval_us >= CRSF_LINK_MIN_INTERVAL_US && interval_us <= CRSF_LINK_MAX_INTERVAL_US) {
+        link->interval_us = interval_us;
+        link->interval_from_timing = true;
+    }
+}
+
+static void handle_frame(crsf_link_t *link, uint32_t time_us) {
+    const uint8_t *frame = link->buffer;
+    uint8_t length = frame[1];
+    if (crsf_crc8(&frame[2], (uint8_t)(length - 1)) != frame[length + 1]) {
+        link->rx.crc_errors++;
+        return;
+    }
+    link->rx.frames++;
+    link->last_rx_us = time_us;
+
+    uint8_t type = frame[2];
+    const uint8_t *payload = &frame[3];
+    uint8_t payload_length = (uint8_t)(length - 2);
+    if (type >= CRSF_FRAMETYPE_EXTENDED_FIRST && payload_length < 2) {
+        link->rx.other++;
+        return;
+    }
+
+    switch (type) {
+        case CRSF_FRAMETYPE_RC_CHANNELS_PACKED:
+            track_rc_frame(link, time_us);
+            break;
+
+        case CRSF_FRAMETYPE_LINK_STATISTICS:
+            if (payload_length >= sizeof(crsf_link_statistics_t)) {
+                memcpy(&link->statistics, payload, sizeof(crsf_link_statistics_t));
+                link->statistics_valid = true;
+                link->rx.link_statistics++;
+            }
+            break;
+
+        case CRSF_FRAMETYPE_DEVICE_PING:
+            link->rx.pings++;
+            if (payload[0] == CRSF_ADDRESS_BROADCAST || payload[0] == CRSF_ADDRESS_FLIGHT_CONTROLLER) {
+                link->ping_pending = true;
+                link->ping_origin = payload[1];
+            }
+            break;
+
+        case CRSF_FRAMETYPE_RADIO_ID:
+            handle_timing(link, &payload[2], (uint8_t)(payload_length - 2));
+            break;
+
+        default:
+            link->rx.other++;
+            break;
+    }
+}
+
+// Sync on a known address byte followed by a plausible length; a frame
+// failing its CRC is dropped and the parser waits for the next address
+void crsf_link_process_byte(crsf_link_t *link, uint8_t byte, uint32_t time_us) {
+    if (link->index == 0) {
+        if (is_address(byte)) {
+            link->buffer[link->index++] = byte;
+        }
+        return;
+    }
+    if (link->index == 1 && (byte < CRSF_MIN_FRAME_LENGTH || byte > CRSF_MAX_PACKET_SIZE - 2)) {
+        link->rx.bad_lengths++;
+        link->index = 0;
+        crsf_link_process_byte(link, byte, time_us);
+        return;
+    }
+
+    link->buffer[link->index++] = byte;
+    if (link->index == link->buffer[1] + 2) {
+        handle_frame(link, time_us);
+        link->index = 0;
+    }
+}
+
+// end_us is the arrival of the last byte, earlier bytes are dated back by
+// the byte time of the line
+void crsf_link_process_buffer_at(crsf_link_t *link, const uint8_t *data, size_t length, uint32_t end_us) {
+    for (size_t i = 0; i < length; i++) {
+        uint32_t behind = (uint32_t)(length - 1 - i);
+        crsf_link_process_byte(link, data[i], end_us - (uint32_t)(((uint64_t)behind * link->byte_time_ns) / 1000u));
+    }
+}
+
+// A device ping addressed to us is answered once
+bool crsf_link_take_ping(crsf_link_t *link, uint8_t *origin) {
+    if (!link->ping_pending) {
+        return false;
+    }
+    link->ping_pending = false;
+    *origin = link->ping_origin;
+    return true;
+}
+
+bool crsf_link_paced(const crsf_link_t *link, uint32_t now) {
+    return CRSF_PACING_ENABLED && link->interval_us > 0 && link->rx.frames > 0 &&
+           now - link->last_rx_us < CRSF_PACING_TIMEOUT_US;
+}
+
+// Credit accrues with time up to a burst worth of frames. The limit moves
+// with the interval estimate, so credit saved under a longer interval is cut
+// down to it first.
+bool crsf_link_may_send(crsf_link_t *link, uint32_t now) {
+    uint32_t elapsed = now - link->last_credit_us;
+    link->last_credit_us = now;
+    if (!crsf_link_paced(link, now)) {
+        return true;
+    }
+    uint32_t cost = link->interval_us * CRSF_PACING_INTERVALS_PER_FRAME;
+    uint32_t limit = cost * CRSF_PACING_BURST;
+    if (link->credit_us > limit) {
+        link->credit_us = limit;
+    }
+    link->credit_us = elapsed >= limit - link->credit_us ? limit : link->credit_us + elapsed;
+    return link->credit_us >= cost;
+}
+
+// Time until crsf_link_may_send will allow a frame, 0 if it does now
+uint32_t crsf_link_credit_wait_us(const crsf_link_t *link, uint32_t now) {
+    if (!crsf_link_paced(link, now)) {
+        return 0;
+    }
+    uint32_t cost = link->interval_us * CRSF_PACING_INTERVALS_PER_FRAME;
+    uint32_t elapsed = now - link->last_credit_us;
+    uint32_t credit = link->credit_us < cost ? link->credit_us : cost;
+    return elapsed >= cost - credit ? 0 : cost - credit - elapsed;
+}
+
+void crsf_link_sent(crsf_link_t *link, uint32_t now) {
+    link->backlog = false;
+    if (!crsf_link_paced(link, now)) {
+        return;
+    }
+    uint32_t cost = link->interval_us * CRSF_PACING_INTERVALS_PER_FRAME;
+    link->credit_us = link->credit_us > cost ? link->credit_us - cost : 0;
+    link->pacing.paced++;
+}
+
+// A due frame waits for credit; counted once per wait
+void crsf_link_held_back(crsf_link_t *link) {
+    if (!link->backlog) {
+        link->backlog = true;
+        link->pacing.deferred++;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef CRSF_LINK_H
+#define CRSF_LINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "config.h"
+#include "crsf.h"
+
+// Receive side of the CRSF UART and the downlink pace it sets. Frames from
+// the receiver are parsed for link statistics, timing and device pings; RC
+// frames only count for their spacing. Once the receiver's frame interval
+// is known the downlink gets one frame per CRSF_PACING_INTERVALS_PER_FRAME
+// intervals, in bursts of up to CRSF_PACING_BURST, so the receiver's
+// telemetry buffer is not overrun. Without frames from the receiver for
+// CRSF_PACING_TIMEOUT_US the downlink is not paced.
+
+// Link statistics frame payload
+typedef struct {
+    uint8_t uplink_rssi_1;       // -dBm
+    uint8_t uplink_rssi_2;       // -dBm
+    uint8_t uplink_link_quality; // %
+    int8_t uplink_snr;           // dB
+    uint8_t active_antenna;
+    uint8_t rf_mode;
+    uint8_t uplink_tx_power;
+    uint8_t downlink_rssi;       // -dBm
+    uint8_t downlink_link_quality;
+    int8_t downlink_snr;
+} crsf_link_statistics_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t bad_lengths;
+    uint32_t rc_frames;
+    uint32_t link_statistics;
+    uint32_t timing_frames;
+    uint32_t pings;
+    uint32_t other;
+} crsf_link_rx_stats_t;
+
+typedef struct {
+    uint32_t paced;    // Frames sent while pacing was active
+    uint32_t deferred; // Times a due frame had to wait for its slot
+    uint32_t dropped;  // Sensor updates superseded while frames waited
+} crsf_pacing_stats_t;
+
+typedef struct {
+    uint8_t buffer[CRSF_MAX_PACKET_SIZE];
+    uint8_t index;
+    uint32_t byte_time_ns;
+
+    crsf_link_statistics_t statistics;
+    bool statistics_valid;
+    uint32_t interval_us;       // Receiver frame interval, 0 while unknown
+    bool interval_from_timing;
+    uint32_t last_rc_us;
+    uint32_t last_rx_us;
+    bool ping_pending;
+    uint8_t ping_origin;
+
+    uint32_t credit_us;
+    uint32_t last_credit_us;
+    bool backlog;
+
+    crsf_link_rx_stats_t rx;
+    crsf_pacing_stats_t pacing;
+} crsf_link_t;
+
+// Function prototypes
+void crsf_link_init(crsf_link_t *link, uint32_t baud_rate, uint32_t now);
+void crsf_link_set_baud_rate(crsf_link_t *link, uint32_t baud_rate);
+void crsf_link_process_byte(crsf_link_t *link, uint8_t byte, uint32_t time_us);
+void crsf_link_process_buffer_at(crsf_link_t *link, const uint8_t *data, size_t length, uint32_t end_us);
+bool crsf_link_take_ping(crsf_link_t *link, uint8_t *origin);
+bool crsf_link_paced(const crsf_link_t *link, uint32_t now);
+bool crsf_link_may_send(crsf_link_t *link, uint32_t now);
+uint32_t crsf_link_credit_wait_us(const crsf_link_t *link, uint32_t now);
+void crsf_link_sent(crsf_link_t *link, uint32_t now);
+void crsf_link_held_back(crsf_link_t *link);
+
+#endif // CRSF_LINK_H
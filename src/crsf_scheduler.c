@@ -0,0 +1,114 @@
+#include "crsf_scheduler.h"
+#include <string.h>
+
+static int find_entry(const crsf_scheduler_t *scheduler, uint8_t frame_type) {
+    for (uint8_t i = 0; i < scheduler->count; i++) {
+        if (scheduler->entries[i].frame_type == frame_type) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void crsf_scheduler_init(crsf_scheduler_t *scheduler, const crsf_schedule_entry_t *entries, uint8_t count) {
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->entries = entries;
+    scheduler->count = count < CRSF_SCHEDULER_MAX_ENTRIES ? count : CRSF_SCHEDULER_MAX_ENTRIES;
+}
+
+// Record an update for a frame type. Unchanged data only keeps the type
+// alive for the keepalive; repeated changes before the next emission are
+// coalesced into one frame.
+void crsf_scheduler_mark(crsf_scheduler_t *scheduler, uint8_t frame_type, bool changed) {
+    int index = find_entry(scheduler, frame_type);
+    if (index < 0) {
+        return;
+    }
+
+    uint32_t bit = 1u << index;
+    scheduler->active |= bit;
+
+    if (!changed) {
+        scheduler->stats.updates_unchanged++;
+    } else if (scheduler->dirty & bit) {
+        scheduler->stats.updates_coalesced++;
+    } else {
+        scheduler->dirty |= bit;
+    }
+}
+
+// A type never sent is due at once, so the first frames after boot do not
+// wait out min_interval_us from time zero
+static uint32_t since_sent(const crsf_scheduler_t *scheduler, uint8_t index, uint32_t now_us) {
+    return (scheduler->sent & (1u << index)) ? now_us - scheduler->last_sent[index] : UINT32_MAX;
+}
+
+// Pick the frame type to send now: due dirty types first, then due
+// keepalives, each by priority and then by longest time since last sent
+uint8_t crsf_scheduler_next(crsf_scheduler_t *scheduler, uint32_t now_us) {
+    int best = -1;
+    bool best_dirty = false;
+
+    for (uint8_t i = 0; i < scheduler->count; i++) {
+        uint32_t bit = 1u << i;
+        if (!(scheduler->active & bit)) {
+            continue;
+        }
+
+        const crsf_schedule_entry_t *entry = &scheduler->entries[i];
+        uint32_t since = since_sent(scheduler, i, now_us);
+        bool dirty = (scheduler->dirty & bit) && since >= entry->min_interval_us;
+        bool keepalive = entry->keepalive_us > 0 && since >= entry->keepalive_us;
+        if (!dirty && !keepalive) {
+            continue;
+        }
+
+        if (best < 0 || (dirty && !best_dirty)) {
+            best = i;
+            best_dirty = dirty;
+            continue;
+        }
+        if (dirty != best_dirty) {
+            continue;
+        }
+
+        const crsf_schedule_entry_t *current = &scheduler->entries[best];
+        if (entry->priority < current->priority ||
+            (entry->priority == current->priority &&
+             since > since_sent(scheduler, (uint8_t)best, now_us))) {
+            best = i;
+        }
+    }
+
+    return best < 0 ? CRSF_SCHEDULER_NONE : scheduler->entries[best].frame_type;
+}
+
+void crsf_scheduler_sent(crsf_scheduler_t *scheduler, uint8_t frame_type, uint32_t now_us) {
+    int index = find_entry(scheduler, frame_type);
+    if (index < 0) {
+        return;
+    }
+
+    uint32_t bit = 1u << index;
+    if (scheduler->dirty & bit) {
+        scheduler->stats.frames_sent++;
+    } else {
+        scheduler->stats.keepalives_sent++;
+    }
+    scheduler->dirty &= ~bit;
+    scheduler->sent |= bit;
+    scheduler->last_sent[index] = now_us;
+}
+
+// Stop scheduling a frame type until it is marked again, e.g. when its data
+// timed out and no frame could be built
+void crsf_scheduler_deactivate(crsf_scheduler_t *scheduler, uint8_t frame_type) {
+    int index = find_entry(scheduler, frame_type);
+    if (index < 0) {
+        return;
+    }
+
+    uint32_t bit = 1u << index;
+    scheduler->active &= ~bit;
+    scheduler->dirty &= ~bit;
+}
@@ -0,0 +1,46 @@
+#ifndef CRSF_SCHEDULER_H
+#define CRSF_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CRSF_SCHEDULER_MAX_ENTRIES 16
+#define CRSF_SCHEDULER_NONE 0xFF
+
+// Emission policy for one CRSF frame type. Lower priority values are sent
+// first; min_interval_us caps the rate of changed data and keepalive_us
+// resends unchanged data (0 disables the keepalive).
+typedef struct {
+    uint8_t frame_type;
+    uint8_t priority;
+    uint32_t min_interval_us;
+    uint32_t keepalive_us;
+} crsf_schedule_entry_t;
+
+typedef struct {
+    uint32_t frames_sent;
+    uint32_t keepalives_sent;
+    uint32_t updates_coalesced;
+    uint32_t updates_unchanged;
+} crsf_scheduler_stats_t;
+
+// Frame types are marked dirty when their data changes and emitted by
+// crsf_scheduler_next once their rate limit allows it
+typedef struct {
+    const crsf_schedule_entry_t *entries;
+    uint8_t count;
+    uint32_t dirty;
+    uint32_t active;
+    uint32_t sent;            // Types sent at least once
+    uint32_t last_sent[CRSF_SCHEDULER_MAX_ENTRIES];
+    crsf_scheduler_stats_t stats;
+} crsf_scheduler_t;
+
+// Function prototypes
+void crsf_scheduler_init(crsf_scheduler_t *scheduler, const crsf_schedule_entry_t *entries, uint8_t count);
+void crsf_scheduler_mark(crsf_scheduler_t *scheduler, uint8_t frame_type, bool changed);
+uint8_t crsf_scheduler_next(crsf_scheduler_t *scheduler, uint32_t now_us);
+void crsf_scheduler_sent(crsf_scheduler_t *scheduler, uint8_t frame_type, uint32_t now_us);
+void crsf_scheduler_deactivate(crsf_scheduler_t *scheduler, uint8_t frame_type);
+
+#endif // CRSF_SCHEDULER_H
@@ -0,0 +1,212 @@
+#include "crsf_tx_queue.h"
+#include <string.h>
+
+static crsf_tx_frame_t *frame_at(crsf_tx_queue_t *queue, uint8_t position) {
+    return &queue->frames[(queue->first + position) % CRSF_TX_QUEUE_DEPTH];
+}
+
+void crsf_tx_queue_init(crsf_tx_queue_t *queue, const crsf_tx_sink_t *sink, crsf_tx_drop_policy_t drop_policy) {
+    memset(queue, 0, sizeof(*queue));
+    queue->sink = *sink;
+    queue->drop_policy = drop_policy;
+}
+
+// Find room for length contiguous bytes after the newest frame
+static bool find_space(crsf_tx_queue_t *queue, uint8_t length, uint16_t *offset) {
+    if (queue->count == 0) {
+        *offset = 0;
+        return true;
+    }
+    if (queue->count >= CRSF_TX_QUEUE_DEPTH) {
+        return false;
+    }
+
+    const crsf_tx_frame_t *oldest = frame_at(queue, 0);
+    const crsf_tx_frame_t *newest = frame_at(queue, queue->count - 1);
+    uint16_t end = newest->offset + newest->length;
+
+    if (newest->offset >= oldest->offset) {
+        if (CRSF_TX_BUFFER_SIZE - end >= length) {
+            *offset = end;
+            return true;
+        }
+        if (oldest->offset >= length) {
+            *offset = 0;
+            return true;
+        }
+        return false;
+    }
+
+    if (oldest->offset - end >= length) {
+        *offset = end;
+        return true;
+    }
+    return false;
+}
+
+// Drop the oldest frame that has not been handed to the sink yet. Frames
+// in flight stay where they are; the pending frames behind the dropped one
+// are laid out again after them, so its space can be used at once. Returns
+// false when every queued frame is in flight.
+static bool drop_oldest(crsf_tx_queue_t *queue) {
+    if (queue->count <= queue->in_flight) {
+        return false;
+    }
+
+    uint8_t kept = queue->count - queue->in_flight - 1;
+    crsf_tx_frame_t frames[CRSF_TX_QUEUE_DEPTH];
+    uint8_t data[CRSF_TX_BUFFER_SIZE];
+    uint16_t size = 0;
+    for (uint8_t i = 0; i < kept; i++) {
+        frames[i] = *frame_at(queue, queue->in_flight + 1 + i);
+        memcpy(&data[size], &queue->buffer[frames[i].offset], frames[i].length);
+        size += frames[i].length;
+    }
+    queue->count = queue->in_flight;
+    queue->stats.frames_dropped++;
+
+    // Each frame lands at or before its old place, so all of them fit
+    size = 0;
+    for (uint8_t i = 0; i < kept; i++) {
+        uint16_t offset;
+        if (find_space(queue, frames[i].length, &offset)) {
+            memcpy(&queue->buffer[offset], &data[size], frames[i].length);
+            frames[i].offset = offset;
+            *frame_at(queue, queue->count) = frames[i];
+            queue->count++;
+        } else {
+            queue->stats.frames_dropped++;
+        }
+        size += frames[i].length;
+    }
+    return true;
+}
+
+// Reserve room for a frame of up to max_length bytes inside the queue
+// buffer so it can be serialized in place. Returns NULL (and counts a drop)
+// when there is no room; otherwise crsf_tx_queue_commit must follow before
+// any other frame is queued.
+uint8_t *crsf_tx_queue_reserve(crsf_tx_queue_t *queue, uint8_t max_length) {
+    if (max_length == 0) {
+        return NULL;
+    }
+
+    uint16_t offset;
+    while (!find_space(queue, max_length, &offset)) {
+        if (queue->drop_policy != CRSF_TX_DROP_OLDEST || !drop_oldest(queue)) {
+            queue->stats.frames_dropped++;
+            return NULL;
+        }
+    }
+
+    queue->reserved = true;
+    queue->reserved_offset = offset;
+    return &queue->buffer[offset];
+}
+
+// Queue the reserved frame with its final length, 0 cancels the reservation
+static void commit_frame(crsf_tx_queue_t *queue, uint8_t length, bool timed, uint32_t origin_us) {
+    if (!queue->reserved) {
+        return;
+    }
+    queue->reserved = false;
+    if (length == 0) {
+        return;
+    }
+
+    crsf_tx_frame_t *frame = frame_at(queue, queue->count);
+    frame->offset = queue->reserved_offset;
+    frame->length = length;
+    frame->timed = timed;
+    frame->origin_us = origin_us;
+    queue->count++;
+
+    queue->stats.frames_queued++;
+    if (queue->count > queue->stats.high_water) {
+        queue->stats.high_water = queue->count;
+    }
+}
+
+void crsf_tx_queue_commit(crsf_tx_queue_t *queue, uint8_t length) {
+    commit_frame(queue, length, false, 0);
+}
+
+// Commit a frame carrying data that arrived at origin_us, reported back
+// through the sink's sent() for latency accounting
+void crsf_tx_queue_commit_timed(crsf_tx_queue_t *queue, uint8_t length, uint32_t origin_us) {
+    commit_frame(queue, length, true, origin_us);
+}
+
+bool crsf_tx_queue_push(crsf_tx_queue_t *queue, const uint8_t *data, uint8_t length) {
+    uint8_t *frame = crsf_tx_queue_reserve(queue, length);
+    if (!frame) {
+        return false;
+    }
+
+    memcpy(frame, data, length);
+    crsf_tx_queue_commit(queue, length);
+    return true;
+}
+
+// Release a completed transfer and start the next one, coalescing frames that
+// are adjacent in the buffer into a single transfer
+void crsf_tx_queue_service(crsf_tx_queue_t *queue, uint32_t now_us) {
+    bool busy = queue->sink.busy(queue->sink.context);
+
+    if (queue->in_flight > 0 && !busy) {
+        if (queue->sink.sent) {
+            for (uint8_t i = 0; i < queue->in_flight; i++) {
+                const crsf_tx_frame_t *frame = frame_at(queue, i);
+                queue->sink.sent(queue->sink.context, &queue->buffer[frame->offset], frame->length,
+                                 frame->timed ? &frame->origin_us : NULL, now_us);
+            }
+        }
+        queue->first = (queue->first + queue->in_flight) % CRSF_TX_QUEUE_DEPTH;
+        queue->count -= queue->in_flight;
+        queue->stats.frames_sent += queue->in_flight;
+        queue->in_flight = 0;
+    }
+
+    // Frames held back by a transfer still in flight, or by a busy sink, are
+    // back-pressure: the stall clock runs from the first service that finds
+    // them waiting until the next transfer starts
+    bool waiting = queue->count > queue->in_flight;
+    if (waiting && (queue->in_flight > 0 || busy)) {
+        if (!queue->stalled) {
+            queue->stalled = true;
+            queue->stall_start = now_us;
+        }
+        return;
+    }
+
+    if (queue->stalled) {
+        queue->stats.stall_us += now_us - queue->stall_start;
+        queue->stalled = false;
+    }
+
+    if (!waiting) {
+        return;
+    }
+
+    const crsf_tx_frame_t *frame = frame_at(queue, 0);
+    uint16_t start = frame->offset;
+    uint16_t end = start + frame->length;
+    uint8_t batch = 1;
+
+    while (batch < queue->count && batch < CRSF_TX_MAX_BATCH) {
+        frame = frame_at(queue, batch);
+        if (frame->offset != end) {
+            break;
+        }
+        end += frame->length;
+        batch++;
+    }
+
+    queue->in_flight = batch;
+    queue->stats.transfers++;
+    queue->sink.start(queue->sink.context, &queue->buffer[start], end - start);
+}
+
+uint8_t crsf_tx_queue_pending(const crsf_tx_queue_t *queue) {
+    return queue->count;
+}
@@ -0,0 +1,72 @@
+#ifndef CRSF_TX_QUEUE_H
+#define CRSF_TX_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "config.h"
+
+// Transmit side of the CRSF UART. busy() reports whether the last transfer
+// handed to start() still references its data; start() must not block.
+// The optional sent() is called for every frame once its transfer is done,
+// with the origin time given to crsf_tx_queue_commit_timed if any.
+typedef struct {
+    bool (*busy)(void *context);
+    void (*start)(void *context, const uint8_t *data, size_t length);
+    void (*sent)(void *context, const uint8_t *frame, uint8_t length, const uint32_t *origin_us, uint32_t now_us);
+    void *context;
+} crsf_tx_sink_t;
+
+// What a full queue drops to make room: the new frame, or the oldest frame
+// not yet handed to the sink. Frames in flight are never dropped; with
+// every queued frame in flight the new one is dropped under either policy.
+typedef enum {
+    CRSF_TX_DROP_NEWEST,
+    CRSF_TX_DROP_OLDEST
+} crsf_tx_drop_policy_t;
+
+typedef struct {
+    uint16_t offset;
+    uint8_t length;
+    bool timed;
+    uint32_t origin_us;
+} crsf_tx_frame_t;
+
+// stall_us adds up the time committed frames waited for the UART
+typedef struct {
+    uint32_t frames_queued;
+    uint32_t frames_sent;
+    uint32_t frames_dropped;
+    uint32_t transfers;
+    uint32_t high_water;
+    uint32_t stall_us;
+} crsf_tx_stats_t;
+
+// Frames are stored back to back in buffer so that consecutive frames can be
+// sent as one transfer without copying. A frame never wraps; when it does not
+// fit at the end of the buffer it is placed at the start.
+typedef struct {
+    uint8_t buffer[CRSF_TX_BUFFER_SIZE];
+    crsf_tx_frame_t frames[CRSF_TX_QUEUE_DEPTH];
+    uint8_t first;
+    uint8_t count;
+    uint8_t in_flight;
+    uint16_t reserved_offset;
+    bool reserved;
+    crsf_tx_drop_policy_t drop_policy;
+    crsf_tx_sink_t sink;
+    bool stalled;
+    uint32_t stall_start;
+    crsf_tx_stats_t stats;
+} crsf_tx_queue_t;
+
+// Function prototypes
+void crsf_tx_queue_init(crsf_tx_queue_t *queue, const crsf_tx_sink_t *sink, crsf_tx_drop_policy_t drop_policy);
+bool crsf_tx_queue_push(crsf_tx_queue_t *queue, const uint8_t *data, uint8_t length);
+uint8_t *crsf_tx_queue_reserve(crsf_tx_queue_t *queue, uint8_t max_length);
+void crsf_tx_queue_commit(crsf_tx_queue_t *queue, uint8_t length);
+void crsf_tx_queue_commit_timed(crsf_tx_queue_t *queue, uint8_t length, uint32_t origin_us);
+void crsf_tx_queue_service(crsf_tx_queue_t *queue, uint32_t now_us);
+uint8_t crsf_tx_queue_pending(const crsf_tx_queue_t *queue);
+
+#endif // CRSF_TX_QUEUE_H
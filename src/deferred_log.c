@@ -0,0 +1,110 @@
+#include "deferred_log.h"
+#include "core_ring.h"
+#include "hal.h"
+#include <stdio.h>
+
+// Rings take no RAM when logging is compiled out
+#if DEFERRED_LOG_ENABLED
+#define LOG_RING_RECORDS DEFERRED_LOG_RING_SIZE
+#else
+#define LOG_RING_RECORDS 1
+#endif
+
+_Static_assert((LOG_RING_RECORDS & (LOG_RING_RECORDS - 1)) == 0, "log ring size must be a power of two");
+
+static log_record_t records[DEFERRED_LOG_CORE_COUNT][LOG_RING_RECORDS];
+static core_ring_t rings[DEFERRED_LOG_CORE_COUNT];
+
+static const char *const formats[LOG_FORMAT_COUNT] = {
+#define LOG_FORMAT(id, arguments, format) [id] = format,
+#include "log_formats.def"
+#undef LOG_FORMAT
+};
+
+static const uint8_t arg_counts[LOG_FORMAT_COUNT] = {
+#define LOG_FORMAT(id, arguments, format) [id] = (arguments),
+#include "log_formats.def"
+#undef LOG_FORMAT
+};
+
+void deferred_log_init(void) {
+    for (int i = 0; i < DEFERRED_LOG_CORE_COUNT; i++) {
+        core_ring_init(&rings[i], LOG_RING_RECORDS, false);
+    }
+}
+
+// Called through the DLOG macros
+void deferred_log_write(uint8_t id, uint32_t a, uint32_t b, uint32_t c) {
+    uint8_t core = hal_core_num();
+    uint32_t slot;
+    if (!core_ring_claim(&rings[core], &slot)) {
+        return;
+    }
+    log_record_t *record = &records[core][slot];
+    record->time_us = hal_time_us();
+    record->id = id;
+    record->core = core;
+    record->args[0] = a;
+    record->args[1] = b;
+    record->args[2] = c;
+    core_ring_publish(&rings[core]);
+}
+
+// Oldest record of all rings, by timestamp. Core0 only.
+bool deferred_log_pop(log_record_t *record) {
+    int oldest = -1;
+    uint32_t oldest_slot = 0;
+    for (int i = 0; i < DEFERRED_LOG_CORE_COUNT; i++) {
+        uint32_t slot;
+        if (!core_ring_peek(&rings[i], &slot)) {
+            continue;
+        }
+        if (oldest < 0 || (int32_t)(records[i][slot].time_us - records[oldest][oldest_slot].time_us) < 0) {
+            oldest = i;
+            oldest_slot = slot;
+        }
+    }
+    if (oldest < 0) {
+        return false;
+    }
+    *record = records[oldest][oldest_slot];
+    core_ring_release(&rings[oldest]);
+    return true;
+}
+
+uint32_t deferred_log_dropped(void) {
+    uint32_t dropped = 0;
+    for (int i = 0; i < DEFERRED_LOG_CORE_COUNT; i++) {
+        dropped += core_ring_dropped(&rings[i]);
+    }
+    return dropped;
+}
+
+uint8_t deferred_log_arg_count(uint8_t id) {
+    return id < LOG_FORMAT_COUNT ? arg_counts[id] : 0;
+}
+
+const char *deferred_log_format_string(uint8_t id) {
+    return id < LOG_FORMAT_COUNT ? formats[id] : NULL;
+}
+
+// The text of a record, as snprintf would give it
+size_t deferred_log_format(const log_record_t *record, char *out, size_t capacity) {
+    const char *format = deferred_log_format_string(record->id);
+    int length = format ? snprintf(out, capacity, format, record->args[0], record->args[1], record->args[2])
+                        : snprintf(out, capacity, "Unknown log format %u", record->id);
+    return length > 0 ? (size_t)length : 0;
+}
+
+// FNV-1a over the format table, so a reader can tell whether it was built
+// from the same log_formats.def as the writer
+uint32_t deferred_log_table_hash(void) {
+    uint32_t hash = 2166136261u;
+    for (int id = 0; id < LOG_FORMAT_COUNT; id++) {
+        hash = (hash ^ arg_counts[id]) * 16777619u;
+        for (const char *c = formats[id]; *c; c++) {
+            hash = (hash ^ (uint8_t)*c) * 16777619u;
+        }
+    }
+    return hash;
+}
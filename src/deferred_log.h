@@ -0,0 +1,67 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "config.h"
+
+// Deferred logging. DLOG0..DLOG3 store a format ID from log_formats.def, a
+// microsecond timestamp and the raw arguments in a ring per core; nothing
+// is formatted until core0 drains the rings in the background, or the host
+// does it from the telemetry mirror. Each ring has one producer, its core,
+// with interrupts masked only while a slot is claimed, and one consumer on
+// core0. A full ring drops new records and counts them. The argument count
+// is checked against the format table at compile time. With
+// DEFERRED_LOG_ENABLED 0 the macros compile to nothing and the arguments
+// are not evaluated.
+#define DEFERRED_LOG_MAX_ARGS 3
+#define DEFERRED_LOG_CORE_COUNT 2
+
+typedef enum {
+#define LOG_FORMAT(id, arguments, format) id,
+#include "log_formats.def"
+#undef LOG_FORMAT
+    LOG_FORMAT_COUNT
+} log_format_id_t;
+
+enum {
+#define LOG_FORMAT(id, arguments, format) id##_ARGS = (arguments),
+#include "log_formats.def"
+#undef LOG_FORMAT
+};
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t id;
+    uint8_t core;
+    uint32_t args[DEFERRED_LOG_MAX_ARGS];
+} log_record_t;
+
+// Compile error unless id takes count arguments
+#define DLOG_CHECK(id, count) ((void)sizeof(char[id##_ARGS == (count) ? 1 : -1]))
+
+#if DEFERRED_LOG_ENABLED
+#define DLOG0(id) (DLOG_CHECK(id, 0), deferred_log_write((id), 0, 0, 0))
+#define DLOG1(id, a) (DLOG_CHECK(id, 1), deferred_log_write((id), (uint32_t)(a), 0, 0))
+#define DLOG2(id, a, b) (DLOG_CHECK(id, 2), deferred_log_write((id), (uint32_t)(a), (uint32_t)(b), 0))
+#define DLOG3(id, a, b, c) \
+    (DLOG_CHECK(id, 3), deferred_log_write((id), (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)))
+#else
+#define DLOG0(id) DLOG_CHECK(id, 0)
+#define DLOG1(id, a) (DLOG_CHECK(id, 1), (void)sizeof(a))
+#define DLOG2(id, a, b) (DLOG_CHECK(id, 2), (void)sizeof(a), (void)sizeof(b))
+#define DLOG3(id, a, b, c) (DLOG_CHECK(id, 3), (void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#endif
+
+// Function prototypes
+void deferred_log_init(void);
+void deferred_log_write(uint8_t id, uint32_t a, uint32_t b, uint32_t c);
+bool deferred_log_pop(log_record_t *record);
+uint32_t deferred_log_dropped(void);
+uint8_t deferred_log_arg_count(uint8_t id);
+const char *deferred_log_format_string(uint8_t id);
+size_t deferred_log_format(const log_record_t *record, char *out, size_t capacity);
+uint32_t deferred_log_table_hash(void);
+
+#endif // DEFERRED_LOG_H
@@ -0,0 +1,147 @@
+#include "derived_sensors.h"
+#include "hal.h"
+#include "units.h"
+#include <string.h>
+
+// One mAh in the units of derived_sensors_t.charge
+#define DERIVED_CHARGE_PER_MAH (2ull * 3600ull * 1000000ull)
+
+#define DERIVED_RETAINED_MAGIC 0x6D416821u
+
+// Altitude and vertical speed are clamped so the Q8 arithmetic cannot
+// overflow
+#define DERIVED_ALTITUDE_LIMIT_CM 1000000
+#define DERIVED_VARIO_LIMIT_Q8 ((int64_t)INT16_MAX * 256)
+
+// Seeds for the reciprocal of d / 2^16 in [0.5, 1), in Q15, at the middle
+// of each 1/64 step
+#define RECIPROCAL_SEED(i) ((uint16_t)((1u << 22) / (65u + 2u * (i))))
+
+static const uint16_t reciprocal_seeds[32] = {
+    RECIPROCAL_SEED(0), RECIPROCAL_SEED(1), RECIPROCAL_SEED(2), RECIPROCAL_SEED(3),
+    RECIPROCAL_SEED(4), RECIPROCAL_SEED(5), RECIPROCAL_SEED(6), RECIPROCAL_SEED(7),
+    RECIPROCAL_SEED(8), RECIPROCAL_SEED(9), RECIPROCAL_SEED(10), RECIPROCAL_SEED(11),
+    RECIPROCAL_SEED(12), RECIPROCAL_SEED(13), RECIPROCAL_SEED(14), RECIPROCAL_SEED(15),
+    RECIPROCAL_SEED(16), RECIPROCAL_SEED(17), RECIPROCAL_SEED(18), RECIPROCAL_SEED(19),
+    RECIPROCAL_SEED(20), RECIPROCAL_SEED(21), RECIPROCAL_SEED(22), RECIPROCAL_SEED(23),
+    RECIPROCAL_SEED(24), RECIPROCAL_SEED(25), RECIPROCAL_SEED(26), RECIPROCAL_SEED(27),
+    RECIPROCAL_SEED(28), RECIPROCAL_SEED(29), RECIPROCAL_SEED(30), RECIPROCAL_SEED(31),
+};
+
+// Retained words: magic, capacity, and the capacity inverted as a check
+enum {
+    RETAINED_MAGIC,
+    RETAINED_CAPACITY,
+    RETAINED_CHECK
+};
+
+void derived_sensors_init(derived_sensors_t *derived) {
+    memset(derived, 0, sizeof(*derived));
+}
+
+// Take over the capacity counted before a reset, if the retained words
+// still hold it
+bool derived_sensors_restore(derived_sensors_t *derived) {
+    volatile uint32_t *retained = hal_retained_words();
+    if (retained[RETAINED_MAGIC] != DERIVED_RETAINED_MAGIC ||
+        retained[RETAINED_CHECK] != ~retained[RETAINED_CAPACITY]) {
+        return false;
+    }
+    derived->capacity_mah = retained[RETAINED_CAPACITY];
+    return true;
+}
+
+static void retain_capacity(uint32_t capacity_mah) {
+    volatile uint32_t *retained = hal_retained_words();
+    retained[RETAINED_MAGIC] = DERIVED_RETAINED_MAGIC;
+    retained[RETAINED_CAPACITY] = capacity_mah;
+    retained[RETAINED_CHECK] = ~capacity_mah;
+}
+
+// Add the charge since the previous current sample, returns the consumed
+// capacity in mAh
+uint32_t derived_sensors_current(derived_sensors_t *derived, uint16_t current_ma, uint32_t now) {
+    uint32_t dt = now - derived->last_current_us;
+    if (derived->current_valid && (int32_t)dt < 0) {
+        // Stamped before the previous sample, e.g. from another bus
+        return derived->capacity_mah;
+    }
+    if (derived->current_valid && dt <= DERIVED_CAPACITY_MAX_GAP_US) {
+        derived->charge += (uint64_t)((uint32_t)derived->last_current_ma + current_ma) * dt;
+        if (derived->charge >= DERIVED_CHARGE_PER_MAH) {
+            // At most a few mAh per sample at the gap limit
+            do {
+                derived->charge -= DERIVED_CHARGE_PER_MAH;
+                derived->capacity_mah++;
+            } while (derived->charge >= DERIVED_CHARGE_PER_MAH);
+            retain_capacity(derived->capacity_mah);
+        }
+    }
+    derived->current_valid = true;
+    derived->last_current_ma = current_ma;
+    derived->last_current_us = now;
+    return derived->capacity_mah;
+}
+
+// 1 / dt as reciprocal / 2^shift for dt >= 1, without dividing: dt is
+// normalized to 16 bits, the seed table gets within 1% and one Newton step
+// brings the error under 3e-4
+static uint32_t reciprocal_of(uint32_t dt, uint8_t *shift) {
+    uint32_t d = dt;
+    uint8_t exponent = 15;
+    while (d >= 1u << 16) {
+        d >>= 1;
+        exponent++;
+    }
+    while (d < 1u << 15) {
+        d <<= 1;
+        exponent--;
+    }
+
+    uint64_t seed = reciprocal_seeds[(d >> 10) - 32];
+    uint64_t product_q31 = d * seed;
+    *shift = (uint8_t)(exponent + 16);
+    return (uint32_t)((seed * ((1ull << 32) - product_q31)) >> 31);
+}
+
+// Feed an altitude sample through the alpha-beta filter, returns the
+// vertical speed in cm/s
+int16_t derived_sensors_altitude(derived_sensors_t *derived, int32_t altitude_cm, uint32_t now) {
+    uint32_t dt = now - derived->last_altitude_us;
+    if (altitude_cm > DERIVED_ALTITUDE_LIMIT_CM) {
+        altitude_cm = DERIVED_ALTITUDE_LIMIT_CM;
+    } else if (altitude_cm < -DERIVED_ALTITUDE_LIMIT_CM) {
+        altitude_cm = -DERIVED_ALTITUDE_LIMIT_CM;
+    }
+    int32_t measured_q8 = altitude_cm * 256;
+
+    // A sample stamped with or before the previous one carries no slope
+    if (derived->altitude_valid && (dt == 0 || (int32_t)dt < 0)) {
+        return (int16_t)(derived->vario_q8 >> 8);
+    }
+    derived->last_altitude_us = now;
+
+    if (!derived->altitude_valid || dt > DERIVED_VARIO_MAX_GAP_US) {
+        derived->altitude_valid = true;
+        derived->altitude_q8 = measured_q8;
+        derived->vario_q8 = 0;
+        return 0;
+    }
+
+    // Sample spacing in seconds * 2^20, without dividing
+    int64_t dt_q20 = (int64_t)(((uint64_t)dt * UNITS_RECIPROCAL(1000000u, 40)) >> 20);
+    int32_t predicted_q8 = derived->altitude_q8 + (int32_t)(((int64_t)derived->vario_q8 * dt_q20) >> 20);
+    int32_t error_q8 = measured_q8 - predicted_q8;
+
+    derived->altitude_q8 = predicted_q8 + (error_q8 >> DERIVED_VARIO_ALPHA_SHIFT);
+    uint8_t shift;
+    int64_t per_second = (int64_t)reciprocal_of(dt, &shift) * 1000000;
+    int64_t vario_q8 = derived->vario_q8 + (((int64_t)(error_q8 >> DERIVED_VARIO_BETA_SHIFT) * per_second) >> shift);
+    if (vario_q8 > DERIVED_VARIO_LIMIT_Q8) {
+        vario_q8 = DERIVED_VARIO_LIMIT_Q8;
+    } else if (vario_q8 < -DERIVED_VARIO_LIMIT_Q8) {
+        vario_q8 = -DERIVED_VARIO_LIMIT_Q8;
+    }
+    derived->vario_q8 = (int32_t)vario_q8;
+    return (int16_t)(derived->vario_q8 >> 8);
+}
@@ -0,0 +1,33 @@
+#ifndef DERIVED_SENSORS_H
+#define DERIVED_SENSORS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+// Values computed from other sensors, one constant-time step per sample.
+// Consumed capacity is the trapezoidal integral of the current; the mAh
+// count is mirrored into the HAL's retained words on every increment, so a
+// brownout reset does not start it over. Vertical speed comes from an
+// alpha-beta filter over the altitude samples, in fixed point and using the
+// real spacing of the samples. now is the arrival time of the sample.
+typedef struct {
+    bool current_valid;
+    uint16_t last_current_ma;
+    uint32_t last_current_us;
+    uint64_t charge;          // mA * us * 2 not yet counted as a mAh
+    uint32_t capacity_mah;
+
+    bool altitude_valid;
+    uint32_t last_altitude_us;
+    int32_t altitude_q8;      // Filtered altitude, cm * 256
+    int32_t vario_q8;         // cm/s * 256
+} derived_sensors_t;
+
+// Function prototypes
+void derived_sensors_init(derived_sensors_t *derived);
+bool derived_sensors_restore(derived_sensors_t *derived);
+uint32_t derived_sensors_current(derived_sensors_t *derived, uint16_t current_ma, uint32_t now);
+int16_t derived_sensors_altitude(derived_sensors_t *derived, int32_t altitude_cm, uint32_t now);
+
+#endif // DERIVED_SENSORS_H
@@ -0,0 +1,83 @@
+#include "freshness.h"
+#include <string.h>
+
+#define SLOT_MASK (FRESHNESS_WHEEL_SLOTS - 1)
+
+_Static_assert((FRESHNESS_WHEEL_SLOTS & SLOT_MASK) == 0, "wheel slots must be a power of two");
+
+void freshness_init(freshness_t *freshness, uint32_t tick_us, uint32_t timeout_us, uint32_t now) {
+    memset(freshness, 0, sizeof(*freshness));
+    memset(freshness->heads, FRESHNESS_NONE, sizeof(freshness->heads));
+    freshness->tick_us = tick_us;
+    freshness->timeout_ticks = (timeout_us + tick_us - 1) / tick_us;
+    if (freshness->timeout_ticks >= FRESHNESS_WHEEL_SLOTS) {
+        freshness->timeout_ticks = FRESHNESS_WHEEL_SLOTS - 1;
+    }
+    freshness->tick_start_us = now;
+}
+
+static void unlink_entry(freshness_t *freshness, uint8_t entry) {
+    uint8_t next = freshness->next[entry];
+    uint8_t prev = freshness->prev[entry];
+    if (prev == FRESHNESS_NONE) {
+        freshness->heads[freshness->deadline[entry] & SLOT_MASK] = next;
+    } else {
+        freshness->next[prev] = next;
+    }
+    if (next != FRESHNESS_NONE) {
+        freshness->prev[next] = prev;
+    }
+}
+
+// The entry's deadline is a full timeout after the current tick ends, so
+// it stays fresh at least timeout_us
+void freshness_touch(freshness_t *freshness, uint8_t entry) {
+    uint64_t bit = 1ull << entry;
+    if (freshness->fresh & bit) {
+        unlink_entry(freshness, entry);
+    }
+    uint32_t deadline = freshness->tick + freshness->timeout_ticks + 1;
+    uint8_t slot = deadline & SLOT_MASK;
+    freshness->deadline[entry] = deadline;
+    freshness->prev[entry] = FRESHNESS_NONE;
+    freshness->next[entry] = freshness->heads[slot];
+    if (freshness->heads[slot] != FRESHNESS_NONE) {
+        freshness->prev[freshness->heads[slot]] = entry;
+    }
+    freshness->heads[slot] = entry;
+    freshness->fresh |= bit;
+}
+
+// Expire the entries of one slot, whose deadlines are all this tick
+static uint64_t expire_slot(freshness_t *freshness, uint32_t tick) {
+    uint64_t expired = 0;
+    uint8_t slot = tick & SLOT_MASK;
+    uint8_t entry = freshness->heads[slot];
+    while (entry != FRESHNESS_NONE) {
+        expired |= 1ull << entry;
+        entry = freshness->next[entry];
+    }
+    freshness->heads[slot] = FRESHNESS_NONE;
+    freshness->fresh &= ~expired;
+    freshness->lost |= expired;
+    return expired;
+}
+
+// Move the wheel up to now, returns the entries that expired on the way.
+// After a stall longer than a turn every slot is emptied once.
+uint64_t freshness_advance(freshness_t *freshness, uint32_t now) {
+    uint64_t expired = 0;
+    uint32_t elapsed = now - freshness->tick_start_us;
+    if (elapsed < freshness->tick_us) {
+        return 0;
+    }
+    uint32_t ticks = elapsed / freshness->tick_us;
+    freshness->tick_start_us += ticks * freshness->tick_us;
+
+    uint32_t steps = ticks < FRESHNESS_WHEEL_SLOTS ? ticks : FRESHNESS_WHEEL_SLOTS;
+    for (uint32_t i = 0; i < steps; i++) {
+        expired |= expire_slot(freshness, ++freshness->tick);
+    }
+    freshness->tick += ticks - steps;
+    return expired;
+}
@@ -0,0 +1,35 @@
+#ifndef FRESHNESS_H
+#define FRESHNESS_H
+
+#include <stdint.h>
+
+// Freshness of up to 64 sensor entries as a bitmask, expired by a hashed
+// timer wheel. A touch files the entry into the wheel slot of its deadline,
+// one tick_us tick per slot; advancing the wheel empties the slots whose
+// tick has come, so touching and expiring are O(1) however many entries are
+// tracked. The timeout must stay below FRESHNESS_WHEEL_SLOTS ticks, every
+// entry in a slot then expires when the wheel reaches it. An entry expires
+// between the timeout and one tick later.
+#define FRESHNESS_MAX_ENTRIES 64
+#define FRESHNESS_WHEEL_SLOTS 64
+#define FRESHNESS_NONE 0xFF
+
+typedef struct {
+    uint32_t tick_us;
+    uint32_t timeout_ticks;
+    uint32_t tick;            // Ticks since init, slots up to it are processed
+    uint32_t tick_start_us;
+    uint64_t fresh;           // Entries touched within the timeout
+    uint64_t lost;            // Expired entries, cleared by the caller once reported
+    uint8_t heads[FRESHNESS_WHEEL_SLOTS];
+    uint8_t next[FRESHNESS_MAX_ENTRIES];
+    uint8_t prev[FRESHNESS_MAX_ENTRIES];
+    uint32_t deadline[FRESHNESS_MAX_ENTRIES];
+} freshness_t;
+
+// Function prototypes
+void freshness_init(freshness_t *freshness, uint32_t tick_us, uint32_t timeout_us, uint32_t now);
+void freshness_touch(freshness_t *freshness, uint8_t entry);
+uint64_t freshness_advance(freshness_t *freshness, uint32_t now);
+
+#endif // FRESHNESS_H
@@ -1,17 +1,20 @@
 #include "frsky_sport.h"
+#include "rx_stats.h"
 #include <string.h>
 
-static frsky_sport_state_t frsky_state = FRSKY_STATE_IDLE;
-static frsky_sport_packet_t current_packet;
-static uint8_t packet_buffer[FRSKY_SPORT_PACKET_SIZE];
-static uint8_t packet_index = 0;
-static bool packet_ready = false;
+// True when any byte of the word is zero
+#define FRSKY_HAS_ZERO_BYTE(v) (((v) - 0x01010101u) & ~(v) & 0x80808080u)
+
+static frsky_sport_decoder_t default_decoder;
+
+void frsky_sport_decoder_init(frsky_sport_decoder_t *decoder, uint8_t bus) {
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->state = FRSKY_STATE_IDLE;
+    decoder->bus = bus;
+}
 
 void frsky_sport_init(void) {
-    frsky_state = FRSKY_STATE_IDLE;
-    packet_ready = false;
-    packet_index = 0;
-    memset(&current_packet, 0, sizeof(current_packet));
+    frsky_sport_decoder_init(&default_decoder, 0);
 }
 
 uint8_t frsky_sport_crc(const uint8_t *data, uint8_t length) {
@@ -33,71 +36,198 @@ uint8_t frsky_sport_unstuff_byte(uint8_t byte) {
     return byte;
 }
 
-void frsky_sport_process_byte(uint8_t byte) {
-    static bool escape_next = false;
-    
-    switch (frsky_state) {
-        case FRSKY_STATE_IDLE:
-            if (byte == FRSKY_SPORT_START_BYTE) {
-                frsky_state = FRSKY_STATE_START;
-                packet_index = 0;
-                escape_next = false;
-            }
+// Length of the leading run without start or stuff bytes, four bytes at a time
+static size_t scan_plain_run(const uint8_t *data, size_t length) {
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        uint32_t word;
+        memcpy(&word, &data[i], sizeof(word));
+        uint32_t start = word ^ 0x7E7E7E7Eu;
+        uint32_t stuff = word ^ 0x7D7D7D7Du;
+        if (FRSKY_HAS_ZERO_BYTE(start) | FRSKY_HAS_ZERO_BYTE(stuff)) {
             break;
-            
-        case FRSKY_STATE_START:
-            if (byte == FRSKY_SPORT_START_BYTE) {
-                packet_index = 0;
-            } else {
-                if (byte == 0x7D) {
-                    escape_next = true;
-                } else {
-                    if (escape_next) {
-                        byte = frsky_sport_unstuff_byte(byte);
-                        escape_next = false;
-                    }
-                    packet_buffer[packet_index++] = byte;
-                    frsky_state = FRSKY_STATE_DATA;
-                }
-            }
+        }
+    }
+    for (; i < length; i++) {
+        if (data[i] == FRSKY_SPORT_START_BYTE || data[i] == FRSKY_SPORT_STUFF_BYTE) {
             break;
-            
-        case FRSKY_STATE_DATA:
-            if (byte == 0x7D && !escape_next) {
-                escape_next = true;
+        }
+    }
+    return i;
+}
+
+void frsky_sport_decoder_set_baud_rate(frsky_sport_decoder_t *decoder, uint32_t baud_rate) {
+    decoder->byte_time_ns = baud_rate ? (uint32_t)(10000000000ull / baud_rate) : 0;
+}
+
+// Sensor a partial frame belongs to, if its ID byte has arrived
+static uint8_t frame_sensor(const frsky_sport_decoder_t *decoder) {
+    return decoder->index > 0 ? decoder->buffer[0] : RX_STATS_NO_SENSOR;
+}
+
+// A poll is a start byte and an ID byte, so a new start byte after those
+// two is a normal unanswered poll; any later it cuts a frame short
+static void begin_frame(frsky_sport_decoder_t *decoder, uint32_t start_us) {
+    if (decoder->state != FRSKY_STATE_IDLE && decoder->index > 1) {
+        decoder->resyncs++;
+        rx_stats_count(RX_STATS_RESYNC, frame_sensor(decoder));
+    }
+    decoder->state = FRSKY_STATE_START;
+    decoder->index = 0;
+    decoder->escape_next = false;
+    decoder->frame_start_us = start_us;
+}
+
+// Validate the completed frame and append it to the queue. When the
+// converter falls behind the oldest queued packet makes room.
+static void finish_frame(frsky_sport_decoder_t *decoder) {
+    const uint8_t *buffer = decoder->buffer;
+    decoder->state = FRSKY_STATE_IDLE;
+    decoder->frames_received++;
+
+    uint8_t calculated_crc = frsky_sport_crc(buffer, FRSKY_SPORT_PACKET_SIZE - 1);
+    if (calculated_crc != buffer[FRSKY_SPORT_PACKET_SIZE - 1]) {
+        decoder->crc_errors++;
+        rx_stats_count(RX_STATS_CRC_FAIL, buffer[0]);
+        return;
+    }
+    rx_stats_count(RX_STATS_FRAMES, buffer[0]);
+
+    if (decoder->queue_count == FRSKY_SPORT_QUEUE_SIZE) {
+        rx_stats_count(RX_STATS_OVERWRITE, decoder->queue[decoder->queue_first].sensor_id);
+        decoder->queue_first = (decoder->queue_first + 1) % FRSKY_SPORT_QUEUE_SIZE;
+        decoder->queue_count--;
+    }
+
+    uint8_t slot = (decoder->queue_first + decoder->queue_count) % FRSKY_SPORT_QUEUE_SIZE;
+    frsky_sport_packet_t *packet = &decoder->queue[slot];
+    packet->sensor_id = buffer[0];
+    packet->frame_id = buffer[1];
+    packet->data_id = (buffer[3] << 8) | buffer[2];
+    packet->value = ((uint32_t)buffer[7] << 24) | (buffer[6] << 16) |
+                    (buffer[5] << 8) | buffer[4];
+    packet->bus = decoder->bus;
+    packet->valid = true;
+    packet->timestamp_us = decoder->frame_start_us;
+    decoder->queue_count++;
+}
+
+static void append_byte(frsky_sport_decoder_t *decoder, uint8_t byte) {
+    decoder->buffer[decoder->index++] = byte;
+    decoder->state = FRSKY_STATE_DATA;
+    if (decoder->index >= FRSKY_SPORT_PACKET_SIZE) {
+        finish_frame(decoder);
+    }
+}
+
+// A start byte never appears inside a stuffed frame, so it always
+// resynchronises the decoder, including after a poll without an answer
+static void process_byte_at(frsky_sport_decoder_t *decoder, uint8_t byte, uint32_t time_us) {
+    if (byte == FRSKY_SPORT_START_BYTE) {
+        begin_frame(decoder, time_us);
+        return;
+    }
+
+    if (decoder->state == FRSKY_STATE_IDLE) {
+        return;
+    }
+
+    // Only 0x5E and 0x5D may follow a stuff byte. Anything else is kept as
+    // is and left for the CRC to reject.
+    bool bad_escape = decoder->escape_next && byte != (FRSKY_SPORT_START_BYTE ^ 0x20) &&
+                      byte != (FRSKY_SPORT_STUFF_BYTE ^ 0x20);
+    if (bad_escape) {
+        decoder->bad_escapes++;
+        rx_stats_count(RX_STATS_BAD_ESCAPE, frame_sensor(decoder));
+    }
+
+    if (byte == FRSKY_SPORT_STUFF_BYTE) {
+        decoder->escape_next = true;
+        return;
+    }
+
+    if (decoder->escape_next) {
+        byte = frsky_sport_unstuff_byte(byte);
+        decoder->escape_next = false;
+    }
+    append_byte(decoder, byte);
+}
+
+// Without a time reference packets carry a zero timestamp
+void frsky_sport_decoder_process_byte(frsky_sport_decoder_t *decoder, uint8_t byte) {
+    process_byte_at(decoder, byte, 0);
+}
+
+// Arrival time of data[index] when the last byte arrived at end_us
+static uint32_t byte_time_at(const frsky_sport_decoder_t *decoder, size_t index, size_t length, uint32_t end_us) {
+    return end_us - (uint32_t)(((uint64_t)(length - 1 - index) * decoder->byte_time_ns) / 1000u);
+}
+
+void frsky_sport_decoder_process_buffer(frsky_sport_decoder_t *decoder, const uint8_t *data, size_t length) {
+    frsky_sport_decoder_process_buffer_at(decoder, data, length, 0);
+}
+
+// Same decoder as frsky_sport_decoder_process_byte, but skips to start bytes
+// with memchr and copies runs of plain payload bytes in one step. end_us is
+// the arrival time of the last byte of data.
+void frsky_sport_decoder_process_buffer_at(frsky_sport_decoder_t *decoder, const uint8_t *data, size_t length,
+                                           uint32_t end_us) {
+    size_t i = 0;
+
+    while (i < length) {
+        if (decoder->state == FRSKY_STATE_IDLE) {
+            const uint8_t *start = memchr(&data[i], FRSKY_SPORT_START_BYTE, length - i);
+            if (!start) {
                 return;
             }
-            
-            if (escape_next) {
-                byte = frsky_sport_unstuff_byte(byte);
-                escape_next = false;
-            }
-            
-            packet_buffer[packet_index++] = byte;
-            
-            if (packet_index >= FRSKY_SPORT_PACKET_SIZE) {
-                uint8_t calculated_crc = frsky_sport_crc(packet_buffer, FRSKY_SPORT_PACKET_SIZE - 1);
-                if (calculated_crc == packet_buffer[FRSKY_SPORT_PACKET_SIZE - 1]) {
-                    current_packet.sensor_id = packet_buffer[0];
-                    current_packet.frame_id = packet_buffer[1];
-                    current_packet.data_id = (packet_buffer[3] << 8) | packet_buffer[2];
-                    current_packet.value = (packet_buffer[7] << 24) | (packet_buffer[6] << 16) | 
-                                         (packet_buffer[5] << 8) | packet_buffer[4];
-                    current_packet.valid = true;
-                    packet_ready = true;
-                }
-                frsky_state = FRSKY_STATE_IDLE;
-            }
-            break;
+            i = (size_t)(start - data);
+            begin_frame(decoder, byte_time_at(decoder, i, length, end_us));
+            i++;
+            continue;
+        }
+
+        uint8_t byte = data[i];
+        if (byte == FRSKY_SPORT_START_BYTE || byte == FRSKY_SPORT_STUFF_BYTE || decoder->escape_next) {
+            process_byte_at(decoder, byte, byte_time_at(decoder, i, length, end_us));
+            i++;
+            continue;
+        }
+
+        size_t needed = FRSKY_SPORT_PACKET_SIZE - decoder->index;
+        size_t run = scan_plain_run(&data[i], length - i < needed ? length - i : needed);
+        memcpy(&decoder->buffer[decoder->index], &data[i], run);
+        decoder->index += (uint8_t)run;
+        i += run;
+        decoder->state = FRSKY_STATE_DATA;
+        if (decoder->index >= FRSKY_SPORT_PACKET_SIZE) {
+            finish_frame(decoder);
+        }
     }
 }
 
-bool frsky_sport_get_packet(frsky_sport_packet_t *packet) {
-    if (packet_ready && current_packet.valid) {
-        *packet = current_packet;
-        packet_ready = false;
-        current_packet.valid = false;
-        return true;
+// Drain up to max_packets queued packets in arrival order
+size_t frsky_sport_decoder_get_packets(frsky_sport_decoder_t *decoder, frsky_sport_packet_t *packets, size_t max_packets) {
+    size_t count = decoder->queue_count < max_packets ? decoder->queue_count : max_packets;
+    for (size_t i = 0; i < count; i++) {
+        packets[i] = decoder->queue[decoder->queue_first];
+        decoder->queue_first = (decoder->queue_first + 1) % FRSKY_SPORT_QUEUE_SIZE;
     }
-    return false;
+    decoder->queue_count -= (uint8_t)count;
+    return count;
+}
+
+void frsky_sport_process_byte(uint8_t byte) {
+    frsky_sport_decoder_process_byte(&default_decoder, byte);
+}
+
+void frsky_sport_process_buffer(const uint8_t *data, size_t length) {
+    frsky_sport_decoder_process_buffer(&default_decoder, data, length);
+}
+
+bool frsky_sport_get_packet(frsky_sport_packet_t *packet) {
+    return frsky_sport_decoder_get_packets(&default_decoder, packet, 1) == 1;
+}
+
+size_t frsky_sport_get_packets(frsky_sport_packet_t *packets, size_t max_packets) {
+    return frsky_sport_decoder_get_packets(&default_decoder, packets, max_packets);
 }
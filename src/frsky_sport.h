@@ -3,12 +3,18 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // FrSky S.PORT protocol constants
 #define FRSKY_SPORT_START_BYTE 0x7E
 #define FRSKY_SPORT_PACKET_SIZE 9
+#define FRSKY_SPORT_STUFF_BYTE 0x7D
+#define FRSKY_SPORT_QUEUE_SIZE 16
 
-// FrSky data IDs
+// FrSky data IDs. Each sensor type owns a range of 16 IDs, the low four bits
+// tell several sensors of the same type apart; values below are the first
+// ID of each range.
+#define FRSKY_ID_RANGE(data_id) ((uint16_t)((data_id) & 0xFFF0))
 #define FRSKY_ID_VFAS 0x0210    // Battery voltage
 #define FRSKY_ID_CURR 0x0200    // Current
 #define FRSKY_ID_VSPD 0x0110    // Vertical speed
@@ -19,15 +25,18 @@
 #define FRSKY_ID_GPS_COURS 0x0840 // GPS course
 #define FRSKY_ID_FUEL 0x0600    // Fuel level
 #define FRSKY_ID_RPM 0x0500     // RPM
-#define FRSKY_ID_TEMP1 0x0401   // Temperature 1
-#define FRSKY_ID_TEMP2 0x0402   // Temperature 2
+#define FRSKY_ID_TEMP1 0x0400   // Temperature 1
+#define FRSKY_ID_TEMP2 0x0410   // Temperature 2
+#define FRSKY_ID_CELLS 0x0300   // FLVSS cell voltages, two per frame
 
 typedef struct {
     uint8_t sensor_id;
     uint8_t frame_id;
     uint16_t data_id;
     uint32_t value;
+    uint8_t bus;
     bool valid;
+    uint32_t timestamp_us; // arrival of the start byte
 } frsky_sport_packet_t;
 
 typedef enum {
@@ -36,10 +45,42 @@ typedef enum {
     FRSKY_STATE_DATA
 } frsky_sport_state_t;
 
+// Decoder state for one S.PORT bus. Instances are independent, so several
+// buses can be decoded side by side; bus is copied into every packet.
+// Packets are stamped with the arrival time of their start byte, estimated
+// from the time of the last byte of a buffer and the byte time of the line.
+typedef struct {
+    frsky_sport_state_t state;
+    uint8_t buffer[FRSKY_SPORT_PACKET_SIZE];
+    uint8_t index;
+    bool escape_next;
+    uint8_t bus;
+    uint32_t byte_time_ns;
+    uint32_t frame_start_us;
+    uint32_t frames_received;
+    uint32_t crc_errors;
+    uint32_t bad_escapes;
+    uint32_t resyncs;
+    frsky_sport_packet_t queue[FRSKY_SPORT_QUEUE_SIZE];
+    uint8_t queue_first;
+    uint8_t queue_count;
+} frsky_sport_decoder_t;
+
 // Function prototypes
+void frsky_sport_decoder_init(frsky_sport_decoder_t *decoder, uint8_t bus);
+void frsky_sport_decoder_process_byte(frsky_sport_decoder_t *decoder, uint8_t byte);
+void frsky_sport_decoder_process_buffer(frsky_sport_decoder_t *decoder, const uint8_t *data, size_t length);
+void frsky_sport_decoder_set_baud_rate(frsky_sport_decoder_t *decoder, uint32_t baud_rate);
+void frsky_sport_decoder_process_buffer_at(frsky_sport_decoder_t *decoder, const uint8_t *data, size_t length,
+                                           uint32_t end_us);
+size_t frsky_sport_decoder_get_packets(frsky_sport_decoder_t *decoder, frsky_sport_packet_t *packets, size_t max_packets);
+
+// Single-bus API operating on a default decoder instance
 void frsky_sport_init(void);
 void frsky_sport_process_byte(uint8_t byte);
+void frsky_sport_process_buffer(const uint8_t *data, size_t length);
 bool frsky_sport_get_packet(frsky_sport_packet_t *packet);
+size_t frsky_sport_get_packets(frsky_sport_packet_t *packets, size_t max_packets);
 uint8_t frsky_sport_crc(const uint8_t *data, uint8_t length);
 uint8_t frsky_sport_unstuff_byte(uint8_t byte);
 
@@ -0,0 +1,75 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "config.h"
+#include "rx_ring.h"
+
+// Platform services used by the protocol core and the pipeline. Implemented
+// by hal_pico.c on the target and hal_host.c for the host build, where the
+// clock can be virtual and UART traffic is injected and observed by tools.
+
+// UART ports: the CRSF link and one port per S.PORT bus
+#define HAL_UART_CRSF 0
+#define HAL_UART_SPORT(bus) (1 + (bus))
+#define HAL_UART_COUNT (1 + FRSKY_BUS_COUNT)
+
+#define HAL_FLASH_SECTOR_SIZE 4096u
+#define HAL_FLASH_PAGE_SIZE 256u
+#define HAL_RETAINED_WORDS 4
+
+typedef struct {
+    uint32_t baud_rate;
+    uint16_t tx_pin;
+    uint16_t rx_pin;
+} hal_uart_config_t;
+
+// Function prototypes
+uint32_t hal_time_us(void);
+
+// Free-running cycle counter for the stage profiler, counting up at
+// hal_cycle_hz and wrapping at hal_cycle_bits. Each core has its own and
+// enables it with hal_cycle_counter_init.
+void hal_cycle_counter_init(void);
+uint32_t hal_cycles(void);
+uint32_t hal_cycle_hz(void);
+uint8_t hal_cycle_bits(void);
+uint8_t hal_core_num(void);
+uint32_t hal_irq_save(void);
+void hal_irq_restore(uint32_t state);
+
+// Sleep until an interrupt on this core, hal_signal_event from the other
+// core or the deadline, whichever comes first. May return early.
+void hal_wait_for_event(uint32_t deadline_us);
+void hal_signal_event(void);
+
+// Receive is continuous into a ring, transmit is one asynchronous transfer
+// at a time; the data passed to hal_uart_tx_start must stay valid until
+// hal_uart_tx_busy returns false. hal_uart_rx_time_us is when the newest
+// byte in the ring was first seen.
+bool hal_uart_init(uint8_t port, const hal_uart_config_t *config);
+size_t hal_uart_rx_span(uint8_t port, const uint8_t **span);
+void hal_uart_rx_consume(uint8_t port, size_t length);
+const rx_ring_t *hal_uart_rx_ring(uint8_t port);
+uint32_t hal_uart_rx_time_us(uint8_t port);
+bool hal_uart_tx_busy(uint8_t port);
+void hal_uart_tx_start(uint8_t port, const uint8_t *data, size_t length);
+
+void hal_gpio_init_output(uint16_t pin, bool value);
+void hal_gpio_put(uint16_t pin, bool value);
+void hal_gpio_toggle(uint16_t pin);
+
+// Flash offsets are from the start of flash; erase and program take whole
+// sectors and pages and may stall the other core
+const uint8_t *hal_flash_read(uint32_t offset);
+bool hal_flash_erase(uint32_t offset, size_t length);
+bool hal_flash_program(uint32_t offset, const uint8_t *data, size_t length);
+
+// RAM words that boot does not clear, so they keep their value through a
+// watchdog reset or a brownout that leaves the SRAM powered. After a power
+// cut they hold garbage; users check their own magic and checksum.
+volatile uint32_t *hal_retained_words(void);
+
+#endif // HAL_H
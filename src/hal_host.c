@@ -0,0 +1,289 @@
+#define _POSIX_C_SOURCE 199309L
+#include "hal_host.h"
+#include <string.h>
+#include <time.h>
+
+#define HAL_HOST_RX_BUFFER_SIZE 4096
+#define HAL_HOST_GPIO_COUNT 32
+
+typedef struct {
+    bool initialized;
+    uint32_t baud_rate;
+    rx_ring_t rx_ring;
+    uint8_t rx_buffer[HAL_HOST_RX_BUFFER_SIZE];
+    uint32_t rx_time_us;
+    hal_host_tx_handler_t tx_handler;
+    void *tx_context;
+    bool tx_active;
+    uint32_t tx_done_us;
+} hal_host_uart_t;
+
+static bool virtual_clock = false;
+static uint64_t virtual_time_us = 0;
+static uint64_t event_time_us = UINT64_MAX;
+static hal_host_uart_t uarts[HAL_UART_COUNT];
+static bool gpio_state[HAL_HOST_GPIO_COUNT];
+static uint32_t gpio_toggles[HAL_HOST_GPIO_COUNT];
+static uint8_t flash_image[HAL_HOST_FLASH_SIZE];
+static bool flash_initialized = false;
+static int32_t flash_budget = -1;
+static bool flash_failed = false;
+static uint32_t retained_words[HAL_RETAINED_WORDS];
+
+static uint64_t wall_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+void hal_host_reset(void) {
+    virtual_time_us = 0;
+    event_time_us = UINT64_MAX;
+    memset(uarts, 0, sizeof(uarts));
+    memset(gpio_state, 0, sizeof(gpio_state));
+    memset(gpio_toggles, 0, sizeof(gpio_toggles));
+    memset(flash_image, 0xFF, sizeof(flash_image));
+    flash_initialized = true;
+    flash_budget = -1;
+    flash_failed = false;
+}
+
+void hal_host_set_virtual_clock(bool enabled) {
+    virtual_clock = enabled;
+}
+
+void hal_host_set_time(uint64_t time_us) {
+    virtual_time_us = time_us;
+}
+
+void hal_host_advance_time(uint32_t us) {
+    virtual_time_us += us;
+}
+
+uint64_t hal_host_time_us64(void) {
+    return virtual_clock ? virtual_time_us : wall_time_us();
+}
+
+uint32_t hal_time_us(void) {
+    return (uint32_t)hal_host_time_us64();
+}
+
+// Wake the next hal_wait_for_event at time_us, or right away if it is past;
+// the earliest pending wakeup wins
+void hal_host_post_event(uint64_t time_us) {
+    if (time_us < event_time_us) {
+        event_time_us = time_us;
+    }
+}
+
+void hal_wait_for_event(uint32_t deadline_us) {
+    uint64_t now = hal_host_time_us64();
+    int32_t remaining = (int32_t)(deadline_us - (uint32_t)now);
+    uint64_t wake = now + (uint64_t)(remaining > 0 ? remaining : 0);
+    if (event_time_us <= wake) {
+        wake = event_time_us > now ? event_time_us : now;
+        event_time_us = UINT64_MAX;
+    }
+    if (virtual_clock) {
+        virtual_time_us = wake;
+    } else if (wake > now) {
+        struct timespec duration = { (time_t)((wake - now) / 1000000u), (long)((wake - now) % 1000000u) * 1000 };
+        nanosleep(&duration, NULL);
+    }
+}
+
+void hal_signal_event(void) {
+}
+
+// Host cycles are wall-clock nanoseconds, whatever the virtual clock says,
+// so profiles show real cost
+void hal_cycle_counter_init(void) {
+}
+
+uint32_t hal_cycles(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+
+uint32_t hal_cycle_hz(void) {
+    return 1000000000u;
+}
+
+uint8_t hal_cycle_bits(void) {
+    return 32;
+}
+
+// The host pipeline runs on one thread without interrupts
+uint8_t hal_core_num(void) {
+    return 0;
+}
+
+uint32_t hal_irq_save(void) {
+    return 0;
+}
+
+void hal_irq_restore(uint32_t state) {
+    (void)state;
+}
+
+bool hal_uart_init(uint8_t port, const hal_uart_config_t *config) {
+    if (port >= HAL_UART_COUNT || config->baud_rate == 0) {
+        return false;
+    }
+    hal_host_uart_t *uart = &uarts[port];
+    uart->baud_rate = config->baud_rate;
+    uart->tx_active = false;
+    rx_ring_init(&uart->rx_ring, uart->rx_buffer, HAL_HOST_RX_BUFFER_SIZE);
+    uart->initialized = true;
+    return true;
+}
+
+size_t hal_host_uart_inject(uint8_t port, const uint8_t *data, size_t length) {
+    if (port >= HAL_UART_COUNT || !uarts[port].initialized) {
+        return 0;
+    }
+    uarts[port].rx_time_us = hal_time_us();
+    return rx_ring_write(&uarts[port].rx_ring, data, length);
+}
+
+size_t hal_uart_rx_span(uint8_t port, const uint8_t **span) {
+    if (port >= HAL_UART_COUNT || !uarts[port].initialized) {
+        return 0;
+    }
+    return rx_ring_read(&uarts[port].rx_ring, span);
+}
+
+void hal_uart_rx_consume(uint8_t port, size_t length) {
+    rx_ring_consume(&uarts[port].rx_ring, length);
+}
+
+const rx_ring_t *hal_uart_rx_ring(uint8_t port) {
+    return &uarts[port].rx_ring;
+}
+
+uint32_t hal_uart_rx_time_us(uint8_t port) {
+    return uarts[port].rx_time_us;
+}
+
+void hal_host_uart_set_tx_handler(uint8_t port, hal_host_tx_handler_t handler, void *context) {
+    uarts[port].tx_handler = handler;
+    uarts[port].tx_context = context;
+}
+
+// A transfer occupies the line for ten bit times per byte
+bool hal_uart_tx_busy(uint8_t port) {
+    hal_host_uart_t *uart = &uarts[port];
+    if (uart->tx_active && (int32_t)(hal_time_us() - uart->tx_done_us) >= 0) {
+        uart->tx_active = false;
+    }
+    return uart->tx_active;
+}
+
+void hal_uart_tx_start(uint8_t port, const uint8_t *data, size_t length) {
+    hal_host_uart_t *uart = &uarts[port];
+    uint32_t now = hal_time_us();
+    if (uart->tx_handler) {
+        uart->tx_handler(uart->tx_context, data, length, now);
+    }
+    uint32_t baud_rate = uart->baud_rate ? uart->baud_rate : 1;
+    uart->tx_done_us = now + (uint32_t)(((uint64_t)length * 10u * 1000000u + baud_rate - 1) / baud_rate);
+    uart->tx_active = true;
+}
+
+void hal_gpio_init_output(uint16_t pin, bool value) {
+    hal_gpio_put(pin, value);
+}
+
+void hal_gpio_put(uint16_t pin, bool value) {
+    if (pin < HAL_HOST_GPIO_COUNT) {
+        if (gpio_state[pin] != value) {
+            gpio_toggles[pin]++;
+        }
+        gpio_state[pin] = value;
+    }
+}
+
+void hal_gpio_toggle(uint16_t pin) {
+    if (pin < HAL_HOST_GPIO_COUNT) {
+        hal_gpio_put(pin, !gpio_state[pin]);
+    }
+}
+
+bool hal_host_gpio_get(uint16_t pin) {
+    return pin < HAL_HOST_GPIO_COUNT && gpio_state[pin];
+}
+
+uint32_t hal_host_gpio_toggles(uint16_t pin) {
+    return pin < HAL_HOST_GPIO_COUNT ? gpio_toggles[pin] : 0;
+}
+
+// Erased NOR flash reads as 0xFF
+uint8_t *hal_host_flash_image(void) {
+    if (!flash_initialized) {
+        memset(flash_image, 0xFF, sizeof(flash_image));
+        flash_initialized = true;
+    }
+    return flash_image;
+}
+
+// A negative budget disarms the injection and powers the flash back up
+void hal_host_flash_fail_after(int32_t bytes) {
+    flash_budget = bytes;
+    flash_failed = false;
+}
+
+bool hal_host_flash_failed(void) {
+    return flash_failed;
+}
+
+// Bytes of an operation that complete before the injected power failure
+static size_t flash_bytes_allowed(size_t length) {
+    if (flash_budget < 0 || (size_t)flash_budget >= length) {
+        if (flash_budget >= 0) {
+            flash_budget -= (int32_t)length;
+        }
+        return length;
+    }
+    size_t allowed = (size_t)flash_budget;
+    flash_budget = 0;
+    flash_failed = true;
+    return allowed;
+}
+
+const uint8_t *hal_flash_read(uint32_t offset) {
+    return &hal_host_flash_image()[offset];
+}
+
+bool hal_flash_erase(uint32_t offset, size_t length) {
+    if (offset % HAL_FLASH_SECTOR_SIZE || length % HAL_FLASH_SECTOR_SIZE || offset + length > HAL_HOST_FLASH_SIZE) {
+        return false;
+    }
+    if (flash_failed) {
+        return false;
+    }
+    size_t allowed = flash_bytes_allowed(length);
+    memset(&hal_host_flash_image()[offset], 0xFF, allowed);
+    return allowed == length;
+}
+
+// Programming can only clear bits, as on the real part
+bool hal_flash_program(uint32_t offset, const uint8_t *data, size_t length) {
+    if (offset % HAL_FLASH_PAGE_SIZE || length % HAL_FLASH_PAGE_SIZE || offset + length > HAL_HOST_FLASH_SIZE) {
+        return false;
+    }
+    if (flash_failed) {
+        return false;
+    }
+    size_t allowed = flash_bytes_allowed(length);
+    uint8_t *image = hal_host_flash_image();
+    for (size_t i = 0; i < allowed; i++) {
+        image[offset + i] &= data[i];
+    }
+    return allowed == length;
+}
+
+// Not cleared by hal_host_reset, which stands for a reset with power kept
+volatile uint32_t *hal_retained_words(void) {
+    return retained_words;
+}
@@ -0,0 +1,36 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include "hal.h"
+
+// Host-only controls of the HAL used by simulations. With the virtual clock
+// enabled hal_time_us only moves through hal_host_advance_time, so runs are
+// repeatable and as fast as the host allows. UART receive data is injected
+// by the caller and transmitted data is handed to a callback; a transfer
+// keeps the port busy for its duration at the configured baud rate.
+// Flash power failures are injected with hal_host_flash_fail_after: the
+// erase or program that crosses the byte budget only takes partial effect
+// and the flash refuses all further operations until it is disarmed.
+// There are no interrupts on the host, so hal_wait_for_event only ends
+// early at a wakeup set with hal_host_post_event; on the virtual clock the
+// wait moves the time forward instead of sleeping.
+#define HAL_HOST_FLASH_SIZE (1024u * 1024u)
+
+typedef void (*hal_host_tx_handler_t)(void *context, const uint8_t *data, size_t length, uint32_t now);
+
+// Function prototypes
+void hal_host_reset(void);
+void hal_host_set_virtual_clock(bool enabled);
+void hal_host_set_time(uint64_t time_us);
+void hal_host_advance_time(uint32_t us);
+uint64_t hal_host_time_us64(void);
+void hal_host_post_event(uint64_t time_us);
+size_t hal_host_uart_inject(uint8_t port, const uint8_t *data, size_t length);
+void hal_host_uart_set_tx_handler(uint8_t port, hal_host_tx_handler_t handler, void *context);
+bool hal_host_gpio_get(uint16_t pin);
+uint32_t hal_host_gpio_toggles(uint16_t pin);
+uint8_t *hal_host_flash_image(void);
+void hal_host_flash_fail_after(int32_t bytes);
+bool hal_host_flash_failed(void);
+
+#endif // HAL_HOST_H
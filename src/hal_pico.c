@@ -0,0 +1,330 @@
+#include "hal.h"
+#include "trace.h"
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/uart.h"
+#include "hardware/gpio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "uart_rx.pio.h"
+
+// Buffers for incoming FrSky data, filled by DMA with write address wrapping.
+// The ring wrap requires each buffer to be aligned to its own size.
+#define FRSKY_RX_DMA_TRANSFER_COUNT 0xFFFFFFFFu
+
+// One DMA-fed input: S.PORT bus 0 is FRSKY_UART_ID, further buses are PIO
+// UARTs, and the last slot is the receive side of the CRSF UART
+#define CRSF_RX_BUS FRSKY_BUS_COUNT
+#define RX_BUS_COUNT (FRSKY_BUS_COUNT + 1)
+
+typedef struct {
+    rx_ring_t ring;
+    bool active;
+    int dma_channel;
+    volatile uint32_t dma_base;
+    volatile uint32_t rx_time_us;
+} frsky_bus_t;
+
+static uint8_t frsky_buffers[RX_BUS_COUNT][FRSKY_BUFFER_SIZE] __attribute__((aligned(FRSKY_BUFFER_SIZE)));
+static frsky_bus_t frsky_buses[RX_BUS_COUNT];
+static bool frsky_dma_irq_installed = false;
+static int frsky_pio_offset = -1;
+static uint32_t frsky_timeout_us = 0;
+static uint32_t __uninitialized_ram(retained_words)[HAL_RETAINED_WORDS];
+
+// Outgoing CRSF frames, sent by a TX DMA channel
+static int crsf_tx_dma_channel = -1;
+
+// End of a CRSF transfer. Taking the interrupt is all that is needed, it
+// wakes the core so the next queued frame goes out.
+static void on_crsf_tx_dma_complete() {
+    dma_channel_acknowledge_irq1(crsf_tx_dma_channel);
+}
+
+uint32_t hal_time_us(void) {
+    return time_us_32();
+}
+
+// SysTick is a 24 bit down-counter on the processor clock, one per core
+#define SYSTICK_MAX 0x00FFFFFFu
+#define SYSTICK_CSR_ENABLE_PROCESSOR_CLOCK 0x5u
+
+void hal_cycle_counter_init(void) {
+    systick_hw->csr = 0;
+    systick_hw->rvr = SYSTICK_MAX;
+    systick_hw->cvr = 0;
+    systick_hw->csr = SYSTICK_CSR_ENABLE_PROCESSOR_CLOCK;
+}
+
+uint32_t hal_cycles(void) {
+    return SYSTICK_MAX - systick_hw->cvr;
+}
+
+uint32_t hal_cycle_hz(void) {
+    return clock_get_hz(clk_sys);
+}
+
+uint8_t hal_cycle_bits(void) {
+    return 24;
+}
+
+uint8_t hal_core_num(void) {
+    return (uint8_t)get_core_num();
+}
+
+uint32_t hal_irq_save(void) {
+    return save_and_disable_interrupts();
+}
+
+void hal_irq_restore(uint32_t state) {
+    restore_interrupts(state);
+}
+
+// WFE with an alarm from the SDK's default pool at the deadline. Any
+// interrupt taken on this core or a SEV from the other one ends it early.
+void hal_wait_for_event(uint32_t deadline_us) {
+    int32_t remaining = (int32_t)(deadline_us - time_us_32());
+    if (remaining > 0) {
+        best_effort_wfe_or_timeout(make_timeout_time_us((uint64_t)remaining));
+    }
+}
+
+void hal_signal_event(void) {
+    __sev();
+}
+
+// Number of bytes the RX DMA channel of a bus has written since it was started
+static uint32_t frsky_rx_dma_position(frsky_bus_t *bus) {
+    uint32_t base;
+    uint32_t remaining;
+    do {
+        base = bus->dma_base;
+        remaining = dma_channel_hw_addr(bus->dma_channel)->transfer_count;
+    } while (base != bus->dma_base);
+    return base + (FRSKY_RX_DMA_TRANSFER_COUNT - remaining);
+}
+
+// DMA completion handler: re-arm the channel, the write address keeps wrapping
+static void on_frsky_rx_dma_complete() {
+    for (int i = 0; i < RX_BUS_COUNT; i++) {
+        frsky_bus_t *bus = &frsky_buses[i];
+        if (bus->active && dma_channel_get_irq0_status(bus->dma_channel)) {
+            dma_channel_acknowledge_irq0(bus->dma_channel);
+            bus->dma_base += FRSKY_RX_DMA_TRANSFER_COUNT;
+            dma_channel_set_trans_count(bus->dma_channel, FRSKY_RX_DMA_TRANSFER_COUNT, true);
+        }
+    }
+}
+
+// Publish the DMA position of a bus, noting when new bytes were first seen
+static void update_frsky_head(frsky_bus_t *bus, uint32_t now) {
+    uint32_t head = frsky_rx_dma_position(bus);
+    if (head != bus->ring.head) {
+        bus->rx_time_us = now;
+        rx_ring_set_head(&bus->ring, head);
+    }
+}
+
+// UART receive-timeout handler: the line went idle, release what DMA has
+// stored so far to the parser instead of waiting for more bytes. The timeout
+// fires 32 bit times after the last byte.
+static void on_frsky_uart_rx() {
+    TRACE_BEGIN(TRACE_STAGE_RX_ISR);
+    uart_hw_t *hw = uart_get_hw(FRSKY_UART_ID);
+    if (hw->mis & UART_UARTMIS_RTMIS_BITS) {
+        hw->icr = UART_UARTICR_RTIC_BITS;
+        update_frsky_head(&frsky_buses[0], time_us_32() - frsky_timeout_us);
+    }
+    TRACE_END(TRACE_STAGE_RX_ISR);
+}
+
+// Start the RX DMA of a bus, reading one byte per DREQ from src. The
+// interrupts are serviced by the core that calls this.
+static void start_frsky_rx_dma(int index, const volatile void *src, unsigned dreq) {
+    frsky_bus_t *bus = &frsky_buses[index];
+    rx_ring_init(&bus->ring, frsky_buffers[index], FRSKY_BUFFER_SIZE);
+    bus->dma_base = 0;
+    bus->dma_channel = dma_claim_unused_channel(true);
+    bus->active = true;
+
+    dma_channel_config rx_dma = dma_channel_get_default_config(bus->dma_channel);
+    channel_config_set_transfer_data_size(&rx_dma, DMA_SIZE_8);
+    channel_config_set_read_increment(&rx_dma, false);
+    channel_config_set_write_increment(&rx_dma, true);
+    channel_config_set_ring(&rx_dma, true, FRSKY_BUFFER_SIZE_BITS);
+    channel_config_set_dreq(&rx_dma, dreq);
+    dma_channel_set_irq0_enabled(bus->dma_channel, true);
+    dma_channel_configure(bus->dma_channel, &rx_dma, frsky_buffers[index],
+                          src, FRSKY_RX_DMA_TRANSFER_COUNT, true);
+
+    if (!frsky_dma_irq_installed) {
+        irq_add_shared_handler(DMA_IRQ_0, on_frsky_rx_dma_complete, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0, true);
+        frsky_dma_irq_installed = true;
+    }
+}
+
+// Bus 0: hardware UART, receive-timeout interrupt only, data is moved by DMA
+static void init_frsky_uart(const hal_uart_config_t *config) {
+    uart_init(FRSKY_UART_ID, config->baud_rate);
+    frsky_timeout_us = 32000000u / config->baud_rate;
+    gpio_set_function(config->tx_pin, GPIO_FUNC_UART);
+    gpio_set_function(config->rx_pin, GPIO_FUNC_UART);
+    uart_set_format(FRSKY_UART_ID, 8, 1, UART_PARITY_NONE);
+
+    start_frsky_rx_dma(0, &uart_get_hw(FRSKY_UART_ID)->dr, uart_get_dreq(FRSKY_UART_ID, false));
+
+    uart_get_hw(FRSKY_UART_ID)->dmacr = UART_UARTDMACR_RXDMAE_BITS;
+    uart_get_hw(FRSKY_UART_ID)->imsc = UART_UARTIMSC_RTIM_BITS;
+    irq_set_exclusive_handler(UART0_IRQ, on_frsky_uart_rx);
+    irq_set_enabled(UART0_IRQ, true);
+}
+
+// Additional S.PORT inputs on PIO UART receivers. The program shifts right,
+// so each received byte sits in the top byte of the RX FIFO word.
+static void init_frsky_pio_bus(int index, const hal_uart_config_t *config) {
+    if (frsky_pio_offset < 0) {
+        frsky_pio_offset = (int)pio_add_program(FRSKY_PIO_ID, &uart_rx_program);
+    }
+
+    uint sm = (uint)(index - 1);
+    uart_rx_program_init(FRSKY_PIO_ID, sm, (uint)frsky_pio_offset, config->rx_pin, config->baud_rate);
+    const volatile uint8_t *rx_fifo = (const volatile uint8_t *)&FRSKY_PIO_ID->rxf[sm] + 3;
+    start_frsky_rx_dma(index, rx_fifo, pio_get_dreq(FRSKY_PIO_ID, sm, false));
+}
+
+// CRSF UART with TX DMA, paced by the UART TX FIFO, and RX DMA into a ring
+// like the S.PORT buses
+static void init_crsf_uart(const hal_uart_config_t *config) {
+    uart_init(CRSF_UART_ID, config->baud_rate);
+    gpio_set_function(config->tx_pin, GPIO_FUNC_UART);
+    gpio_set_function(config->rx_pin, GPIO_FUNC_UART);
+    uart_set_format(CRSF_UART_ID, 8, 1, UART_PARITY_NONE);
+
+    crsf_tx_dma_channel = dma_claim_unused_channel(true);
+    dma_channel_config tx_dma = dma_channel_get_default_config(crsf_tx_dma_channel);
+    channel_config_set_transfer_data_size(&tx_dma, DMA_SIZE_8);
+    channel_config_set_read_increment(&tx_dma, true);
+    channel_config_set_write_increment(&tx_dma, false);
+    channel_config_set_dreq(&tx_dma, uart_get_dreq(CRSF_UART_ID, true));
+    dma_channel_configure(crsf_tx_dma_channel, &tx_dma, &uart_get_hw(CRSF_UART_ID)->dr,
+                          NULL, 0, false);
+    dma_channel_set_irq1_enabled(crsf_tx_dma_channel, true);
+    irq_set_exclusive_handler(DMA_IRQ_1, on_crsf_tx_dma_complete);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+    start_frsky_rx_dma(CRSF_RX_BUS, &uart_get_hw(CRSF_UART_ID)->dr, uart_get_dreq(CRSF_UART_ID, false));
+    uart_get_hw(CRSF_UART_ID)->dmacr = UART_UARTDMACR_TXDMAE_BITS | UART_UARTDMACR_RXDMAE_BITS;
+}
+
+static frsky_bus_t *bus_for_port(uint8_t port) {
+    return port == HAL_UART_CRSF ? &frsky_buses[CRSF_RX_BUS] : &frsky_buses[port - HAL_UART_SPORT(0)];
+}
+
+bool hal_uart_init(uint8_t port, const hal_uart_config_t *config) {
+    if (port == HAL_UART_CRSF) {
+        init_crsf_uart(config);
+    } else if (port == HAL_UART_SPORT(0)) {
+        init_frsky_uart(config);
+    } else if (port < HAL_UART_COUNT) {
+        init_frsky_pio_bus(port - HAL_UART_SPORT(0), config);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Get the next contiguous run of received bytes, consume it with
+// hal_uart_rx_consume once parsed
+size_t hal_uart_rx_span(uint8_t port, const uint8_t **span) {
+    frsky_bus_t *bus = bus_for_port(port);
+    uint32_t interrupts = save_and_disable_interrupts();
+    update_frsky_head(bus, time_us_32());
+    restore_interrupts(interrupts);
+    return rx_ring_read(&bus->ring, span);
+}
+
+void hal_uart_rx_consume(uint8_t port, size_t length) {
+    rx_ring_consume(&bus_for_port(port)->ring, length);
+}
+
+const rx_ring_t *hal_uart_rx_ring(uint8_t port) {
+    return &bus_for_port(port)->ring;
+}
+
+uint32_t hal_uart_rx_time_us(uint8_t port) {
+    return bus_for_port(port)->rx_time_us;
+}
+
+// CRSF: the buffer may be reused once the DMA has moved the last byte into
+// the UART FIFO. S.PORT bus 0 only sends sensor polls, which fit the FIFO;
+// the line is half duplex, so the TX pin must reach it through a diode or
+// tristate buffer and the poll is received back as an echo. The PIO buses
+// are receive only.
+bool hal_uart_tx_busy(uint8_t port) {
+    if (port == HAL_UART_SPORT(0)) {
+        return (uart_get_hw(FRSKY_UART_ID)->fr & UART_UARTFR_BUSY_BITS) != 0;
+    }
+    return dma_channel_is_busy(crsf_tx_dma_channel);
+}
+
+void hal_uart_tx_start(uint8_t port, const uint8_t *data, size_t length) {
+    if (port == HAL_UART_CRSF) {
+        dma_channel_transfer_from_buffer_now(crsf_tx_dma_channel, data, length);
+    } else if (port == HAL_UART_SPORT(0)) {
+        uart_write_blocking(FRSKY_UART_ID, data, length);
+    }
+}
+
+void hal_gpio_init_output(uint16_t pin, bool value) {
+    gpio_init(pin);
+    gpio_set_dir(pin, GPIO_OUT);
+    gpio_put(pin, value);
+}
+
+void hal_gpio_put(uint16_t pin, bool value) {
+    gpio_put(pin, value);
+}
+
+void hal_gpio_toggle(uint16_t pin) {
+    gpio_xor_mask(1u << pin);
+}
+
+const uint8_t *hal_flash_read(uint32_t offset) {
+    return (const uint8_t *)(XIP_BASE + offset);
+}
+
+// The other core runs from flash too, so it is parked in RAM for the
+// duration of the erase and program
+bool hal_flash_erase(uint32_t offset, size_t length) {
+    if (offset % HAL_FLASH_SECTOR_SIZE || length % HAL_FLASH_SECTOR_SIZE) {
+        return false;
+    }
+    multicore_lockout_start_blocking();
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_erase(offset, length);
+    restore_interrupts(interrupts);
+    multicore_lockout_end_blocking();
+    return true;
+}
+
+bool hal_flash_program(uint32_t offset, const uint8_t *data, size_t length) {
+    if (offset % HAL_FLASH_PAGE_SIZE || length % HAL_FLASH_PAGE_SIZE) {
+        return false;
+    }
+    multicore_lockout_start_blocking();
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_program(offset, data, length);
+    restore_interrupts(interrupts);
+    multicore_lockout_end_blocking();
+    return true;
+}
+
+volatile uint32_t *hal_retained_words(void) {
+    return retained_words;
+}
@@ -0,0 +1,38 @@
+#include "latency_histogram.h"
+#include <string.h>
+
+void latency_histogram_reset(latency_histogram_t *histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+void latency_histogram_record(latency_histogram_t *histogram, uint32_t latency_us) {
+    uint32_t bucket = latency_us ? 32u - (uint32_t)__builtin_clz(latency_us) : 0;
+    if (bucket >= LATENCY_HISTOGRAM_BUCKETS) {
+        bucket = LATENCY_HISTOGRAM_BUCKETS - 1;
+    }
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->total_us += latency_us;
+    if (latency_us > histogram->max_us) {
+        histogram->max_us = latency_us;
+    }
+}
+
+// Upper bound of the bucket holding the given percentile, capped at the
+// largest value seen
+uint32_t latency_histogram_percentile(const latency_histogram_t *histogram, uint32_t percent) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = ((uint64_t)histogram->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank && seen > 0) {
+            uint32_t upper = bucket ? (1u << bucket) - 1 : 0;
+            return upper < histogram->max_us ? upper : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
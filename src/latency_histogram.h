@@ -0,0 +1,23 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Latency histogram with log2 buckets: bucket 0 holds 0 us, bucket k holds
+// [2^(k-1), 2^k) us, the last bucket everything above. Percentiles are
+// reported as the upper bound of the bucket they fall in.
+#define LATENCY_HISTOGRAM_BUCKETS 24
+
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+} latency_histogram_t;
+
+// Function prototypes
+void latency_histogram_reset(latency_histogram_t *histogram);
+void latency_histogram_record(latency_histogram_t *histogram, uint32_t latency_us);
+uint32_t latency_histogram_percentile(const latency_histogram_t *histogram, uint32_t percent);
+
+#endif // LATENCY_HISTOGRAM_H
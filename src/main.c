@@ -1,24 +1,30 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include "pico/stdlib.h"
-#include "hardware/uart.h"
-#include "hardware/gpio.h"
-#include "hardware/timer.h"
-#include "hardware/flash.h"
-#include "hardware/sync.h"
+#include "pico/multicore.h"
 #include "config.h"
 #include "frsky_sport.h"
 #include "crsf.h"
 #include "telemetry_converter.h"
+#include "spsc_queue.h"
+#include "sport_capture.h"
+#include "telemetry_mirror.h"
+#include "deferred_log.h"
+#include "hal.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "rx_stats.h"
+#include "config_store.h"
+#include "boot_phases.h"
 
-// Buffer for incoming FrSky data
-static uint8_t frsky_buffer[FRSKY_BUFFER_SIZE];
-static volatile uint16_t frsky_buffer_head = 0;
-static volatile uint16_t frsky_buffer_tail = 0;
-
-// Configuration storage
+// Configuration storage: a record log over CONFIG_STORE_SECTORS sectors
 #define CONFIG_FLASH_OFFSET (256 * 1024)
+#define CONFIG_SCHEMA_VERSION 2
+
+// Schema 1: the raw struct older firmware kept in the first sector, read
+// once when the log is still empty
 #define CONFIG_MAGIC 0x46525343
 
 typedef struct {
@@ -34,10 +40,25 @@ typedef struct {
     uint32_t led_blink_interval_us;
     uint8_t debug_enabled;
     uint8_t reserved[32];
+} config_v1_t;
+
+// Schema 2. New fields go at the end: shorter records from older firmware
+// leave them at their defaults, longer ones from newer firmware are cut.
+typedef struct {
+    uint16_t frsky_tx_pin;
+    uint16_t frsky_rx_pin;
+    uint32_t frsky_baud_rate;
+    uint16_t crsf_tx_pin;
+    uint16_t crsf_rx_pin;
+    uint32_t crsf_baud_rate;
+    uint16_t led_pin;
+    uint32_t heartbeat_interval_us;
+    uint32_t led_blink_interval_us;
+    uint8_t debug_enabled;
+    uint8_t sport_master_enabled;
 } config_data_t;
 
 static config_data_t current_config = {
-    .magic = CONFIG_MAGIC,
     .frsky_tx_pin = FRSKY_TX_PIN,
     .frsky_rx_pin = FRSKY_RX_PIN,
     .frsky_baud_rate = FRSKY_BAUD_RATE,
@@ -47,84 +68,337 @@ static config_data_t current_config = {
     .led_pin = LED_PIN,
     .heartbeat_interval_us = HEARTBEAT_INTERVAL_US,
     .led_blink_interval_us = LED_BLINK_INTERVAL_US,
-    .debug_enabled = DEBUG_ENABLED
+    .debug_enabled = DEBUG_ENABLED,
+    .sport_master_enabled = SPORT_MASTER_ENABLED
 };
 
-// Statistics
-static uint32_t frsky_packets_received = 0;
-static uint32_t frsky_packets_valid = 0;
-static uint32_t crsf_packets_sent = 0;
-
-// UART interrupt handler
-void on_frsky_uart_rx() {
-    while (uart_is_readable(FRSKY_UART_ID)) {
-        uint8_t ch = uart_getc(FRSKY_UART_ID);
-        uint16_t next_head = (frsky_buffer_head + 1) % sizeof(frsky_buffer);
-        if (next_head != frsky_buffer_tail) {
-            frsky_buffer[frsky_buffer_head] = ch;
-            frsky_buffer_head = next_head;
-        }
+static config_store_t config_store;
+
+// Loop timing of one core
+typedef struct {
+    uint32_t iterations;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} loop_stats_t;
+
+// Core1 -> core0: periodic statistics snapshot
+typedef struct {
+    uint32_t frsky_packets_received;
+    uint32_t frsky_packets_valid;
+    uint32_t sensors_lost;
+    crsf_tx_stats_t crsf_tx;
+    crsf_scheduler_stats_t scheduler;
+    uint32_t rx_overflows[FRSKY_BUS_COUNT];
+    uint32_t rx_bytes_dropped[FRSKY_BUS_COUNT];
+    loop_stats_t loop;
+    float idle_percent;
+    task_t heartbeat;
+    uint8_t latency_count;
+    uint8_t latency_types[PIPELINE_LATENCY_TYPES];
+    latency_histogram_t latency[PIPELINE_LATENCY_TYPES];
+    bool master_enabled;
+    uint32_t master_polls;
+    uint32_t master_probes;
+    uint32_t master_polls_by_id[SPORT_MASTER_IDS];
+    float master_rates[SPORT_MASTER_IDS];
+    crsf_link_rx_stats_t crsf_rx;
+    crsf_pacing_stats_t pacing;
+    crsf_link_statistics_t link;
+    bool link_valid;
+    bool paced;
+    uint32_t receiver_interval_us;
+} pipeline_stats_t;
+
+// Core0 -> core1: configuration changes applied by the pipeline
+typedef enum {
+    CONFIG_KEY_DEBUG_ENABLED,
+    CONFIG_KEY_HEARTBEAT_INTERVAL,
+    CONFIG_KEY_CAPTURE_ENABLED,
+    CONFIG_KEY_FLASH_WINDOW,
+    CONFIG_KEY_SPORT_MASTER,
+    CONFIG_KEY_MIRROR_ENABLED
+} config_key_t;
+
+typedef struct {
+    uint8_t key;
+    uint32_t value;
+} config_message_t;
+
+// Core1 -> core0: encoded capture or mirror records, written to USB
+// unchanged
+typedef struct {
+    uint8_t length;
+    bool last;
+    uint8_t data[SPORT_CAPTURE_CHUNK_SIZE];
+} capture_chunk_t;
+
+_Static_assert(TELEMETRY_MIRROR_ENCODED_MAX <= SPORT_CAPTURE_CHUNK_SIZE, "mirror record exceeds a capture chunk");
+
+static pipeline_stats_t stats_storage[4];
+static config_message_t config_storage[8];
+static capture_chunk_t capture_storage[SPORT_CAPTURE_QUEUE_DEPTH];
+static spsc_queue_t stats_queue;
+static spsc_queue_t config_queue;
+static spsc_queue_t capture_queue;
+
+// Pipeline state, owned by core1
+typedef struct {
+    uint8_t debug_enabled;
+    uint8_t capture_enabled;
+    uint8_t mirror_enabled;
+    bool flash_window_requested;
+} pipeline_config_t;
+
+static pipeline_t pipeline;
+static pipeline_config_t pipeline_config;
+static sport_capture_writer_t capture_writer;
+static telemetry_mirror_writer_t mirror_writer;
+static loop_stats_t core1_loop;
+
+// Set by core1 when core0 may stall it for a flash operation
+static _Atomic bool flash_window_ready = false;
+
+// Every push wakes the other core in case it is idle
+static void post_config_change(config_key_t key, uint32_t value) {
+    config_message_t message = { .key = (uint8_t)key, .value = value };
+    spsc_queue_push(&config_queue, &message);
+    hal_signal_event();
+}
+
+// Housekeeping state, owned by core0. A capture or mirror is starting until
+// its first record has gone out.
+typedef enum {
+    CAPTURE_IDLE,
+    CAPTURE_STARTING,
+    CAPTURE_RUNNING,
+    CAPTURE_STOPPING
+} capture_state_t;
+
+static pipeline_stats_t pipeline_stats;
+static loop_stats_t core0_loop;
+static task_scheduler_t core0_tasks;
+static rx_stats_window_t rx_window;
+static capture_state_t capture_state = CAPTURE_IDLE;
+static config_key_t capture_key;          // Capture or mirror, whichever runs
+static telemetry_mirror_writer_t log_writer;
+
+static void loop_stats_update(loop_stats_t *stats, uint32_t start_us, uint32_t end_us) {
+    uint32_t elapsed = end_us - start_us;
+    stats->iterations++;
+    stats->last_us = elapsed;
+    stats->total_us += elapsed;
+    if (elapsed > stats->max_us) {
+        stats->max_us = elapsed;
     }
 }
 
-// Load configuration from flash
+static void config_from_v1(const config_v1_t *legacy) {
+    current_config.frsky_tx_pin = legacy->frsky_tx_pin;
+    current_config.frsky_rx_pin = legacy->frsky_rx_pin;
+    current_config.frsky_baud_rate = legacy->frsky_baud_rate;
+    current_config.crsf_tx_pin = legacy->crsf_tx_pin;
+    current_config.crsf_rx_pin = legacy->crsf_rx_pin;
+    current_config.crsf_baud_rate = legacy->crsf_baud_rate;
+    current_config.led_pin = legacy->led_pin;
+    current_config.heartbeat_interval_us = legacy->heartbeat_interval_us;
+    current_config.led_blink_interval_us = legacy->led_blink_interval_us;
+    current_config.debug_enabled = legacy->debug_enabled;
+}
+
+// Load the newest configuration record, records of an unknown schema are
+// ignored. Runs before USB is up, what it logs is printed once core0's log
+// task runs.
 void load_config() {
-    const config_data_t *flash_config = (const config_data_t *)(XIP_BASE + CONFIG_FLASH_OFFSET);
-    if (flash_config->magic == CONFIG_MAGIC) {
-        current_config = *flash_config;
-        if (current_config.debug_enabled) {
-            printf("Configuration loaded from flash\n");
+    static uint8_t payload[CONFIG_STORE_MAX_PAYLOAD];
+    uint16_t schema;
+    size_t length;
+    config_store_init(&config_store, CONFIG_FLASH_OFFSET, CONFIG_STORE_SECTORS);
+    
+    if (config_store_load(&config_store, payload, sizeof(payload), &schema, &length)) {
+        if (schema == CONFIG_SCHEMA_VERSION) {
+            memcpy(&current_config, payload, length < sizeof(current_config) ? length : sizeof(current_config));
+            if (current_config.debug_enabled) {
+                DLOG2(LOG_CONFIG_LOADED, schema, length);
+            }
+        }
+    } else {
+        const config_v1_t *legacy = (const config_v1_t *)hal_flash_read(CONFIG_FLASH_OFFSET);
+        if (legacy->magic == CONFIG_MAGIC) {
+            config_from_v1(legacy);
+            if (current_config.debug_enabled) {
+                DLOG0(LOG_CONFIG_LEGACY);
+            }
         }
     }
 }
 
-// Save configuration to flash
+// Ask core1 for a quiet moment before touching flash. Core1 is parked while
+// the flash is busy, but the RX DMA keeps filling the rings, so nothing is
+// lost as long as the pause is shorter than a ring's worth of bytes.
+static void request_flash_window() {
+    atomic_store(&flash_window_ready, false);
+    post_config_change(CONFIG_KEY_FLASH_WINDOW, 1);
+    uint32_t start = time_us_32();
+    while (!atomic_load(&flash_window_ready) && time_us_32() - start < CONFIG_FLASH_WINDOW_TIMEOUT_US) {
+        tight_loop_contents();
+    }
+}
+
+// Append the configuration to the record log. Usually a single page
+// program; every CONFIG_STORE_SECTORS-th sector fill also erases one sector.
 void save_config() {
-    uint32_t interrupts = save_and_disable_interrupts();
-    flash_range_erase(CONFIG_FLASH_OFFSET, FLASH_SECTOR_SIZE);
-    flash_range_program(CONFIG_FLASH_OFFSET, (const uint8_t*)&current_config, sizeof(current_config));
-    restore_interrupts(interrupts);
+    bool erases = config_store_next_save_erases(&config_store);
+    request_flash_window();
+    bool saved = config_store_save(&config_store, CONFIG_SCHEMA_VERSION, &current_config, sizeof(current_config));
+    atomic_store(&flash_window_ready, false);
     
-    if (current_config.debug_enabled) {
-        printf("Configuration saved to flash\n");
+    if (current_config.debug_enabled && saved) {
+        DLOG2(LOG_CONFIG_SAVED, config_store.sequence, erases);
+    } else if (current_config.debug_enabled) {
+        DLOG2(LOG_CONFIG_SAVE_FAILED, config_store.sequence + 1, erases);
     }
 }
 
-// Initialize UARTs
+// Initialize UARTs, CRSF first so the heartbeat can start as early as
+// possible. The RX interrupts are serviced by the calling core.
 void init_uarts() {
-    // FrSky UART
-    uart_init(FRSKY_UART_ID, current_config.frsky_baud_rate);
-    gpio_set_function(current_config.frsky_tx_pin, GPIO_FUNC_UART);
-    gpio_set_function(current_config.frsky_rx_pin, GPIO_FUNC_UART);
-    uart_set_format(FRSKY_UART_ID, 8, 1, UART_PARITY_NONE);
+    static const uint8_t pio_rx_pins[] = FRSKY_PIO_RX_PINS;
+    hal_uart_config_t frsky = {
+        .baud_rate = current_config.frsky_baud_rate,
+        .tx_pin = current_config.frsky_tx_pin,
+        .rx_pin = current_config.frsky_rx_pin
+    };
+    hal_uart_config_t crsf = {
+        .baud_rate = current_config.crsf_baud_rate,
+        .tx_pin = current_config.crsf_tx_pin,
+        .rx_pin = current_config.crsf_rx_pin
+    };
     
-    // Enable RX interrupt
-    irq_set_exclusive_handler(UART0_IRQ, on_frsky_uart_rx);
-    irq_set_enabled(UART0_IRQ, true);
-    uart_set_irq_enables(FRSKY_UART_ID, true, false);
+    hal_uart_init(HAL_UART_CRSF, &crsf);
+    boot_phase_mark(BOOT_PHASE_CRSF_READY);
+    hal_uart_init(HAL_UART_SPORT(0), &frsky);
+    for (int i = 1; i < FRSKY_BUS_COUNT; i++) {
+        frsky.rx_pin = pio_rx_pins[i - 1];
+        hal_uart_init(HAL_UART_SPORT(i), &frsky);
+    }
+}
+
+static void post_capture_chunk(const uint8_t *data, size_t length, bool last) {
+    capture_chunk_t chunk = { .length = (uint8_t)length, .last = last };
+    memcpy(chunk.data, data, length);
+    spsc_queue_push(&capture_queue, &chunk);
+    hal_signal_event();
+}
+
+// Record a span exactly as received, split into records that fit a chunk
+static void capture_span(uint8_t bus, const uint8_t *span, size_t length, uint32_t now) {
+    const size_t max_run = SPORT_CAPTURE_CHUNK_SIZE - SPORT_CAPTURE_RECORD_OVERHEAD;
+    uint8_t record[SPORT_CAPTURE_CHUNK_SIZE];
     
-    // CRSF UART
-    uart_init(CRSF_UART_ID, current_config.crsf_baud_rate);
-    gpio_set_function(current_config.crsf_tx_pin, GPIO_FUNC_UART);
-    gpio_set_function(current_config.crsf_rx_pin, GPIO_FUNC_UART);
-    uart_set_format(CRSF_UART_ID, 8, 1, UART_PARITY_NONE);
+    while (length > 0) {
+        size_t run = length < max_run ? length : max_run;
+        size_t size = sport_capture_write_run(&capture_writer, record, sizeof(record), now, bus, span, run);
+        post_capture_chunk(record, size, false);
+        span += run;
+        length -= run;
+    }
 }
 
-// Get next byte from FrSky buffer
-bool get_frsky_byte(uint8_t *byte) {
-    if (frsky_buffer_tail == frsky_buffer_head) {
-        return false;
+static void set_capture_enabled(bool enabled) {
+    uint8_t record[SPORT_CAPTURE_CHUNK_SIZE];
+    
+    if (enabled && !pipeline_config.capture_enabled) {
+        sport_capture_writer_init(&capture_writer);
+        post_capture_chunk(record, sport_capture_write_header(record, sizeof(record)), false);
+    } else if (!enabled && pipeline_config.capture_enabled) {
+        post_capture_chunk(record, sport_capture_write_end(&capture_writer, record, sizeof(record), time_us_32()), true);
     }
+    pipeline_config.capture_enabled = enabled;
+}
+
+// The mirror shares the capture chunks: one record per chunk, dropped when
+// core0 falls behind, which the reader sees as a sequence gap
+static void set_mirror_enabled(bool enabled) {
+    uint8_t record[SPORT_CAPTURE_CHUNK_SIZE];
     
-    *byte = frsky_buffer[frsky_buffer_tail];
-    frsky_buffer_tail = (frsky_buffer_tail + 1) % sizeof(frsky_buffer);
-    return true;
+    if (enabled && !pipeline_config.mirror_enabled) {
+        telemetry_mirror_writer_init(&mirror_writer);
+        post_capture_chunk(record, telemetry_mirror_write_start(&mirror_writer, record, sizeof(record), time_us_32()),
+                           false);
+    } else if (!enabled && pipeline_config.mirror_enabled) {
+        post_capture_chunk(record, telemetry_mirror_write_end(&mirror_writer, record, sizeof(record), time_us_32()),
+                           true);
+    }
+    pipeline_config.mirror_enabled = enabled;
 }
 
-// Send CRSF packet
-void send_crsf_packet(const uint8_t *data, uint8_t length) {
-    uart_write_blocking(CRSF_UART_ID, data, length);
-    crsf_packets_sent++;
+// Pipeline observers: capture, mirror and packet debug log
+static void on_rx_span(void *context, uint8_t bus, const uint8_t *span, size_t length) {
+    (void)context;
+    if (pipeline_config.capture_enabled) {
+        capture_span(bus, span, length, time_us_32());
+    }
+}
+
+static void on_frsky_packet(void *context, const frsky_sport_packet_t *packet) {
+    (void)context;
+    if (pipeline_config.mirror_enabled) {
+        uint8_t record[TELEMETRY_MIRROR_ENCODED_MAX];
+        post_capture_chunk(record, telemetry_mirror_write_sport(&mirror_writer, record, sizeof(record), packet), false);
+    }
+    if (pipeline_config.debug_enabled && DEBUG_FRSKY_PACKETS) {
+        DLOG3(LOG_FRSKY_PACKET, packet->bus, packet->data_id, packet->value);
+    }
+}
+
+static void on_crsf_frame(void *context, const uint8_t *frame, uint8_t length) {
+    (void)context;
+    if (pipeline_config.mirror_enabled) {
+        uint8_t record[TELEMETRY_MIRROR_ENCODED_MAX];
+        post_capture_chunk(record, telemetry_mirror_write_crsf(&mirror_writer, record, sizeof(record), time_us_32(),
+                                                               frame, length), false);
+    }
+    if (pipeline_config.debug_enabled && DEBUG_CRSF_PACKETS) {
+        DLOG2(LOG_CRSF_FRAME, frame[2], length);
+    }
+}
+
+static void on_sensor_lost(void *context, uint8_t frame_type, uint8_t source) {
+    (void)context;
+    if (pipeline_config.debug_enabled) {
+        DLOG3(LOG_SENSOR_LOST, frame_type, source, TELEMETRY_TIMEOUT_US / 1000);
+    }
+}
+
+static const pipeline_hooks_t pipeline_hooks = {
+    .rx_span = on_rx_span,
+    .frsky_packet = on_frsky_packet,
+    .crsf_frame = on_crsf_frame,
+    .sensor_lost = on_sensor_lost,
+    .context = NULL
+};
+
+// Binary trace dump between two text lines, for tools/trace_decode.c
+static void write_raw(void *context, const uint8_t *data, size_t length) {
+    (void)context;
+    for (size_t i = 0; i < length; i++) {
+        putchar_raw(data[i]);
+    }
+}
+
+static void dump_trace() {
+    if (!TRACE_ENABLED) {
+        printf("\nProfiler not built in (TRACE_ENABLED is 0)\n");
+        return;
+    }
+    printf("\nTrace dump:\n");
+    stdio_flush();
+    trace_set_paused(true);
+    size_t size = trace_dump(write_raw, NULL);
+    trace_set_paused(false);
+    stdio_flush();
+    printf("\nTrace dump end, %d bytes\n", (int)size);
 }
 
 // Configuration menu
@@ -138,14 +412,128 @@ void print_config_menu() {
     printf("6. CRSF Baud Rate: %d\n", current_config.crsf_baud_rate);
     printf("7. LED Pin: %d\n", current_config.led_pin);
     printf("8. Debug Enabled: %s\n", current_config.debug_enabled ? "Yes" : "No");
+    printf("9. S.PORT Master: %s\n", current_config.sport_master_enabled ? "Yes" : "No");
     printf("\nCommands:\n");
     printf("s - Save configuration\n");
     printf("r - Reset to defaults\n");
     printf("t - Show statistics\n");
+    printf("p - Start raw S.PORT capture (any key stops it)\n");
+    printf("b - Start binary telemetry mirror (any key stops it)\n");
+    printf("d - Dump the stage profiler trace\n");
+    printf("e - Dump a binary receive accounting snapshot\n");
+    printf("m - Toggle S.PORT master mode (poll the sensors without a receiver)\n");
     printf("x - Exit configuration\n");
     printf("\nEnter option: ");
 }
 
+// Byte arrival to TX completion, per CRSF frame type
+static void print_latency_stats(const pipeline_stats_t *stats) {
+    printf("Latency (S.PORT start byte to CRSF sent), us:\n");
+    for (int i = 0; i < stats->latency_count; i++) {
+        const latency_histogram_t *histogram = &stats->latency[i];
+        printf("  0x%02X: p50 %d, p99 %d, max %d over %d frames\n", stats->latency_types[i],
+               latency_histogram_percentile(histogram, 50), latency_histogram_percentile(histogram, 99),
+               histogram->max_us, histogram->count);
+    }
+}
+
+// Receive losses by cause with rates over 1, 10 and 60 s, then the sensors
+// that had any
+static void print_rx_stats() {
+    printf("Receive accounting (total, per second over 1/10/60 s):\n");
+    for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+        printf("  %-10s %10d %8.1f %8.1f %8.1f\n", rx_stats_cause_name(cause), rx_stats_total(cause),
+               rx_stats_window_rate(&rx_window, cause, 1000000), rx_stats_window_rate(&rx_window, cause, 10000000),
+               rx_stats_window_rate(&rx_window, cause, 60000000));
+    }
+    for (uint8_t slot = 0; slot < RX_STATS_SLOTS; slot++) {
+        uint32_t losses = 0;
+        for (int cause = RX_STATS_FRAMES + 1; cause < RX_STATS_CAUSE_COUNT; cause++) {
+            losses += rx_stats_get(cause, slot);
+        }
+        if (losses == 0) {
+            continue;
+        }
+        printf(slot == RX_STATS_NO_SENSOR ? "  no sensor:" : "  sensor %2d:", slot);
+        for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+            printf(" %s %d", rx_stats_cause_name(cause), rx_stats_get(cause, slot));
+        }
+        printf("\n");
+    }
+}
+
+// Frames from the receiver, its link statistics and the downlink pacing
+static void print_crsf_link_stats(const pipeline_stats_t *stats) {
+    const crsf_link_rx_stats_t *rx = &stats->crsf_rx;
+    printf("CRSF from receiver: %d frames (%d RC, %d link stats, %d timing, %d pings, %d other), "
+           "%d CRC errors, %d bad lengths\n", rx->frames, rx->rc_frames, rx->link_statistics, rx->timing_frames,
+           rx->pings, rx->other, rx->crc_errors, rx->bad_lengths);
+    if (stats->link_valid) {
+        printf("Link: uplink -%d dBm LQ %d%% SNR %d, downlink -%d dBm LQ %d%% SNR %d, RF mode %d\n",
+               stats->link.uplink_rssi_1, stats->link.uplink_link_quality, stats->link.uplink_snr,
+               stats->link.downlink_rssi, stats->link.downlink_link_quality, stats->link.downlink_snr,
+               stats->link.rf_mode);
+    }
+    printf("CRSF pacing: %s, receiver interval %d us, %d frames paced, %d deferred, %d updates dropped\n",
+           stats->paced ? "active" : "off", stats->receiver_interval_us, stats->pacing.paced, stats->pacing.deferred,
+           stats->pacing.dropped);
+}
+
+// Polling slots and achieved update rate of the IDs that were polled more
+// than the occasional probe
+static void print_sport_master_stats(const pipeline_stats_t *stats) {
+    if (!stats->master_enabled) {
+        return;
+    }
+    printf("S.PORT master: %d polls, %d probes\n", stats->master_polls, stats->master_probes);
+    for (int id = 0; id < SPORT_MASTER_IDS; id++) {
+        if (stats->master_rates[id] > 0.0f) {
+            printf("  sensor %2d: %d polls, %.1f updates/s\n", id, stats->master_polls_by_id[id],
+                   stats->master_rates[id]);
+        }
+    }
+}
+
+// Time from reset to each boot phase
+static void print_boot_phases() {
+    printf("Boot phases (us since reset):");
+    for (int phase = 0; phase < BOOT_PHASE_COUNT; phase++) {
+        if (boot_phase_reached(phase)) {
+            printf(" %s %d,", boot_phase_name(phase), boot_phase_time_us(phase));
+        } else {
+            printf(" %s -,", boot_phase_name(phase));
+        }
+    }
+    printf("\n");
+}
+
+// Binary receive accounting snapshot between two text lines, for
+// tools/rx_stats_decode.c
+static void dump_rx_stats() {
+    static uint8_t snapshot[RX_STATS_SNAPSHOT_MAX_SIZE];
+    size_t size = rx_stats_write_snapshot(snapshot, sizeof(snapshot), time_us_32());
+    printf("\nRX stats snapshot:\n");
+    stdio_flush();
+    for (size_t i = 0; i < size; i++) {
+        putchar_raw(snapshot[i]);
+    }
+    stdio_flush();
+    printf("\nRX stats snapshot end, %d bytes\n", (int)size);
+}
+
+static void print_loop_stats(const char *name, const loop_stats_t *stats, float idle_percent) {
+    printf("%s: avg %d us, max %d us over %d iterations, idle %.1f%%\n", name,
+           stats->iterations > 0 ? (uint32_t)(stats->total_us / stats->iterations) : 0,
+           stats->max_us, stats->iterations, idle_percent);
+}
+
+// How late the heartbeat task ran behind its deadlines
+static void print_heartbeat_jitter(const task_t *heartbeat) {
+    printf("Heartbeat jitter: avg %d us, max %d us over %d beats, %d skipped\n",
+           heartbeat->runs > 0 ? (uint32_t)(heartbeat->late_total_us / heartbeat->runs) : 0,
+           heartbeat->late_max_us, heartbeat->runs, heartbeat->overruns);
+}
+
 // Handle configuration input
 void handle_config_input() {
     int ch = getchar_timeout_us(0);
@@ -153,6 +541,17 @@ void handle_config_input() {
     
     static bool in_config_mode = false;
     
+    // While capturing or mirroring the USB stream is binary, any key ends
+    // it quietly
+    if (capture_state == CAPTURE_STARTING || capture_state == CAPTURE_RUNNING) {
+        post_config_change(capture_key, 0);
+        capture_state = CAPTURE_STOPPING;
+        return;
+    }
+    if (capture_state == CAPTURE_STOPPING) {
+        return;
+    }
+    
     if (!in_config_mode && ch == 'c') {
         in_config_mode = true;
         print_config_menu();
@@ -177,18 +576,77 @@ void handle_config_input() {
             current_config.crsf_baud_rate = CRSF_BAUD_RATE;
             current_config.led_pin = LED_PIN;
             current_config.debug_enabled = DEBUG_ENABLED;
+            current_config.sport_master_enabled = SPORT_MASTER_ENABLED;
+            post_config_change(CONFIG_KEY_DEBUG_ENABLED, current_config.debug_enabled);
+            post_config_change(CONFIG_KEY_SPORT_MASTER, current_config.sport_master_enabled);
+            post_config_change(CONFIG_KEY_HEARTBEAT_INTERVAL, current_config.heartbeat_interval_us);
             printf("Configuration reset to defaults!\n");
             print_config_menu();
             break;
             
         case 't':
             printf("\n=== Statistics ===\n");
-            printf("FrSky packets received: %d\n", frsky_packets_received);
-            printf("FrSky packets valid: %d\n", frsky_packets_valid);
-            printf("CRSF packets sent: %d\n", crsf_packets_sent);
+            printf("FrSky packets received: %d\n", pipeline_stats.frsky_packets_received);
+            printf("FrSky packets valid: %d\n", pipeline_stats.frsky_packets_valid);
+            printf("Sensors lost: %d\n", pipeline_stats.sensors_lost);
+            printf("CRSF packets sent: %d\n", pipeline_stats.crsf_tx.frames_sent);
+            printf("CRSF packets dropped: %d\n", pipeline_stats.crsf_tx.frames_dropped);
+            printf("CRSF TX transfers: %d, queue high water: %d/%d\n",
+                   pipeline_stats.crsf_tx.transfers, pipeline_stats.crsf_tx.high_water, CRSF_TX_QUEUE_DEPTH);
+            printf("CRSF TX stall time (frames waiting for the UART): %d us\n", pipeline_stats.crsf_tx.stall_us);
+            printf("CRSF frames scheduled: %d changed, %d keepalive (%d updates coalesced, %d unchanged)\n",
+                   pipeline_stats.scheduler.frames_sent, pipeline_stats.scheduler.keepalives_sent,
+                   pipeline_stats.scheduler.updates_coalesced, pipeline_stats.scheduler.updates_unchanged);
+            for (int i = 0; i < FRSKY_BUS_COUNT; i++) {
+                printf("FrSky bus %d RX overflows: %d (%d bytes dropped)\n", i,
+                       pipeline_stats.rx_overflows[i], pipeline_stats.rx_bytes_dropped[i]);
+            }
             printf("Success rate: %.1f%%\n", 
-                   frsky_packets_received > 0 ? 
-                   (100.0 * frsky_packets_valid / frsky_packets_received) : 0.0);
+                   pipeline_stats.frsky_packets_received > 0 ? 
+                   (100.0 * pipeline_stats.frsky_packets_valid / pipeline_stats.frsky_packets_received) : 0.0);
+            print_latency_stats(&pipeline_stats);
+            print_crsf_link_stats(&pipeline_stats);
+            print_rx_stats();
+            print_sport_master_stats(&pipeline_stats);
+            print_boot_phases();
+            print_loop_stats("Core0 loop", &core0_loop, task_scheduler_idle_percent(&core0_tasks));
+            print_loop_stats("Core1 loop", &pipeline_stats.loop, pipeline_stats.idle_percent);
+            print_heartbeat_jitter(&pipeline_stats.heartbeat);
+            printf("Log records dropped: %d\n", deferred_log_dropped());
+            printf("Capture and mirror chunks dropped: %d\n", capture_queue.dropped);
+            print_config_menu();
+            break;
+            
+        case 'p':
+            in_config_mode = false;
+            capture_state = CAPTURE_STARTING;
+            capture_key = CONFIG_KEY_CAPTURE_ENABLED;
+            stdio_flush();
+            post_config_change(CONFIG_KEY_CAPTURE_ENABLED, 1);
+            break;
+            
+        case 'b':
+            in_config_mode = false;
+            capture_state = CAPTURE_STARTING;
+            capture_key = CONFIG_KEY_MIRROR_ENABLED;
+            telemetry_mirror_writer_init(&log_writer);
+            stdio_flush();
+            post_config_change(CONFIG_KEY_MIRROR_ENABLED, 1);
+            break;
+            
+        case 'e':
+            dump_rx_stats();
+            print_config_menu();
+            break;
+            
+        case 'm':
+            current_config.sport_master_enabled = !current_config.sport_master_enabled;
+            post_config_change(CONFIG_KEY_SPORT_MASTER, current_config.sport_master_enabled);
+            print_config_menu();
+            break;
+            
+        case 'd':
+            dump_trace();
             print_config_menu();
             break;
             
@@ -203,86 +661,220 @@ void handle_config_input() {
     }
 }
 
+static void apply_config_change(const config_message_t *message) {
+    switch (message->key) {
+        case CONFIG_KEY_DEBUG_ENABLED:
+            pipeline_config.debug_enabled = (uint8_t)message->value;
+            break;
+            
+        case CONFIG_KEY_HEARTBEAT_INTERVAL:
+            pipeline_set_heartbeat_interval(&pipeline, message->value, time_us_32());
+            break;
+            
+        case CONFIG_KEY_CAPTURE_ENABLED:
+            set_capture_enabled(message->value != 0);
+            break;
+            
+        case CONFIG_KEY_FLASH_WINDOW:
+            pipeline_config.flash_window_requested = true;
+            break;
+            
+        case CONFIG_KEY_SPORT_MASTER:
+            pipeline_set_sport_master(&pipeline, message->value != 0, time_us_32());
+            break;
+            
+        case CONFIG_KEY_MIRROR_ENABLED:
+            set_mirror_enabled(message->value != 0);
+            break;
+    }
+}
+
+static void publish_pipeline_stats() {
+    pipeline_stats_t stats = {
+        .frsky_packets_received = pipeline.frsky_packets_received,
+        .frsky_packets_valid = pipeline.frsky_packets_valid,
+        .sensors_lost = pipeline.sensors_lost,
+        .crsf_tx = pipeline.tx_queue.stats,
+        .scheduler = *telemetry_converter_scheduler_stats(),
+        .loop = core1_loop,
+        .idle_percent = task_scheduler_idle_percent(&pipeline.tasks),
+        .heartbeat = pipeline.tasks.tasks[pipeline.heartbeat_task]
+    };
+    for (int i = 0; i < FRSKY_BUS_COUNT; i++) {
+        const rx_ring_t *ring = hal_uart_rx_ring(HAL_UART_SPORT(i));
+        stats.rx_overflows[i] = ring->overflows;
+        stats.rx_bytes_dropped[i] = ring->bytes_dropped;
+    }
+    stats.latency_count = pipeline.latency_count;
+    for (int i = 0; i < pipeline.latency_count; i++) {
+        stats.latency_types[i] = pipeline.latency[i].frame_type;
+        stats.latency[i] = pipeline.latency[i].histogram;
+    }
+    stats.crsf_rx = pipeline.link.rx;
+    stats.pacing = pipeline.link.pacing;
+    stats.link = pipeline.link.statistics;
+    stats.link_valid = pipeline.link.statistics_valid;
+    stats.paced = crsf_link_paced(&pipeline.link, time_us_32());
+    stats.receiver_interval_us = pipeline.link.interval_us;
+    stats.master_enabled = pipeline.master_enabled;
+    stats.master_polls = pipeline.master.polls;
+    stats.master_probes = pipeline.master.probes;
+    for (int id = 0; id < SPORT_MASTER_IDS; id++) {
+        stats.master_polls_by_id[id] = pipeline.master.sensors[id].polls;
+        stats.master_rates[id] = pipeline.master.sensors[id].rate_hz;
+    }
+    spsc_queue_push(&stats_queue, &stats);
+    hal_signal_event();
+}
+
+static void stats_task(void *context, uint32_t now) {
+    (void)context;
+    (void)now;
+    publish_pipeline_stats();
+}
+
+// Core1: the byte to CRSF pipeline. The RX interrupts are enabled from here
+// so they are serviced by this core. Between passes it sleeps until the
+// next pipeline task, one of those interrupts or a message from core0.
+void core1_pipeline() {
+    boot_phase_mark(BOOT_PHASE_PIPELINE_START);
+    multicore_lockout_victim_init();
+    hal_cycle_counter_init();
+    
+    init_uarts();
+    pipeline_init(&pipeline, &pipeline_hooks, current_config.heartbeat_interval_us, current_config.frsky_baud_rate);
+    telemetry_converter_restore();
+    crsf_link_set_baud_rate(&pipeline.link, current_config.crsf_baud_rate);
+    pipeline_set_sport_master(&pipeline, current_config.sport_master_enabled, time_us_32());
+    task_scheduler_add(&pipeline.tasks, stats_task, NULL, PIPELINE_STATS_INTERVAL_US, time_us_32());
+    
+    while (1) {
+        uint32_t loop_start = time_us_32();
+        
+        config_message_t message;
+        while (spsc_queue_pop(&config_queue, &message)) {
+            apply_config_change(&message);
+        }
+        
+        uint32_t now = time_us_32();
+        pipeline_poll(&pipeline, now);
+        
+        if (pipeline_config.flash_window_requested && pipeline_quiet(&pipeline)) {
+            pipeline_config.flash_window_requested = false;
+            atomic_store(&flash_window_ready, true);
+        }
+        
+        loop_stats_update(&core1_loop, loop_start, time_us_32());
+        pipeline_idle(&pipeline, PIPELINE_IDLE_MAX_US);
+    }
+}
+
+// Write capture and mirror records to USB without CRLF translation. Text
+// output stays off until the end record has gone out; the first record out
+// is the header or START record core1 posted when it was enabled.
+static void drain_capture_queue() {
+    capture_chunk_t chunk;
+    while (spsc_queue_pop(&capture_queue, &chunk)) {
+        for (uint8_t i = 0; i < chunk.length; i++) {
+            putchar_raw(chunk.data[i]);
+        }
+        if (capture_state == CAPTURE_STARTING) {
+            capture_state = CAPTURE_RUNNING;
+        }
+        if (chunk.last) {
+            capture_state = CAPTURE_IDLE;
+        }
+    }
+}
+
+// The deferred log is formatted here, away from the pipeline. While the
+// mirror runs the records go into its stream for the host to format, once
+// its START record is out, so the reader's LOG sequence starts with them.
+// During a raw capture, and while the mirror starts or stops, they wait in
+// the rings.
+static void log_task(void *context, uint32_t now) {
+    (void)context;
+    (void)now;
+    bool mirror = capture_state == CAPTURE_RUNNING && capture_key == CONFIG_KEY_MIRROR_ENABLED;
+    if (capture_state != CAPTURE_IDLE && !mirror) {
+        return;
+    }
+    
+    log_record_t record;
+    while (deferred_log_pop(&record)) {
+        if (mirror) {
+            uint8_t out[TELEMETRY_MIRROR_ENCODED_MAX];
+            write_raw(NULL, out, telemetry_mirror_write_log(&log_writer, out, sizeof(out), &record));
+        } else {
+            char text[128];
+            deferred_log_format(&record, text, sizeof(text));
+            printf("%s\n", text);
+        }
+    }
+}
+
+static void rx_stats_task(void *context, uint32_t now) {
+    rx_stats_window_sample(context, now);
+}
+
+// Core0: USB stdio, configuration UI, flash and LED. The pipeline on core1
+// is started first with the stored configuration; USB enumerates in the
+// background afterwards and the UI only comes up once core1 is running.
+// Between passes the core sleeps until its next task, USB activity or a
+// message from core1.
 int main() {
-    stdio_init_all();
+    hal_cycle_counter_init();
+    trace_init();
+    deferred_log_init();
     
-    // Load configuration
+    // Fast path: configuration straight from flash, then the pipeline
     load_config();
+    boot_phase_mark(BOOT_PHASE_CONFIG_LOADED);
     
-    // Initialize LED
-    gpio_init(current_config.led_pin);
-    gpio_set_dir(current_config.led_pin, GPIO_OUT);
-    gpio_put(current_config.led_pin, 1);
-    
-    // Initialize UARTs
-    init_uarts();
+    // Inter-core queues, then start the pipeline
+    spsc_queue_init(&stats_queue, stats_storage, sizeof(stats_storage[0]), 4);
+    spsc_queue_init(&config_queue, config_storage, sizeof(config_storage[0]), 8);
+    spsc_queue_init(&capture_queue, capture_storage, sizeof(capture_storage[0]), SPORT_CAPTURE_QUEUE_DEPTH);
+    pipeline_config.debug_enabled = current_config.debug_enabled;
+    rx_stats_window_init(&rx_window, RX_STATS_SAMPLE_INTERVAL_US, time_us_32());
+    multicore_launch_core1(core1_pipeline);
     
-    // Initialize telemetry systems
-    frsky_sport_init();
-    crsf_init();
-    telemetry_converter_init();
+    // Slow path: USB, LED and UI
+    stdio_init_all();
+    boot_phase_mark(BOOT_PHASE_USB_READY);
+    static status_led_t led;
+    status_led_init(&led, current_config.led_pin, current_config.led_blink_interval_us);
+    task_scheduler_init(&core0_tasks, time_us_32());
+    task_scheduler_add(&core0_tasks, status_led_task, &led, led.interval_us, time_us_32() + led.interval_us);
+    task_scheduler_add(&core0_tasks, rx_stats_task, &rx_window, RX_STATS_SAMPLE_INTERVAL_US,
+                       time_us_32() + RX_STATS_SAMPLE_INTERVAL_US);
+    task_scheduler_add(&core0_tasks, log_task, NULL, DEFERRED_LOG_DRAIN_INTERVAL_US, time_us_32());
     
     if (current_config.debug_enabled) {
         printf("FrSky S.PORT to CRSF Converter Started\n");
         printf("Press 'c' for configuration menu\n");
-        printf("FrSky: GPIO%d/%d @ %d baud\n", 
-               current_config.frsky_tx_pin, current_config.frsky_rx_pin, current_config.frsky_baud_rate);
+        printf("FrSky: GPIO%d/%d @ %d baud, %d bus(es)\n", 
+               current_config.frsky_tx_pin, current_config.frsky_rx_pin, current_config.frsky_baud_rate,
+               FRSKY_BUS_COUNT);
         printf("CRSF: GPIO%d/%d @ %d baud\n", 
                current_config.crsf_tx_pin, current_config.crsf_rx_pin, current_config.crsf_baud_rate);
     }
     
-    uint32_t last_heartbeat = 0;
-    uint8_t byte;
-    
     while (1) {
+        uint32_t loop_start = time_us_32();
+        task_scheduler_run(&core0_tasks);
+        
         // Handle configuration
         handle_config_input();
         
-        // Process FrSky data
-        while (get_frsky_byte(&byte)) {
-            frsky_sport_process_byte(byte);
+        // Latest statistics and pending binary output from core1
+        while (spsc_queue_pop(&stats_queue, &pipeline_stats)) {
         }
         
-        // Convert packets
-        frsky_sport_packet_t frsky_packet;
-        if (frsky_sport_get_packet(&frsky_packet)) {
-            frsky_packets_received++;
-            frsky_packets_valid++;
-            
-            if (current_config.debug_enabled && DEBUG_FRSKY_PACKETS) {
-                printf("FrSky: ID=0x%04X, Value=0x%08X\n", 
-                       frsky_packet.data_id, frsky_packet.value);
-            }
-            
-            crsf_packet_t crsf_packet;
-            if (convert_frsky_to_crsf(&frsky_packet, &crsf_packet)) {
-                send_crsf_packet(crsf_packet.data, crsf_packet.length);
-                
-                if (current_config.debug_enabled && DEBUG_CRSF_PACKETS) {
-                    printf("CRSF: Type=0x%02X, Length=%d\n", 
-                           crsf_packet.data[2], crsf_packet.length);
-                }
-            }
-        }
-        
-        // Send heartbeat
-        uint32_t now = time_us_32();
-        if (now - last_heartbeat > current_config.heartbeat_interval_us) {
-            crsf_packet_t heartbeat;
-            if (crsf_create_heartbeat(&heartbeat)) {
-                send_crsf_packet(heartbeat.data, heartbeat.length);
-            }
-            last_heartbeat = now;
-        }
+        drain_capture_queue();
         
-        // Toggle LED
-        static uint32_t last_led_toggle = 0;
-        if (now - last_led_toggle > current_config.led_blink_interval_us) {
-            gpio_xor_mask(1u << current_config.led_pin);
-            last_led_toggle = now;
-        }
-        
-        tight_loop_contents();
+        loop_stats_update(&core0_loop, loop_start, time_us_32());
+        task_scheduler_idle(&core0_tasks, CORE0_IDLE_MAX_US);
     }
     
     return 0;
@@ -0,0 +1,351 @@
+#include "pipeline.h"
+#include "hal.h"
+#include "crsf.h"
+#include "telemetry_converter.h"
+#include "trace.h"
+#include "rx_stats.h"
+#include "boot_phases.h"
+#include <string.h>
+
+// Latency slot of a frame type, created on first use; NULL when all slots
+// are taken
+static pipeline_latency_t *find_latency(pipeline_t *pipeline, uint8_t frame_type, bool create) {
+    for (uint8_t i = 0; i < pipeline->latency_count; i++) {
+        if (pipeline->latency[i].frame_type == frame_type) {
+            return &pipeline->latency[i];
+        }
+    }
+    if (!create || pipeline->latency_count >= PIPELINE_LATENCY_TYPES) {
+        return NULL;
+    }
+    pipeline_latency_t *latency = &pipeline->latency[pipeline->latency_count++];
+    latency->frame_type = frame_type;
+    return latency;
+}
+
+// CRSF TX sink on the HAL UART
+static bool crsf_tx_busy(void *context) {
+    (void)context;
+    return hal_uart_tx_busy(HAL_UART_CRSF);
+}
+
+// Boot phases of the first transfers: any frame, then one that is not a
+// heartbeat
+static void mark_first_frames(const uint8_t *data, size_t length) {
+    boot_phase_mark(BOOT_PHASE_FIRST_FRAME);
+    for (size_t offset = 0; offset + 2 < length; offset += (size_t)data[offset + 1] + 2) {
+        if (data[offset + 2] != CRSF_FRAMETYPE_HEARTBEAT) {
+            boot_phase_mark(BOOT_PHASE_FIRST_SENSOR_FRAME);
+            return;
+        }
+    }
+}
+
+static void crsf_tx_start(void *context, const uint8_t *data, size_t length) {
+    (void)context;
+    if (!boot_phase_reached(BOOT_PHASE_FIRST_SENSOR_FRAME)) {
+        mark_first_frames(data, length);
+    }
+    hal_uart_tx_start(HAL_UART_CRSF, data, length);
+}
+
+static void crsf_tx_sent(void *context, const uint8_t *frame, uint8_t length, const uint32_t *origin_us,
+                         uint32_t now_us) {
+    (void)length;
+    if (origin_us) {
+        pipeline_latency_t *latency = find_latency(context, frame[2], true);
+        if (latency) {
+            latency_histogram_record(&latency->histogram, now_us - *origin_us);
+        }
+    }
+}
+
+// Tasks: the heartbeat is sent by pipeline_poll once due, sensors that
+// stopped reporting are expired and reported to the observer
+static void heartbeat_task(void *context, uint32_t now) {
+    pipeline_t *pipeline = context;
+    (void)now;
+    pipeline->heartbeat_due = true;
+}
+
+static void lost_sensors_task(void *context, uint32_t now) {
+    pipeline_t *pipeline = context;
+    uint8_t frame_type, source;
+    telemetry_converter_expire(now);
+    while (telemetry_converter_next_lost(&frame_type, &source)) {
+        pipeline->sensors_lost++;
+        if (pipeline->hooks.sensor_lost) {
+            pipeline->hooks.sensor_lost(pipeline->hooks.context, frame_type, source);
+        }
+    }
+}
+
+// The UARTs are initialized by the caller through hal_uart_init
+void pipeline_init(pipeline_t *pipeline, const pipeline_hooks_t *hooks, uint32_t heartbeat_interval_us,
+                   uint32_t sport_baud_rate) {
+    memset(pipeline, 0, sizeof(*pipeline));
+    if (hooks) {
+        pipeline->hooks = *hooks;
+    }
+    // The first heartbeat goes out with the first poll
+    uint32_t now = hal_time_us();
+    task_scheduler_init(&pipeline->tasks, now);
+    pipeline->heartbeat_task = task_scheduler_add(&pipeline->tasks, heartbeat_task, pipeline, heartbeat_interval_us,
+                                                  now);
+    task_scheduler_add(&pipeline->tasks, lost_sensors_task, pipeline, FRESHNESS_TICK_US, now + FRESHNESS_TICK_US);
+    for (int i = 0; i < FRSKY_BUS_COUNT; i++) {
+        frsky_sport_decoder_init(&pipeline->decoders[i], (uint8_t)i);
+        frsky_sport_decoder_set_baud_rate(&pipeline->decoders[i], sport_baud_rate);
+    }
+
+    const crsf_tx_sink_t sink = {
+        .busy = crsf_tx_busy,
+        .start = crsf_tx_start,
+        .sent = crsf_tx_sent,
+        .context = pipeline
+    };
+    crsf_tx_queue_init(&pipeline->tx_queue, &sink, CRSF_TX_DROP_POLICY);
+    crsf_link_init(&pipeline->link, CRSF_BAUD_RATE, hal_time_us());
+    crsf_init();
+    telemetry_converter_init();
+}
+
+// Store every queued FrSky packet of a bus in the telemetry store, which
+// all buses share. CRSF frames are produced by send_scheduled_frames.
+static void convert_frsky_packets(pipeline_t *pipeline, frsky_sport_decoder_t *decoder, uint32_t now) {
+    frsky_sport_packet_t frsky_packets[FRSKY_SPORT_QUEUE_SIZE];
+    size_t count = frsky_sport_decoder_get_packets(decoder, frsky_packets, FRSKY_SPORT_QUEUE_SIZE);
+
+    for (size_t i = 0; i < count; i++) {
+        pipeline->frsky_packets_valid++;
+        if (pipeline->hooks.frsky_packet) {
+            pipeline->hooks.frsky_packet(pipeline->hooks.context, &frsky_packets[i]);
+        }
+
+        if (pipeline->master_enabled && frsky_packets[i].bus == 0) {
+            sport_master_answer(&pipeline->master, frsky_packets[i].sensor_id, now);
+        }
+        if (!telemetry_converter_handles(frsky_packets[i].data_id)) {
+            rx_stats_count(RX_STATS_UNKNOWN_ID, frsky_packets[i].sensor_id);
+        }
+        uint8_t frame_type = telemetry_converter_update(&frsky_packets[i], now);
+        pipeline_latency_t *latency = frame_type ? find_latency(pipeline, frame_type, true) : NULL;
+        if (latency && !latency->pending) {
+            latency->pending = true;
+            latency->origin_us = frsky_packets[i].timestamp_us;
+        }
+    }
+}
+
+// Serialize every CRSF frame the scheduler considers due directly into the
+// transmit queue, as far as the receiver's pace allows. Held back frames
+// stay with the scheduler, which keeps coalescing their updates. Room is
+// only reserved once a frame is due, as reserving may evict a queued frame
+// and counts a drop when it fails.
+static void send_scheduled_frames(pipeline_t *pipeline, uint32_t now) {
+    while (telemetry_converter_frame_due(now)) {
+        if (!crsf_link_may_send(&pipeline->link, now)) {
+            crsf_link_held_back(&pipeline->link);
+            return;
+        }
+        uint8_t *frame = crsf_tx_queue_reserve(&pipeline->tx_queue, CRSF_TX_RESERVE_SIZE);
+        if (!frame) {
+            return;
+        }
+
+        uint8_t length = telemetry_converter_poll_frame(now, frame, CRSF_TX_RESERVE_SIZE);
+        if (length == 0) {
+            crsf_tx_queue_commit(&pipeline->tx_queue, 0);
+            return;
+        }
+
+        crsf_link_sent(&pipeline->link, now);
+        pipeline_latency_t *latency = find_latency(pipeline, frame[2], false);
+        if (latency && latency->pending) {
+            crsf_tx_queue_commit_timed(&pipeline->tx_queue, length, latency->origin_us);
+            latency->pending = false;
+        } else {
+            crsf_tx_queue_commit(&pipeline->tx_queue, length);
+        }
+
+        if (pipeline->hooks.crsf_frame) {
+            pipeline->hooks.crsf_frame(pipeline->hooks.context, frame, length);
+        }
+    }
+}
+
+// Frames from the receiver, then the answer to a device ping, which goes
+// out without waiting for pacing
+static void receive_crsf(pipeline_t *pipeline) {
+    const rx_ring_t *ring = hal_uart_rx_ring(HAL_UART_CRSF);
+    const uint8_t *span;
+    size_t span_length;
+    while ((span_length = hal_uart_rx_span(HAL_UART_CRSF, &span)) > 0) {
+        uint32_t newer = rx_ring_available(ring) - (uint32_t)span_length;
+        uint32_t end_us = hal_uart_rx_time_us(HAL_UART_CRSF) -
+                          (uint32_t)(((uint64_t)newer * pipeline->link.byte_time_ns) / 1000u);
+        crsf_link_process_buffer_at(&pipeline->link, span, span_length, end_us);
+        hal_uart_rx_consume(HAL_UART_CRSF, span_length);
+    }
+
+    uint8_t origin;
+    if (crsf_link_take_ping(&pipeline->link, &origin)) {
+        uint8_t *frame = crsf_tx_queue_reserve(&pipeline->tx_queue, CRSF_TX_RESERVE_SIZE);
+        if (frame) {
+            crsf_tx_queue_commit(&pipeline->tx_queue, crsf_write_device_info(frame, CRSF_TX_RESERVE_SIZE, origin));
+        }
+    }
+}
+
+// Heartbeat once its task made it due. It takes the first pacing slot, so
+// sensor frames cannot crowd it out, and stays due until it is queued.
+static void send_heartbeat(pipeline_t *pipeline, uint32_t now) {
+    if (!pipeline->heartbeat_due) {
+        return;
+    }
+    if (!crsf_link_may_send(&pipeline->link, now)) {
+        crsf_link_held_back(&pipeline->link);
+        return;
+    }
+    uint8_t *frame = crsf_tx_queue_reserve(&pipeline->tx_queue, CRSF_TX_RESERVE_SIZE);
+    if (!frame) {
+        return;
+    }
+    crsf_tx_queue_commit(&pipeline->tx_queue, crsf_write_heartbeat(frame, CRSF_TX_RESERVE_SIZE));
+    crsf_link_sent(&pipeline->link, now);
+    pipeline->heartbeat_due = false;
+}
+
+// Ring overruns cannot be tied to a sensor, the overwritten bytes are gone
+static void count_rx_overflows(pipeline_t *pipeline, int bus) {
+    uint32_t overflows = hal_uart_rx_ring(HAL_UART_SPORT(bus))->overflows;
+    if (overflows != pipeline->rx_overflows_seen[bus]) {
+        rx_stats_add(RX_STATS_OVERFLOW, RX_STATS_NO_SENSOR, overflows - pipeline->rx_overflows_seen[bus]);
+        pipeline->rx_overflows_seen[bus] = overflows;
+    }
+}
+
+// Send the next poll once the slot is over and the previous poll has left
+// the UART. The poll buffer stays untouched until then, as the HAL needs.
+static void poll_sensors(pipeline_t *pipeline, uint32_t now) {
+    if (hal_uart_tx_busy(HAL_UART_SPORT(0))) {
+        return;
+    }
+    uint8_t id = sport_master_poll(&pipeline->master, now);
+    if (id != SPORT_MASTER_NONE) {
+        hal_uart_tx_start(HAL_UART_SPORT(0), pipeline->master_poll,
+                          sport_master_write_poll(pipeline->master_poll, id));
+    }
+}
+
+// One pass over the due tasks and all inputs. Packets are converted after
+// every span so the decoder queue never has to hold more than one span
+// worth of frames.
+void pipeline_poll(pipeline_t *pipeline, uint32_t now) {
+    TRACE_BEGIN(TRACE_STAGE_PIPELINE_POLL);
+    task_scheduler_run(&pipeline->tasks);
+    receive_crsf(pipeline);
+    uint32_t coalesced = telemetry_converter_scheduler_stats()->updates_coalesced;
+    for (int i = 0; i < FRSKY_BUS_COUNT; i++) {
+        uint8_t port = HAL_UART_SPORT(i);
+        frsky_sport_decoder_t *decoder = &pipeline->decoders[i];
+        count_rx_overflows(pipeline, i);
+        const uint8_t *span;
+        size_t span_length;
+        while ((span_length = hal_uart_rx_span(port, &span)) > 0) {
+            if (pipeline->hooks.rx_span) {
+                pipeline->hooks.rx_span(pipeline->hooks.context, (uint8_t)i, span, span_length);
+            }
+
+            // The span ends before the bytes still behind it in the ring
+            uint32_t newer = rx_ring_available(hal_uart_rx_ring(port)) - (uint32_t)span_length;
+            uint32_t end_us = hal_uart_rx_time_us(port) -
+                              (uint32_t)(((uint64_t)newer * decoder->byte_time_ns) / 1000u);
+            uint32_t frames_before = decoder->frames_received;
+            TRACE_BEGIN(TRACE_STAGE_SPORT_DECODE);
+            frsky_sport_decoder_process_buffer_at(decoder, span, span_length, end_us);
+            TRACE_END(TRACE_STAGE_SPORT_DECODE);
+            pipeline->frsky_packets_received += decoder->frames_received - frames_before;
+            hal_uart_rx_consume(port, span_length);
+            convert_frsky_packets(pipeline, decoder, now);
+        }
+    }
+    if (pipeline->link.backlog) {
+        pipeline->link.pacing.dropped += telemetry_converter_scheduler_stats()->updates_coalesced - coalesced;
+    }
+    if (pipeline->master_enabled) {
+        poll_sensors(pipeline, now);
+    }
+    send_heartbeat(pipeline, now);
+    send_scheduled_frames(pipeline, now);
+
+    TRACE_BEGIN(TRACE_STAGE_CRSF_TX);
+    crsf_tx_queue_service(&pipeline->tx_queue, now);
+    TRACE_END(TRACE_STAGE_CRSF_TX);
+    TRACE_END(TRACE_STAGE_PIPELINE_POLL);
+}
+
+// Nothing received is waiting and no CRSF frame is queued, so stalling the
+// pipeline now delays no data that has already arrived
+bool pipeline_quiet(const pipeline_t *pipeline) {
+    for (int i = 0; i < FRSKY_BUS_COUNT; i++) {
+        if (rx_ring_available(hal_uart_rx_ring(HAL_UART_SPORT(i))) > 0) {
+            return false;
+        }
+    }
+    return crsf_tx_queue_pending(&pipeline->tx_queue) == 0;
+}
+
+// Sleep until the next task, limit_us at most, unless there is work left:
+// received bytes or queued frames while the UART is idle. A frame that is
+// due but held back by pacing shortens the sleep to when its credit is
+// there. The S.PORT bus 0 receive timeout, the RX DMA and the end of a CRSF
+// transfer wake the core early; buses without such an interrupt are only
+// seen after the limit.
+void pipeline_idle(pipeline_t *pipeline, uint32_t limit_us) {
+    uint32_t now = hal_time_us();
+    for (int i = 0; i < FRSKY_BUS_COUNT; i++) {
+        if (rx_ring_available(hal_uart_rx_ring(HAL_UART_SPORT(i))) > 0) {
+            return;
+        }
+    }
+    if (crsf_tx_queue_pending(&pipeline->tx_queue) > 0 && !hal_uart_tx_busy(HAL_UART_CRSF)) {
+        return;
+    }
+    if (pipeline->heartbeat_due || telemetry_converter_frame_due(now)) {
+        uint32_t wait_us = crsf_link_credit_wait_us(&pipeline->link, now);
+        if (wait_us == 0) {
+            return;
+        }
+        if (wait_us < limit_us) {
+            limit_us = wait_us;
+        }
+    }
+    task_scheduler_idle(&pipeline->tasks, limit_us);
+}
+
+// New heartbeat interval, the next heartbeat one interval from now
+void pipeline_set_heartbeat_interval(pipeline_t *pipeline, uint32_t interval_us, uint32_t now) {
+    task_scheduler_set_interval(&pipeline->tasks, pipeline->heartbeat_task, interval_us, now);
+}
+
+// Start or stop polling the sensors on bus 0. Polling restarts from a clean
+// state, every ID silent.
+void pipeline_set_sport_master(pipeline_t *pipeline, bool enabled, uint32_t now) {
+    if (enabled && !pipeline->master_enabled) {
+        sport_master_init(&pipeline->master, SPORT_MASTER_SLOT_US, now);
+    }
+    pipeline->master_enabled = enabled;
+}
+
+void status_led_init(status_led_t *led, uint16_t pin, uint32_t interval_us) {
+    led->pin = pin;
+    led->interval_us = interval_us;
+    hal_gpio_init_output(pin, true);
+}
+
+void status_led_task(void *context, uint32_t now) {
+    status_led_t *led = context;
+    (void)now;
+    hal_gpio_toggle(led->pin);
+}
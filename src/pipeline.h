@@ -0,0 +1,80 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "config.h"
+#include "frsky_sport.h"
+#include "crsf_tx_queue.h"
+#include "latency_histogram.h"
+#include "sport_master.h"
+#include "crsf_link.h"
+#include "task_scheduler.h"
+
+// Byte to CRSF pipeline: S.PORT spans from the HAL UARTs are decoded,
+// stored in the telemetry converter and sent as scheduled CRSF frames, plus
+// the heartbeat, paced to the receiver (see crsf_link.h). Optionally it polls the sensors on bus 0 itself (see
+// sport_master.h). It only talks to the hardware through hal.h, so the same
+// code runs on core1 of the target and in host simulations. Periodic work,
+// the heartbeat and sensor expiry, runs from the pipeline's task scheduler,
+// to which the caller may add its own tasks.
+
+// Optional observers, called from pipeline_poll
+typedef struct {
+    void (*rx_span)(void *context, uint8_t bus, const uint8_t *span, size_t length);
+    void (*frsky_packet)(void *context, const frsky_sport_packet_t *packet);
+    void (*crsf_frame)(void *context, const uint8_t *frame, uint8_t length);
+    // A sensor went quiet for the telemetry timeout: its frame type and
+    // index among the sources of that type
+    void (*sensor_lost)(void *context, uint8_t frame_type, uint8_t source);
+    void *context;
+} pipeline_hooks_t;
+
+// Latency from the start byte of the oldest S.PORT packet that changed a
+// frame's data to the end of the transfer that sent the frame
+typedef struct {
+    uint8_t frame_type;
+    bool pending;
+    uint32_t origin_us;
+    latency_histogram_t histogram;
+} pipeline_latency_t;
+
+typedef struct {
+    frsky_sport_decoder_t decoders[FRSKY_BUS_COUNT];
+    crsf_tx_queue_t tx_queue;
+    crsf_link_t link;
+    pipeline_hooks_t hooks;
+    task_scheduler_t tasks;
+    uint8_t heartbeat_task;
+    bool heartbeat_due;
+    uint32_t frsky_packets_received;
+    uint32_t frsky_packets_valid;
+    uint32_t sensors_lost;
+    uint32_t rx_overflows_seen[FRSKY_BUS_COUNT];
+    pipeline_latency_t latency[PIPELINE_LATENCY_TYPES];
+    uint8_t latency_count;
+    bool master_enabled;
+    sport_master_t master;
+    uint8_t master_poll[SPORT_MASTER_POLL_SIZE];
+} pipeline_t;
+
+// Status LED blinking at a fixed interval, toggled by status_led_task as a
+// task of that interval
+typedef struct {
+    uint16_t pin;
+    uint32_t interval_us;
+} status_led_t;
+
+// Function prototypes
+void pipeline_init(pipeline_t *pipeline, const pipeline_hooks_t *hooks, uint32_t heartbeat_interval_us,
+                   uint32_t sport_baud_rate);
+void pipeline_poll(pipeline_t *pipeline, uint32_t now);
+bool pipeline_quiet(const pipeline_t *pipeline);
+void pipeline_idle(pipeline_t *pipeline, uint32_t limit_us);
+void pipeline_set_heartbeat_interval(pipeline_t *pipeline, uint32_t interval_us, uint32_t now);
+void pipeline_set_sport_master(pipeline_t *pipeline, bool enabled, uint32_t now);
+void status_led_init(status_led_t *led, uint16_t pin, uint32_t interval_us);
+void status_led_task(void *context, uint32_t now);
+
+#endif // PIPELINE_H
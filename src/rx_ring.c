@@ -0,0 +1,76 @@
+#include "rx_ring.h"
+
+bool rx_ring_init(rx_ring_t *ring, uint8_t *storage, uint32_t size) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return false;
+    }
+
+    ring->buffer = storage;
+    ring->mask = size - 1;
+    rx_ring_reset(ring);
+    return true;
+}
+
+void rx_ring_reset(rx_ring_t *ring) {
+    ring->head = 0;
+    ring->tail = 0;
+    ring->overflows = 0;
+    ring->bytes_dropped = 0;
+}
+
+// Publish the producer position of a DMA writer. The DMA never stops for the
+// consumer, so an overrun is only detected here and in rx_ring_read.
+void rx_ring_set_head(rx_ring_t *ring, uint32_t head) {
+    ring->head = head;
+}
+
+// CPU producer: bytes that do not fit are dropped and counted.
+size_t rx_ring_write(rx_ring_t *ring, const uint8_t *data, size_t length) {
+    uint32_t head = ring->head;
+    uint32_t free_space = (ring->mask + 1) - (head - ring->tail);
+    size_t count = length < free_space ? length : free_space;
+
+    for (size_t i = 0; i < count; i++) {
+        ring->buffer[(head + i) & ring->mask] = data[i];
+    }
+    ring->head = head + (uint32_t)count;
+
+    if (count < length) {
+        ring->overflows++;
+        ring->bytes_dropped += (uint32_t)(length - count);
+    }
+    return count;
+}
+
+// Return the longest contiguous readable span starting at the tail. If the
+// producer has lapped the consumer the unread data is no longer trustworthy,
+// so it is discarded, counted, and reading resumes at the producer position.
+size_t rx_ring_read(rx_ring_t *ring, const uint8_t **span) {
+    uint32_t head = ring->head;
+    uint32_t tail = ring->tail;
+    uint32_t used = head - tail;
+
+    if (used > ring->mask + 1) {
+        ring->overflows++;
+        ring->bytes_dropped += used;
+        ring->tail = head;
+        return 0;
+    }
+
+    if (used == 0) {
+        return 0;
+    }
+
+    uint32_t index = tail & ring->mask;
+    uint32_t to_end = (ring->mask + 1) - index;
+    *span = &ring->buffer[index];
+    return used < to_end ? used : to_end;
+}
+
+void rx_ring_consume(rx_ring_t *ring, size_t length) {
+    ring->tail += (uint32_t)length;
+}
+
+uint32_t rx_ring_available(const rx_ring_t *ring) {
+    return ring->head - ring->tail;
+}
@@ -0,0 +1,31 @@
+#ifndef RX_RING_H
+#define RX_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Single-producer/single-consumer byte ring. The producer is either a DMA
+// channel writing into the storage with address wrapping (it publishes its
+// position through rx_ring_set_head) or a CPU writer using rx_ring_write.
+// head and tail are free-running byte counters; the storage size must be a
+// power of two so the index is a mask.
+typedef struct {
+    uint8_t *buffer;
+    uint32_t mask;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t overflows;
+    volatile uint32_t bytes_dropped;
+} rx_ring_t;
+
+// Function prototypes
+bool rx_ring_init(rx_ring_t *ring, uint8_t *storage, uint32_t size);
+void rx_ring_reset(rx_ring_t *ring);
+void rx_ring_set_head(rx_ring_t *ring, uint32_t head);
+size_t rx_ring_write(rx_ring_t *ring, const uint8_t *data, size_t length);
+size_t rx_ring_read(rx_ring_t *ring, const uint8_t **span);
+void rx_ring_consume(rx_ring_t *ring, size_t length);
+uint32_t rx_ring_available(const rx_ring_t *ring);
+
+#endif // RX_RING_H
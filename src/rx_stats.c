@@ -0,0 +1,212 @@
+#include "rx_stats.h"
+#include "hal.h"
+#include <stdatomic.h>
+#include <string.h>
+
+static _Atomic uint32_t counters[RX_STATS_BANKS][RX_STATS_SLOTS][RX_STATS_CAUSE_COUNT];
+
+static const char *const cause_names[RX_STATS_CAUSE_COUNT] = {
+    [RX_STATS_FRAMES] = "frames",
+    [RX_STATS_CRC_FAIL] = "crc_fail",
+    [RX_STATS_OVERFLOW] = "overflow",
+    [RX_STATS_OVERWRITE] = "overwrite",
+    [RX_STATS_BAD_ESCAPE] = "bad_escape",
+    [RX_STATS_RESYNC] = "resync",
+    [RX_STATS_UNKNOWN_ID] = "unknown_id",
+};
+
+// The physical ID is the low five bits of the sensor ID byte, the rest is
+// parity
+static uint8_t slot_for(uint8_t sensor_id) {
+    uint8_t physical_id = sensor_id & 0x1F;
+    return physical_id < RX_STATS_SENSOR_COUNT ? physical_id : RX_STATS_NO_SENSOR;
+}
+
+void rx_stats_reset(void) {
+    for (int bank = 0; bank < RX_STATS_BANKS; bank++) {
+        for (int slot = 0; slot < RX_STATS_SLOTS; slot++) {
+            for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+                atomic_store_explicit(&counters[bank][slot][cause], 0, memory_order_relaxed);
+            }
+        }
+    }
+}
+
+// Only the calling core writes its bank; masking interrupts keeps a handler
+// on the same core from losing an update between the load and the store
+void rx_stats_add(rx_stats_cause_t cause, uint8_t sensor_id, uint32_t count) {
+    _Atomic uint32_t *counter = &counters[hal_core_num()][slot_for(sensor_id)][cause];
+    uint32_t state = hal_irq_save();
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + count,
+                          memory_order_relaxed);
+    hal_irq_restore(state);
+}
+
+void rx_stats_count(rx_stats_cause_t cause, uint8_t sensor_id) {
+    rx_stats_add(cause, sensor_id, 1);
+}
+
+uint32_t rx_stats_get(rx_stats_cause_t cause, uint8_t slot) {
+    uint32_t total = 0;
+    for (int bank = 0; bank < RX_STATS_BANKS; bank++) {
+        total += atomic_load_explicit(&counters[bank][slot][cause], memory_order_relaxed);
+    }
+    return total;
+}
+
+uint32_t rx_stats_total(rx_stats_cause_t cause) {
+    uint32_t total = 0;
+    for (uint8_t slot = 0; slot < RX_STATS_SLOTS; slot++) {
+        total += rx_stats_get(cause, slot);
+    }
+    return total;
+}
+
+const char *rx_stats_cause_name(rx_stats_cause_t cause) {
+    return cause < RX_STATS_CAUSE_COUNT ? cause_names[cause] : "unknown";
+}
+
+static size_t put_varint(uint8_t *out, uint32_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+static size_t get_varint(const uint8_t *data, size_t length, uint32_t *value) {
+    uint32_t result = 0;
+    for (size_t i = 0; i < length && i < 5; i++) {
+        result |= (uint32_t)(data[i] & 0x7F) << (7 * i);
+        if (!(data[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Returns the snapshot size, 0 if capacity is below
+// RX_STATS_SNAPSHOT_MAX_SIZE
+size_t rx_stats_write_snapshot(uint8_t *out, size_t capacity, uint32_t time_us) {
+    if (capacity < RX_STATS_SNAPSHOT_MAX_SIZE) {
+        return 0;
+    }
+    memcpy(out, RX_STATS_MAGIC, 4);
+    out[4] = RX_STATS_VERSION;
+    out[5] = RX_STATS_CAUSE_COUNT;
+    out[6] = RX_STATS_SLOTS;
+    out[7] = 0;
+    out[8] = (uint8_t)time_us;
+    out[9] = (uint8_t)(time_us >> 8);
+    out[10] = (uint8_t)(time_us >> 16);
+    out[11] = (uint8_t)(time_us >> 24);
+    size_t size = 12;
+
+    for (uint8_t slot = 0; slot < RX_STATS_SLOTS; slot++) {
+        uint32_t counts[RX_STATS_CAUSE_COUNT];
+        uint8_t mask = 0;
+        for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+            counts[cause] = rx_stats_get((rx_stats_cause_t)cause, slot);
+            if (counts[cause]) {
+                mask |= (uint8_t)(1u << cause);
+            }
+        }
+        if (!mask) {
+            continue;
+        }
+        out[size++] = slot;
+        out[size++] = mask;
+        for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+            if (counts[cause]) {
+                size += put_varint(&out[size], counts[cause]);
+            }
+        }
+    }
+    out[size++] = RX_STATS_END_SLOT;
+    return size;
+}
+
+// data must start at the magic. Returns the bytes consumed, 0 if the
+// snapshot is malformed or cut short.
+size_t rx_stats_parse_snapshot(const uint8_t *data, size_t length, rx_stats_snapshot_t *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    if (length < 13 || memcmp(data, RX_STATS_MAGIC, 4) != 0 || data[4] != RX_STATS_VERSION) {
+        return 0;
+    }
+    uint8_t cause_count = data[5];
+    snapshot->time_us = (uint32_t)data[8] | ((uint32_t)data[9] << 8) | ((uint32_t)data[10] << 16) |
+                        ((uint32_t)data[11] << 24);
+    size_t position = 12;
+
+    while (position < length) {
+        uint8_t slot = data[position++];
+        if (slot == RX_STATS_END_SLOT) {
+            return position;
+        }
+        if (position >= length) {
+            return 0;
+        }
+        uint8_t mask = data[position++];
+        for (uint8_t cause = 0; cause < cause_count && cause < 8; cause++) {
+            if (!(mask & (1u << cause))) {
+                continue;
+            }
+            uint32_t value;
+            size_t used = get_varint(&data[position], length - position, &value);
+            if (used == 0) {
+                return 0;
+            }
+            position += used;
+            // Causes and slots added by newer firmware are skipped
+            if (slot < RX_STATS_SLOTS && cause < RX_STATS_CAUSE_COUNT) {
+                snapshot->counts[slot][cause] = value;
+            }
+        }
+    }
+    return 0;
+}
+
+void rx_stats_window_init(rx_stats_window_t *window, uint32_t interval_us, uint32_t now) {
+    memset(window, 0, sizeof(*window));
+    window->interval_us = interval_us;
+    window->last_sample_us = now - interval_us;
+    rx_stats_window_poll(window, now);
+}
+
+// Take a sample of the cause totals once per interval
+void rx_stats_window_poll(rx_stats_window_t *window, uint32_t now) {
+    if (now - window->last_sample_us < window->interval_us) {
+        return;
+    }
+    rx_stats_window_sample(window, now);
+}
+
+// Take a sample now, for callers that keep the interval themselves
+void rx_stats_window_sample(rx_stats_window_t *window, uint32_t now) {
+    window->last_sample_us = now;
+    window->newest = (uint16_t)((window->newest + 1) % RX_STATS_WINDOW_SAMPLES);
+    for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+        window->samples[window->newest][cause] = rx_stats_total((rx_stats_cause_t)cause);
+    }
+    if (window->count < RX_STATS_WINDOW_SAMPLES) {
+        window->count++;
+    }
+}
+
+// Events per second over the last window_us, or over the samples there are
+// when the window is not full yet
+float rx_stats_window_rate(const rx_stats_window_t *window, rx_stats_cause_t cause, uint32_t window_us) {
+    uint32_t intervals = window_us / window->interval_us;
+    if (intervals >= window->count) {
+        intervals = window->count > 0 ? window->count - 1u : 0u;
+    }
+    if (intervals == 0) {
+        return 0.0f;
+    }
+    uint16_t oldest = (uint16_t)((window->newest + RX_STATS_WINDOW_SAMPLES - intervals) % RX_STATS_WINDOW_SAMPLES);
+    uint32_t events = window->samples[window->newest][cause] - window->samples[oldest][cause];
+    return (float)events * 1e6f / ((float)intervals * (float)window->interval_us);
+}
@@ -0,0 +1,69 @@
+#ifndef RX_STATS_H
+#define RX_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "config.h"
+
+// Receive path accounting: good frames and every way a frame can be lost,
+// per S.PORT physical sensor ID (0..27). Losses that cannot be tied to a
+// sensor, such as ring overflows, go to RX_STATS_NO_SENSOR. Each core
+// updates its own bank of counters, so increments need no lock; interrupts
+// are masked only around the load and store. Readers sum the banks.
+typedef enum {
+    RX_STATS_FRAMES,        // Frames with a good CRC
+    RX_STATS_CRC_FAIL,      // Complete frames with a bad CRC
+    RX_STATS_OVERFLOW,      // Receive ring overran the parser
+    RX_STATS_OVERWRITE,     // Queued packet dropped before conversion
+    RX_STATS_BAD_ESCAPE,    // Stuff byte not followed by 0x5D or 0x5E
+    RX_STATS_RESYNC,        // Start byte in the middle of a frame
+    RX_STATS_UNKNOWN_ID,    // Good frame with a data ID that is not converted
+    RX_STATS_CAUSE_COUNT
+} rx_stats_cause_t;
+
+#define RX_STATS_SENSOR_COUNT 28
+#define RX_STATS_NO_SENSOR RX_STATS_SENSOR_COUNT
+#define RX_STATS_SLOTS (RX_STATS_SENSOR_COUNT + 1)
+#define RX_STATS_BANKS 2
+
+// Binary snapshot: magic "RXS1", version, cause count, slot count, a
+// reserved byte and the 32-bit little-endian time, then for each slot with
+// a nonzero counter its index, a bit mask of the nonzero causes and those
+// counters as LEB128, ended by 0xFF
+#define RX_STATS_MAGIC "RXS1"
+#define RX_STATS_VERSION 1
+#define RX_STATS_END_SLOT 0xFF
+#define RX_STATS_SNAPSHOT_MAX_SIZE (12 + RX_STATS_SLOTS * (2 + 5 * RX_STATS_CAUSE_COUNT) + 1)
+
+typedef struct {
+    uint32_t time_us;
+    uint32_t counts[RX_STATS_SLOTS][RX_STATS_CAUSE_COUNT];
+} rx_stats_snapshot_t;
+
+// Cause totals sampled at a fixed interval for rates over sliding windows
+typedef struct {
+    uint32_t samples[RX_STATS_WINDOW_SAMPLES][RX_STATS_CAUSE_COUNT];
+    uint32_t interval_us;
+    uint32_t last_sample_us;
+    uint16_t newest;
+    uint16_t count;
+} rx_stats_window_t;
+
+// Function prototypes
+void rx_stats_reset(void);
+void rx_stats_add(rx_stats_cause_t cause, uint8_t sensor_id, uint32_t count);
+void rx_stats_count(rx_stats_cause_t cause, uint8_t sensor_id);
+uint32_t rx_stats_get(rx_stats_cause_t cause, uint8_t slot);
+uint32_t rx_stats_total(rx_stats_cause_t cause);
+const char *rx_stats_cause_name(rx_stats_cause_t cause);
+
+size_t rx_stats_write_snapshot(uint8_t *out, size_t capacity, uint32_t time_us);
+size_t rx_stats_parse_snapshot(const uint8_t *data, size_t length, rx_stats_snapshot_t *snapshot);
+
+void rx_stats_window_init(rx_stats_window_t *window, uint32_t interval_us, uint32_t now);
+void rx_stats_window_poll(rx_stats_window_t *window, uint32_t now);
+void rx_stats_window_sample(rx_stats_window_t *window, uint32_t now);
+float rx_stats_window_rate(const rx_stats_window_t *window, rx_stats_cause_t cause, uint32_t window_us);
+
+#endif // RX_STATS_H
@@ -0,0 +1,115 @@
+#include "sport_capture.h"
+#include <string.h>
+
+static size_t put_varint(uint8_t *out, uint32_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+static bool get_varint(sport_capture_reader_t *reader, uint32_t *value) {
+    uint32_t result = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        if (reader->position >= reader->length) {
+            return false;
+        }
+        uint8_t byte = reader->data[reader->position++];
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+void sport_capture_writer_init(sport_capture_writer_t *writer) {
+    writer->last_us = 0;
+    writer->started = false;
+}
+
+size_t sport_capture_write_header(uint8_t *out, size_t capacity) {
+    if (capacity < SPORT_CAPTURE_HEADER_SIZE) {
+        return 0;
+    }
+    memcpy(out, SPORT_CAPTURE_MAGIC, SPORT_CAPTURE_MAGIC_SIZE);
+    out[SPORT_CAPTURE_MAGIC_SIZE] = SPORT_CAPTURE_VERSION;
+    return SPORT_CAPTURE_HEADER_SIZE;
+}
+
+// Encode one run of received bytes. The first record after init carries a
+// zero delta, so the replay clock starts at the first byte. Returns the
+// record size, or 0 when it does not fit in capacity.
+size_t sport_capture_write_run(sport_capture_writer_t *writer, uint8_t *out, size_t capacity,
+                               uint32_t time_us, uint8_t bus, const uint8_t *data, size_t length) {
+    if (length > UINT32_MAX || capacity < SPORT_CAPTURE_RECORD_OVERHEAD + length) {
+        return 0;
+    }
+
+    uint32_t delta = writer->started ? time_us - writer->last_us : 0;
+    writer->last_us = time_us;
+    writer->started = true;
+
+    size_t size = put_varint(out, delta);
+    out[size++] = bus;
+    size += put_varint(&out[size], (uint32_t)length);
+    if (length > 0) {
+        memcpy(&out[size], data, length);
+    }
+    return size + length;
+}
+
+size_t sport_capture_write_end(sport_capture_writer_t *writer, uint8_t *out, size_t capacity, uint32_t time_us) {
+    return sport_capture_write_run(writer, out, capacity, time_us, SPORT_CAPTURE_END_BUS, NULL, 0);
+}
+
+// Position the reader after the first magic in data. Returns false when
+// there is none or the version is unknown.
+bool sport_capture_reader_init(sport_capture_reader_t *reader, const uint8_t *data, size_t length) {
+    memset(reader, 0, sizeof(*reader));
+    for (size_t i = 0; i + SPORT_CAPTURE_HEADER_SIZE <= length; i++) {
+        if (memcmp(&data[i], SPORT_CAPTURE_MAGIC, SPORT_CAPTURE_MAGIC_SIZE) == 0) {
+            if (data[i + SPORT_CAPTURE_MAGIC_SIZE] != SPORT_CAPTURE_VERSION) {
+                return false;
+            }
+            reader->data = data;
+            reader->length = length;
+            reader->position = i + SPORT_CAPTURE_HEADER_SIZE;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Next record with its absolute time. Stops at the end record or at a
+// truncated record, as left behind when a capture is cut off.
+bool sport_capture_next(sport_capture_reader_t *reader, sport_capture_run_t *run) {
+    if (reader->ended || !reader->data) {
+        return false;
+    }
+
+    uint32_t delta;
+    uint32_t length;
+    if (!get_varint(reader, &delta) || reader->position >= reader->length) {
+        reader->ended = true;
+        return false;
+    }
+    uint8_t bus = reader->data[reader->position++];
+    if (bus == SPORT_CAPTURE_END_BUS || !get_varint(reader, &length) ||
+        length > reader->length - reader->position) {
+        reader->ended = true;
+        return false;
+    }
+
+    reader->time_us += delta;
+    run->time_us = reader->time_us;
+    run->bus = bus;
+    run->data = &reader->data[reader->position];
+    run->length = length;
+    reader->position += length;
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef SPORT_CAPTURE_H
+#define SPORT_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Raw S.PORT capture format
+//
+// A capture starts with the four magic bytes "SPC1" followed by a version
+// byte. Each received run of bytes is then stored as one record:
+//
+//   delta_us  LEB128, microseconds since the previous record
+//   bus       1 byte, SPORT_CAPTURE_END_BUS marks the end of the capture
+//   length    LEB128
+//   data      length raw bytes as they came off the wire
+//
+// Readers look for the magic anywhere in the input, so a capture taken from
+// a USB console with text in front of it can be used as it is.
+#define SPORT_CAPTURE_MAGIC "SPC1"
+#define SPORT_CAPTURE_MAGIC_SIZE 4
+#define SPORT_CAPTURE_VERSION 1
+#define SPORT_CAPTURE_HEADER_SIZE (SPORT_CAPTURE_MAGIC_SIZE + 1)
+#define SPORT_CAPTURE_END_BUS 0xFF
+
+// Largest record header: two five-byte varints and the bus byte
+#define SPORT_CAPTURE_RECORD_OVERHEAD 11
+
+typedef struct {
+    uint32_t last_us;
+    bool started;
+} sport_capture_writer_t;
+
+typedef struct {
+    const uint8_t *data;
+    size_t length;
+    size_t position;
+    uint64_t time_us;
+    bool ended;
+} sport_capture_reader_t;
+
+// One record; data points into the reader's input
+typedef struct {
+    uint64_t time_us;
+    uint8_t bus;
+    const uint8_t *data;
+    size_t length;
+} sport_capture_run_t;
+
+// Function prototypes
+void sport_capture_writer_init(sport_capture_writer_t *writer);
+size_t sport_capture_write_header(uint8_t *out, size_t capacity);
+size_t sport_capture_write_run(sport_capture_writer_t *writer, uint8_t *out, size_t capacity,
+                               uint32_t time_us, uint8_t bus, const uint8_t *data, size_t length);
+size_t sport_capture_write_end(sport_capture_writer_t *writer, uint8_t *out, size_t capacity, uint32_t time_us);
+bool sport_capture_reader_init(sport_capture_reader_t *reader, const uint8_t *data, size_t length);
+bool sport_capture_next(sport_capture_reader_t *reader, sport_capture_run_t *run);
+
+#endif // SPORT_CAPTURE_H
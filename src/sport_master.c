@@ -0,0 +1,102 @@
+#include "sport_master.h"
+#include "frsky_sport.h"
+#include <string.h>
+
+// Sensor ID bytes: the physical ID in the low five bits, three parity bits
+// on top
+static const uint8_t id_bytes[SPORT_MASTER_IDS] = {
+    0x00, 0xA1, 0x22, 0x83, 0xE4, 0x45, 0xC6, 0x67, 0x48, 0xE9, 0x6A, 0xCB, 0xAC, 0x0D,
+    0x8E, 0x2F, 0xD0, 0x71, 0xF2, 0x53, 0x34, 0x95, 0x16, 0xB7, 0x98, 0x39, 0xBA, 0x1B
+};
+
+uint8_t sport_master_id_byte(uint8_t physical_id) {
+    return physical_id < SPORT_MASTER_IDS ? id_bytes[physical_id] : 0;
+}
+
+// A poll is a start byte followed by the ID byte, returns its length
+uint8_t sport_master_write_poll(uint8_t *out, uint8_t physical_id) {
+    out[0] = FRSKY_SPORT_START_BYTE;
+    out[1] = sport_master_id_byte(physical_id);
+    return SPORT_MASTER_POLL_SIZE;
+}
+
+void sport_master_init(sport_master_t *master, uint32_t slot_us, uint32_t now) {
+    memset(master, 0, sizeof(*master));
+    master->slot_us = slot_us;
+    master->last_poll_us = now - slot_us;
+    master->window_start_us = now;
+}
+
+// Next ID from position on whose active state is as wanted, advancing the
+// position past it
+static uint8_t next_id(sport_master_t *master, uint8_t *position, bool active) {
+    for (uint8_t i = 0; i < SPORT_MASTER_IDS; i++) {
+        uint8_t id = (uint8_t)((*position + i) % SPORT_MASTER_IDS);
+        if (master->sensors[id].active == active) {
+            *position = (uint8_t)((id + 1) % SPORT_MASTER_IDS);
+            return id;
+        }
+    }
+    return SPORT_MASTER_NONE;
+}
+
+// Retire IDs that stopped answering and close the rate window when due
+static void update_sensors(sport_master_t *master, uint32_t now) {
+    uint32_t window_us = now - master->window_start_us;
+    bool close_window = window_us >= SPORT_MASTER_RATE_WINDOW_US;
+
+    for (uint8_t id = 0; id < SPORT_MASTER_IDS; id++) {
+        sport_master_sensor_t *sensor = &master->sensors[id];
+        if (sensor->active && now - sensor->last_answer_us >= SPORT_MASTER_ACTIVE_US) {
+            sensor->active = false;
+        }
+        if (close_window) {
+            sensor->rate_hz = (float)sensor->window_answers * 1e6f / (float)window_us;
+            sensor->window_answers = 0;
+        }
+    }
+    if (close_window) {
+        master->window_start_us = now;
+    }
+}
+
+// Physical ID to poll now, or SPORT_MASTER_NONE while the current slot
+// lasts
+uint8_t sport_master_poll(sport_master_t *master, uint32_t now) {
+    if (now - master->last_poll_us < master->slot_us) {
+        return SPORT_MASTER_NONE;
+    }
+    master->last_poll_us = now;
+    update_sensors(master, now);
+
+    bool probe = master->slots_since_probe + 1u >= SPORT_MASTER_PROBE_EVERY;
+    uint8_t id = probe ? SPORT_MASTER_NONE : next_id(master, &master->next_active, true);
+    if (id == SPORT_MASTER_NONE) {
+        id = next_id(master, &master->next_probe, false);
+        if (id == SPORT_MASTER_NONE) {
+            id = next_id(master, &master->next_active, true);
+        } else {
+            master->probes++;
+        }
+        master->slots_since_probe = 0;
+    } else {
+        master->slots_since_probe++;
+    }
+
+    master->sensors[id].polls++;
+    master->polls++;
+    return id;
+}
+
+// A frame from sensor_id arrived on the polled bus
+void sport_master_answer(sport_master_t *master, uint8_t sensor_id, uint32_t now) {
+    uint8_t id = sensor_id & 0x1F;
+    if (id >= SPORT_MASTER_IDS) {
+        return;
+    }
+    sport_master_sensor_t *sensor = &master->sensors[id];
+    sensor->answers++;
+    sensor->window_answers++;
+    sensor->last_answer_us = now;
+    sensor->active = true;
+}
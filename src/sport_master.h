@@ -0,0 +1,47 @@
+#ifndef SPORT_MASTER_H
+#define SPORT_MASTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+
+// Active S.PORT master: instead of listening to a receiver polling the
+// sensors, the converter polls the 28 physical IDs on bus 0 itself, one
+// poll per slot. Slots go round-robin to the IDs that answered within
+// SPORT_MASTER_ACTIVE_US; every SPORT_MASTER_PROBE_EVERY-th slot, and every
+// slot while no ID is active, probes the next silent ID instead, so a
+// sensor plugged in later is still found. Only use it without a receiver
+// on the same line.
+#define SPORT_MASTER_IDS 28
+#define SPORT_MASTER_NONE 0xFF
+#define SPORT_MASTER_POLL_SIZE 2
+
+typedef struct {
+    uint32_t polls;
+    uint32_t answers;
+    uint32_t last_answer_us;
+    bool active;
+    uint16_t window_answers;
+    float rate_hz;            // Answers per second over the last rate window
+} sport_master_sensor_t;
+
+typedef struct {
+    sport_master_sensor_t sensors[SPORT_MASTER_IDS];
+    uint32_t slot_us;
+    uint32_t last_poll_us;
+    uint32_t window_start_us;
+    uint8_t next_active;      // Round-robin positions
+    uint8_t next_probe;
+    uint8_t slots_since_probe;
+    uint32_t polls;
+    uint32_t probes;
+} sport_master_t;
+
+// Function prototypes
+void sport_master_init(sport_master_t *master, uint32_t slot_us, uint32_t now);
+uint8_t sport_master_poll(sport_master_t *master, uint32_t now);
+void sport_master_answer(sport_master_t *master, uint8_t sensor_id, uint32_t now);
+uint8_t sport_master_write_poll(uint8_t *out, uint8_t physical_id);
+uint8_t sport_master_id_byte(uint8_t physical_id);
+
+#endif // SPORT_MASTER_H
@@ -0,0 +1,52 @@
+#include "spsc_queue.h"
+#include <string.h>
+
+bool spsc_queue_init(spsc_queue_t *queue, void *storage, uint16_t element_size, uint32_t capacity) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return false;
+    }
+
+    queue->storage = storage;
+    queue->element_size = element_size;
+    queue->mask = capacity - 1;
+    queue->dropped = 0;
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return true;
+}
+
+// Producer side. The element is copied before head is published with
+// release order, so the consumer never sees a partially written slot.
+bool spsc_queue_push(spsc_queue_t *queue, const void *element) {
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head - tail > queue->mask) {
+        queue->dropped++;
+        return false;
+    }
+
+    memcpy(&queue->storage[(head & queue->mask) * queue->element_size], element, queue->element_size);
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+// Consumer side, mirrors spsc_queue_push
+bool spsc_queue_pop(spsc_queue_t *queue, void *element) {
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (head == tail) {
+        return false;
+    }
+
+    memcpy(element, &queue->storage[(tail & queue->mask) * queue->element_size], queue->element_size);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t spsc_queue_count(spsc_queue_t *queue) {
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    return head - tail;
+}
@@ -0,0 +1,26 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Lock-free single-producer/single-consumer queue of fixed-size elements,
+// used to pass messages between the two cores. Exactly one context may push
+// and exactly one may pop. Capacity must be a power of two.
+typedef struct {
+    uint8_t *storage;
+    uint16_t element_size;
+    uint32_t mask;
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    uint32_t dropped;
+} spsc_queue_t;
+
+// Function prototypes
+bool spsc_queue_init(spsc_queue_t *queue, void *storage, uint16_t element_size, uint32_t capacity);
+bool spsc_queue_push(spsc_queue_t *queue, const void *element);
+bool spsc_queue_pop(spsc_queue_t *queue, void *element);
+uint32_t spsc_queue_count(spsc_queue_t *queue);
+
+#endif // SPSC_QUEUE_H
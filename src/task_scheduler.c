@@ -0,0 +1,151 @@
+#include "task_scheduler.h"
+#include "hal.h"
+#include <string.h>
+
+// Deadline order with wraparound
+static bool earlier(const task_scheduler_t *scheduler, uint8_t a, uint8_t b) {
+    return (int32_t)(scheduler->tasks[a].deadline_us - scheduler->tasks[b].deadline_us) < 0;
+}
+
+static void swap(task_scheduler_t *scheduler, uint8_t a, uint8_t b) {
+    uint8_t task = scheduler->heap[a];
+    scheduler->heap[a] = scheduler->heap[b];
+    scheduler->heap[b] = task;
+}
+
+static void sift_up(task_scheduler_t *scheduler, uint8_t position) {
+    while (position > 0) {
+        uint8_t parent = (uint8_t)((position - 1) / 2);
+        if (!earlier(scheduler, scheduler->heap[position], scheduler->heap[parent])) {
+            return;
+        }
+        swap(scheduler, position, parent);
+        position = parent;
+    }
+}
+
+static void sift_down(task_scheduler_t *scheduler, uint8_t position) {
+    while (1) {
+        uint8_t first = position;
+        uint8_t left = (uint8_t)(2 * position + 1);
+        uint8_t right = (uint8_t)(left + 1);
+        if (left < scheduler->count && earlier(scheduler, scheduler->heap[left], scheduler->heap[first])) {
+            first = left;
+        }
+        if (right < scheduler->count && earlier(scheduler, scheduler->heap[right], scheduler->heap[first])) {
+            first = right;
+        }
+        if (first == position) {
+            return;
+        }
+        swap(scheduler, position, first);
+        position = first;
+    }
+}
+
+void task_scheduler_init(task_scheduler_t *scheduler, uint32_t now) {
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->mark_us = now;
+}
+
+// Add a periodic task first due at first_us, returns its handle or
+// TASK_SCHEDULER_NONE when the scheduler is full
+uint8_t task_scheduler_add(task_scheduler_t *scheduler, task_fn_t run, void *context, uint32_t interval_us,
+                           uint32_t first_us) {
+    if (scheduler->count == TASK_SCHEDULER_MAX_TASKS || interval_us == 0) {
+        return TASK_SCHEDULER_NONE;
+    }
+    uint8_t task = scheduler->count++;
+    scheduler->tasks[task] = (task_t){
+        .run = run,
+        .context = context,
+        .interval_us = interval_us,
+        .deadline_us = first_us
+    };
+    scheduler->heap[task] = task;
+    sift_up(scheduler, task);
+    return task;
+}
+
+// New period, counted from now
+void task_scheduler_set_interval(task_scheduler_t *scheduler, uint8_t task, uint32_t interval_us, uint32_t now) {
+    if (task >= scheduler->count || interval_us == 0) {
+        return;
+    }
+    scheduler->tasks[task].interval_us = interval_us;
+    scheduler->tasks[task].deadline_us = now + interval_us;
+    for (uint8_t position = 0; position < scheduler->count; position++) {
+        if (scheduler->heap[position] == task) {
+            sift_up(scheduler, position);
+            sift_down(scheduler, position);
+            break;
+        }
+    }
+}
+
+// Run every due task in deadline order, returns how many ran. The clock is
+// read again for each task, so its lateness includes the runs before it.
+uint8_t task_scheduler_run(task_scheduler_t *scheduler) {
+    uint8_t ran = 0;
+    while (scheduler->count > 0) {
+        task_t *task = &scheduler->tasks[scheduler->heap[0]];
+        uint32_t now = hal_time_us();
+        uint32_t late = now - task->deadline_us;
+        if ((int32_t)late < 0) {
+            break;
+        }
+
+        task->runs++;
+        task->late_total_us += late;
+        if (late > task->late_max_us) {
+            task->late_max_us = late;
+        }
+        uint32_t next = task->deadline_us + task->interval_us;
+        if ((int32_t)(now - next) >= 0) {
+            task->overruns++;
+            next = now + task->interval_us;
+        }
+        task->deadline_us = next;
+        sift_down(scheduler, 0);
+
+        task->run(task->context, now);
+        ran++;
+    }
+    return ran;
+}
+
+// When the core has to be awake again: the next deadline, but no later
+// than limit_us from now
+uint32_t task_scheduler_next_deadline(const task_scheduler_t *scheduler, uint32_t now, uint32_t limit_us) {
+    uint32_t deadline = now + limit_us;
+    if (scheduler->count > 0) {
+        uint32_t next = scheduler->tasks[scheduler->heap[0]].deadline_us;
+        if ((int32_t)(next - now) <= 0) {
+            return now;
+        }
+        if ((int32_t)(next - deadline) < 0) {
+            deadline = next;
+        }
+    }
+    return deadline;
+}
+
+// Sleep until the next deadline, limit_us at most, or until an interrupt or
+// the other core signals. The time spent counts as idle.
+void task_scheduler_idle(task_scheduler_t *scheduler, uint32_t limit_us) {
+    uint32_t start = hal_time_us();
+    uint32_t deadline = task_scheduler_next_deadline(scheduler, start, limit_us);
+    if (deadline != start) {
+        hal_wait_for_event(deadline);
+        scheduler->wakeups++;
+    }
+    uint32_t end = hal_time_us();
+    scheduler->idle_us += end - start;
+    scheduler->total_us += end - scheduler->mark_us;
+    scheduler->mark_us = end;
+}
+
+// Share of the time since init spent in task_scheduler_idle
+float task_scheduler_idle_percent(const task_scheduler_t *scheduler) {
+    return scheduler->total_us > 0 ? 100.0f * (float)scheduler->idle_us / (float)scheduler->total_us : 0.0f;
+}
@@ -0,0 +1,51 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Cooperative timers of one core, kept in a heap ordered by deadline. A
+// periodic task is re-armed one interval after its deadline, not after the
+// time it ran, so lateness does not add up; a run a whole interval late
+// skips the missed periods. Between runs the core sleeps in
+// task_scheduler_idle until the next deadline or an interrupt or event
+// wakes it. Deadlines compare with wraparound, intervals stay below 2^31 us.
+#define TASK_SCHEDULER_MAX_TASKS 8
+#define TASK_SCHEDULER_NONE 0xFF
+
+typedef void (*task_fn_t)(void *context, uint32_t now);
+
+// A task runs late by the time the core was busy with something else when
+// its deadline came
+typedef struct {
+    task_fn_t run;
+    void *context;
+    uint32_t interval_us;
+    uint32_t deadline_us;
+    uint32_t runs;
+    uint32_t overruns;        // Periods skipped after a run a whole interval late
+    uint32_t late_max_us;
+    uint64_t late_total_us;
+} task_t;
+
+typedef struct {
+    task_t tasks[TASK_SCHEDULER_MAX_TASKS];
+    uint8_t heap[TASK_SCHEDULER_MAX_TASKS];  // Task indices, earliest deadline first
+    uint8_t count;
+    uint32_t mark_us;         // End of the time accounted so far
+    uint64_t total_us;
+    uint64_t idle_us;
+    uint32_t wakeups;
+} task_scheduler_t;
+
+// Function prototypes
+void task_scheduler_init(task_scheduler_t *scheduler, uint32_t now);
+uint8_t task_scheduler_add(task_scheduler_t *scheduler, task_fn_t run, void *context, uint32_t interval_us,
+                           uint32_t first_us);
+void task_scheduler_set_interval(task_scheduler_t *scheduler, uint8_t task, uint32_t interval_us, uint32_t now);
+uint8_t task_scheduler_run(task_scheduler_t *scheduler);
+uint32_t task_scheduler_next_deadline(const task_scheduler_t *scheduler, uint32_t now, uint32_t limit_us);
+void task_scheduler_idle(task_scheduler_t *scheduler, uint32_t limit_us);
+float task_scheduler_idle_percent(const task_scheduler_t *scheduler);
+
+#endif // TASK_SCHEDULER_H
@@ -1,192 +1,601 @@
 #include "telemetry_converter.h"
 #include "config.h"
-#include "pico/stdlib.h"
+#include "hal.h"
+#include "crsf_scheduler.h"
+#include "trace.h"
+#include "units.h"
+#include "derived_sensors.h"
+#include "telemetry_store.h"
+#include "freshness.h"
 #include <string.h>
 
+// Assign a telemetry field and remember whether its value changed
+#define SET_FIELD(field, new_value) do { \
+        __typeof__(field) value_ = (new_value); \
+        changed |= (field) != value_; \
+        (field) = value_; \
+    } while (0)
+
 static telemetry_data_t telemetry_data;
 
+static const crsf_schedule_entry_t schedule[] = {
+    { CRSF_FRAMETYPE_GPS, CRSF_GPS_PRIORITY, CRSF_GPS_MIN_INTERVAL_US, CRSF_GPS_KEEPALIVE_US },
+    { CRSF_FRAMETYPE_BATTERY_SENSOR, CRSF_BATTERY_PRIORITY, CRSF_BATTERY_MIN_INTERVAL_US, CRSF_BATTERY_KEEPALIVE_US },
+    { CRSF_FRAMETYPE_VARIO, CRSF_VARIO_PRIORITY, CRSF_VARIO_MIN_INTERVAL_US, CRSF_VARIO_KEEPALIVE_US },
+    { CRSF_FRAMETYPE_BARO_ALT, CRSF_BARO_ALT_PRIORITY, CRSF_BARO_ALT_MIN_INTERVAL_US, CRSF_BARO_ALT_KEEPALIVE_US },
+    { CRSF_FRAMETYPE_RPM, CRSF_RPM_PRIORITY, CRSF_RPM_MIN_INTERVAL_US, CRSF_RPM_KEEPALIVE_US },
+    { CRSF_FRAMETYPE_TEMPERATURE, CRSF_TEMPERATURE_PRIORITY, CRSF_TEMPERATURE_MIN_INTERVAL_US,
+      CRSF_TEMPERATURE_KEEPALIVE_US },
+    { CRSF_FRAMETYPE_CELLS, CRSF_CELLS_PRIORITY, CRSF_CELLS_MIN_INTERVAL_US, CRSF_CELLS_KEEPALIVE_US },
+};
+
+#define SCHEDULE_COUNT (sizeof(schedule) / sizeof(schedule[0]))
+
+// Published contents of one CRSF frame type, a telemetry store group
+typedef union {
+    crsf_gps_t gps;
+    crsf_battery_t battery;
+    crsf_vario_t vario;
+    crsf_baro_alt_t baro_alt;
+    crsf_rpm_t rpm;
+    crsf_temperature_t temperature;
+    crsf_cells_t cells;
+} telemetry_group_t;
+
+// Freshness entries, one per sensor instance. A frame type is fresh while
+// any of its entries is; the vario frame also carries the vertical speed
+// derived from the altitude.
+enum {
+    ENTRY_GPS,
+    ENTRY_BATTERY,
+    ENTRY_VSPD,
+    ENTRY_ALT,
+    ENTRY_RPM,
+    ENTRY_TEMPERATURE = ENTRY_RPM + TELEMETRY_MAX_RPM_SOURCES,
+    ENTRY_CELLS = ENTRY_TEMPERATURE + TELEMETRY_MAX_TEMPERATURES,
+    ENTRY_COUNT
+};
+
+#define ENTRY_BIT(entry) (1ull << (entry))
+#define ENTRY_RANGE(first, count) (((1ull << (count)) - 1) << (first))
+
+_Static_assert(ENTRY_COUNT <= FRESHNESS_MAX_ENTRIES, "more sensor instances than freshness entries");
+
+_Static_assert(sizeof(telemetry_group_t) <= TELEMETRY_STORE_GROUP_SIZE, "telemetry group exceeds store group");
+_Static_assert(SCHEDULE_COUNT <= TELEMETRY_STORE_GROUPS, "more frame types than store groups");
+
+static crsf_scheduler_t scheduler;
+static derived_sensors_t derived;
+static telemetry_store_t store;
+static freshness_t freshness;
+
 void telemetry_converter_init(void) {
     memset(&telemetry_data, 0, sizeof(telemetry_data));
+    crsf_scheduler_init(&scheduler, schedule, SCHEDULE_COUNT);
+    derived_sensors_init(&derived);
+    telemetry_store_init(&store);
+    freshness_init(&freshness, FRESHNESS_TICK_US, TELEMETRY_TIMEOUT_US, hal_time_us());
+}
+
+// Continue the consumed capacity from before a brownout or watchdog reset,
+// called once at boot after telemetry_converter_init
+bool telemetry_converter_restore(void) {
+    if (!derived_sensors_restore(&derived)) {
+        return false;
+    }
+    telemetry_data.capacity_used = derived.capacity_mah;
+    return true;
+}
+
+// Freshness entries behind a frame type
+static uint64_t entry_mask(uint8_t crsf_type) {
+    switch (crsf_type) {
+        case CRSF_FRAMETYPE_GPS:
+            return ENTRY_BIT(ENTRY_GPS);
+        case CRSF_FRAMETYPE_BATTERY_SENSOR:
+            return ENTRY_BIT(ENTRY_BATTERY);
+        case CRSF_FRAMETYPE_VARIO:
+            return ENTRY_BIT(ENTRY_VSPD) | ENTRY_BIT(ENTRY_ALT);
+        case CRSF_FRAMETYPE_BARO_ALT:
+            return ENTRY_BIT(ENTRY_ALT);
+        case CRSF_FRAMETYPE_RPM:
+            return ENTRY_RANGE(ENTRY_RPM, TELEMETRY_MAX_RPM_SOURCES);
+        case CRSF_FRAMETYPE_TEMPERATURE:
+            return ENTRY_RANGE(ENTRY_TEMPERATURE, TELEMETRY_MAX_TEMPERATURES);
+        case CRSF_FRAMETYPE_CELLS:
+            return ENTRY_BIT(ENTRY_CELLS);
+        default:
+            return 0;
+    }
+}
+
+// Frame type and source index of a freshness entry
+static uint8_t entry_frame_type(uint8_t entry, uint8_t *source) {
+    *source = 0;
+    if (entry >= ENTRY_CELLS) {
+        return CRSF_FRAMETYPE_CELLS;
+    }
+    if (entry >= ENTRY_TEMPERATURE) {
+        *source = entry - ENTRY_TEMPERATURE;
+        return CRSF_FRAMETYPE_TEMPERATURE;
+    }
+    if (entry >= ENTRY_RPM) {
+        *source = entry - ENTRY_RPM;
+        return CRSF_FRAMETYPE_RPM;
+    }
+    static const uint8_t types[] = { CRSF_FRAMETYPE_GPS, CRSF_FRAMETYPE_BATTERY_SENSOR, CRSF_FRAMETYPE_VARIO,
+                                     CRSF_FRAMETYPE_BARO_ALT };
+    return types[entry];
+}
+
+// Expire the sensors that went quiet up to now. A frame type whose last
+// sensor expired leaves the schedule until fresh data marks it again.
+void telemetry_converter_expire(uint32_t now) {
+    uint64_t expired = freshness_advance(&freshness, now);
+    if (expired == 0) {
+        return;
+    }
+    for (uint8_t i = 0; i < SCHEDULE_COUNT; i++) {
+        uint64_t mask = entry_mask(schedule[i].frame_type);
+        if ((expired & mask) && !(freshness.fresh & mask)) {
+            crsf_scheduler_deactivate(&scheduler, schedule[i].frame_type);
+        }
+    }
 }
 
+// Next sensor that expired since the last call, for lost notifications.
+// Returns false when there is none.
+bool telemetry_converter_next_lost(uint8_t *frame_type, uint8_t *source) {
+    if (freshness.lost == 0) {
+        return false;
+    }
+    uint8_t entry = (uint8_t)__builtin_ctzll(freshness.lost);
+    freshness.lost &= freshness.lost - 1;
+    *frame_type = entry_frame_type(entry, source);
+    return true;
+}
+
+// Vertical speed comes from the altitude unless a VSPD sensor reported
+// within the telemetry timeout
+static bool vario_from_altitude(void) {
+    return !(freshness.fresh & ENTRY_BIT(ENTRY_VSPD));
+}
+
+// Conversions are the kernels in units.h, saturating out-of-range values
 int32_t frsky_gps_to_decimal(uint32_t frsky_coord) {
-    uint32_t degrees = frsky_coord / 1000000;
-    uint32_t minutes = (frsky_coord % 1000000) / 10000;
-    uint32_t minutes_frac = frsky_coord % 10000;
-    
-    int32_t decimal = degrees * 10000000;
-    decimal += (minutes * 10000000) / 60;
-    decimal += (minutes_frac * 1000) / 60;
-    
-    return decimal;
+    return units_gps_to_decimal(frsky_coord);
 }
 
 uint16_t frsky_voltage_to_mv(uint32_t frsky_voltage) {
-    return (uint16_t)(frsky_voltage * 100);
+    return units_scale_u16(frsky_voltage, 100);
 }
 
 uint16_t frsky_current_to_ma(uint32_t frsky_current) {
-    return (uint16_t)(frsky_current * 100);
+    return units_scale_u16(frsky_current, 100);
 }
 
 int16_t frsky_vspeed_to_cms(uint32_t frsky_vspeed) {
-    int32_t signed_vspeed = (int32_t)frsky_vspeed;
-    if (signed_vspeed > 0x7FFFFFFF) {
-        signed_vspeed = signed_vspeed - 0x100000000;
-    }
-    return (int16_t)signed_vspeed;
+    return units_saturate_s16(frsky_vspeed);
 }
 
 uint16_t frsky_altitude_to_meters(uint32_t frsky_altitude) {
-    return (uint16_t)(frsky_altitude / 10);
+    return units_altitude_to_meters(frsky_altitude);
 }
 
-void update_telemetry_data(const frsky_sport_packet_t *frsky_packet) {
-    uint32_t now = time_us_32();
+// FLVSS value: index of the first cell in bits 0-3, the cell count in bits
+// 4-7 and two 12-bit cell voltages in 2 mV steps above. Both cells are
+// always unpacked, the caller stores the second one into a spare slot
+// when the pair is the last and odd one.
+void frsky_cells_unpack(uint32_t frsky_cells, uint8_t *first, uint8_t *count, uint16_t mv[2]) {
+    *first = (uint8_t)(frsky_cells & 0xF);
+    *count = (uint8_t)((frsky_cells >> 4) & 0xF);
+    mv[0] = (uint16_t)(((frsky_cells >> 8) & 0xFFF) * 2);
+    mv[1] = (uint16_t)((frsky_cells >> 20) * 2);
+}
+
+// Slot of a sensor among ids, taking a free one for a new data ID. Returns
+// max when all slots are taken by other sensors.
+static uint8_t source_slot(uint16_t *ids, uint8_t *count, uint8_t max, uint16_t data_id) {
+    for (uint8_t i = 0; i < *count; i++) {
+        if (ids[i] == data_id) {
+            return i;
+        }
+    }
+    if (*count == max) {
+        return max;
+    }
+    ids[*count] = data_id;
+    return (*count)++;
+}
+
+// Store a FrSky value, returns true when it changed the telemetry data
+static bool update_telemetry_fields(const frsky_sport_packet_t *frsky_packet) {
+    bool changed = false;
     
-    switch (frsky_packet->data_id) {
+    switch (FRSKY_ID_RANGE(frsky_packet->data_id)) {
         case FRSKY_ID_GPS_LONG_LATI:
             if (frsky_packet->value & 0x80000000) {
-                telemetry_data.longitude = frsky_gps_to_decimal(frsky_packet->value & 0x7FFFFFFF);
+                int32_t longitude = frsky_gps_to_decimal(frsky_packet->value & 0x7FFFFFFF);
                 if (frsky_packet->value & 0x40000000) {
-                    telemetry_data.longitude = -telemetry_data.longitude;
+                    longitude = -longitude;
                 }
+                telemetry_data.pending_longitude = longitude;
+                telemetry_data.pending_position |= 2;
             } else {
-                telemetry_data.latitude = frsky_gps_to_decimal(frsky_packet->value & 0x3FFFFFFF);
+                int32_t latitude = frsky_gps_to_decimal(frsky_packet->value & 0x3FFFFFFF);
                 if (frsky_packet->value & 0x40000000) {
-                    telemetry_data.latitude = -telemetry_data.latitude;
+                    latitude = -latitude;
                 }
+                telemetry_data.pending_latitude = latitude;
+                telemetry_data.pending_position |= 1;
             }
-            telemetry_data.gps_valid = true;
-            telemetry_data.last_gps_update = now;
+            if (telemetry_data.pending_position == 3) {
+                SET_FIELD(telemetry_data.latitude, telemetry_data.pending_latitude);
+                SET_FIELD(telemetry_data.longitude, telemetry_data.pending_longitude);
+                telemetry_data.pending_position = 0;
+            }
+            SET_FIELD(telemetry_data.gps_valid, true);
+            freshness_touch(&freshness, ENTRY_GPS);
             break;
             
         case FRSKY_ID_GPS_ALT:
-            telemetry_data.gps_altitude = frsky_altitude_to_meters(frsky_packet->value) + 1000;
-            telemetry_data.gps_valid = true;
-            telemetry_data.last_gps_update = now;
+            SET_FIELD(telemetry_data.gps_altitude, frsky_altitude_to_meters(frsky_packet->value) + 1000);
+            SET_FIELD(telemetry_data.gps_valid, true);
+            freshness_touch(&freshness, ENTRY_GPS);
             break;
             
         case FRSKY_ID_GPS_SPEED:
-            telemetry_data.gps_speed = (uint16_t)((frsky_packet->value * 1852) / 10000);
-            telemetry_data.gps_valid = true;
-            telemetry_data.last_gps_update = now;
+            SET_FIELD(telemetry_data.gps_speed, units_gps_speed(frsky_packet->value));
+            SET_FIELD(telemetry_data.gps_valid, true);
+            freshness_touch(&freshness, ENTRY_GPS);
             break;
             
         case FRSKY_ID_GPS_COURS:
-            telemetry_data.gps_heading = (uint16_t)(frsky_packet->value / 100);
-            telemetry_data.gps_valid = true;
-            telemetry_data.last_gps_update = now;
+            SET_FIELD(telemetry_data.gps_heading, units_gps_heading(frsky_packet->value));
+            SET_FIELD(telemetry_data.gps_valid, true);
+            freshness_touch(&freshness, ENTRY_GPS);
             break;
             
         case FRSKY_ID_VFAS:
-            telemetry_data.voltage = frsky_voltage_to_mv(frsky_packet->value);
-            telemetry_data.battery_valid = true;
-            telemetry_data.last_battery_update = now;
+            SET_FIELD(telemetry_data.voltage, frsky_voltage_to_mv(frsky_packet->value));
+            SET_FIELD(telemetry_data.battery_valid, true);
+            freshness_touch(&freshness, ENTRY_BATTERY);
             break;
             
         case FRSKY_ID_CURR:
-            telemetry_data.current = frsky_current_to_ma(frsky_packet->value);
-            telemetry_data.battery_valid = true;
-            telemetry_data.last_battery_update = now;
+            SET_FIELD(telemetry_data.current, frsky_current_to_ma(frsky_packet->value));
+            SET_FIELD(telemetry_data.capacity_used,
+                      derived_sensors_current(&derived, telemetry_data.current, frsky_packet->timestamp_us));
+            SET_FIELD(telemetry_data.battery_valid, true);
+            freshness_touch(&freshness, ENTRY_BATTERY);
             break;
             
         case FRSKY_ID_FUEL:
-            telemetry_data.fuel_percent = (uint8_t)frsky_packet->value;
-            telemetry_data.battery_valid = true;
-            telemetry_data.last_battery_update = now;
+            SET_FIELD(telemetry_data.fuel_percent, (uint8_t)frsky_packet->value);
+            SET_FIELD(telemetry_data.battery_valid, true);
+            freshness_touch(&freshness, ENTRY_BATTERY);
             break;
             
-        case FRSKY_ID_ALT:
-            telemetry_data.altitude = (int32_t)(frsky_packet->value / 10);
-            telemetry_data.altitude_valid = true;
-            telemetry_data.last_altitude_update = now;
+        case FRSKY_ID_ALT: {
+            SET_FIELD(telemetry_data.altitude, units_div10_signed((int32_t)frsky_packet->value));
+            SET_FIELD(telemetry_data.altitude_valid, true);
+            freshness_touch(&freshness, ENTRY_ALT);
+            int16_t vertical_speed =
+                derived_sensors_altitude(&derived, (int32_t)frsky_packet->value, frsky_packet->timestamp_us);
+            telemetry_data.vario_derived = vario_from_altitude();
+            if (telemetry_data.vario_derived) {
+                SET_FIELD(telemetry_data.vertical_speed, vertical_speed);
+                SET_FIELD(telemetry_data.vario_valid, true);
+            }
             break;
+        }
             
         case FRSKY_ID_VSPD:
-            telemetry_data.vertical_speed = frsky_vspeed_to_cms(frsky_packet->value);
-            telemetry_data.vario_valid = true;
-            telemetry_data.last_vario_update = now;
-            break;
-    }
-}
-
-bool create_crsf_from_telemetry(uint8_t crsf_type, crsf_packet_t *crsf_packet) {
-    uint32_t now = time_us_32();
-    const uint32_t timeout_us = TELEMETRY_TIMEOUT_US;
-    
-    switch (crsf_type) {
-        case CRSF_FRAMETYPE_GPS:
-            if (telemetry_data.gps_valid && (now - telemetry_data.last_gps_update) < timeout_us) {
-                crsf_gps_t gps_data = {
-                    .latitude = telemetry_data.latitude,
-                    .longitude = telemetry_data.longitude,
-                    .groundspeed = telemetry_data.gps_speed,
-                    .heading = telemetry_data.gps_heading,
-                    .altitude = telemetry_data.gps_altitude,
-                    .satellites = telemetry_data.satellites
-                };
-                return crsf_create_gps_packet(&gps_data, crsf_packet);
-            }
+            SET_FIELD(telemetry_data.vertical_speed, frsky_vspeed_to_cms(frsky_packet->value));
+            SET_FIELD(telemetry_data.vario_valid, true);
+            telemetry_data.vario_derived = false;
+            freshness_touch(&freshness, ENTRY_VSPD);
             break;
             
-        case CRSF_FRAMETYPE_BATTERY_SENSOR:
-            if (telemetry_data.battery_valid && (now - telemetry_data.last_battery_update) < timeout_us) {
-                crsf_battery_t battery_data = {
-                    .voltage = telemetry_data.voltage,
-                    .current = telemetry_data.current,
-                    .capacity = telemetry_data.capacity_used,
-                    .remaining = telemetry_data.fuel_percent
-                };
-                return crsf_create_battery_packet(&battery_data, crsf_packet);
+        case FRSKY_ID_RPM: {
+            uint8_t slot = source_slot(telemetry_data.rpm_ids, &telemetry_data.rpm_count,
+                                       TELEMETRY_MAX_RPM_SOURCES, frsky_packet->data_id);
+            if (slot < TELEMETRY_MAX_RPM_SOURCES) {
+                SET_FIELD(telemetry_data.rpm[slot], (int32_t)frsky_packet->value);
+                freshness_touch(&freshness, ENTRY_RPM + slot);
             }
             break;
+        }
             
-        case CRSF_FRAMETYPE_VARIO:
-            if (telemetry_data.vario_valid && (now - telemetry_data.last_vario_update) < timeout_us) {
-                crsf_vario_t vario_data = {
-                    .vertical_speed = telemetry_data.vertical_speed
-                };
-                return crsf_create_vario_packet(&vario_data, crsf_packet);
+        case FRSKY_ID_TEMP1:
+        case FRSKY_ID_TEMP2: {
+            uint8_t slot = source_slot(telemetry_data.temperature_ids, &telemetry_data.temperature_count,
+                                       TELEMETRY_MAX_TEMPERATURES, frsky_packet->data_id);
+            if (slot < TELEMETRY_MAX_TEMPERATURES) {
+                SET_FIELD(telemetry_data.temperature[slot], (int16_t)((int32_t)frsky_packet->value * 10));
+                freshness_touch(&freshness, ENTRY_TEMPERATURE + slot);
             }
             break;
+        }
             
-        case CRSF_FRAMETYPE_BARO_ALT:
-            if (telemetry_data.altitude_valid && (now - telemetry_data.last_altitude_update) < timeout_us) {
-                crsf_baro_alt_t baro_data = {
-                    .altitude = (uint16_t)(telemetry_data.altitude + 10000),
-                    .vertical_speed = telemetry_data.vertical_speed
-                };
-                return crsf_create_baro_alt_packet(&baro_data, crsf_packet);
+        case FRSKY_ID_CELLS: {
+            if (!telemetry_data.cells_valid) {
+                telemetry_data.cells_id = frsky_packet->data_id;
+            } else if (telemetry_data.cells_id != frsky_packet->data_id) {
+                break;
             }
+            uint8_t first, count;
+            uint16_t mv[2];
+            frsky_cells_unpack(frsky_packet->value, &first, &count, mv);
+            SET_FIELD(telemetry_data.cells_mv[first], mv[0]);
+            SET_FIELD(telemetry_data.cells_mv[first + 1], mv[1]);
+            SET_FIELD(telemetry_data.cell_count, count);
+            SET_FIELD(telemetry_data.cells_valid, true);
+            freshness_touch(&freshness, ENTRY_CELLS);
             break;
+        }
     }
     
-    return false;
+    return changed;
 }
 
-bool convert_frsky_to_crsf(const frsky_sport_packet_t *frsky_packet, crsf_packet_t *crsf_packet) {
-    update_telemetry_data(frsky_packet);
-    
-    switch (frsky_packet->data_id) {
+// CRSF frame type carrying a FrSky data ID, 0 if it is not converted
+static uint8_t crsf_type_for_data_id(uint16_t data_id) {
+    switch (FRSKY_ID_RANGE(data_id)) {
         case FRSKY_ID_GPS_LONG_LATI:
         case FRSKY_ID_GPS_ALT:
         case FRSKY_ID_GPS_SPEED:
         case FRSKY_ID_GPS_COURS:
-            return create_crsf_from_telemetry(CRSF_FRAMETYPE_GPS, crsf_packet);
+            return CRSF_FRAMETYPE_GPS;
             
         case FRSKY_ID_VFAS:
         case FRSKY_ID_CURR:
         case FRSKY_ID_FUEL:
-            return create_crsf_from_telemetry(CRSF_FRAMETYPE_BATTERY_SENSOR, crsf_packet);
+            return CRSF_FRAMETYPE_BATTERY_SENSOR;
             
         case FRSKY_ID_VSPD:
-            return create_crsf_from_telemetry(CRSF_FRAMETYPE_VARIO, crsf_packet);
+            return CRSF_FRAMETYPE_VARIO;
             
         case FRSKY_ID_ALT:
-            return create_crsf_from_telemetry(CRSF_FRAMETYPE_BARO_ALT, crsf_packet);
+            return CRSF_FRAMETYPE_BARO_ALT;
+            
+        case FRSKY_ID_RPM:
+            return ENABLE_RPM_CONVERSION ? CRSF_FRAMETYPE_RPM : 0;
+            
+        case FRSKY_ID_TEMP1:
+        case FRSKY_ID_TEMP2:
+            return ENABLE_TEMPERATURE_CONVERSION ? CRSF_FRAMETYPE_TEMPERATURE : 0;
+            
+        case FRSKY_ID_CELLS:
+            return ENABLE_CELLS_CONVERSION ? CRSF_FRAMETYPE_CELLS : 0;
             
         default:
-            return false;
+            return 0;
+    }
+}
+
+// Bytes of a group in use for a frame type
+static size_t group_size(uint8_t crsf_type) {
+    switch (crsf_type) {
+        case CRSF_FRAMETYPE_GPS:
+            return sizeof(crsf_gps_t);
+        case CRSF_FRAMETYPE_BATTERY_SENSOR:
+            return sizeof(crsf_battery_t);
+        case CRSF_FRAMETYPE_VARIO:
+            return sizeof(crsf_vario_t);
+        case CRSF_FRAMETYPE_BARO_ALT:
+            return sizeof(crsf_baro_alt_t);
+        default:
+            return sizeof(telemetry_group_t);
+    }
+}
+
+// Group of a frame type in the telemetry store, SCHEDULE_COUNT if none
+static uint8_t group_index(uint8_t crsf_type) {
+    uint8_t index = 0;
+    while (index < SCHEDULE_COUNT && schedule[index].frame_type != crsf_type) {
+        index++;
+    }
+    return index;
+}
+
+// Fill a frame type's group from the working copy, false while its data is
+// missing
+static bool build_group(uint8_t crsf_type, telemetry_group_t *group) {
+    switch (crsf_type) {
+        case CRSF_FRAMETYPE_GPS:
+            group->gps = (crsf_gps_t){
+                .latitude = telemetry_data.latitude,
+                .longitude = telemetry_data.longitude,
+                .groundspeed = telemetry_data.gps_speed,
+                .heading = telemetry_data.gps_heading,
+                .altitude = telemetry_data.gps_altitude,
+                .satellites = telemetry_data.satellites
+            };
+            return telemetry_data.gps_valid;
+            
+        case CRSF_FRAMETYPE_BATTERY_SENSOR:
+            group->battery = (crsf_battery_t){
+                .voltage = telemetry_data.voltage,
+                .current = telemetry_data.current,
+                .capacity = telemetry_data.capacity_used,
+                .remaining = telemetry_data.fuel_percent
+            };
+            return telemetry_data.battery_valid;
+            
+        case CRSF_FRAMETYPE_VARIO:
+            group->vario = (crsf_vario_t){
+                .vertical_speed = telemetry_data.vertical_speed
+            };
+            return telemetry_data.vario_valid;
+            
+        case CRSF_FRAMETYPE_BARO_ALT:
+            group->baro_alt = (crsf_baro_alt_t){
+                .altitude = (uint16_t)(telemetry_data.altitude + 10000),
+                .vertical_speed = telemetry_data.vertical_speed
+            };
+            return telemetry_data.altitude_valid;
+            
+        case CRSF_FRAMETYPE_RPM:
+            group->rpm.source_id = 0;
+            group->rpm.count = telemetry_data.rpm_count;
+            memcpy(group->rpm.values, telemetry_data.rpm, telemetry_data.rpm_count * sizeof(int32_t));
+            return telemetry_data.rpm_count > 0;
+            
+        case CRSF_FRAMETYPE_TEMPERATURE:
+            group->temperature.source_id = 0;
+            group->temperature.count = telemetry_data.temperature_count;
+            memcpy(group->temperature.values, telemetry_data.temperature,
+                   telemetry_data.temperature_count * sizeof(int16_t));
+            return telemetry_data.temperature_count > 0;
+            
+        case CRSF_FRAMETYPE_CELLS:
+            group->cells.source_id = 0;
+            group->cells.count = telemetry_data.cell_count < TELEMETRY_MAX_CELLS ? telemetry_data.cell_count
+                                                                                 : TELEMETRY_MAX_CELLS;
+            memcpy(group->cells.values, telemetry_data.cells_mv, group->cells.count * sizeof(uint16_t));
+            return telemetry_data.cells_valid;
+    }
+    
+    return false;
+}
+
+static void publish_group(uint8_t crsf_type) {
+    telemetry_group_t group;
+    uint8_t index = group_index(crsf_type);
+    if (index < SCHEDULE_COUNT && build_group(crsf_type, &group)) {
+        telemetry_store_publish(&store, index, &group, group_size(crsf_type));
     }
 }
+
+// Store a FrSky value and publish the groups it is part of, returns true
+// when it changed the telemetry data
+static bool store_packet(const frsky_sport_packet_t *frsky_packet, uint32_t now) {
+    telemetry_converter_expire(now);
+    bool changed = update_telemetry_fields(frsky_packet);
+    uint8_t crsf_type = crsf_type_for_data_id(frsky_packet->data_id);
+    if (crsf_type == 0) {
+        return changed;
+    }
+    
+    // The vertical speed is in both the vario and the baro altitude frame
+    publish_group(crsf_type);
+    if (crsf_type == CRSF_FRAMETYPE_VARIO) {
+        publish_group(CRSF_FRAMETYPE_BARO_ALT);
+    } else if (crsf_type == CRSF_FRAMETYPE_BARO_ALT && telemetry_data.vario_derived) {
+        publish_group(CRSF_FRAMETYPE_VARIO);
+    }
+    return changed;
+}
+
+void update_telemetry_data(const frsky_sport_packet_t *frsky_packet) {
+    TRACE_BEGIN(TRACE_STAGE_TELEMETRY_UPDATE);
+    store_packet(frsky_packet, hal_time_us());
+    TRACE_END(TRACE_STAGE_TELEMETRY_UPDATE);
+}
+
+// Serialize a CRSF frame from its published group straight into buffer,
+// returns the frame length or 0 if the data is missing or stale. The
+// freshness wheel must have been advanced to the current time.
+static uint8_t write_crsf_from_telemetry(uint8_t crsf_type, uint8_t *buffer, uint8_t capacity) {
+    telemetry_group_t group;
+    uint8_t index = group_index(crsf_type);
+    if (index == SCHEDULE_COUNT || !(freshness.fresh & entry_mask(crsf_type)) ||
+        telemetry_store_read(&store, index, &group, group_size(crsf_type)) == 0) {
+        return 0;
+    }
+    
+    switch (crsf_type) {
+        case CRSF_FRAMETYPE_GPS:
+            return crsf_write_gps(buffer, capacity, &group.gps);
+        case CRSF_FRAMETYPE_BATTERY_SENSOR:
+            return crsf_write_battery(buffer, capacity, &group.battery);
+        case CRSF_FRAMETYPE_VARIO:
+            return crsf_write_vario(buffer, capacity, &group.vario);
+        case CRSF_FRAMETYPE_BARO_ALT:
+            return crsf_write_baro_alt(buffer, capacity, &group.baro_alt);
+        case CRSF_FRAMETYPE_RPM:
+            return crsf_write_rpm(buffer, capacity, &group.rpm);
+        case CRSF_FRAMETYPE_TEMPERATURE:
+            return crsf_write_temperature(buffer, capacity, &group.temperature);
+        case CRSF_FRAMETYPE_CELLS:
+            return crsf_write_cells(buffer, capacity, &group.cells);
+    }
+    
+    return 0;
+}
+
+bool create_crsf_from_telemetry(uint8_t crsf_type, crsf_packet_t *crsf_packet) {
+    TRACE_BEGIN(TRACE_STAGE_CRSF_BUILD);
+    telemetry_converter_expire(hal_time_us());
+    crsf_packet->length = write_crsf_from_telemetry(crsf_type, crsf_packet->data, sizeof(crsf_packet->data));
+    TRACE_END(TRACE_STAGE_CRSF_BUILD);
+    return crsf_packet->length > 0;
+}
+
+bool telemetry_converter_handles(uint16_t data_id) {
+    return crsf_type_for_data_id(data_id) != 0;
+}
+
+// Immediate conversion: one CRSF frame for every FrSky packet
+bool convert_frsky_to_crsf(const frsky_sport_packet_t *frsky_packet, crsf_packet_t *crsf_packet) {
+    update_telemetry_data(frsky_packet);
+    
+    uint8_t crsf_type = crsf_type_for_data_id(frsky_packet->data_id);
+    if (crsf_type == 0) {
+        return false;
+    }
+    return create_crsf_from_telemetry(crsf_type, crsf_packet);
+}
+
+// Scheduled conversion: store the packet and mark its frame type dirty if
+// the value changed, frames are produced by telemetry_converter_poll.
+// Returns the frame type made dirty, 0 if nothing changed.
+uint8_t telemetry_converter_update(const frsky_sport_packet_t *frsky_packet, uint32_t now) {
+    TRACE_BEGIN(TRACE_STAGE_TELEMETRY_UPDATE);
+    bool changed = store_packet(frsky_packet, now);
+    TRACE_END(TRACE_STAGE_TELEMETRY_UPDATE);
+    
+    uint8_t crsf_type = crsf_type_for_data_id(frsky_packet->data_id);
+    if (crsf_type == 0) {
+        return 0;
+    }
+    crsf_scheduler_mark(&scheduler, crsf_type, changed);
+    if (crsf_type == CRSF_FRAMETYPE_BARO_ALT && telemetry_data.vario_derived) {
+        crsf_scheduler_mark(&scheduler, CRSF_FRAMETYPE_VARIO, changed);
+    }
+    return changed ? crsf_type : 0;
+}
+
+// Serialize the next frame the scheduler wants sent now into buffer, e.g.
+// space reserved in the TX queue. Returns the length, 0 if none is due.
+uint8_t telemetry_converter_poll_frame(uint32_t now, uint8_t *buffer, uint8_t capacity) {
+    uint8_t crsf_type;
+    telemetry_converter_expire(now);
+    while ((crsf_type = crsf_scheduler_next(&scheduler, now)) != CRSF_SCHEDULER_NONE) {
+        TRACE_BEGIN(TRACE_STAGE_CRSF_BUILD);
+        uint8_t length = write_crsf_from_telemetry(crsf_type, buffer, capacity);
+        TRACE_END(TRACE_STAGE_CRSF_BUILD);
+        if (length > 0) {
+            crsf_scheduler_sent(&scheduler, crsf_type, now);
+            return length;
+        }
+        crsf_scheduler_deactivate(&scheduler, crsf_type);
+    }
+    return 0;
+}
+
+// Whether telemetry_converter_poll_frame has a frame to send now
+bool telemetry_converter_frame_due(uint32_t now) {
+    telemetry_converter_expire(now);
+    return crsf_scheduler_next(&scheduler, now) != CRSF_SCHEDULER_NONE;
+}
+
+bool telemetry_converter_poll(uint32_t now, crsf_packet_t *crsf_packet) {
+    crsf_packet->length = telemetry_converter_poll_frame(now, crsf_packet->data, sizeof(crsf_packet->data));
+    return crsf_packet->length > 0;
+}
+
+const crsf_scheduler_stats_t *telemetry_converter_scheduler_stats(void) {
+    return &scheduler.stats;
+}
@@ -3,13 +3,26 @@
 
 #include "frsky_sport.h"
 #include "crsf.h"
+#include "crsf_scheduler.h"
 #include <stdbool.h>
 
-// Telemetry data storage
+// Sources kept per multi-sensor type; further data IDs of the type are
+// ignored
+#define TELEMETRY_MAX_RPM_SOURCES 4
+#define TELEMETRY_MAX_TEMPERATURES 4
+#define TELEMETRY_MAX_CELLS 12
+
+// Telemetry data storage, the writer's working copy. Frames are built from
+// the groups it publishes to the telemetry store. Which sensors still
+// report is tracked by a freshness wheel next to it (see freshness.h).
 typedef struct {
-    // GPS data
+    // GPS data. Latitude and longitude arrive in separate packets and are
+    // only taken over as a pair.
     int32_t latitude;
     int32_t longitude;
+    int32_t pending_latitude;
+    int32_t pending_longitude;
+    uint8_t pending_position;  // Halves received: bit 0 latitude, bit 1 longitude
     uint16_t gps_altitude;
     uint16_t gps_speed;
     uint16_t gps_heading;
@@ -28,19 +41,39 @@ typedef struct {
     int16_t vertical_speed;
     bool altitude_valid;
     bool vario_valid;
+    bool vario_derived;      // From the altitude, no VSPD sensor seen lately
+    
+    // RPM and temperature sensors, in the order their data IDs were first
+    // seen
+    uint16_t rpm_ids[TELEMETRY_MAX_RPM_SOURCES];
+    int32_t rpm[TELEMETRY_MAX_RPM_SOURCES];
+    uint8_t rpm_count;
+    uint16_t temperature_ids[TELEMETRY_MAX_TEMPERATURES];
+    int16_t temperature[TELEMETRY_MAX_TEMPERATURES]; // deci-degrees Celsius
+    uint8_t temperature_count;
     
-    // Timestamps for data freshness
-    uint32_t last_gps_update;
-    uint32_t last_battery_update;
-    uint32_t last_altitude_update;
-    uint32_t last_vario_update;
+    // FLVSS cells of the first cell sensor seen, in mV. One spare entry
+    // takes the second cell of a pair starting at the last index.
+    uint16_t cells_id;
+    uint16_t cells_mv[16 + 1];
+    uint8_t cell_count;
+    bool cells_valid;
 } telemetry_data_t;
 
 // Function prototypes
 void telemetry_converter_init(void);
+bool telemetry_converter_restore(void);
 bool convert_frsky_to_crsf(const frsky_sport_packet_t *frsky_packet, crsf_packet_t *crsf_packet);
 void update_telemetry_data(const frsky_sport_packet_t *frsky_packet);
 bool create_crsf_from_telemetry(uint8_t crsf_type, crsf_packet_t *crsf_packet);
+uint8_t telemetry_converter_update(const frsky_sport_packet_t *frsky_packet, uint32_t now);
+bool telemetry_converter_handles(uint16_t data_id);
+bool telemetry_converter_poll(uint32_t now, crsf_packet_t *crsf_packet);
+uint8_t telemetry_converter_poll_frame(uint32_t now, uint8_t *buffer, uint8_t capacity);
+bool telemetry_converter_frame_due(uint32_t now);
+void telemetry_converter_expire(uint32_t now);
+bool telemetry_converter_next_lost(uint8_t *frame_type, uint8_t *source);
+const crsf_scheduler_stats_t *telemetry_converter_scheduler_stats(void);
 
 // Utility functions
 int32_t frsky_gps_to_decimal(uint32_t frsky_coord);
@@ -48,5 +81,6 @@ uint16_t frsky_voltage_to_mv(uint32_t frsky_voltage);
 uint16_t frsky_current_to_ma(uint32_t frsky_current);
 int16_t frsky_vspeed_to_cms(uint32_t frsky_vspeed);
 uint16_t frsky_altitude_to_meters(uint32_t frsky_altitude);
+void frsky_cells_unpack(uint32_t frsky_cells, uint8_t *first, uint8_t *count, uint16_t mv[2]);
 
 #endif // TELEMETRY_CONVERTER_H
@@ -0,0 +1,255 @@
+#include "telemetry_mirror.h"
+#include <string.h>
+
+// Consistent overhead byte stuffing: every zero is replaced by the distance
+// to the next one, so the encoded data holds no zero. Returns the encoded
+// size, at most length + length / 254 + 1; no delimiter is added.
+size_t cobs_encode(const uint8_t *data, size_t length, uint8_t *out) {
+    size_t code_at = 0;
+    size_t size = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] != 0) {
+            out[size++] = data[i];
+            code++;
+        }
+        if (data[i] == 0 || code == 0xFF) {
+            out[code_at] = code;
+            code_at = size++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    return size;
+}
+
+// Returns the decoded size, or 0 when the data is not valid COBS or does
+// not fit in capacity
+size_t cobs_decode(const uint8_t *data, size_t length, uint8_t *out, size_t capacity) {
+    size_t size = 0;
+    size_t i = 0;
+
+    while (i < length) {
+        uint8_t code = data[i++];
+        if (code == 0 || i + code - 1 > length) {
+            return 0;
+        }
+        for (uint8_t j = 1; j < code; j++) {
+            if (data[i] == 0 || size == capacity) {
+                return 0;
+            }
+            out[size++] = data[i++];
+        }
+        if (code != 0xFF && i < length) {
+            if (size == capacity) {
+                return 0;
+            }
+            out[size++] = 0;
+        }
+    }
+    return size;
+}
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Finish a record whose body is already in place after the header: add the
+// CRC, encode and delimit. Returns the encoded size, or 0 when it does not
+// fit in capacity.
+static size_t write_record(telemetry_mirror_writer_t *writer, uint8_t *record, size_t body_length,
+                           uint8_t type, uint32_t time_us, uint8_t *out, size_t capacity) {
+    size_t length = TELEMETRY_MIRROR_HEADER_SIZE + body_length;
+    size_t lead = type == TELEMETRY_MIRROR_START ? 1 : 0;
+    if (capacity < lead + length + 1 + (length + 1) / 254 + 2) {
+        return 0;
+    }
+
+    record[0] = type;
+    record[1] = writer->seq++;
+    put_u32(&record[2], time_us);
+    record[length] = crsf_crc8(record, (uint8_t)length);
+
+    if (lead) {
+        out[0] = 0;
+    }
+    size_t size = lead + cobs_encode(record, length + 1, &out[lead]);
+    out[size++] = 0;
+    return size;
+}
+
+void telemetry_mirror_writer_init(telemetry_mirror_writer_t *writer) {
+    writer->seq = 0;
+}
+
+size_t telemetry_mirror_write_start(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                    uint32_t time_us) {
+    uint8_t record[TELEMETRY_MIRROR_RECORD_MAX];
+    record[TELEMETRY_MIRROR_HEADER_SIZE] = TELEMETRY_MIRROR_VERSION;
+    put_u32(&record[TELEMETRY_MIRROR_HEADER_SIZE + 1], deferred_log_table_hash());
+    return write_record(writer, record, 5, TELEMETRY_MIRROR_START, time_us, out, capacity);
+}
+
+// Stamped with the arrival of the packet's start byte
+size_t telemetry_mirror_write_sport(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                    const frsky_sport_packet_t *packet) {
+    uint8_t record[TELEMETRY_MIRROR_RECORD_MAX];
+    uint8_t *body = &record[TELEMETRY_MIRROR_HEADER_SIZE];
+    body[0] = packet->bus;
+    body[1] = packet->sensor_id;
+    body[2] = (uint8_t)packet->data_id;
+    body[3] = (uint8_t)(packet->data_id >> 8);
+    put_u32(&body[4], packet->value);
+    return write_record(writer, record, 8, TELEMETRY_MIRROR_SPORT, packet->timestamp_us, out, capacity);
+}
+
+size_t telemetry_mirror_write_crsf(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                   uint32_t time_us, const uint8_t *frame, uint8_t length) {
+    uint8_t record[TELEMETRY_MIRROR_RECORD_MAX];
+    if (length > CRSF_MAX_PACKET_SIZE) {
+        return 0;
+    }
+    memcpy(&record[TELEMETRY_MIRROR_HEADER_SIZE], frame, length);
+    return write_record(writer, record, length, TELEMETRY_MIRROR_CRSF, time_us, out, capacity);
+}
+
+size_t telemetry_mirror_write_end(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                  uint32_t time_us) {
+    uint8_t record[TELEMETRY_MIRROR_RECORD_MAX];
+    return write_record(writer, record, 0, TELEMETRY_MIRROR_END, time_us, out, capacity);
+}
+
+// Only the arguments its format takes
+size_t telemetry_mirror_write_log(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                  const log_record_t *log) {
+    uint8_t record[TELEMETRY_MIRROR_RECORD_MAX];
+    uint8_t *body = &record[TELEMETRY_MIRROR_HEADER_SIZE];
+    uint8_t count = deferred_log_arg_count(log->id);
+    body[0] = log->id;
+    body[1] = log->core;
+    for (uint8_t i = 0; i < count; i++) {
+        put_u32(&body[2 + 4 * i], log->args[i]);
+    }
+    return write_record(writer, record, 2 + 4 * (size_t)count, TELEMETRY_MIRROR_LOG, log->time_us, out, capacity);
+}
+
+void telemetry_mirror_reader_init(telemetry_mirror_reader_t *reader) {
+    memset(reader, 0, sizeof(*reader));
+}
+
+// Check and unpack one decoded record
+static bool parse_record(telemetry_mirror_reader_t *reader, size_t length, telemetry_mirror_record_t *record) {
+    const uint8_t *data = reader->decoded;
+    if (length < TELEMETRY_MIRROR_HEADER_SIZE + 1 || crsf_crc8(data, (uint8_t)(length - 1)) != data[length - 1]) {
+        return false;
+    }
+    const uint8_t *body = &data[TELEMETRY_MIRROR_HEADER_SIZE];
+    size_t body_length = length - TELEMETRY_MIRROR_HEADER_SIZE - 1;
+
+    memset(record, 0, sizeof(*record));
+    record->type = data[0];
+    record->seq = data[1];
+    record->time_us = get_u32(&data[2]);
+    switch (record->type) {
+        case TELEMETRY_MIRROR_START:
+            if (body_length != 5) {
+                return false;
+            }
+            record->version = body[0];
+            record->log_hash = get_u32(&body[1]);
+            break;
+
+        case TELEMETRY_MIRROR_SPORT:
+            if (body_length != 8) {
+                return false;
+            }
+            record->bus = body[0];
+            record->sensor_id = body[1];
+            record->data_id = (uint16_t)(body[2] | (body[3] << 8));
+            record->value = get_u32(&body[4]);
+            break;
+
+        case TELEMETRY_MIRROR_CRSF:
+            if (body_length < 4) {
+                return false;
+            }
+            record->frame = body;
+            record->length = (uint8_t)body_length;
+            break;
+
+        case TELEMETRY_MIRROR_END:
+            break;
+
+        case TELEMETRY_MIRROR_LOG:
+            if (body_length < 2 || (body_length - 2) % 4 != 0 || body_length > 2 + 4 * DEFERRED_LOG_MAX_ARGS) {
+                return false;
+            }
+            record->log.time_us = record->time_us;
+            record->log.id = body[0];
+            record->log.core = body[1];
+            for (size_t i = 0; i < (body_length - 2) / 4; i++) {
+                record->log.args[i] = get_u32(&body[2 + 4 * i]);
+            }
+            break;
+
+        default:
+            return false;
+    }
+    return true;
+}
+
+// Feed one byte of the stream. Returns true with the record filled in when
+// the byte completes a valid record. Bad frames count from the first valid
+// record on and sequence gaps from the first record of their sequence, so
+// whatever came before the stream does not; a START record begins both
+// sequences anew.
+bool telemetry_mirror_feed(telemetry_mirror_reader_t *reader, uint8_t byte, telemetry_mirror_record_t *record) {
+    if (byte != 0) {
+        if (reader->length < sizeof(reader->encoded)) {
+            reader->encoded[reader->length++] = byte;
+        } else {
+            reader->overlong = true;
+        }
+        return false;
+    }
+
+    size_t encoded_length = reader->length;
+    bool overlong = reader->overlong;
+    reader->length = 0;
+    reader->overlong = false;
+    if (encoded_length == 0) {
+        return false;
+    }
+
+    size_t length = overlong ? 0 : cobs_decode(reader->encoded, encoded_length, reader->decoded,
+                                               sizeof(reader->decoded));
+    if (length == 0 || !parse_record(reader, length, record)) {
+        if (reader->started) {
+            reader->bad_frames++;
+        }
+        return false;
+    }
+
+    bool log = record->type == TELEMETRY_MIRROR_LOG;
+    bool *sequenced = log ? &reader->log_sequenced : &reader->sequenced;
+    uint8_t *next_seq = log ? &reader->next_log_seq : &reader->next_seq;
+    if (record->type == TELEMETRY_MIRROR_START) {
+        reader->log_sequenced = true;
+        reader->next_log_seq = 0;
+    } else if (*sequenced) {
+        reader->lost += (uint8_t)(record->seq - *next_seq);
+    }
+    reader->started = true;
+    *sequenced = true;
+    *next_seq = (uint8_t)(record->seq + 1);
+    reader->records++;
+    return true;
+}
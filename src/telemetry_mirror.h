@@ -0,0 +1,98 @@
+#ifndef TELEMETRY_MIRROR_H
+#define TELEMETRY_MIRROR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "frsky_sport.h"
+#include "crsf.h"
+#include "deferred_log.h"
+
+// Binary telemetry mirror format
+//
+// A copy of every decoded S.PORT packet and every CRSF frame handed to the
+// downlink, for watching the converter live from the host, together with
+// the deferred log records. Each record is
+// COBS encoded and followed by a 0x00 delimiter, so a reader picks the
+// stream up at any delimiter. Before encoding a record is:
+//
+//   type      1 byte, TELEMETRY_MIRROR_*
+//   seq       1 byte, counts up per record; a gap means records were dropped.
+//             LOG records come from core0 and count on their own.
+//   time_us   4 bytes little endian, device clock
+//   body      START: version byte, deferred log format table hash (4 bytes LE)
+//             SPORT: bus, sensor ID, data ID (2 bytes LE), value (4 bytes LE)
+//             CRSF:  the frame as sent, sync byte to CRC
+//             END:   empty
+//             LOG:   format ID, core, its arguments (4 bytes LE each)
+//   crc       1 byte, CRSF CRC8 over everything before it
+//
+// The writer puts a delimiter in front of START, so text that came before
+// it on the console ends up in one frame that fails its CRC.
+#define TELEMETRY_MIRROR_VERSION 2
+#define TELEMETRY_MIRROR_START 1
+#define TELEMETRY_MIRROR_SPORT 2
+#define TELEMETRY_MIRROR_CRSF 3
+#define TELEMETRY_MIRROR_END 4
+#define TELEMETRY_MIRROR_LOG 5
+
+#define TELEMETRY_MIRROR_HEADER_SIZE 6
+#define TELEMETRY_MIRROR_RECORD_MAX (TELEMETRY_MIRROR_HEADER_SIZE + CRSF_MAX_PACKET_SIZE + 1)
+
+// Largest encoded record: one COBS code byte per 254 bytes, the leading
+// delimiter of START and the trailing one
+#define TELEMETRY_MIRROR_ENCODED_MAX (TELEMETRY_MIRROR_RECORD_MAX + TELEMETRY_MIRROR_RECORD_MAX / 254 + 3)
+
+typedef struct {
+    uint8_t seq;
+} telemetry_mirror_writer_t;
+
+// One decoded record; frame points into the reader
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    uint32_t time_us;
+    uint8_t version;
+    uint32_t log_hash;
+    uint8_t bus;
+    uint8_t sensor_id;
+    uint16_t data_id;
+    uint32_t value;
+    const uint8_t *frame;
+    uint8_t length;
+    log_record_t log;
+} telemetry_mirror_record_t;
+
+typedef struct {
+    uint8_t encoded[TELEMETRY_MIRROR_ENCODED_MAX];
+    uint8_t decoded[TELEMETRY_MIRROR_RECORD_MAX];
+    size_t length;
+    bool overlong;
+    bool started;
+    bool sequenced;
+    bool log_sequenced;
+    uint8_t next_seq;
+    uint8_t next_log_seq;
+    uint32_t records;
+    uint32_t bad_frames;      // Failed COBS, CRC or length checks
+    uint32_t lost;            // Records missing from the sequence, mod 256 per gap
+} telemetry_mirror_reader_t;
+
+// Function prototypes
+size_t cobs_encode(const uint8_t *data, size_t length, uint8_t *out);
+size_t cobs_decode(const uint8_t *data, size_t length, uint8_t *out, size_t capacity);
+void telemetry_mirror_writer_init(telemetry_mirror_writer_t *writer);
+size_t telemetry_mirror_write_start(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                    uint32_t time_us);
+size_t telemetry_mirror_write_sport(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                    const frsky_sport_packet_t *packet);
+size_t telemetry_mirror_write_crsf(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                   uint32_t time_us, const uint8_t *frame, uint8_t length);
+size_t telemetry_mirror_write_end(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                  uint32_t time_us);
+size_t telemetry_mirror_write_log(telemetry_mirror_writer_t *writer, uint8_t *out, size_t capacity,
+                                  const log_record_t *log);
+void telemetry_mirror_reader_init(telemetry_mirror_reader_t *reader);
+bool telemetry_mirror_feed(telemetry_mirror_reader_t *reader, uint8_t byte, telemetry_mirror_record_t *record);
+
+#endif // TELEMETRY_MIRROR_H
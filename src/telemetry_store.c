@@ -0,0 +1,51 @@
+#include "telemetry_store.h"
+#include <string.h>
+
+void telemetry_store_init(telemetry_store_t *store) {
+    for (int group = 0; group < TELEMETRY_STORE_GROUPS; group++) {
+        atomic_init(&store->groups[group].sequence, 0);
+        for (int i = 0; i < TELEMETRY_STORE_GROUP_WORDS; i++) {
+            atomic_init(&store->groups[group].words[i], 0);
+        }
+    }
+}
+
+// Writer side, one context per store. The odd sequence is visible before
+// any data word changes and the even one only after all of them have.
+void telemetry_store_publish(telemetry_store_t *store, uint8_t group, const void *data, size_t size) {
+    telemetry_store_group_t *slot = &store->groups[group];
+    uint32_t words[TELEMETRY_STORE_GROUP_WORDS] = { 0 };
+    size = size < TELEMETRY_STORE_GROUP_SIZE ? size : TELEMETRY_STORE_GROUP_SIZE;
+    size_t count = (size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    memcpy(words, data, size);
+
+    uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < count; i++) {
+        atomic_store_explicit(&slot->words[i], words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+}
+
+// Copy the first size bytes of a consistent group into data, returns its
+// version: the number of times it was published, 0 if never
+uint32_t telemetry_store_read(telemetry_store_t *store, uint8_t group, void *data, size_t size) {
+    telemetry_store_group_t *slot = &store->groups[group];
+    uint32_t words[TELEMETRY_STORE_GROUP_WORDS];
+    uint32_t before, after;
+    size = size < TELEMETRY_STORE_GROUP_SIZE ? size : TELEMETRY_STORE_GROUP_SIZE;
+    size_t count = (size + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    do {
+        before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            words[i] = atomic_load_explicit(&slot->words[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    memcpy(data, words, size);
+    return before / 2;
+}
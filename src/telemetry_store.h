@@ -0,0 +1,32 @@
+#ifndef TELEMETRY_STORE_H
+#define TELEMETRY_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Sequence-locked groups of telemetry values. One writer publishes a whole
+// group at a time; readers in any context or on the other core copy a group
+// without taking a lock and retry if the writer was inside it meanwhile, so
+// a reader never sees fields of two different updates. The data words are
+// relaxed atomics ordered by fences around the sequence, which keeps the
+// copy race-free under the C11 memory model.
+#define TELEMETRY_STORE_GROUPS 8
+#define TELEMETRY_STORE_GROUP_WORDS 12
+#define TELEMETRY_STORE_GROUP_SIZE (TELEMETRY_STORE_GROUP_WORDS * sizeof(uint32_t))
+
+typedef struct {
+    _Atomic uint32_t sequence;  // Odd while the writer is inside the group
+    _Atomic uint32_t words[TELEMETRY_STORE_GROUP_WORDS];
+} telemetry_store_group_t;
+
+typedef struct {
+    telemetry_store_group_t groups[TELEMETRY_STORE_GROUPS];
+} telemetry_store_t;
+
+// Function prototypes
+void telemetry_store_init(telemetry_store_t *store);
+void telemetry_store_publish(telemetry_store_t *store, uint8_t group, const void *data, size_t size);
+uint32_t telemetry_store_read(telemetry_store_t *store, uint8_t group, void *data, size_t size);
+
+#endif // TELEMETRY_STORE_H
@@ -0,0 +1,136 @@
+#include "trace.h"
+#include "core_ring.h"
+#include "hal.h"
+#include <stdatomic.h>
+#include <string.h>
+
+// Rings take no RAM when tracing is compiled out
+#if TRACE_ENABLED
+#define TRACE_RING_EVENTS TRACE_RING_SIZE
+#else
+#define TRACE_RING_EVENTS 1
+#endif
+
+static trace_event_t events[TRACE_CORE_COUNT][TRACE_RING_EVENTS];
+static core_ring_t rings[TRACE_CORE_COUNT];
+static _Atomic bool trace_paused = false;
+
+static const char *const stage_names[TRACE_STAGE_COUNT] = {
+    [TRACE_STAGE_PIPELINE_POLL] = "pipeline_poll",
+    [TRACE_STAGE_RX_ISR] = "rx_isr",
+    [TRACE_STAGE_SPORT_DECODE] = "sport_decode",
+    [TRACE_STAGE_TELEMETRY_UPDATE] = "telemetry_update",
+    [TRACE_STAGE_CRSF_BUILD] = "crsf_build",
+    [TRACE_STAGE_CRSF_CRC] = "crsf_crc8",
+    [TRACE_STAGE_CRSF_TX] = "crsf_tx",
+};
+
+void trace_init(void) {
+    for (int i = 0; i < TRACE_CORE_COUNT; i++) {
+        core_ring_init(&rings[i], TRACE_RING_EVENTS, true);
+    }
+    atomic_store(&trace_paused, false);
+}
+
+void trace_record(uint8_t stage, uint8_t phase) {
+    if (atomic_load_explicit(&trace_paused, memory_order_relaxed)) {
+        return;
+    }
+    uint8_t core = hal_core_num();
+    uint32_t slot;
+    if (!core_ring_claim(&rings[core], &slot)) {
+        return;
+    }
+    trace_event_t *event = &events[core][slot];
+    event->cycles = hal_cycles();
+    event->stage = stage;
+    event->phase = phase;
+    event->core = core;
+    core_ring_publish(&rings[core]);
+}
+
+// Paused while a dump is read so the rings hold still; a record already in
+// progress lands in the slot after the dumped range
+void trace_set_paused(bool paused) {
+    atomic_store(&trace_paused, paused);
+}
+
+static void put_u32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// The slot at the head may be being written, so a full ring yields one
+// event less than its size
+static uint32_t ring_count(uint32_t head) {
+#if TRACE_ENABLED
+    return head < TRACE_RING_EVENTS - 1 ? head : TRACE_RING_EVENTS - 1;
+#else
+    (void)head;
+    return 0;
+#endif
+}
+
+// Write the header and all events through write, returns the bytes written
+size_t trace_dump(trace_write_t write, void *context) {
+    uint32_t heads[TRACE_CORE_COUNT];
+    uint32_t total = 0;
+    for (int i = 0; i < TRACE_CORE_COUNT; i++) {
+        heads[i] = core_ring_head(&rings[i]);
+        total += ring_count(heads[i]);
+    }
+
+    uint8_t header[TRACE_HEADER_SIZE];
+    memcpy(header, TRACE_MAGIC, 4);
+    header[4] = TRACE_VERSION;
+    header[5] = hal_cycle_bits();
+    header[6] = TRACE_CORE_COUNT;
+    header[7] = 0;
+    put_u32(&header[8], hal_cycle_hz());
+    put_u32(&header[12], total);
+    write(context, header, sizeof(header));
+
+    uint8_t record[TRACE_EVENT_SIZE];
+    for (int i = 0; i < TRACE_CORE_COUNT; i++) {
+        uint32_t count = ring_count(heads[i]);
+        for (uint32_t n = heads[i] - count; n != heads[i]; n++) {
+            const trace_event_t *event = &events[i][n & (TRACE_RING_EVENTS - 1)];
+            put_u32(record, event->cycles);
+            record[4] = event->stage;
+            record[5] = event->phase;
+            record[6] = event->core;
+            record[7] = 0;
+            write(context, record, sizeof(record));
+        }
+    }
+    return TRACE_HEADER_SIZE + (size_t)total * TRACE_EVENT_SIZE;
+}
+
+const char *trace_stage_name(uint8_t stage) {
+    return stage < TRACE_STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+bool trace_parse_header(const uint8_t *data, size_t length, trace_header_t *header) {
+    if (length < TRACE_HEADER_SIZE || memcmp(data, TRACE_MAGIC, 4) != 0 || data[4] != TRACE_VERSION) {
+        return false;
+    }
+    header->version = data[4];
+    header->counter_bits = data[5];
+    header->core_count = data[6];
+    header->counter_hz = get_u32(&data[8]);
+    header->event_count = get_u32(&data[12]);
+    return header->counter_bits > 0 && header->counter_bits <= 32 && header->counter_hz > 0;
+}
+
+void trace_parse_event(const uint8_t *data, trace_event_t *event) {
+    event->cycles = get_u32(data);
+    event->stage = data[4];
+    event->phase = data[5];
+    event->core = data[6];
+}
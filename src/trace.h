@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "config.h"
+
+// Stage profiler. TRACE_BEGIN and TRACE_END store a cycle-stamped event in
+// a ring per core; each ring has one producer, interrupts on the same core
+// are masked only while a slot is claimed. Old events are overwritten.
+// With TRACE_ENABLED 0 the macros compile to nothing.
+//
+// Dump format, little-endian: a 16 byte header (magic "TRC1", version,
+// counter bits, core count, reserved byte, counter Hz, event count), then
+// 8 byte events (cycles, stage, phase, core, reserved), oldest first per
+// core. The host build records and dumps with this same code, only the
+// cycle counter behind hal_cycles differs.
+
+#define TRACE_MAGIC "TRC1"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+#define TRACE_EVENT_SIZE 8
+#define TRACE_CORE_COUNT 2
+
+typedef enum {
+    TRACE_STAGE_PIPELINE_POLL,
+    TRACE_STAGE_RX_ISR,
+    TRACE_STAGE_SPORT_DECODE,
+    TRACE_STAGE_TELEMETRY_UPDATE,
+    TRACE_STAGE_CRSF_BUILD,
+    TRACE_STAGE_CRSF_CRC,
+    TRACE_STAGE_CRSF_TX,
+    TRACE_STAGE_COUNT
+} trace_stage_t;
+
+#define TRACE_PHASE_BEGIN 0
+#define TRACE_PHASE_END 1
+
+typedef struct {
+    uint32_t cycles;
+    uint8_t stage;
+    uint8_t phase;
+    uint8_t core;
+} trace_event_t;
+
+typedef struct {
+    uint8_t version;
+    uint8_t counter_bits;
+    uint8_t core_count;
+    uint32_t counter_hz;
+    uint32_t event_count;
+} trace_header_t;
+
+typedef void (*trace_write_t)(void *context, const uint8_t *data, size_t length);
+
+#if TRACE_ENABLED
+#define TRACE_BEGIN(stage) trace_record((stage), TRACE_PHASE_BEGIN)
+#define TRACE_END(stage) trace_record((stage), TRACE_PHASE_END)
+#else
+#define TRACE_BEGIN(stage) ((void)0)
+#define TRACE_END(stage) ((void)0)
+#endif
+
+// Function prototypes
+void trace_init(void);
+void trace_record(uint8_t stage, uint8_t phase);
+void trace_set_paused(bool paused);
+size_t trace_dump(trace_write_t write, void *context);
+const char *trace_stage_name(uint8_t stage);
+
+// Dump parsing for host tools
+bool trace_parse_header(const uint8_t *data, size_t length, trace_header_t *header);
+void trace_parse_event(const uint8_t *data, trace_event_t *event);
+
+#endif // TRACE_H
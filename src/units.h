@@ -0,0 +1,90 @@
+#ifndef UNITS_H
+#define UNITS_H
+
+#include <stdint.h>
+
+// Unit conversion kernels for the FrSky values, without runtime division.
+// n / d is computed as (n * UNITS_RECIPROCAL(d, shift)) >> shift with the
+// multiplier rounded up; the result is exact for every n < 2^shift / d and
+// the constant is folded at compile time. Each kernel clamps its input to
+// the range its shift was chosen for and saturates its result to the output
+// type. tools/units_verify.c checks every kernel against 64-bit division
+// over its whole input domain.
+#define UNITS_RECIPROCAL(d, shift) ((((uint64_t)1 << (shift)) + (d) - 1) / (d))
+#define UNITS_DIV(n, d, shift) ((uint32_t)(((uint64_t)(n) * UNITS_RECIPROCAL(d, shift)) >> (shift)))
+
+// Largest GPS coordinate, 180 degrees in 1e-7 degrees
+#define UNITS_GPS_COORD_MAX 1800000000
+
+// Inputs above these saturate their conversion
+#define UNITS_GPS_SPEED_INPUT_MAX 353866u    // (65536 * 10000 - 1) / 1852
+#define UNITS_GPS_HEADING_INPUT_MAX 6553599u // 0xFFFF * 100 + 99
+#define UNITS_ALTITUDE_INPUT_MAX 655359u     // 0xFFFF * 10 + 9
+
+// DDDMMmmmm (degrees, minutes, 1e-4 minutes) to 1e-7 degrees, input without
+// the sign and hemisphere bits
+static inline int32_t units_gps_to_decimal(uint32_t frsky_coord) {
+    frsky_coord &= 0x3FFFFFFF;
+    uint32_t degrees = UNITS_DIV(frsky_coord, 1000000u, 50);
+    if (degrees > 180) {
+        return UNITS_GPS_COORD_MAX;
+    }
+    uint32_t remainder = frsky_coord - degrees * 1000000u;
+    uint32_t minutes = UNITS_DIV(remainder, 10000u, 34);
+    uint32_t minutes_frac = remainder - minutes * 10000u;
+
+    uint32_t decimal = degrees * 10000000u;
+    decimal += UNITS_DIV(minutes * 10000000u, 60u, 36);
+    decimal += UNITS_DIV(minutes_frac * 1000u, 60u, 36);
+    return decimal > UNITS_GPS_COORD_MAX ? UNITS_GPS_COORD_MAX : (int32_t)decimal;
+}
+
+// Knots * 1000 to km/h * 10
+static inline uint16_t units_gps_speed(uint32_t frsky_speed) {
+    if (frsky_speed > UNITS_GPS_SPEED_INPUT_MAX) {
+        return 0xFFFF;
+    }
+    return (uint16_t)UNITS_DIV(frsky_speed * 1852u, 10000u, 43);
+}
+
+// Degrees * 100 to whole degrees
+static inline uint16_t units_gps_heading(uint32_t frsky_course) {
+    if (frsky_course > UNITS_GPS_HEADING_INPUT_MAX) {
+        return 0xFFFF;
+    }
+    return (uint16_t)UNITS_DIV(frsky_course, 100u, 30);
+}
+
+// Tenths to whole units, for the unsigned GPS altitude
+static inline uint16_t units_altitude_to_meters(uint32_t frsky_altitude) {
+    if (frsky_altitude > UNITS_ALTITUDE_INPUT_MAX) {
+        return 0xFFFF;
+    }
+    return (uint16_t)UNITS_DIV(frsky_altitude, 10u, 23);
+}
+
+// Signed tenths to whole units, rounded toward zero like C division
+static inline int32_t units_div10_signed(int32_t value) {
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    uint32_t quotient = UNITS_DIV(magnitude, 10u, 35);
+    return value < 0 ? -(int32_t)quotient : (int32_t)quotient;
+}
+
+// value * factor, saturated to 16 bits
+static inline uint16_t units_scale_u16(uint32_t value, uint16_t factor) {
+    return value > 0xFFFFu / factor ? 0xFFFF : (uint16_t)(value * factor);
+}
+
+// A signed 32-bit FrSky value saturated to 16 bits
+static inline int16_t units_saturate_s16(uint32_t value) {
+    int32_t signed_value = (int32_t)value;
+    if (signed_value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (signed_value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)signed_value;
+}
+
+#endif // UNITS_H
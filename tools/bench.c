@@ -0,0 +1,980 @@
+// Host benchmark suite for the protocol core.
+//
+// Usage: frsky_crsf_bench [--stream FILE] [--baseline FILE] [--write-baseline FILE]
+//                         [--tolerance PERCENT] [--write-capture FILE]
+//
+// Every case reports ns per unit (byte or frame) and frames/s. With
+// --baseline the result checksum of each case is compared against the
+// stored one and the run fails when a result changed. Timing is only
+// checked with --tolerance: each cost is scaled by how much slower or faster
+// the calibration case (BENCH_CALIBRATION_CASE) ran than in the baseline,
+// and the run fails when a case is more than PERCENT slower than that.
+// --stream takes raw S.PORT bytes or a capture (see sport_capture.h), whose
+// runs are concatenated. --write-capture stores the synthetic stream as a
+// capture at 57600 baud for sport_replay.
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "frsky_sport.h"
+#include "crsf.h"
+#include "telemetry_converter.h"
+#include "sport_capture.h"
+#include "config.h"
+#include "hal_host.h"
+#include "pipeline.h"
+#include "boot_phases.h"
+#include "crsf_link.h"
+#include "units.h"
+#include "derived_sensors.h"
+#include "freshness.h"
+#include "deferred_log.h"
+
+#define BENCH_SYNTHETIC_FRAMES 4096
+#define BENCH_SPAN_SIZE 64
+#define BENCH_UPLINK_FRAMES 4096
+#define BENCH_MAX_DECODERS 8
+#define BENCH_MIN_PASS_NS 200000000ull
+#define BENCH_REPEATS 5
+#define BENCH_MAX_CASES 32
+#define BENCH_CALIBRATION_CASE "crsf_crc8"
+#define BENCH_CAPTURE_BYTE_US 174u
+#define BENCH_BOOT_POLL_US 100u
+#define BENCH_BOOT_LIMIT_US 1000000u
+#define BENCH_PACKET_SPACING_US 1000u
+
+typedef struct {
+    uint64_t units;
+    uint64_t frames;
+} bench_result_t;
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    bench_result_t (*run)(uint32_t *checksum);
+} bench_case_t;
+
+typedef struct {
+    char name[64];
+    double ns_per_unit;
+    uint32_t checksum;
+} bench_baseline_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t length;
+} bench_stream_t;
+
+static bench_stream_t synthetic_stream;
+static bench_stream_t recorded_stream;
+static bench_stream_t uplink_stream;
+static frsky_sport_packet_t synthetic_packets[BENCH_SYNTHETIC_FRAMES];
+static size_t synthetic_packet_count;
+
+static const uint16_t bench_data_ids[] = {
+    FRSKY_ID_VFAS, FRSKY_ID_CURR, FRSKY_ID_VSPD, FRSKY_ID_ALT,
+    FRSKY_ID_GPS_LONG_LATI, FRSKY_ID_GPS_ALT, FRSKY_ID_GPS_SPEED,
+    FRSKY_ID_GPS_COURS, FRSKY_ID_FUEL, FRSKY_ID_RPM, FRSKY_ID_TEMP1
+};
+
+static uint32_t bench_rng_state = 0x12345678;
+
+static uint32_t bench_rand(void) {
+    uint32_t x = bench_rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    bench_rng_state = x;
+    return x;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t mix(uint32_t checksum, uint32_t value) {
+    return (checksum ^ value) * 16777619u;
+}
+
+// Append one byte-stuffed S.PORT frame to out, returns its length
+static size_t encode_sport_frame(uint8_t *out, uint8_t sensor_id, uint16_t data_id, uint32_t value) {
+    uint8_t raw[FRSKY_SPORT_PACKET_SIZE] = {
+        sensor_id, 0x10, (uint8_t)data_id, (uint8_t)(data_id >> 8),
+        (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24), 0
+    };
+    raw[FRSKY_SPORT_PACKET_SIZE - 1] = frsky_sport_crc(raw, FRSKY_SPORT_PACKET_SIZE - 1);
+
+    size_t length = 0;
+    out[length++] = FRSKY_SPORT_START_BYTE;
+    for (size_t i = 0; i < FRSKY_SPORT_PACKET_SIZE; i++) {
+        if (raw[i] == 0x7E || raw[i] == 0x7D) {
+            out[length++] = 0x7D;
+            out[length++] = raw[i] ^ 0x20;
+        } else {
+            out[length++] = raw[i];
+        }
+    }
+    return length;
+}
+
+// Synthetic bus traffic: valid frames for the known sensors, a few receiver
+// polls without answer and occasional line noise
+static void build_synthetic_stream(void) {
+    synthetic_stream.data = malloc(BENCH_SYNTHETIC_FRAMES * 32);
+    synthetic_stream.length = 0;
+
+    for (size_t i = 0; i < BENCH_SYNTHETIC_FRAMES; i++) {
+        uint8_t *out = &synthetic_stream.data[synthetic_stream.length];
+        uint32_t r = bench_rand();
+
+        if ((r & 0x0F) == 0) {
+            out[0] = FRSKY_SPORT_START_BYTE;
+            out[1] = (uint8_t)(r >> 8);
+            synthetic_stream.length += 2;
+        }
+
+        uint16_t data_id = bench_data_ids[bench_rand() % (sizeof(bench_data_ids) / sizeof(bench_data_ids[0]))];
+        uint32_t value = bench_rand();
+        out = &synthetic_stream.data[synthetic_stream.length];
+        synthetic_stream.length += encode_sport_frame(out, (uint8_t)(bench_rand() & 0x1F), data_id, value);
+
+        if ((r & 0xFF00) == 0) {
+            synthetic_stream.data[synthetic_stream.length++] = (uint8_t)(r >> 16);
+        }
+
+        frsky_sport_packet_t *packet = &synthetic_packets[synthetic_packet_count++];
+        packet->sensor_id = 0;
+        packet->frame_id = 0x10;
+        packet->data_id = data_id;
+        packet->value = value;
+        packet->valid = true;
+    }
+}
+
+// Receiver traffic on the CRSF RX line: RC frames, link statistics every
+// tenth frame, a few pings and timing frames and occasional line noise
+static void append_uplink_frame(uint8_t type, const uint8_t *payload, uint8_t length) {
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, &uplink_stream.data[uplink_stream.length], CRSF_MAX_PACKET_SIZE, type);
+    for (uint8_t i = 0; i < length; i++) {
+        crsf_writer_put_u8(&writer, payload[i]);
+    }
+    uplink_stream.length += crsf_writer_finish(&writer);
+}
+
+static void build_uplink_stream(void) {
+    uplink_stream.data = malloc(BENCH_UPLINK_FRAMES * (CRSF_MAX_PACKET_SIZE + 1));
+    uplink_stream.length = 0;
+
+    for (size_t i = 0; i < BENCH_UPLINK_FRAMES; i++) {
+        uint8_t payload[22];
+        uint32_t r = bench_rand();
+        for (size_t j = 0; j < sizeof(payload); j++) {
+            payload[j] = (uint8_t)bench_rand();
+        }
+        if (i % 10 == 9) {
+            append_uplink_frame(CRSF_FRAMETYPE_LINK_STATISTICS, payload, 10);
+        } else if ((r & 0xFF) == 0) {
+            const uint8_t ping[2] = { CRSF_ADDRESS_BROADCAST, CRSF_ADDRESS_RADIO_TRANSMITTER };
+            append_uplink_frame(CRSF_FRAMETYPE_DEVICE_PING, ping, sizeof(ping));
+        } else if ((r & 0xFF) == 1) {
+            const uint8_t timing[11] = { CRSF_ADDRESS_RADIO_TRANSMITTER, CRSF_ADDRESS_TRANSMITTER_MODULE,
+                                         CRSF_RADIO_ID_TIMING, 0, 0, 0x4E, 0x20, 0, 0, 0, 0 };
+            append_uplink_frame(CRSF_FRAMETYPE_RADIO_ID, timing, sizeof(timing));
+        } else {
+            append_uplink_frame(CRSF_FRAMETYPE_RC_CHANNELS_PACKED, payload, sizeof(payload));
+        }
+        if ((r & 0xFF00) == 0) {
+            uplink_stream.data[uplink_stream.length++] = (uint8_t)(r >> 16);
+        }
+    }
+}
+
+// Raw bytes, or the payload of every run when the file is a capture
+static bool load_stream(const char *path, bench_stream_t *stream) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(file);
+        return false;
+    }
+    stream->data = malloc((size_t)size);
+    stream->length = fread(stream->data, 1, (size_t)size, file);
+    fclose(file);
+
+    sport_capture_reader_t reader;
+    if (sport_capture_reader_init(&reader, stream->data, stream->length)) {
+        sport_capture_run_t run;
+        size_t length = 0;
+        while (sport_capture_next(&reader, &run)) {
+            memmove(&stream->data[length], run.data, run.length);
+            length += run.length;
+        }
+        stream->length = length;
+    }
+    return stream->length > 0;
+}
+
+// Synthetic stream as a capture, one record per span at line-rate timing
+static bool write_capture(const char *path, const bench_stream_t *stream) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+
+    uint8_t record[SPORT_CAPTURE_RECORD_OVERHEAD + BENCH_SPAN_SIZE];
+    sport_capture_writer_t writer;
+    sport_capture_writer_init(&writer);
+    fwrite(record, 1, sport_capture_write_header(record, sizeof(record)), file);
+
+    uint32_t time_us = 0;
+    for (size_t offset = 0; offset < stream->length; offset += BENCH_SPAN_SIZE) {
+        size_t length = stream->length - offset;
+        if (length > BENCH_SPAN_SIZE) {
+            length = BENCH_SPAN_SIZE;
+        }
+        time_us += (uint32_t)length * BENCH_CAPTURE_BYTE_US;
+        fwrite(record, 1, sport_capture_write_run(&writer, record, sizeof(record), time_us, 0,
+                                                  &stream->data[offset], length), file);
+    }
+    fwrite(record, 1, sport_capture_write_end(&writer, record, sizeof(record), time_us), file);
+    return fclose(file) == 0;
+}
+
+static bench_result_t run_process_byte(const bench_stream_t *stream, uint32_t *checksum) {
+    bench_result_t result = { stream->length, 0 };
+    frsky_sport_packet_t packet;
+
+    frsky_sport_init();
+    for (size_t i = 0; i < stream->length; i++) {
+        frsky_sport_process_byte(stream->data[i]);
+        if (frsky_sport_get_packet(&packet)) {
+            *checksum = mix(*checksum, packet.value);
+            result.frames++;
+        }
+    }
+    return result;
+}
+
+static bench_result_t bench_process_byte_synthetic(uint32_t *checksum) {
+    return run_process_byte(&synthetic_stream, checksum);
+}
+
+static bench_result_t bench_process_byte_recorded(uint32_t *checksum) {
+    return run_process_byte(&recorded_stream, checksum);
+}
+
+// Feed the stream in RX-ring sized spans and drain the packet queue after each
+static bench_result_t run_process_buffer(const bench_stream_t *stream, uint32_t *checksum) {
+    bench_result_t result = { stream->length, 0 };
+    frsky_sport_packet_t packets[FRSKY_SPORT_QUEUE_SIZE];
+
+    frsky_sport_init();
+    for (size_t offset = 0; offset < stream->length; offset += BENCH_SPAN_SIZE) {
+        size_t length = stream->length - offset;
+        frsky_sport_process_buffer(&stream->data[offset], length < BENCH_SPAN_SIZE ? length : BENCH_SPAN_SIZE);
+
+        size_t count = frsky_sport_get_packets(packets, FRSKY_SPORT_QUEUE_SIZE);
+        for (size_t i = 0; i < count; i++) {
+            *checksum = mix(*checksum, packets[i].value);
+        }
+        result.frames += count;
+    }
+    return result;
+}
+
+static bench_result_t bench_process_buffer_synthetic(uint32_t *checksum) {
+    return run_process_buffer(&synthetic_stream, checksum);
+}
+
+static bench_result_t bench_process_buffer_recorded(uint32_t *checksum) {
+    return run_process_buffer(&recorded_stream, checksum);
+}
+
+// Several independent decoders fed interleaved spans, each bus at its own
+// phase of the synthetic stream. ns/byte should not grow with the count.
+static bench_result_t run_interleaved(size_t instances, uint32_t *checksum) {
+    static frsky_sport_decoder_t decoders[BENCH_MAX_DECODERS];
+    bench_result_t result = { 0, 0 };
+    frsky_sport_packet_t packets[FRSKY_SPORT_QUEUE_SIZE];
+    const size_t stride = synthetic_stream.length / instances;
+
+    for (size_t d = 0; d < instances; d++) {
+        frsky_sport_decoder_init(&decoders[d], (uint8_t)d);
+    }
+
+    for (size_t offset = 0; offset < synthetic_stream.length; offset += BENCH_SPAN_SIZE) {
+        for (size_t d = 0; d < instances; d++) {
+            size_t start = (offset + d * stride) % synthetic_stream.length;
+            size_t length = synthetic_stream.length - start;
+            if (length > BENCH_SPAN_SIZE) {
+                length = BENCH_SPAN_SIZE;
+            }
+            frsky_sport_decoder_process_buffer(&decoders[d], &synthetic_stream.data[start], length);
+            result.units += length;
+
+            size_t count = frsky_sport_decoder_get_packets(&decoders[d], packets, FRSKY_SPORT_QUEUE_SIZE);
+            for (size_t i = 0; i < count; i++) {
+                *checksum = mix(*checksum, packets[i].value + packets[i].bus);
+            }
+            result.frames += count;
+        }
+    }
+    return result;
+}
+
+static bench_result_t bench_decoders_x1(uint32_t *checksum) {
+    return run_interleaved(1, checksum);
+}
+
+static bench_result_t bench_decoders_x2(uint32_t *checksum) {
+    return run_interleaved(2, checksum);
+}
+
+static bench_result_t bench_decoders_x4(uint32_t *checksum) {
+    return run_interleaved(4, checksum);
+}
+
+static bench_result_t bench_decoders_x8(uint32_t *checksum) {
+    return run_interleaved(8, checksum);
+}
+
+static bench_result_t bench_frsky_sport_crc(uint32_t *checksum) {
+    bench_result_t result = { 0, 0 };
+    const uint8_t *data = synthetic_stream.data;
+    size_t limit = synthetic_stream.length - FRSKY_SPORT_PACKET_SIZE;
+
+    for (size_t i = 0; i < limit; i += FRSKY_SPORT_PACKET_SIZE) {
+        *checksum = mix(*checksum, frsky_sport_crc(&data[i], FRSKY_SPORT_PACKET_SIZE - 1));
+        result.units += FRSKY_SPORT_PACKET_SIZE - 1;
+        result.frames++;
+    }
+    return result;
+}
+
+static bench_result_t bench_crsf_crc8(uint32_t *checksum) {
+    bench_result_t result = { 0, 0 };
+    const uint8_t *data = synthetic_stream.data;
+    const uint8_t length = CRSF_MAX_PACKET_SIZE - 2;
+    size_t limit = synthetic_stream.length - length;
+
+    for (size_t i = 0; i < limit; i += length) {
+        *checksum = mix(*checksum, crsf_crc8(&data[i], length));
+        result.units += length;
+        result.frames++;
+    }
+    return result;
+}
+
+static bench_result_t bench_crsf_create_packet(uint32_t *checksum) {
+    bench_result_t result = { 0, 0 };
+    crsf_packet_t packet;
+    const uint8_t *data = synthetic_stream.data;
+
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        uint8_t payload_size = (uint8_t)(i % 16);
+        if (crsf_create_packet(CRSF_FRAMETYPE_GPS, &data[i * 4], payload_size, &packet)) {
+            *checksum = mix(*checksum, packet.data[packet.length - 1]);
+            result.frames++;
+        }
+    }
+    result.units = result.frames;
+    return result;
+}
+
+// On the virtual clock, a packet every BENCH_PACKET_SPACING_US, so the
+// derived sensors integrate the same time steps on every run
+static bench_result_t bench_convert_frsky_to_crsf(uint32_t *checksum) {
+    bench_result_t result = { synthetic_packet_count, 0 };
+    crsf_packet_t packet;
+
+    hal_host_set_virtual_clock(true);
+    hal_host_set_time(0);
+    telemetry_converter_init();
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        hal_host_advance_time(BENCH_PACKET_SPACING_US);
+        frsky_sport_packet_t frsky_packet = synthetic_packets[i];
+        frsky_packet.timestamp_us = hal_time_us();
+        if (convert_frsky_to_crsf(&frsky_packet, &packet)) {
+            *checksum = mix(*checksum, packet.data[packet.length - 1]);
+            result.frames++;
+        }
+    }
+    hal_host_set_virtual_clock(false);
+    return result;
+}
+
+// Current and altitude samples alternating, 10 ms apart
+static bench_result_t bench_derived_sensors(uint32_t *checksum) {
+    bench_result_t result = { synthetic_packet_count, synthetic_packet_count };
+    derived_sensors_t derived;
+
+    derived_sensors_init(&derived);
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        uint32_t value = synthetic_packets[i].value;
+        uint32_t now = (uint32_t)i * 10000u;
+        if (i & 1) {
+            *checksum = mix(*checksum, (uint16_t)derived_sensors_altitude(&derived, (int32_t)(value >> 20), now));
+        } else {
+            *checksum = mix(*checksum, derived_sensors_current(&derived, (uint16_t)(value >> 16), now));
+        }
+    }
+    return result;
+}
+
+// A full wheel of sensor instances, each synthetic value touching one of
+// them 10 ms apart. Every 1024 values the other half of the instances
+// reports, so the quiet half expires meanwhile.
+static bench_result_t bench_freshness_wheel(uint32_t *checksum) {
+    bench_result_t result = { synthetic_packet_count, synthetic_packet_count };
+    freshness_t freshness;
+
+    freshness_init(&freshness, FRESHNESS_TICK_US, TELEMETRY_TIMEOUT_US, 0);
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        uint32_t value = synthetic_packets[i].value;
+        uint8_t half = FRESHNESS_MAX_ENTRIES / 2;
+        uint64_t expired = freshness_advance(&freshness, (uint32_t)i * 10000u);
+        freshness_touch(&freshness, (uint8_t)((value ^ (value >> 11)) % half + ((i >> 10) & 1) * half));
+        *checksum = mix(*checksum, (uint32_t)(expired ^ (expired >> 32)) ^ (uint32_t)freshness.fresh);
+    }
+    return result;
+}
+
+// Every synthetic packet logged as with DEBUG_FRSKY_PACKETS, the rings
+// drained every 64 records as core0's log task would. Only the recording
+// counts as the hot path cost; the draining is timed along with it.
+static bench_result_t bench_deferred_log(uint32_t *checksum) {
+    bench_result_t result = { synthetic_packet_count, synthetic_packet_count };
+    log_record_t record;
+
+    deferred_log_init();
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        const frsky_sport_packet_t *packet = &synthetic_packets[i];
+        DLOG3(LOG_FRSKY_PACKET, packet->bus, packet->data_id, packet->value);
+        if ((i & 63) == 63) {
+            while (deferred_log_pop(&record)) {
+                *checksum = mix(*checksum, record.id ^ record.args[1] ^ record.args[2]);
+            }
+        }
+    }
+    while (deferred_log_pop(&record)) {
+        *checksum = mix(*checksum, record.id ^ record.args[1] ^ record.args[2]);
+    }
+    return result;
+}
+
+// The same packets formatted on the spot, what the log replaces
+static bench_result_t bench_log_snprintf(uint32_t *checksum) {
+    bench_result_t result = { synthetic_packet_count, synthetic_packet_count };
+    char text[128];
+
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        const frsky_sport_packet_t *packet = &synthetic_packets[i];
+        int length = snprintf(text, sizeof(text), deferred_log_format_string(LOG_FRSKY_PACKET), packet->bus,
+                              packet->data_id, packet->value);
+        *checksum = mix(*checksum, (uint32_t)length ^ (uint8_t)text[length - 1]);
+    }
+    return result;
+}
+
+// Every synthetic value taken as an FLVSS cell pair
+static bench_result_t bench_frsky_cells_unpack(uint32_t *checksum) {
+    bench_result_t result = { synthetic_packet_count, synthetic_packet_count };
+
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        uint8_t first, count;
+        uint16_t mv[2];
+        frsky_cells_unpack(synthetic_packets[i].value, &first, &count, mv);
+        *checksum = mix(*checksum, ((uint32_t)mv[1] << 16 | mv[0]) ^ ((uint32_t)count << 4 | first));
+    }
+    return result;
+}
+
+// Each synthetic value through every unit conversion kernel
+static bench_result_t bench_units_convert(uint32_t *checksum) {
+    bench_result_t result = { 0, synthetic_packet_count };
+
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        uint32_t value = synthetic_packets[i].value;
+        uint32_t sum = (uint32_t)units_gps_to_decimal(value);
+        sum += units_gps_speed(value >> 12);
+        sum += units_gps_heading(value >> 9);
+        sum += units_altitude_to_meters(value >> 12);
+        sum += (uint32_t)units_div10_signed((int32_t)value);
+        sum += units_scale_u16(value >> 20, 100);
+        sum += (uint32_t)units_saturate_s16(value >> 16);
+        *checksum = mix(*checksum, sum);
+        result.units += 7;
+    }
+    return result;
+}
+
+// Frame serialization before the in-place writers: the payload struct is
+// copied as it sits in memory into a crsf_packet_t, the CRC taken over it
+// afterwards, and the packet copied into the transmit buffer. Kept here so
+// the in-place cases have something to be measured against.
+typedef struct {
+    int32_t latitude;
+    int32_t longitude;
+    uint16_t groundspeed;
+    uint16_t heading;
+    uint16_t altitude;
+    uint8_t satellites;
+} __attribute__((packed)) legacy_gps_t;
+
+typedef struct {
+    int16_t vertical_speed;
+} __attribute__((packed)) legacy_vario_t;
+
+typedef struct {
+    uint16_t voltage;
+    uint16_t current;
+    uint32_t capacity;
+    uint8_t remaining;
+} __attribute__((packed)) legacy_battery_t;
+
+typedef struct {
+    uint16_t altitude;
+    int16_t vertical_speed;
+} __attribute__((packed)) legacy_baro_alt_t;
+
+static bool legacy_create_packet(uint8_t type, const void *payload, uint8_t payload_size, crsf_packet_t *packet) {
+    if (payload_size > CRSF_MAX_PACKET_SIZE - 4) {
+        return false;
+    }
+    packet->data[0] = CRSF_ADDRESS_FLIGHT_CONTROLLER;
+    packet->data[1] = payload_size + 2;
+    packet->data[2] = type;
+    memcpy(&packet->data[3], payload, payload_size);
+    packet->data[3 + payload_size] = crsf_crc8(&packet->data[2], payload_size + 1);
+    packet->length = 4 + payload_size;
+    return true;
+}
+
+typedef enum {
+    BENCH_FRAME_GPS,
+    BENCH_FRAME_BATTERY,
+    BENCH_FRAME_VARIO,
+    BENCH_FRAME_BARO_ALT
+} bench_frame_t;
+
+// Old path for one frame type, the fields taken from each packet's value
+static bench_result_t run_frames_legacy(bench_frame_t type, uint32_t *checksum) {
+    bench_result_t result = { 0, 0 };
+    uint8_t tx_buffer[CRSF_TX_RESERVE_SIZE];
+
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        uint32_t value = synthetic_packets[i].value;
+        crsf_packet_t packet;
+        bool created;
+        if (type == BENCH_FRAME_GPS) {
+            legacy_gps_t gps = {
+                (int32_t)value, (int32_t)~value, (uint16_t)value, (uint16_t)(value >> 16), (uint16_t)(value >> 8),
+                (uint8_t)value
+            };
+            created = legacy_create_packet(CRSF_FRAMETYPE_GPS, &gps, sizeof(gps), &packet);
+        } else if (type == BENCH_FRAME_BATTERY) {
+            legacy_battery_t battery = { (uint16_t)value, (uint16_t)(value >> 16), value, (uint8_t)value };
+            created = legacy_create_packet(CRSF_FRAMETYPE_BATTERY_SENSOR, &battery, sizeof(battery), &packet);
+        } else if (type == BENCH_FRAME_VARIO) {
+            legacy_vario_t vario = { (int16_t)value };
+            created = legacy_create_packet(CRSF_FRAMETYPE_VARIO, &vario, sizeof(vario), &packet);
+        } else {
+            legacy_baro_alt_t baro = { (uint16_t)(value >> 4), (int16_t)(value >> 12) };
+            created = legacy_create_packet(CRSF_FRAMETYPE_BARO_ALT, &baro, sizeof(baro), &packet);
+        }
+        if (created) {
+            memcpy(tx_buffer, packet.data, packet.length);
+            *checksum = mix(*checksum, tx_buffer[packet.length - 1]);
+            result.frames++;
+        }
+    }
+    result.units = result.frames;
+    return result;
+}
+
+// Current path: the same fields serialized straight into the transmit buffer
+static bench_result_t run_frames_in_place(bench_frame_t type, uint32_t *checksum) {
+    bench_result_t result = { 0, 0 };
+    uint8_t tx_buffer[CRSF_TX_RESERVE_SIZE];
+
+    for (size_t i = 0; i < synthetic_packet_count; i++) {
+        uint32_t value = synthetic_packets[i].value;
+        uint8_t length;
+        if (type == BENCH_FRAME_GPS) {
+            crsf_gps_t gps = {
+                (int32_t)value, (int32_t)~value, (uint16_t)value, (uint16_t)(value >> 16), (uint16_t)(value >> 8),
+                (uint8_t)value
+            };
+            length = crsf_write_gps(tx_buffer, sizeof(tx_buffer), &gps);
+        } else if (type == BENCH_FRAME_BATTERY) {
+            crsf_battery_t battery = { (uint16_t)value, (uint16_t)(value >> 16), value, (uint8_t)value };
+            length = crsf_write_battery(tx_buffer, sizeof(tx_buffer), &battery);
+        } else if (type == BENCH_FRAME_VARIO) {
+            crsf_vario_t vario = { (int16_t)value };
+            length = crsf_write_vario(tx_buffer, sizeof(tx_buffer), &vario);
+        } else {
+            crsf_baro_alt_t baro = { (uint16_t)(value >> 4), (int16_t)(value >> 12) };
+            length = crsf_write_baro_alt(tx_buffer, sizeof(tx_buffer), &baro);
+        }
+        if (length) {
+            *checksum = mix(*checksum, tx_buffer[length - 1]);
+            result.frames++;
+        }
+    }
+    result.units = result.frames;
+    return result;
+}
+
+static bench_result_t bench_gps_legacy(uint32_t *checksum) {
+    return run_frames_legacy(BENCH_FRAME_GPS, checksum);
+}
+
+static bench_result_t bench_gps_in_place(uint32_t *checksum) {
+    return run_frames_in_place(BENCH_FRAME_GPS, checksum);
+}
+
+static bench_result_t bench_battery_legacy(uint32_t *checksum) {
+    return run_frames_legacy(BENCH_FRAME_BATTERY, checksum);
+}
+
+static bench_result_t bench_battery_in_place(uint32_t *checksum) {
+    return run_frames_in_place(BENCH_FRAME_BATTERY, checksum);
+}
+
+static bench_result_t bench_vario_legacy(uint32_t *checksum) {
+    return run_frames_legacy(BENCH_FRAME_VARIO, checksum);
+}
+
+static bench_result_t bench_vario_in_place(uint32_t *checksum) {
+    return run_frames_in_place(BENCH_FRAME_VARIO, checksum);
+}
+
+static bench_result_t bench_baro_alt_legacy(uint32_t *checksum) {
+    return run_frames_legacy(BENCH_FRAME_BARO_ALT, checksum);
+}
+
+static bench_result_t bench_baro_alt_in_place(uint32_t *checksum) {
+    return run_frames_in_place(BENCH_FRAME_BARO_ALT, checksum);
+}
+
+// CRSF uplink parser, fed in spans of 64 bytes at 4 ms virtual spacing
+static bench_result_t bench_crsf_link_parse(uint32_t *checksum) {
+    bench_result_t result = { 0, 0 };
+    static crsf_link_t link;
+    crsf_link_init(&link, CRSF_BAUD_RATE, 0);
+
+    uint32_t time_us = 0;
+    for (size_t offset = 0; offset < uplink_stream.length; offset += BENCH_SPAN_SIZE) {
+        size_t length = uplink_stream.length - offset;
+        if (length > BENCH_SPAN_SIZE) {
+            length = BENCH_SPAN_SIZE;
+        }
+        time_us += 4000;
+        crsf_link_process_buffer_at(&link, &uplink_stream.data[offset], length, time_us);
+        uint8_t origin;
+        if (crsf_link_take_ping(&link, &origin)) {
+            *checksum = mix(*checksum, origin);
+        }
+    }
+
+    *checksum = mix(*checksum, link.rx.frames);
+    *checksum = mix(*checksum, link.rx.crc_errors);
+    *checksum = mix(*checksum, link.rx.rc_frames);
+    *checksum = mix(*checksum, link.rx.link_statistics);
+    *checksum = mix(*checksum, link.rx.pings);
+    *checksum = mix(*checksum, link.interval_us);
+    result.units = uplink_stream.length;
+    result.frames = link.rx.frames;
+    return result;
+}
+
+// Cold start of the pipeline on the host HAL's virtual clock: CRSF up
+// first, then S.PORT bytes arriving at line rate until the first converted
+// sensor frame goes out. The virtual phase times go into the checksum, so
+// a slower boot path shows up as a changed result.
+static bench_result_t bench_boot_to_first_sensor_frame(uint32_t *checksum) {
+    bench_result_t result = { 0, 0 };
+    hal_host_reset();
+    hal_host_set_virtual_clock(true);
+    boot_phases_reset();
+    boot_phase_mark(BOOT_PHASE_CONFIG_LOADED);
+    boot_phase_mark(BOOT_PHASE_PIPELINE_START);
+
+    hal_uart_config_t crsf = { CRSF_BAUD_RATE, CRSF_TX_PIN, CRSF_RX_PIN };
+    hal_uart_config_t frsky = { FRSKY_BAUD_RATE, FRSKY_TX_PIN, FRSKY_RX_PIN };
+    hal_uart_init(HAL_UART_CRSF, &crsf);
+    boot_phase_mark(BOOT_PHASE_CRSF_READY);
+    hal_uart_init(HAL_UART_SPORT(0), &frsky);
+
+    static pipeline_t pipeline;
+    pipeline_init(&pipeline, NULL, HEARTBEAT_INTERVAL_US, FRSKY_BAUD_RATE);
+    size_t offset = 0;
+    for (uint32_t now = 0; now < BENCH_BOOT_LIMIT_US && !boot_phase_reached(BOOT_PHASE_FIRST_SENSOR_FRAME);
+         now += BENCH_BOOT_POLL_US) {
+        hal_host_set_time(now);
+        size_t arrived = now / BENCH_CAPTURE_BYTE_US;
+        if (arrived > offset && arrived <= synthetic_stream.length) {
+            hal_host_uart_inject(HAL_UART_SPORT(0), &synthetic_stream.data[offset], arrived - offset);
+            offset = arrived;
+        }
+        pipeline_poll(&pipeline, now);
+    }
+    hal_host_set_virtual_clock(false);
+
+    for (int phase = 0; phase < BOOT_PHASE_COUNT; phase++) {
+        if (boot_phase_reached((boot_phase_t)phase)) {
+            *checksum = mix(*checksum, boot_phase_time_us((boot_phase_t)phase));
+        }
+    }
+    result.units = 1;
+    result.frames = boot_phase_reached(BOOT_PHASE_FIRST_SENSOR_FRAME) ? 1 : 0;
+    return result;
+}
+
+static bench_case_t bench_cases[BENCH_MAX_CASES] = {
+    { "frsky_sport_process_byte", "byte", bench_process_byte_synthetic },
+    { "frsky_sport_process_buffer", "byte", bench_process_buffer_synthetic },
+    { "frsky_sport_decoders_x1", "byte", bench_decoders_x1 },
+    { "frsky_sport_decoders_x2", "byte", bench_decoders_x2 },
+    { "frsky_sport_decoders_x4", "byte", bench_decoders_x4 },
+    { "frsky_sport_decoders_x8", "byte", bench_decoders_x8 },
+    { "frsky_sport_crc", "byte", bench_frsky_sport_crc },
+    { "crsf_crc8", "byte", bench_crsf_crc8 },
+    { "crsf_create_packet", "frame", bench_crsf_create_packet },
+    { "convert_frsky_to_crsf", "frame", bench_convert_frsky_to_crsf },
+    { "crsf_gps_legacy", "frame", bench_gps_legacy },
+    { "crsf_gps_in_place", "frame", bench_gps_in_place },
+    { "crsf_battery_legacy", "frame", bench_battery_legacy },
+    { "crsf_battery_in_place", "frame", bench_battery_in_place },
+    { "crsf_vario_legacy", "frame", bench_vario_legacy },
+    { "crsf_vario_in_place", "frame", bench_vario_in_place },
+    { "crsf_baro_alt_legacy", "frame", bench_baro_alt_legacy },
+    { "crsf_baro_alt_in_place", "frame", bench_baro_alt_in_place },
+    { "boot_to_first_sensor_frame", "boot", bench_boot_to_first_sensor_frame },
+    { "crsf_link_parse", "byte", bench_crsf_link_parse },
+    { "frsky_cells_unpack", "frame", bench_frsky_cells_unpack },
+    { "units_convert", "conversion", bench_units_convert },
+    { "derived_sensors", "sample", bench_derived_sensors },
+    { "freshness_wheel", "touch", bench_freshness_wheel },
+    { "deferred_log", "record", bench_deferred_log },
+    { "log_snprintf", "record", bench_log_snprintf },
+};
+static size_t bench_case_count = 26;
+
+// Best-of-N ns per unit for one case
+static double measure(const bench_case_t *bench, uint32_t *checksum, double *frames_per_s) {
+    double best = 0.0;
+
+    *checksum = 2166136261u;
+    bench->run(checksum);
+
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        uint64_t units = 0;
+        uint64_t frames = 0;
+        uint64_t start = now_ns();
+        uint64_t elapsed;
+        do {
+            uint32_t scratch = 0;
+            bench_result_t result = bench->run(&scratch);
+            units += result.units;
+            frames += result.frames;
+            elapsed = now_ns() - start;
+        } while (elapsed < BENCH_MIN_PASS_NS);
+
+        double ns_per_unit = units ? (double)elapsed / (double)units : 0.0;
+        if (repeat == 0 || ns_per_unit < best) {
+            best = ns_per_unit;
+            *frames_per_s = frames * 1e9 / (double)elapsed;
+        }
+    }
+    return best;
+}
+
+static size_t load_baseline(const char *path, bench_baseline_t *baseline, size_t capacity) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+
+    char line[256];
+    size_t count = 0;
+    while (count < capacity && fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        bench_baseline_t *entry = &baseline[count];
+        if (sscanf(line, "%63s %lf %x", entry->name, &entry->ns_per_unit, &entry->checksum) == 3) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static const bench_baseline_t *find_baseline(const bench_baseline_t *baseline, size_t count, const char *name) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(baseline[i].name, name) == 0) {
+            return &baseline[i];
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--stream FILE] [--baseline FILE] [--write-baseline FILE] [--tolerance PERCENT]\n"
+                    "          [--write-capture FILE]\n", program);
+}
+
+int main(int argc, char **argv) {
+    const char *stream_path = NULL;
+    const char *baseline_path = NULL;
+    const char *write_path = NULL;
+    const char *capture_path = NULL;
+    double tolerance = -1.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            stream_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--write-baseline") == 0 && i + 1 < argc) {
+            write_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--write-capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    build_synthetic_stream();
+    build_uplink_stream();
+
+    if (capture_path) {
+        if (!write_capture(capture_path, &synthetic_stream)) {
+            fprintf(stderr, "Cannot write capture %s\n", capture_path);
+            return 2;
+        }
+        return 0;
+    }
+
+    if (stream_path) {
+        if (!load_stream(stream_path, &recorded_stream)) {
+            fprintf(stderr, "Cannot read stream %s\n", stream_path);
+            return 2;
+        }
+        bench_cases[bench_case_count++] = (bench_case_t){
+            "frsky_sport_process_byte_recorded", "byte", bench_process_byte_recorded
+        };
+        bench_cases[bench_case_count++] = (bench_case_t){
+            "frsky_sport_process_buffer_recorded", "byte", bench_process_buffer_recorded
+        };
+    }
+
+    bench_baseline_t baseline[BENCH_MAX_CASES];
+    size_t baseline_count = 0;
+    if (baseline_path) {
+        baseline_count = load_baseline(baseline_path, baseline, BENCH_MAX_CASES);
+        if (baseline_count == 0) {
+            fprintf(stderr, "Cannot read baseline %s\n", baseline_path);
+            return 2;
+        }
+    }
+
+    FILE *write_file = NULL;
+    if (write_path) {
+        write_file = fopen(write_path, "w");
+        if (!write_file) {
+            fprintf(stderr, "Cannot write baseline %s\n", write_path);
+            return 2;
+        }
+        fprintf(write_file, "# name  ns_per_unit  checksum\n");
+    }
+
+    // Machine speed relative to the baseline, from the calibration case
+    double speed = 1.0;
+    uint32_t calibration_checksum = 0;
+    double calibration_frames_per_s = 0.0;
+    double calibration_ns = 0.0;
+    const bench_baseline_t *calibration = find_baseline(baseline, baseline_count, BENCH_CALIBRATION_CASE);
+    bool timed = tolerance >= 0.0 && calibration && calibration->ns_per_unit > 0.0;
+    if (tolerance >= 0.0 && !timed) {
+        fprintf(stderr, "No baseline for %s, timing not checked\n", BENCH_CALIBRATION_CASE);
+    }
+    if (timed) {
+        for (size_t i = 0; i < bench_case_count; i++) {
+            if (strcmp(bench_cases[i].name, BENCH_CALIBRATION_CASE) == 0) {
+                calibration_ns = measure(&bench_cases[i], &calibration_checksum, &calibration_frames_per_s);
+                speed = calibration_ns / calibration->ns_per_unit;
+            }
+        }
+        printf("Timing scaled by %.2f from %s, %.0f%% tolerance\n\n", speed, BENCH_CALIBRATION_CASE, tolerance);
+    }
+
+    int failures = 0;
+    printf("%-40s %12s %14s %10s  %s\n", "benchmark", "ns/unit", "frames/s", "checksum", "status");
+
+    for (size_t i = 0; i < bench_case_count; i++) {
+        const bench_case_t *bench = &bench_cases[i];
+        uint32_t checksum;
+        double frames_per_s = 0.0;
+        double ns_per_unit;
+        if (timed && strcmp(bench->name, BENCH_CALIBRATION_CASE) == 0) {
+            ns_per_unit = calibration_ns;
+            checksum = calibration_checksum;
+            frames_per_s = calibration_frames_per_s;
+        } else {
+            ns_per_unit = measure(bench, &checksum, &frames_per_s);
+        }
+
+        const char *status = "";
+        const bench_baseline_t *reference = find_baseline(baseline, baseline_count, bench->name);
+        if (reference) {
+            if (reference->checksum != checksum) {
+                status = "FAIL (result changed)";
+                failures++;
+            } else if (timed && ns_per_unit > reference->ns_per_unit * speed * (1.0 + tolerance / 100.0)) {
+                status = "FAIL (slower than baseline)";
+                failures++;
+            } else {
+                status = "ok";
+            }
+        } else if (baseline_path) {
+            status = "no baseline";
+        }
+
+        char label[64];
+        snprintf(label, sizeof(label), "%s [ns/%s]", bench->name, bench->unit);
+        printf("%-40s %12.2f %14.0f %10x  %s\n", label, ns_per_unit, frames_per_s, checksum, status);
+
+        if (write_file) {
+            fprintf(write_file, "%s %.2f %x\n", bench->name, ns_per_unit, checksum);
+        }
+    }
+
+    if (write_file) {
+        fclose(write_file);
+    }
+
+    uint32_t boot_checksum = 0;
+    bench_boot_to_first_sensor_frame(&boot_checksum);
+    printf("\nBoot (virtual time): first CRSF frame at %u us, first sensor frame at %u us\n",
+           boot_phase_time_us(BOOT_PHASE_FIRST_FRAME), boot_phase_time_us(BOOT_PHASE_FIRST_SENSOR_FRAME));
+
+    if (failures > 0) {
+        printf("%d benchmark(s) regressed\n", failures);
+        return 1;
+    }
+    return 0;
+}
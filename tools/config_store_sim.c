@@ -0,0 +1,149 @@
+// Power-failure test of the configuration store on the host flash.
+//
+// Usage: config_store_sim [CYCLES]
+//
+// Each cycle boots the store from the simulated flash, checks that it loads
+// either the last configuration that was saved successfully or the one
+// whose save was cut off, then saves a few new configurations. In half the
+// cycles power fails after a random number of flash bytes, in the middle of
+// an erase or program. Reports saves, erases per sector, the boot scan time
+// and any cycle that loaded something else; exits with 1 if there was one.
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hal_host.h"
+#include "config_store.h"
+
+#define SIM_OFFSET (256u * 1024u)
+#define SIM_SECTORS 4
+#define SIM_DEFAULT_CYCLES 20000
+
+typedef struct {
+    uint16_t schema;
+    size_t length;
+    uint8_t data[CONFIG_STORE_MAX_PAYLOAD];
+} sim_config_t;
+
+static uint32_t sim_rng_state = 0xC0FFEE;
+
+static uint32_t sim_rand(void) {
+    uint32_t x = sim_rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim_rng_state = x;
+    return x;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void make_config(sim_config_t *config, uint32_t serial) {
+    config->schema = (uint16_t)(1 + serial % 3);
+    config->length = 4 + sim_rand() % (CONFIG_STORE_MAX_PAYLOAD - 4);
+    memcpy(config->data, &serial, 4);
+    for (size_t i = 4; i < config->length; i++) {
+        config->data[i] = (uint8_t)sim_rand();
+    }
+}
+
+static bool same_config(const sim_config_t *config, uint16_t schema, const uint8_t *data, size_t length) {
+    return config->schema == schema && config->length == length && memcmp(config->data, data, length) == 0;
+}
+
+int main(int argc, char **argv) {
+    long cycles = argc > 1 ? atol(argv[1]) : SIM_DEFAULT_CYCLES;
+    if (cycles <= 0) {
+        fprintf(stderr, "Usage: %s [CYCLES]\n", argv[0]);
+        return 2;
+    }
+
+    hal_host_reset();
+    static sim_config_t committed;
+    static sim_config_t attempted;
+    bool have_committed = false;
+    bool have_attempted = false;
+    uint32_t serial = 0;
+    uint64_t saves = 0;
+    uint64_t power_failures = 0;
+    uint64_t lost_saves = 0;
+    uint64_t erases[SIM_SECTORS] = { 0 };
+    uint64_t scan_total_ns = 0;
+    uint64_t scan_max_ns = 0;
+    long bad_cycles = 0;
+
+    for (long cycle = 0; cycle < cycles; cycle++) {
+        hal_host_flash_fail_after(-1);
+        config_store_t store;
+        uint64_t scan_start = now_ns();
+        config_store_init(&store, SIM_OFFSET, SIM_SECTORS);
+        uint64_t scan_ns = now_ns() - scan_start;
+        scan_total_ns += scan_ns;
+        if (scan_ns > scan_max_ns) {
+            scan_max_ns = scan_ns;
+        }
+
+        uint8_t data[CONFIG_STORE_MAX_PAYLOAD];
+        uint16_t schema = 0;
+        size_t length = 0;
+        bool loaded = config_store_load(&store, data, sizeof(data), &schema, &length);
+        bool as_committed = loaded && have_committed && same_config(&committed, schema, data, length);
+        bool as_attempted = loaded && have_attempted && same_config(&attempted, schema, data, length);
+        if (as_attempted) {
+            committed = attempted;
+            have_committed = true;
+        } else if (!as_committed && (loaded || have_committed)) {
+            uint32_t expected = 0;
+            memcpy(&expected, committed.data, sizeof(expected));
+            if (bad_cycles++ < 10) {
+                printf("cycle %ld: loaded %s, expected serial %u\n", cycle, loaded ? "an unknown record" : "nothing",
+                       expected);
+            }
+        } else if (have_attempted) {
+            lost_saves++;
+        }
+        have_attempted = false;
+
+        if (sim_rand() % 2) {
+            hal_host_flash_fail_after((int32_t)(sim_rand() % (HAL_FLASH_SECTOR_SIZE + 2 * CONFIG_STORE_RECORD_SIZE)));
+        }
+        uint32_t writes = 1 + sim_rand() % 5;
+        for (uint32_t i = 0; i < writes; i++) {
+            make_config(&attempted, ++serial);
+            have_attempted = true;
+            uint32_t erases_before = store.erases;
+            bool saved = config_store_save(&store, attempted.schema, attempted.data, attempted.length);
+            if (store.erases != erases_before) {
+                erases[store.sector]++;
+            }
+            if (hal_host_flash_failed()) {
+                power_failures++;
+                break;
+            }
+            if (!saved) {
+                printf("cycle %ld: save failed without a power failure\n", cycle);
+                bad_cycles++;
+                break;
+            }
+            saves++;
+            committed = attempted;
+            have_committed = true;
+            have_attempted = false;
+        }
+    }
+
+    printf("%ld boot cycles, %llu saves, %llu power failures (%llu lost the save in flight)\n", cycles,
+           (unsigned long long)saves, (unsigned long long)power_failures, (unsigned long long)lost_saves);
+    printf("Erases per sector:");
+    for (int i = 0; i < SIM_SECTORS; i++) {
+        printf(" %llu", (unsigned long long)erases[i]);
+    }
+    printf("\nBoot scan: avg %.1f us, max %.1f us\n", scan_total_ns / 1000.0 / (double)cycles, scan_max_ns / 1000.0);
+    printf("%ld cycles loaded a wrong configuration: %s\n", bad_cycles, bad_cycles ? "FAIL" : "ok");
+    return bad_cycles ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+// Host check of the CRSF frame writers in crsf.h.
+//
+// Usage: crsf_frame_verify
+//
+// Builds frames with the in-place writers and compares every byte against
+// frames written out by hand: multi-byte fields big-endian, the battery
+// capacity in 24 bits and clamped above that, and CRCs computed outside
+// this code. Also checks that a frame which does not fit its buffer is
+// refused. Prints every failed check; exits with 1 if there was one.
+#include <stdio.h>
+#include <string.h>
+#include "crsf.h"
+
+static unsigned failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Compares a written frame with the expected bytes, printing both on a mismatch
+static void check_frame(const uint8_t *frame, uint8_t length, const uint8_t *expected, size_t expected_length,
+                        const char *what) {
+    bool same = length == expected_length && memcmp(frame, expected, expected_length) == 0;
+    check(same, what);
+    if (!same) {
+        printf("  got     ");
+        for (uint8_t i = 0; i < length; i++) {
+            printf(" %02X", frame[i]);
+        }
+        printf("\n  expected");
+        for (size_t i = 0; i < expected_length; i++) {
+            printf(" %02X", expected[i]);
+        }
+        printf("\n");
+    }
+}
+
+// 12.34 km/h, 270 degrees, 500 m, 12 satellites, with a western longitude
+// so a negative field goes out too
+static void verify_gps(void) {
+    static const uint8_t expected[] = {
+        0xC8, 0x11, 0x02,
+        0x1C, 0x40, 0x52, 0x4C,                       // latitude 473977420
+        0xB7, 0x23, 0x5D, 0xC8,                       // longitude -1222419000
+        0x04, 0xD2,                                   // groundspeed 1234
+        0x69, 0x78,                                   // heading 27000
+        0x05, 0xDC,                                   // altitude 1500
+        0x0C,                                         // satellites
+        0xF0
+    };
+    crsf_gps_t gps = {
+        .latitude = 473977420, .longitude = -1222419000, .groundspeed = 1234, .heading = 27000,
+        .altitude = 1500, .satellites = 12
+    };
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    uint8_t length = crsf_write_gps(frame, sizeof(frame), &gps);
+    check_frame(frame, length, expected, sizeof(expected), "GPS frame bytes");
+    check(crsf_write_gps(frame, sizeof(expected) - 1, &gps) == 0, "a GPS frame one byte short is refused");
+    check(crsf_write_gps(frame, sizeof(expected), &gps) == sizeof(expected), "a GPS frame fits its exact size");
+}
+
+static void verify_battery(void) {
+    static const uint8_t expected[] = {
+        0xC8, 0x0A, 0x08,
+        0x0A, 0x8C,                                   // voltage
+        0x01, 0x23,                                   // current
+        0x01, 0x23, 0x45,                             // capacity, 24 bits
+        0x57,                                         // remaining 87 %
+        0x96
+    };
+    crsf_battery_t battery = { .voltage = 0x0A8C, .current = 0x0123, .capacity = 0x012345, .remaining = 87 };
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    uint8_t length = crsf_write_battery(frame, sizeof(frame), &battery);
+    check_frame(frame, length, expected, sizeof(expected), "battery frame bytes");
+
+    static const uint8_t clamped[] = {
+        0xC8, 0x0A, 0x08, 0x0A, 0x8C, 0x01, 0x23, 0xFF, 0xFF, 0xFF, 0x57, 0xF1
+    };
+    battery.capacity = 0x01000000;
+    length = crsf_write_battery(frame, sizeof(frame), &battery);
+    check_frame(frame, length, clamped, sizeof(clamped), "a capacity above 24 bits is clamped");
+}
+
+// The CRC written in place must match crsf_crc8 over type and payload
+static void verify_crc(void) {
+    crsf_gps_t gps = { .latitude = -1, .longitude = 0x7FFFFFFF, .groundspeed = 0xFFFF, .satellites = 0xFF };
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    uint8_t length = crsf_write_gps(frame, sizeof(frame), &gps);
+    check(length > 4 && frame[length - 1] == crsf_crc8(&frame[2], (uint8_t)(length - 3)),
+          "the in-place CRC matches crsf_crc8");
+    check(frame[1] == length - 2, "the length byte counts type, payload and CRC");
+}
+
+int main(void) {
+    verify_gps();
+    verify_battery();
+    verify_crc();
+    printf("CRSF frame checks: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
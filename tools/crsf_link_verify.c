@@ -0,0 +1,258 @@
+// Host check of the CRSF receive parser and downlink pacing in crsf_link.h.
+//
+// Usage: crsf_link_verify
+//
+// Feeds known frames byte by byte through crsf_link_process_byte: device
+// pings to the flight controller, to broadcast and to another device, link
+// statistics, a 0x3A/0x10 timing frame, a frame failing its CRC and a bad
+// length byte followed by a good frame that must still be found. Then the
+// frame interval estimated from RC frame spacing, and the pacing credit:
+// one frame per slot, the wait for the next one, bursts after idle time, no
+// pacing without a receiver, and a burst after an idle second that stays
+// within CRSF_PACING_BURST when the interval has just shrunk. Prints every
+// failed check; exits with 1 if there was one.
+#include <stdio.h>
+#include <string.h>
+#include "crsf_link.h"
+
+static unsigned failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Address, length, type, payload and CRC; returns the frame length
+static uint8_t build_frame(uint8_t address, uint8_t type, const uint8_t *payload, uint8_t payload_length,
+                           uint8_t *frame) {
+    frame[0] = address;
+    frame[1] = (uint8_t)(payload_length + 2);
+    frame[2] = type;
+    memcpy(&frame[3], payload, payload_length);
+    frame[3 + payload_length] = crsf_crc8(&frame[2], (uint8_t)(payload_length + 1));
+    return (uint8_t)(payload_length + 4);
+}
+
+static void feed(crsf_link_t *link, const uint8_t *data, size_t length, uint32_t time_us) {
+    for (size_t i = 0; i < length; i++) {
+        crsf_link_process_byte(link, data[i], time_us);
+    }
+}
+
+static void send_ping(crsf_link_t *link, uint8_t destination, uint8_t origin, uint32_t time_us) {
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    const uint8_t payload[] = { destination, origin };
+    feed(link, frame, build_frame(CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_FRAMETYPE_DEVICE_PING, payload, 2, frame),
+         time_us);
+}
+
+// Timing frame from the receiver, interval in units of 0.1 us
+static void send_timing(crsf_link_t *link, uint32_t interval_tenths, uint32_t time_us) {
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    const uint8_t payload[] = {
+        CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_ADDRESS_RECEIVER, CRSF_RADIO_ID_TIMING,
+        (uint8_t)(interval_tenths >> 24), (uint8_t)(interval_tenths >> 16), (uint8_t)(interval_tenths >> 8),
+        (uint8_t)interval_tenths, 0, 0, 0, 0
+    };
+    feed(link, frame, build_frame(CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_FRAMETYPE_RADIO_ID, payload,
+                                  sizeof(payload), frame), time_us);
+}
+
+static void send_rc(crsf_link_t *link, uint32_t time_us) {
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    uint8_t channels[22];
+    memset(channels, 0x55, sizeof(channels));
+    feed(link, frame, build_frame(CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_FRAMETYPE_RC_CHANNELS_PACKED, channels,
+                                  sizeof(channels), frame), time_us);
+}
+
+// Frames that may go out back to back at now, sending each
+static unsigned burst(crsf_link_t *link, uint32_t now) {
+    unsigned count = 0;
+    while (count < 1000 && crsf_link_may_send(link, now)) {
+        crsf_link_sent(link, now);
+        count++;
+    }
+    return count;
+}
+
+static void verify_pings(void) {
+    crsf_link_t link;
+    crsf_link_init(&link, CRSF_BAUD_RATE, 0);
+    uint8_t origin = 0;
+
+    send_ping(&link, CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_ADDRESS_RADIO_TRANSMITTER, 100);
+    check(crsf_link_take_ping(&link, &origin) && origin == CRSF_ADDRESS_RADIO_TRANSMITTER,
+          "a ping to the flight controller is answered to its origin");
+    check(!crsf_link_take_ping(&link, &origin), "a ping is answered once");
+
+    send_ping(&link, CRSF_ADDRESS_BROADCAST, CRSF_ADDRESS_RECEIVER, 200);
+    check(crsf_link_take_ping(&link, &origin) && origin == CRSF_ADDRESS_RECEIVER, "a broadcast ping is answered");
+
+    send_ping(&link, CRSF_ADDRESS_TRANSMITTER_MODULE, CRSF_ADDRESS_RECEIVER, 300);
+    check(!crsf_link_take_ping(&link, &origin), "a ping to another device is not answered");
+    check(link.rx.pings == 3 && link.rx.frames == 3, "every ping is counted");
+}
+
+static void verify_link_statistics(void) {
+    crsf_link_t link;
+    crsf_link_init(&link, CRSF_BAUD_RATE, 0);
+    const uint8_t payload[10] = { 60, 62, 100, (uint8_t)-3, 1, 4, 2, 70, 98, 5 };
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    feed(&link, frame, build_frame(CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_FRAMETYPE_LINK_STATISTICS, payload, 10, frame),
+         1000);
+    check(link.statistics_valid && link.rx.link_statistics == 1, "link statistics taken");
+    check(link.statistics.uplink_rssi_1 == 60 && link.statistics.uplink_link_quality == 100 &&
+              link.statistics.uplink_snr == -3 && link.statistics.downlink_link_quality == 98 &&
+              link.statistics.downlink_snr == 5,
+          "link statistics fields");
+    check(link.last_rx_us == 1000, "receive time of the last frame");
+}
+
+static void verify_timing(void) {
+    crsf_link_t link;
+    crsf_link_init(&link, CRSF_BAUD_RATE, 0);
+    send_timing(&link, 40000, 1000);
+    check(link.rx.timing_frames == 1 && link.interval_us == 4000 && link.interval_from_timing,
+          "timing frame sets the interval");
+
+    send_rc(&link, 2000);
+    send_rc(&link, 9000);
+    check(link.interval_us == 4000, "RC spacing does not override the timing frame");
+
+    send_timing(&link, 5000, 10000);
+    check(link.rx.timing_frames == 2 && link.interval_us == 4000, "an interval below 1 ms is ignored");
+
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    const uint8_t other[] = { CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_ADDRESS_RECEIVER, 0x20, 0, 0, 0, 0, 0, 0, 0, 0 };
+    feed(&link, frame, build_frame(CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_FRAMETYPE_RADIO_ID, other, sizeof(other),
+                                   frame), 11000);
+    check(link.rx.timing_frames == 2 && link.rx.other == 1, "another radio ID subtype is not timing");
+}
+
+static void verify_bad_crc(void) {
+    crsf_link_t link;
+    crsf_link_init(&link, CRSF_BAUD_RATE, 0);
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    const uint8_t payload[] = { CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_ADDRESS_RECEIVER };
+    uint8_t length = build_frame(CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_FRAMETYPE_DEVICE_PING, payload, 2, frame);
+    frame[length - 1] ^= 0x01;
+    feed(&link, frame, length, 100);
+    uint8_t origin;
+    check(link.rx.crc_errors == 1 && link.rx.frames == 0 && !crsf_link_take_ping(&link, &origin),
+          "a frame failing its CRC is dropped");
+
+    frame[length - 1] ^= 0x01;
+    feed(&link, frame, length, 200);
+    check(link.rx.frames == 1 && crsf_link_take_ping(&link, &origin), "the next good frame is taken");
+}
+
+// A length byte out of range drops the address; the parser starts over at
+// the length byte itself, which here is an address again
+static void verify_bad_length(void) {
+    crsf_link_t link;
+    crsf_link_init(&link, CRSF_BAUD_RATE, 0);
+    const uint8_t garbage[] = { CRSF_ADDRESS_FLIGHT_CONTROLLER, 1, 0x33 };
+    feed(&link, garbage, sizeof(garbage), 100);
+    check(link.rx.bad_lengths == 1 && link.index == 0, "a length below 2 is refused");
+
+    uint8_t frame[CRSF_MAX_PACKET_SIZE + 1];
+    const uint8_t payload[] = { CRSF_ADDRESS_BROADCAST, CRSF_ADDRESS_RECEIVER };
+    frame[0] = CRSF_ADDRESS_FLIGHT_CONTROLLER;
+    uint8_t length = build_frame(CRSF_ADDRESS_FLIGHT_CONTROLLER, CRSF_FRAMETYPE_DEVICE_PING, payload, 2, &frame[1]);
+    feed(&link, frame, length + 1u, 200);
+    uint8_t origin;
+    check(link.rx.bad_lengths == 2, "an address as length byte is refused");
+    check(link.rx.frames == 1 && link.rx.crc_errors == 0 && crsf_link_take_ping(&link, &origin),
+          "the frame starting at the refused length byte is found");
+}
+
+static void verify_rc_spacing(void) {
+    crsf_link_t link;
+    crsf_link_init(&link, CRSF_BAUD_RATE, 0);
+    send_rc(&link, 10000);
+    check(link.interval_us == 0, "one RC frame gives no interval");
+    send_rc(&link, 14000);
+    check(link.interval_us == 4000, "the first spacing sets the interval");
+    send_rc(&link, 18800);
+    check(link.interval_us == 4100, "later spacings are averaged in by 1/8");
+    send_rc(&link, 218800);
+    check(link.interval_us == 4100, "a gap after lost frames is ignored");
+    send_rc(&link, 218900);
+    check(link.interval_us == 4100, "a spacing far below 1 ms is ignored");
+
+    uint32_t time_us = 218900;
+    for (int i = 0; i < 200; i++) {
+        time_us += i % 2 ? 3996 : 4004;
+        send_rc(&link, time_us);
+    }
+    check(link.interval_us >= 3996 && link.interval_us <= 4004, "jittered spacing settles on the interval");
+    check(link.rx.rc_frames == 205, "every RC frame counted");
+}
+
+static void verify_pacing(void) {
+    const uint32_t cost = 4000 * CRSF_PACING_INTERVALS_PER_FRAME;
+    crsf_link_t link;
+    crsf_link_init(&link, CRSF_BAUD_RATE, 0);
+    check(burst(&link, 0) == 1000, "not paced before the receiver is heard");
+
+    send_timing(&link, 40000, 0);
+    check(crsf_link_paced(&link, 0), "paced once the interval is known");
+    check(!crsf_link_may_send(&link, 0), "no credit at the start");
+    check(!crsf_link_may_send(&link, cost - 1), "no credit before a slot has passed");
+    check(burst(&link, cost) == 1, "one frame per slot");
+    check(crsf_link_credit_wait_us(&link, cost) == cost && crsf_link_credit_wait_us(&link, cost + 1000) == cost - 1000,
+          "wait for the next slot");
+    check(burst(&link, cost + cost / 2) == 0, "nothing before the next slot");
+    check(crsf_link_credit_wait_us(&link, 2 * cost) == 0, "no wait once the slot has come");
+    check(burst(&link, 2 * cost) == 1, "and one at the next");
+
+    send_timing(&link, 40000, 300000);
+    check(burst(&link, 300000) == CRSF_PACING_BURST, "idle time gives a burst of CRSF_PACING_BURST");
+    check(link.pacing.paced == 2 + CRSF_PACING_BURST, "paced frames counted");
+
+    check(crsf_link_credit_wait_us(&link, 300000) == cost, "a whole slot to wait after the burst");
+    check(!crsf_link_paced(&link, 300000 + CRSF_PACING_TIMEOUT_US) &&
+              crsf_link_credit_wait_us(&link, 300000 + CRSF_PACING_TIMEOUT_US) == 0 &&
+              burst(&link, 300000 + CRSF_PACING_TIMEOUT_US) == 1000,
+          "not paced once the receiver is silent");
+}
+
+// Credit saturated at one interval, then the interval shrinks by 1 us and
+// the link stays idle for a second while frames keep coming in
+static void verify_pacing_interval_shrink(void) {
+    crsf_link_t link;
+    crsf_link_init(&link, CRSF_BAUD_RATE, 0);
+    send_timing(&link, 40000, 0);
+    uint32_t now = 0;
+    for (; now < 100000; now += 1000) {
+        crsf_link_may_send(&link, now);
+    }
+    check(link.credit_us == 4000 * CRSF_PACING_INTERVALS_PER_FRAME * CRSF_PACING_BURST, "credit saturated");
+
+    for (uint32_t end = now + 1000000; now < end; now += 1000) {
+        if (now % 100000 == 0) {
+            send_timing(&link, 39990, now);
+        }
+        crsf_link_may_send(&link, now);
+    }
+    check(link.interval_us == 3999, "the interval shrank");
+    check(link.credit_us <= 3999 * CRSF_PACING_INTERVALS_PER_FRAME * CRSF_PACING_BURST,
+          "credit stays within the smaller burst");
+    check(burst(&link, now) == CRSF_PACING_BURST, "a burst after the idle second is still CRSF_PACING_BURST frames");
+}
+
+int main(void) {
+    verify_pings();
+    verify_link_statistics();
+    verify_timing();
+    verify_bad_crc();
+    verify_bad_length();
+    verify_rc_spacing();
+    verify_pacing();
+    verify_pacing_interval_shrink();
+    printf("CRSF link checks: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
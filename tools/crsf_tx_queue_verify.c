@@ -0,0 +1,333 @@
+// Host check of the CRSF transmit queue in crsf_tx_queue.h.
+//
+// Usage: crsf_tx_queue_verify
+//
+// Drives the queue against a fake sink whose busy flag the checks set by
+// hand, and which records every transfer and every frame reported sent:
+// coalescing of adjacent frames up to CRSF_TX_MAX_BATCH, frames placed back
+// at the start of the buffer when the end is taken, both drop policies with
+// and without a transfer in flight, the high water mark and the time frames
+// wait behind a transfer. Every frame is filled with its own number, so a
+// frame that was moved or overwritten shows. Prints every failed check;
+// exits with 1 if there was one.
+#include <stdio.h>
+#include <string.h>
+#include "crsf_tx_queue.h"
+
+#define VERIFY_MAX_TRANSFERS 64
+#define VERIFY_MAX_SENT 256
+
+typedef struct {
+    bool busy;
+    uint8_t transfers;
+    size_t transfer_length[VERIFY_MAX_TRANSFERS];
+    uint16_t transfer_offset[VERIFY_MAX_TRANSFERS];
+    uint16_t sent_count;
+    uint8_t sent[VERIFY_MAX_SENT];
+    bool sent_intact;
+    const uint8_t *buffer;
+} fake_sink_t;
+
+static unsigned failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static bool fake_busy(void *context) {
+    return ((fake_sink_t *)context)->busy;
+}
+
+// A transfer keeps the sink busy until the check clears it
+static void fake_start(void *context, const uint8_t *data, size_t length) {
+    fake_sink_t *sink = context;
+    if (sink->transfers < VERIFY_MAX_TRANSFERS) {
+        sink->transfer_length[sink->transfers] = length;
+        sink->transfer_offset[sink->transfers] = (uint16_t)(data - sink->buffer);
+        sink->transfers++;
+    }
+    sink->busy = true;
+}
+
+static void fake_sent(void *context, const uint8_t *frame, uint8_t length, const uint32_t *origin_us,
+                      uint32_t now_us) {
+    fake_sink_t *sink = context;
+    (void)origin_us;
+    (void)now_us;
+    for (uint8_t i = 1; i < length; i++) {
+        sink->sent_intact &= frame[i] == frame[0];
+    }
+    if (sink->sent_count < VERIFY_MAX_SENT) {
+        sink->sent[sink->sent_count++] = frame[0];
+    }
+}
+
+static void start_queue(crsf_tx_queue_t *queue, fake_sink_t *sink, crsf_tx_drop_policy_t policy) {
+    memset(sink, 0, sizeof(*sink));
+    sink->sent_intact = true;
+    crsf_tx_sink_t fake = { .busy = fake_busy, .start = fake_start, .sent = fake_sent, .context = sink };
+    crsf_tx_queue_init(queue, &fake, policy);
+    sink->buffer = queue->buffer;
+}
+
+// A frame of length bytes all holding number
+static bool push_frame(crsf_tx_queue_t *queue, uint8_t number, uint8_t length) {
+    uint8_t frame[CRSF_TX_BUFFER_SIZE];
+    memset(frame, number, length);
+    return crsf_tx_queue_push(queue, frame, length);
+}
+
+// Let the current transfer finish and start the next one
+static void finish_transfer(crsf_tx_queue_t *queue, fake_sink_t *sink, uint32_t now_us) {
+    sink->busy = false;
+    crsf_tx_queue_service(queue, now_us);
+}
+
+// Service until nothing is left, then check that the frames sent were
+// first, first + 1, ... without the numbers in skipped
+static bool drain_in_order(crsf_tx_queue_t *queue, fake_sink_t *sink, uint8_t first, uint8_t last,
+                           const uint8_t *skipped, size_t skip_count) {
+    for (int i = 0; i < CRSF_TX_QUEUE_DEPTH + 1 && crsf_tx_queue_pending(queue) > 0; i++) {
+        finish_transfer(queue, sink, 0);
+    }
+    finish_transfer(queue, sink, 0);
+
+    uint16_t at = 0;
+    for (unsigned number = first; number <= last; number++) {
+        bool skip = false;
+        for (size_t i = 0; i < skip_count; i++) {
+            skip |= skipped[i] == number;
+        }
+        if (skip) {
+            continue;
+        }
+        if (at >= sink->sent_count || sink->sent[at] != number) {
+            return false;
+        }
+        at++;
+    }
+    return at == sink->sent_count && sink->sent_intact && crsf_tx_queue_pending(queue) == 0;
+}
+
+// Adjacent frames go out in one transfer, at most CRSF_TX_MAX_BATCH of them
+static void verify_coalescing(void) {
+    crsf_tx_queue_t queue;
+    fake_sink_t sink;
+    start_queue(&queue, &sink, CRSF_TX_DROP_NEWEST);
+
+    const uint8_t count = CRSF_TX_MAX_BATCH + 2;
+    for (uint8_t i = 0; i < count; i++) {
+        check(push_frame(&queue, i, 10), "coalescing frames fit");
+    }
+    crsf_tx_queue_service(&queue, 0);
+    check(sink.transfers == 1 && sink.transfer_length[0] == 10 * CRSF_TX_MAX_BATCH && sink.transfer_offset[0] == 0,
+          "first transfer takes CRSF_TX_MAX_BATCH frames");
+    check(queue.in_flight == CRSF_TX_MAX_BATCH, "the whole batch is in flight");
+
+    crsf_tx_queue_service(&queue, 0);
+    check(sink.transfers == 1 && sink.sent_count == 0, "nothing more while the sink is busy");
+
+    finish_transfer(&queue, &sink, 0);
+    check(sink.sent_count == CRSF_TX_MAX_BATCH, "the batch is reported sent when done");
+    check(sink.transfers == 2 && sink.transfer_length[1] == 10 * (count - CRSF_TX_MAX_BATCH) &&
+              sink.transfer_offset[1] == 10 * CRSF_TX_MAX_BATCH,
+          "the rest follows in one transfer");
+    check(drain_in_order(&queue, &sink, 0, count - 1, NULL, 0), "coalesced frames sent in order");
+    check(queue.stats.frames_sent == count && queue.stats.transfers == 2, "sent and transfer counts");
+}
+
+// A frame that does not fit before the end of the buffer goes to the start,
+// and is not coalesced with the frame before it
+static void verify_wraparound(void) {
+    crsf_tx_queue_t queue;
+    fake_sink_t sink;
+    start_queue(&queue, &sink, CRSF_TX_DROP_NEWEST);
+
+    // 0..3 at 0, 60, 120, 180; the end is at 240
+    for (uint8_t i = 0; i < 4; i++) {
+        push_frame(&queue, i, 60);
+    }
+    crsf_tx_queue_service(&queue, 0);
+    check(queue.in_flight == 4, "four adjacent frames in one transfer");
+    check(push_frame(&queue, 4, 10), "10 bytes fit at the end");
+    check(!push_frame(&queue, 5, 20), "no room at the start while the first frames are in flight");
+
+    finish_transfer(&queue, &sink, 0);
+    check(sink.transfers == 2 && sink.transfer_offset[1] == 240 && sink.transfer_length[1] == 10,
+          "the frame at the end goes out alone");
+    check(push_frame(&queue, 5, 20), "20 bytes fit at the start");
+    check(push_frame(&queue, 6, 20), "and the next 20 after them");
+    check(queue.frames[(queue.first + 1) % CRSF_TX_QUEUE_DEPTH].offset == 0, "the frame that did not fit is at 0");
+    check(queue.frames[(queue.first + 2) % CRSF_TX_QUEUE_DEPTH].offset == 20, "the next one follows it");
+
+    finish_transfer(&queue, &sink, 0);
+    check(sink.transfers == 3 && sink.transfer_offset[2] == 0 && sink.transfer_length[2] == 40,
+          "the frames at the start go out together");
+    check(drain_in_order(&queue, &sink, 0, 6, NULL, 0), "frames around the end sent in order");
+}
+
+// Drop newest: a full queue refuses new frames and keeps the old ones
+static void verify_drop_newest(void) {
+    crsf_tx_queue_t queue;
+    fake_sink_t sink;
+    start_queue(&queue, &sink, CRSF_TX_DROP_NEWEST);
+
+    uint8_t number = 0;
+    while (push_frame(&queue, number, 1)) {
+        number++;
+    }
+    check(number == CRSF_TX_QUEUE_DEPTH, "full at CRSF_TX_QUEUE_DEPTH frames");
+    check(queue.stats.frames_dropped == 1, "the refused frame is counted");
+    check(!push_frame(&queue, 100, 1) && queue.stats.frames_dropped == 2, "every refused frame is counted");
+    check(queue.stats.high_water == CRSF_TX_QUEUE_DEPTH, "high water at the depth");
+    check(drain_in_order(&queue, &sink, 0, CRSF_TX_QUEUE_DEPTH - 1, NULL, 0), "the queued frames are kept");
+}
+
+// Drop oldest with nothing in flight: the head goes
+static void verify_drop_oldest(void) {
+    crsf_tx_queue_t queue;
+    fake_sink_t sink;
+    start_queue(&queue, &sink, CRSF_TX_DROP_OLDEST);
+
+    for (uint8_t i = 0; i < 4; i++) {
+        push_frame(&queue, i, 60);
+    }
+    check(push_frame(&queue, 4, 60), "a new frame evicts the oldest");
+    check(push_frame(&queue, 5, 30), "and the next one");
+    check(queue.stats.frames_dropped == 2 && crsf_tx_queue_pending(&queue) == 4, "two evicted, four queued");
+    const uint8_t skipped[] = { 0, 1 };
+    check(drain_in_order(&queue, &sink, 0, 5, skipped, 2), "the oldest two are gone");
+}
+
+// Drop oldest while a transfer is in flight: the in-flight frames stay and
+// the oldest frame waiting behind them goes, its space reused at once
+static void verify_drop_oldest_in_flight(void) {
+    crsf_tx_queue_t queue;
+    fake_sink_t sink;
+    start_queue(&queue, &sink, CRSF_TX_DROP_OLDEST);
+
+    push_frame(&queue, 0, 60);
+    push_frame(&queue, 1, 60);
+    crsf_tx_queue_service(&queue, 0);
+    check(queue.in_flight == 2, "two frames in flight");
+
+    // 2..4 at 120, 160, 200; 40 bytes left at the end
+    push_frame(&queue, 2, 40);
+    push_frame(&queue, 3, 40);
+    push_frame(&queue, 4, 40);
+    check(push_frame(&queue, 5, 50), "a new frame evicts the oldest waiting one");
+    check(queue.stats.frames_dropped == 1 && queue.in_flight == 2, "one evicted, the transfer untouched");
+    check(queue.frames[(queue.first + 2) % CRSF_TX_QUEUE_DEPTH].offset == 120, "the frames behind it moved up");
+    check(push_frame(&queue, 6, 6) && queue.stats.frames_dropped == 1, "the freed space is usable");
+
+    const uint8_t skipped[] = { 2 };
+    check(drain_in_order(&queue, &sink, 0, 6, skipped, 1), "in-flight frames sent, the oldest waiting one gone");
+}
+
+// Drop oldest with every queued frame in flight: the new frame is dropped
+static void verify_drop_oldest_all_in_flight(void) {
+    crsf_tx_queue_t queue;
+    fake_sink_t sink;
+    start_queue(&queue, &sink, CRSF_TX_DROP_OLDEST);
+
+    for (uint8_t i = 0; i < 4; i++) {
+        push_frame(&queue, i, 60);
+    }
+    crsf_tx_queue_service(&queue, 0);
+    check(!push_frame(&queue, 4, 60), "nothing to evict while all is in flight");
+    check(queue.stats.frames_dropped == 1, "the new frame is counted dropped");
+    check(drain_in_order(&queue, &sink, 0, 3, NULL, 0), "the transfer completes intact");
+}
+
+// Drop oldest at the descriptor limit with frames in flight
+static void verify_drop_oldest_depth(void) {
+    crsf_tx_queue_t queue;
+    fake_sink_t sink;
+    start_queue(&queue, &sink, CRSF_TX_DROP_OLDEST);
+
+    for (uint8_t i = 0; i < CRSF_TX_QUEUE_DEPTH; i++) {
+        push_frame(&queue, i, 2);
+    }
+    crsf_tx_queue_service(&queue, 0);
+    check(queue.in_flight == CRSF_TX_MAX_BATCH, "a batch in flight");
+    for (uint8_t i = 0; i < 3; i++) {
+        push_frame(&queue, CRSF_TX_QUEUE_DEPTH + i, 2);
+    }
+    check(queue.stats.frames_dropped == 3 && crsf_tx_queue_pending(&queue) == CRSF_TX_QUEUE_DEPTH,
+          "each new frame evicts one waiting frame");
+    const uint8_t skipped[] = { CRSF_TX_MAX_BATCH, CRSF_TX_MAX_BATCH + 1, CRSF_TX_MAX_BATCH + 2 };
+    check(drain_in_order(&queue, &sink, 0, CRSF_TX_QUEUE_DEPTH + 2, skipped, 3),
+          "the oldest waiting frames are the ones gone");
+}
+
+// High water follows the deepest the queue has been
+static void verify_high_water(void) {
+    crsf_tx_queue_t queue;
+    fake_sink_t sink;
+    start_queue(&queue, &sink, CRSF_TX_DROP_NEWEST);
+
+    for (uint8_t i = 0; i < 5; i++) {
+        push_frame(&queue, i, 8);
+    }
+    check(queue.stats.high_water == 5, "high water at five");
+    drain_in_order(&queue, &sink, 0, 4, NULL, 0);
+    push_frame(&queue, 5, 8);
+    push_frame(&queue, 6, 8);
+    check(queue.stats.high_water == 5, "high water does not fall");
+    check(queue.stats.frames_queued == 7, "queued count");
+}
+
+// Stall time runs while committed frames wait behind a transfer
+static void verify_stall(void) {
+    crsf_tx_queue_t queue;
+    fake_sink_t sink;
+    start_queue(&queue, &sink, CRSF_TX_DROP_NEWEST);
+
+    // A frame that finds the UART idle goes straight out
+    push_frame(&queue, 0, 8);
+    crsf_tx_queue_service(&queue, 1000);
+    check(sink.transfers == 1 && queue.stats.stall_us == 0, "no stall on an idle UART");
+
+    // The next one waits for that transfer to finish
+    push_frame(&queue, 1, 8);
+    crsf_tx_queue_service(&queue, 1100);
+    crsf_tx_queue_service(&queue, 1200);
+    check(sink.transfers == 1 && queue.stats.stall_us == 0, "stalled behind the transfer in flight");
+    finish_transfer(&queue, &sink, 1400);
+    check(queue.stats.stall_us == 300 && sink.transfers == 2, "stall time counted when the transfer starts");
+
+    // A transfer in flight with nothing behind it is no stall
+    crsf_tx_queue_service(&queue, 2000);
+    finish_transfer(&queue, &sink, 3000);
+    check(queue.stats.stall_us == 300 && crsf_tx_queue_pending(&queue) == 0, "nothing waiting, no stall");
+
+    // A sink busy with something else holds frames back as well
+    sink.busy = true;
+    push_frame(&queue, 2, 8);
+    crsf_tx_queue_service(&queue, 4000);
+    finish_transfer(&queue, &sink, 4050);
+    check(queue.stats.stall_us == 350, "stalled by a busy sink");
+
+    // Across the 32-bit clock wrap
+    push_frame(&queue, 3, 8);
+    crsf_tx_queue_service(&queue, UINT32_MAX - 99);
+    finish_transfer(&queue, &sink, 100);
+    check(queue.stats.stall_us == 550, "stall time across the clock wrap");
+}
+
+int main(void) {
+    verify_coalescing();
+    verify_wraparound();
+    verify_drop_newest();
+    verify_drop_oldest();
+    verify_drop_oldest_in_flight();
+    verify_drop_oldest_all_in_flight();
+    verify_drop_oldest_depth();
+    verify_high_water();
+    verify_stall();
+    printf("Transmit queue checks: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+// Live decoder of the binary telemetry mirror.
+//
+// Usage: mirror_monitor [--interval SECONDS] [--start] [STREAM]
+//
+// STREAM is the USB console of the converter (e.g. /dev/ttyACM0), a file it
+// was logged to or the output of pipeline_soak --mirror; without it, or as
+// "-", the stream is read from stdin. The format is in
+// src/telemetry_mirror.h. A terminal given as STREAM is switched to raw
+// mode; --start sends the menu keys that start the mirror, and Ctrl-C sends
+// the key that stops it and waits for the end record (a second Ctrl-C quits
+// at once).
+//
+// Every SECONDS of device time (default 1) prints the rate of every S.PORT
+// sensor value and CRSF frame type over that interval, with the last value,
+// plus lost records and bad frames; at the end record or the end of the
+// input the same for the whole stream. Deferred log records are printed as
+// they come, formatted with the table this tool was built with from
+// src/log_formats.def; a stream from a different table is flagged at its
+// start. Exits with 1 if no record was seen.
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "telemetry_mirror.h"
+
+#define MONITOR_MAX_SENSORS 128
+#define MONITOR_START_KEYS "cb"
+#define MONITOR_STOP_KEY "x"
+
+typedef struct {
+    uint8_t bus;
+    uint8_t sensor_id;
+    uint16_t data_id;
+    uint32_t value;
+    uint32_t window;
+    uint64_t total;
+} monitor_sensor_t;
+
+typedef struct {
+    uint32_t window;
+    uint64_t total;
+    uint8_t length;
+} monitor_frame_t;
+
+static monitor_sensor_t sensors[MONITOR_MAX_SENSORS];
+static size_t sensor_count;
+static monitor_frame_t frames[256];
+
+static int64_t clock_us;
+static uint32_t last_time_us;
+static int64_t first_us;
+static int64_t window_start_us;
+static uint32_t window_lost;
+static uint32_t window_bad;
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_interrupt(int signal) {
+    (void)signal;
+    stop_requested = 1;
+}
+
+// 64-bit device time from the 32-bit stamps; S.PORT records are stamped
+// with their start byte, so the clock may step back a little
+static void track_time(uint32_t time_us, bool first) {
+    if (first) {
+        clock_us = 0;
+    } else {
+        clock_us += (int32_t)(time_us - last_time_us);
+    }
+    last_time_us = time_us;
+}
+
+static monitor_sensor_t *find_sensor(const telemetry_mirror_record_t *record) {
+    for (size_t i = 0; i < sensor_count; i++) {
+        monitor_sensor_t *sensor = &sensors[i];
+        if (sensor->bus == record->bus && sensor->sensor_id == record->sensor_id &&
+            sensor->data_id == record->data_id) {
+            return sensor;
+        }
+    }
+    if (sensor_count == MONITOR_MAX_SENSORS) {
+        return NULL;
+    }
+    monitor_sensor_t *sensor = &sensors[sensor_count++];
+    *sensor = (monitor_sensor_t){ .bus = record->bus, .sensor_id = record->sensor_id, .data_id = record->data_id };
+    return sensor;
+}
+
+// Rates over seconds, from the window counts or from the totals
+static void print_rates(const char *title, double seconds, bool totals, uint32_t lost, uint32_t bad) {
+    if (seconds <= 0.0) {
+        return;
+    }
+    printf("%s, %.1f s: %u records lost, %u bad frames\n", title, seconds, lost, bad);
+    printf("  %-3s %-6s %-7s %10s %12s\n", "bus", "sensor", "data ID", "rate /s", "last value");
+    for (size_t i = 0; i < sensor_count; i++) {
+        const monitor_sensor_t *sensor = &sensors[i];
+        uint64_t count = totals ? sensor->total : sensor->window;
+        if (count > 0) {
+            printf("  %-3u 0x%02X   0x%04X  %10.1f   0x%08X\n", sensor->bus, sensor->sensor_id, sensor->data_id,
+                   count / seconds, sensor->value);
+        }
+    }
+    printf("  %-11s %10s %12s\n", "CRSF type", "rate /s", "length");
+    for (int type = 0; type < 256; type++) {
+        const monitor_frame_t *frame = &frames[type];
+        uint64_t count = totals ? frame->total : frame->window;
+        if (count > 0) {
+            printf("  0x%02X        %10.1f %12u\n", type, count / seconds, frame->length);
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void end_window(const telemetry_mirror_reader_t *reader) {
+    print_rates("Interval", (clock_us - window_start_us) / 1e6, false, reader->lost - window_lost,
+                reader->bad_frames - window_bad);
+    for (size_t i = 0; i < sensor_count; i++) {
+        sensors[i].window = 0;
+    }
+    for (int type = 0; type < 256; type++) {
+        frames[type].window = 0;
+    }
+    window_start_us = clock_us;
+    window_lost = reader->lost;
+    window_bad = reader->bad_frames;
+}
+
+static void reset_counts(void) {
+    sensor_count = 0;
+    memset(frames, 0, sizeof(frames));
+}
+
+static void count_record(const telemetry_mirror_record_t *record) {
+    if (record->type == TELEMETRY_MIRROR_SPORT) {
+        monitor_sensor_t *sensor = find_sensor(record);
+        if (sensor) {
+            sensor->value = record->value;
+            sensor->window++;
+            sensor->total++;
+        }
+    } else if (record->type == TELEMETRY_MIRROR_CRSF) {
+        monitor_frame_t *frame = &frames[record->frame[2]];
+        frame->length = record->length;
+        frame->window++;
+        frame->total++;
+    } else if (record->type == TELEMETRY_MIRROR_LOG) {
+        char text[160];
+        deferred_log_format(&record->log, text, sizeof(text));
+        printf("%.6f core%u: %s\n", (double)clock_us / 1e6, record->log.core, text);
+    }
+}
+
+// Raw mode, so the line discipline neither buffers nor translates bytes
+static void make_raw(int fd) {
+    struct termios mode;
+    if (tcgetattr(fd, &mode) == 0) {
+        cfmakeraw(&mode);
+        tcsetattr(fd, TCSANOW, &mode);
+    }
+}
+
+static void send_keys(int fd, const char *keys) {
+    if (write(fd, keys, strlen(keys)) < 0) {
+        fprintf(stderr, "Cannot send keys: %s\n", strerror(errno));
+    }
+}
+
+int main(int argc, char **argv) {
+    double interval = 1.0;
+    bool start = false;
+    const char *path = NULL;
+    bool usage = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--start") == 0) {
+            start = true;
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            usage = true;
+        }
+    }
+    if (usage || interval <= 0.0) {
+        fprintf(stderr, "Usage: %s [--interval SECONDS] [--start] [STREAM]\n", argv[0]);
+        return 2;
+    }
+    int64_t interval_us = (int64_t)(interval * 1e6);
+
+    int fd = STDIN_FILENO;
+    if (path && strcmp(path, "-") != 0) {
+        fd = open(path, O_RDWR | O_NOCTTY);
+        if (fd < 0) {
+            fd = open(path, O_RDONLY);
+        }
+        if (fd < 0) {
+            fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+    }
+    if (fd != STDIN_FILENO && isatty(fd)) {
+        make_raw(fd);
+        struct sigaction action = { .sa_handler = on_interrupt, .sa_flags = SA_RESETHAND };
+        sigaction(SIGINT, &action, NULL);
+        if (start) {
+            send_keys(fd, MONITOR_START_KEYS);
+        }
+    }
+
+    static telemetry_mirror_reader_t reader;
+    telemetry_mirror_reader_init(&reader);
+    telemetry_mirror_record_t record;
+    bool stop_sent = false;
+    bool ended = false;
+    uint8_t buffer[4096];
+    while (!ended) {
+        if (stop_requested && !stop_sent) {
+            send_keys(fd, MONITOR_STOP_KEY);
+            stop_sent = true;
+        }
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            break;
+        }
+        for (ssize_t i = 0; i < length && !ended; i++) {
+            bool first = reader.records == 0;
+            if (!telemetry_mirror_feed(&reader, buffer[i], &record)) {
+                continue;
+            }
+            track_time(record.time_us, first);
+            if (first || record.type == TELEMETRY_MIRROR_START) {
+                if (record.type == TELEMETRY_MIRROR_START) {
+                    printf("Mirror started, version %u\n", record.version);
+                    if (record.log_hash != deferred_log_table_hash()) {
+                        printf("Log formats differ from this build's, log text may be wrong\n");
+                    }
+                    printf("\n");
+                    reset_counts();
+                }
+                first_us = clock_us;
+                window_start_us = clock_us;
+            }
+            if (clock_us >= window_start_us + interval_us) {
+                end_window(&reader);
+            }
+            count_record(&record);
+            ended = record.type == TELEMETRY_MIRROR_END;
+        }
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+
+    if (reader.records == 0) {
+        fprintf(stderr, "No mirror records found\n");
+        return 1;
+    }
+    printf("%s after %u records\n\n", ended ? "Mirror ended" : "Input ended", reader.records);
+    print_rates("Whole stream", (clock_us - first_us) / 1e6, true, reader.lost, reader.bad_frames);
+    if (sensor_count == MONITOR_MAX_SENSORS) {
+        printf("Sensor table full, values beyond %d not counted\n", MONITOR_MAX_SENSORS);
+    }
+    return 0;
+}
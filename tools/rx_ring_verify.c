@@ -0,0 +1,202 @@
+// Host check of the receive byte ring in rx_ring.h.
+//
+// Usage: rx_ring_verify
+//
+// Feeds known byte sequences through rx_ring_write, rx_ring_set_head and
+// rx_ring_read: spans that end at the end of the storage, head and tail
+// counters wrapping past 2^32, a CPU writer filling the ring and a DMA
+// writer lapping the reader, and a long random stream with the counters
+// started just below the wrap. Prints every failed check; exits with 1 if
+// there was one.
+#include <stdio.h>
+#include <string.h>
+#include "rx_ring.h"
+
+#define VERIFY_RING_SIZE 16u
+
+static unsigned failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static uint32_t rng_state = 0x6B43A9B5;
+
+static uint32_t next_random(void) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+// Start both counters at position, as if that many bytes had gone through
+static void start_at(rx_ring_t *ring, uint32_t position) {
+    ring->head = position;
+    ring->tail = position;
+}
+
+// Read until empty into out, returns the bytes read and the spans taken
+static size_t read_all(rx_ring_t *ring, uint8_t *out, size_t *spans) {
+    size_t total = 0;
+    const uint8_t *span;
+    size_t length;
+    *spans = 0;
+    while ((length = rx_ring_read(ring, &span)) > 0) {
+        memcpy(&out[total], span, length);
+        rx_ring_consume(ring, length);
+        total += length;
+        (*spans)++;
+    }
+    return total;
+}
+
+static void verify_init(void) {
+    static uint8_t storage[VERIFY_RING_SIZE];
+    rx_ring_t ring;
+    check(!rx_ring_init(&ring, storage, 12), "init rejects a size that is not a power of two");
+    check(!rx_ring_init(&ring, storage, 0), "init rejects size 0");
+    check(rx_ring_init(&ring, storage, VERIFY_RING_SIZE), "init accepts a power of two");
+    const uint8_t *span;
+    check(rx_ring_read(&ring, &span) == 0 && rx_ring_available(&ring) == 0, "a new ring is empty");
+}
+
+// Eight bytes from index 12 of 16: one span to the end, one from the start
+static void verify_span_split(void) {
+    static uint8_t storage[VERIFY_RING_SIZE];
+    rx_ring_t ring;
+    rx_ring_init(&ring, storage, VERIFY_RING_SIZE);
+    start_at(&ring, 12);
+
+    const uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    check(rx_ring_write(&ring, data, sizeof(data)) == sizeof(data), "split write fits");
+    const uint8_t *span;
+    size_t length = rx_ring_read(&ring, &span);
+    check(length == 4 && span == &storage[12] && memcmp(span, data, 4) == 0, "first span ends at the buffer end");
+    rx_ring_consume(&ring, length);
+    length = rx_ring_read(&ring, &span);
+    check(length == 4 && span == &storage[0] && memcmp(span, &data[4], 4) == 0, "second span starts at index 0");
+    rx_ring_consume(&ring, length);
+    check(rx_ring_read(&ring, &span) == 0, "empty after both spans");
+}
+
+// Head wraps past 2^32 while tail has not yet, and then both
+static void verify_counter_wrap(void) {
+    static uint8_t storage[VERIFY_RING_SIZE];
+    rx_ring_t ring;
+    rx_ring_init(&ring, storage, VERIFY_RING_SIZE);
+    start_at(&ring, UINT32_MAX - 5);
+
+    uint8_t data[12];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(0xA0 + i);
+    }
+    check(rx_ring_write(&ring, data, sizeof(data)) == sizeof(data), "write across the counter wrap fits");
+    check(ring.head < ring.tail, "head counter wrapped");
+    check(rx_ring_available(&ring) == sizeof(data), "available across the counter wrap");
+
+    uint8_t out[VERIFY_RING_SIZE];
+    size_t spans;
+    size_t total = read_all(&ring, out, &spans);
+    check(total == sizeof(data) && memcmp(out, data, sizeof(data)) == 0, "bytes in order across the counter wrap");
+    check(ring.tail == ring.head && ring.overflows == 0, "no overflow across the counter wrap");
+}
+
+// CPU writer: what does not fit is dropped and counted once per write
+static void verify_write_overflow(void) {
+    static uint8_t storage[VERIFY_RING_SIZE];
+    rx_ring_t ring;
+    rx_ring_init(&ring, storage, VERIFY_RING_SIZE);
+    start_at(&ring, UINT32_MAX - 3);
+
+    uint8_t data[20];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)i;
+    }
+    check(rx_ring_write(&ring, data, sizeof(data)) == VERIFY_RING_SIZE, "write stops when the ring is full");
+    check(ring.overflows == 1 && ring.bytes_dropped == 4, "overflow counts the write and the dropped bytes");
+    check(rx_ring_write(&ring, data, 1) == 0, "a full ring takes nothing");
+    check(ring.overflows == 2 && ring.bytes_dropped == 5, "each refused write counts");
+
+    uint8_t out[VERIFY_RING_SIZE];
+    size_t spans;
+    size_t total = read_all(&ring, out, &spans);
+    check(total == VERIFY_RING_SIZE && memcmp(out, data, VERIFY_RING_SIZE) == 0, "the oldest bytes are kept");
+}
+
+// DMA writer: lapping the reader discards the unread data, full is fine
+static void verify_dma_overrun(void) {
+    static uint8_t storage[VERIFY_RING_SIZE];
+    rx_ring_t ring;
+    rx_ring_init(&ring, storage, VERIFY_RING_SIZE);
+    start_at(&ring, UINT32_MAX - 7);
+
+    const uint8_t *span;
+    rx_ring_set_head(&ring, ring.tail + VERIFY_RING_SIZE);
+    check(rx_ring_read(&ring, &span) == 8 && ring.overflows == 0, "a full ring is not an overrun");
+
+    uint32_t lapped = ring.tail + VERIFY_RING_SIZE + 5;
+    rx_ring_set_head(&ring, lapped);
+    check(rx_ring_read(&ring, &span) == 0, "an overrun read returns nothing");
+    check(ring.overflows == 1 && ring.bytes_dropped == VERIFY_RING_SIZE + 5, "overrun counts the unread bytes");
+    check(ring.tail == lapped && rx_ring_available(&ring) == 0, "reading resumes at the producer position");
+
+    storage[lapped & (VERIFY_RING_SIZE - 1)] = 0x5A;
+    rx_ring_set_head(&ring, lapped + 1);
+    check(rx_ring_read(&ring, &span) == 1 && *span == 0x5A, "bytes after the overrun are read");
+}
+
+// Random writes and reads of a counting sequence, many laps around the
+// storage and across the counter wrap. Dropped bytes never enter the ring,
+// so the sequence read has no gaps.
+static void verify_random_stream(void) {
+    static uint8_t storage[VERIFY_RING_SIZE];
+    rx_ring_t ring;
+    rx_ring_init(&ring, storage, VERIFY_RING_SIZE);
+    start_at(&ring, UINT32_MAX - 1000);
+
+    uint8_t next_write = 0;
+    uint8_t next_read = 0;
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    bool in_order = true;
+    for (int step = 0; step < 200000; step++) {
+        uint8_t data[VERIFY_RING_SIZE + 4];
+        size_t length = next_random() % sizeof(data);
+        for (size_t i = 0; i < length; i++) {
+            data[i] = (uint8_t)(next_write + i);
+        }
+        size_t count = rx_ring_write(&ring, data, length);
+        next_write = (uint8_t)(next_write + count);
+        written += count;
+        dropped += length - count;
+
+        const uint8_t *span;
+        size_t available = rx_ring_read(&ring, &span);
+        size_t take = available ? next_random() % (available + 1) : 0;
+        for (size_t i = 0; i < take; i++) {
+            in_order &= span[i] == next_read++;
+        }
+        rx_ring_consume(&ring, take);
+    }
+    check(in_order, "random stream read in order");
+    check(ring.bytes_dropped == dropped, "random stream drop count");
+    check((uint32_t)(ring.head - ring.tail) <= VERIFY_RING_SIZE, "random stream never over full");
+    printf("Random stream: %llu bytes through a %u byte ring, %llu dropped\n", (unsigned long long)written,
+           VERIFY_RING_SIZE, (unsigned long long)dropped);
+}
+
+int main(void) {
+    verify_init();
+    verify_span_split();
+    verify_counter_wrap();
+    verify_write_overflow();
+    verify_dma_overrun();
+    verify_random_stream();
+    printf("Receive ring checks: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
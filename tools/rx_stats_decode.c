@@ -0,0 +1,117 @@
+// Decode receive accounting snapshots.
+//
+// Usage: rx_stats_decode SNAPSHOT [LATER_SNAPSHOT]
+//
+// SNAPSHOT is the output of the 'e' command of the configuration menu (the
+// USB log around it is skipped) or of pipeline_soak --rx-stats; the format
+// is in src/rx_stats.h. Prints the counters per sensor and cause. With a
+// second, later snapshot it prints what happened between the two, with
+// rates per second.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rx_stats.h"
+
+static uint8_t *load_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = size > 0 ? malloc((size_t)size) : NULL;
+    *length = data ? fread(data, 1, (size_t)size, file) : 0;
+    fclose(file);
+    return data;
+}
+
+// First parseable snapshot in a file
+static bool load_snapshot(const char *path, rx_stats_snapshot_t *snapshot) {
+    size_t length = 0;
+    uint8_t *data = load_file(path, &length);
+    if (!data) {
+        fprintf(stderr, "Cannot read %s\n", path);
+        return false;
+    }
+    bool found = false;
+    for (size_t i = 0; i + 4 <= length && !found; i++) {
+        found = memcmp(&data[i], RX_STATS_MAGIC, 4) == 0 && rx_stats_parse_snapshot(&data[i], length - i, snapshot);
+    }
+    free(data);
+    if (!found) {
+        fprintf(stderr, "No receive accounting snapshot found in %s\n", path);
+    }
+    return found;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s SNAPSHOT [LATER_SNAPSHOT]\n", argv[0]);
+        return 2;
+    }
+
+    static rx_stats_snapshot_t first;
+    static rx_stats_snapshot_t later;
+    if (!load_snapshot(argv[1], &first)) {
+        return 1;
+    }
+    const rx_stats_snapshot_t *shown = &first;
+    double seconds = 0.0;
+    if (argc > 2) {
+        if (!load_snapshot(argv[2], &later)) {
+            return 1;
+        }
+        for (int slot = 0; slot < RX_STATS_SLOTS; slot++) {
+            for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+                later.counts[slot][cause] -= first.counts[slot][cause];
+            }
+        }
+        seconds = (later.time_us - first.time_us) / 1e6;
+        shown = &later;
+        printf("Between snapshots, %.1f s apart\n\n", seconds);
+    } else {
+        printf("Snapshot at %.1f s\n\n", first.time_us / 1e6);
+    }
+
+    printf("%-10s", "sensor");
+    for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+        printf(" %11s", rx_stats_cause_name((rx_stats_cause_t)cause));
+    }
+    printf("\n");
+
+    uint32_t totals[RX_STATS_CAUSE_COUNT] = { 0 };
+    for (int slot = 0; slot < RX_STATS_SLOTS; slot++) {
+        bool any = false;
+        for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+            any |= shown->counts[slot][cause] != 0;
+            totals[cause] += shown->counts[slot][cause];
+        }
+        if (!any) {
+            continue;
+        }
+        if (slot == RX_STATS_NO_SENSOR) {
+            printf("%-10s", "none");
+        } else {
+            printf("%-10d", slot);
+        }
+        for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+            printf(" %11u", shown->counts[slot][cause]);
+        }
+        printf("\n");
+    }
+
+    printf("%-10s", "total");
+    for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+        printf(" %11u", totals[cause]);
+    }
+    printf("\n");
+    if (seconds > 0.0) {
+        printf("%-10s", "per second");
+        for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+            printf(" %11.2f", totals[cause] / seconds);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Host check of the receive loss accounting in rx_stats.h.
+//
+// Usage: rx_stats_verify
+//
+// Writes snapshots of known counters and parses them back: LEB128 values of
+// 0, 127, 128 and 2^32-1, the slot and cause masks including the slot for
+// losses without a sensor, every truncation of a snapshot, a bad magic and
+// version, and slots and causes from newer firmware that must be skipped.
+// Then feeds the sliding window at known rates, before and after it fills
+// and wraps. Prints every failed check; exits with 1 if there was one.
+#include <stdio.h>
+#include <string.h>
+#include "rx_stats.h"
+
+static unsigned failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static bool write_and_parse(uint8_t *out, size_t *size, rx_stats_snapshot_t *snapshot, uint32_t time_us) {
+    *size = rx_stats_write_snapshot(out, RX_STATS_SNAPSHOT_MAX_SIZE, time_us);
+    return *size > 0 && rx_stats_parse_snapshot(out, *size, snapshot) == *size;
+}
+
+// One value in one slot: header, slot, mask, the varint and the end byte
+static void verify_varint(uint32_t value, size_t varint_length, const char *what) {
+    static uint8_t out[RX_STATS_SNAPSHOT_MAX_SIZE];
+    rx_stats_snapshot_t snapshot;
+    size_t size;
+
+    rx_stats_reset();
+    rx_stats_add(RX_STATS_CRC_FAIL, 3, value);
+    bool parsed = write_and_parse(out, &size, &snapshot, 0);
+    if (value == 0) {
+        check(parsed && size == 13 && out[12] == RX_STATS_END_SLOT, what);
+        return;
+    }
+    check(parsed && size == 12 + 2 + varint_length + 1, what);
+    check(out[12] == 3 && out[13] == 1u << RX_STATS_CRC_FAIL, "slot index and cause mask");
+    check(snapshot.counts[3][RX_STATS_CRC_FAIL] == value, what);
+}
+
+static void verify_round_trip(void) {
+    static uint8_t out[RX_STATS_SNAPSHOT_MAX_SIZE];
+    rx_stats_snapshot_t snapshot;
+    size_t size;
+
+    rx_stats_reset();
+    rx_stats_add(RX_STATS_FRAMES, 0x00, 128);
+    rx_stats_add(RX_STATS_RESYNC, 0x00, 1);
+    rx_stats_add(RX_STATS_FRAMES, 0xA1, UINT32_MAX);
+    rx_stats_add(RX_STATS_UNKNOWN_ID, 0x1B, 127);
+    rx_stats_add(RX_STATS_OVERFLOW, 0x1C, 5);
+    rx_stats_count(RX_STATS_BAD_ESCAPE, RX_STATS_NO_SENSOR);
+    check(write_and_parse(out, &size, &snapshot, 0xDEADBEEF), "snapshot parses back whole");
+    check(snapshot.time_us == 0xDEADBEEF, "time round trip");
+    check(snapshot.counts[0][RX_STATS_FRAMES] == 128 && snapshot.counts[0][RX_STATS_RESYNC] == 1,
+          "two causes in one slot");
+    check(snapshot.counts[1][RX_STATS_FRAMES] == UINT32_MAX, "parity bits of the sensor ID ignored");
+    check(snapshot.counts[27][RX_STATS_UNKNOWN_ID] == 127, "last sensor slot");
+    check(snapshot.counts[RX_STATS_NO_SENSOR][RX_STATS_OVERFLOW] == 5 &&
+          snapshot.counts[RX_STATS_NO_SENSOR][RX_STATS_BAD_ESCAPE] == 1, "IDs past 27 go to the no-sensor slot");
+    check(rx_stats_total(RX_STATS_FRAMES) == 127, "totals wrap like the counters");
+
+    bool empty = true;
+    for (int slot = 2; slot < 27; slot++) {
+        for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+            empty &= snapshot.counts[slot][cause] == 0;
+        }
+    }
+    check(empty, "slots without counts stay zero");
+
+    // Every cut of the snapshot short of the end byte is refused
+    bool refused = true;
+    for (size_t length = 0; length < size; length++) {
+        refused &= rx_stats_parse_snapshot(out, length, &snapshot) == 0;
+    }
+    check(refused, "truncated snapshots are refused");
+
+    out[0] = 'X';
+    check(rx_stats_parse_snapshot(out, size, &snapshot) == 0, "bad magic is refused");
+    out[0] = RX_STATS_MAGIC[0];
+    out[4] = RX_STATS_VERSION + 1;
+    check(rx_stats_parse_snapshot(out, size, &snapshot) == 0, "unknown version is refused");
+}
+
+// A slot and a cause this build does not know are read past
+static void verify_newer_firmware(void) {
+    static const uint8_t data[] = {
+        'R', 'X', 'S', '1', RX_STATS_VERSION, 8, 40, 0, 0, 0, 0, 0,
+        35, 0x01, 0x07,                               // unknown slot
+        2, 0x81, 0x09, 0x80, 0x01,                    // frames 9, unknown cause 128
+        RX_STATS_END_SLOT
+    };
+    rx_stats_snapshot_t snapshot;
+    check(rx_stats_parse_snapshot(data, sizeof(data), &snapshot) == sizeof(data), "newer snapshot parses");
+    check(snapshot.counts[2][RX_STATS_FRAMES] == 9, "known counters of a newer snapshot kept");
+}
+
+// 10 frames per second, then 40 per second from the 31st interval on
+static void verify_window(void) {
+    rx_stats_window_t window;
+    rx_stats_reset();
+    rx_stats_window_init(&window, 1000000, 0);
+    check(rx_stats_window_rate(&window, RX_STATS_FRAMES, 10000000) == 0.0f, "no rate from one sample");
+
+    uint32_t now = 0;
+    for (int second = 1; second <= 5; second++) {
+        rx_stats_add(RX_STATS_FRAMES, 1, 10);
+        now += 1000000;
+        rx_stats_window_poll(&window, now);
+    }
+    check(rx_stats_window_rate(&window, RX_STATS_FRAMES, 1000000) == 10.0f, "rate over one interval");
+    check(rx_stats_window_rate(&window, RX_STATS_FRAMES, 60000000) == 10.0f, "a window not yet full");
+    rx_stats_window_poll(&window, now + 999999);
+    check(window.count == 6, "no sample before the interval is up");
+
+    for (int second = 6; second <= 100; second++) {
+        rx_stats_add(RX_STATS_FRAMES, 1, second > 30 ? 40 : 10);
+        now += 1000000;
+        rx_stats_window_poll(&window, now);
+    }
+    check(window.count == RX_STATS_WINDOW_SAMPLES, "window full");
+    check(rx_stats_window_rate(&window, RX_STATS_FRAMES, 10000000) == 40.0f, "rate over ten intervals");
+    check(rx_stats_window_rate(&window, RX_STATS_FRAMES, 60000000) == 40.0f, "rate over the whole window");
+    check(rx_stats_window_rate(&window, RX_STATS_FRAMES, 600000000) == 40.0f, "a longer window is capped");
+    check(rx_stats_window_rate(&window, RX_STATS_CRC_FAIL, 60000000) == 0.0f, "no events, no rate");
+}
+
+int main(void) {
+    verify_varint(0, 0, "a zero counter is left out");
+    verify_varint(127, 1, "127 takes one byte");
+    verify_varint(128, 2, "128 takes two bytes");
+    verify_varint(UINT32_MAX, 5, "2^32-1 takes five bytes");
+    verify_round_trip();
+    verify_newer_firmware();
+    verify_window();
+    printf("Receive statistics checks: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
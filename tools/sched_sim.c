@@ -0,0 +1,187 @@
+// Host simulation of the CRSF downlink load.
+//
+// Usage: crsf_sched_sim [SECONDS]
+//
+// Replays a synthetic S.PORT sensor mix on a virtual clock through the
+// immediate converter (one CRSF frame per FrSky packet) and through the
+// frame scheduler, then reports downlink bytes/s and, for the scheduler,
+// the delay between a field changing and a frame carrying it being sent.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frsky_sport.h"
+#include "crsf.h"
+#include "telemetry_converter.h"
+#include "units.h"
+
+#define SIM_STEP_US 1000u
+#define SIM_DEFAULT_SECONDS 600
+
+typedef struct {
+    const char *name;
+    uint16_t data_id;
+    uint8_t crsf_type;
+    uint32_t period_us;
+    uint8_t change_percent;
+    uint32_t value_range;     // Values wrap below this, inside the unit conversion's range
+} sim_field_t;
+
+typedef struct {
+    uint32_t value;
+    uint32_t next_update;
+    bool pending;
+    uint32_t pending_since;
+    uint64_t latency_total;
+    uint32_t latency_max;
+    uint32_t latency_count;
+} sim_field_state_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t bytes;
+} sim_downlink_t;
+
+static const sim_field_t sim_fields[] = {
+    { "GPS lat/lon", FRSKY_ID_GPS_LONG_LATI, CRSF_FRAMETYPE_GPS, 125000, 90, 0x10000000 },
+    { "GPS alt", FRSKY_ID_GPS_ALT, CRSF_FRAMETYPE_GPS, 250000, 50, UNITS_ALTITUDE_INPUT_MAX + 1 },
+    { "GPS speed", FRSKY_ID_GPS_SPEED, CRSF_FRAMETYPE_GPS, 250000, 60, UNITS_GPS_SPEED_INPUT_MAX + 1 },
+    { "GPS course", FRSKY_ID_GPS_COURS, CRSF_FRAMETYPE_GPS, 250000, 40, UNITS_GPS_HEADING_INPUT_MAX + 1 },
+    { "VFAS", FRSKY_ID_VFAS, CRSF_FRAMETYPE_BATTERY_SENSOR, 100000, 30, 656 },
+    { "CURR", FRSKY_ID_CURR, CRSF_FRAMETYPE_BATTERY_SENSOR, 100000, 50, 656 },
+    { "FUEL", FRSKY_ID_FUEL, CRSF_FRAMETYPE_BATTERY_SENSOR, 1000000, 5, 101 },
+    { "ALT", FRSKY_ID_ALT, CRSF_FRAMETYPE_BARO_ALT, 50000, 40, 1000000 },
+    { "VSPD", FRSKY_ID_VSPD, CRSF_FRAMETYPE_VARIO, 50000, 60, 32768 },
+};
+
+#define SIM_FIELD_COUNT (sizeof(sim_fields) / sizeof(sim_fields[0]))
+
+static uint32_t sim_rng_state = 0xC0FFEE;
+
+static uint32_t sim_rand(void) {
+    uint32_t x = sim_rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim_rng_state = x;
+    return x;
+}
+
+// Produce the next FrSky packet of a field if it is due, alternating
+// latitude and longitude for the combined GPS data ID
+static bool next_packet(const sim_field_t *field, sim_field_state_t *state, uint32_t now,
+                        frsky_sport_packet_t *packet) {
+    if ((int32_t)(now - state->next_update) < 0) {
+        return false;
+    }
+    state->next_update += field->period_us;
+
+    if (sim_rand() % 100 < field->change_percent) {
+        state->value += 100 * (1 + sim_rand() % 7);
+    }
+
+    uint32_t value = state->value % field->value_range;
+    if (field->data_id == FRSKY_ID_GPS_LONG_LATI && (state->next_update / field->period_us) % 2) {
+        value |= 0x80000000;
+    }
+
+    memset(packet, 0, sizeof(*packet));
+    packet->frame_id = 0x10;
+    packet->data_id = field->data_id;
+    packet->value = value;
+    packet->valid = true;
+    packet->timestamp_us = now;
+    return true;
+}
+
+static void account_frame(sim_downlink_t *downlink, const crsf_packet_t *crsf_packet) {
+    downlink->frames++;
+    downlink->bytes += crsf_packet->length;
+}
+
+static void run_immediate(uint32_t duration_us, sim_downlink_t *downlink) {
+    sim_field_state_t states[SIM_FIELD_COUNT];
+    memset(states, 0, sizeof(states));
+    sim_rng_state = 0xC0FFEE;
+    telemetry_converter_init();
+
+    for (uint32_t now = 0; now < duration_us; now += SIM_STEP_US) {
+        for (size_t i = 0; i < SIM_FIELD_COUNT; i++) {
+            frsky_sport_packet_t packet;
+            crsf_packet_t crsf_packet;
+            if (next_packet(&sim_fields[i], &states[i], now, &packet) &&
+                convert_frsky_to_crsf(&packet, &crsf_packet)) {
+                account_frame(downlink, &crsf_packet);
+            }
+        }
+    }
+}
+
+static void run_scheduled(uint32_t duration_us, sim_downlink_t *downlink, sim_field_state_t *states) {
+    memset(states, 0, sizeof(sim_field_state_t) * SIM_FIELD_COUNT);
+    sim_rng_state = 0xC0FFEE;
+    telemetry_converter_init();
+
+    for (uint32_t now = 0; now < duration_us; now += SIM_STEP_US) {
+        for (size_t i = 0; i < SIM_FIELD_COUNT; i++) {
+            frsky_sport_packet_t packet;
+            uint32_t previous = states[i].value;
+            if (next_packet(&sim_fields[i], &states[i], now, &packet)) {
+                telemetry_converter_update(&packet, now);
+                if (states[i].value != previous && !states[i].pending) {
+                    states[i].pending = true;
+                    states[i].pending_since = now;
+                }
+            }
+        }
+
+        crsf_packet_t crsf_packet;
+        while (telemetry_converter_poll(now, &crsf_packet)) {
+            account_frame(downlink, &crsf_packet);
+            for (size_t i = 0; i < SIM_FIELD_COUNT; i++) {
+                sim_field_state_t *state = &states[i];
+                if (state->pending && sim_fields[i].crsf_type == crsf_packet.data[2]) {
+                    uint32_t latency = now - state->pending_since;
+                    state->latency_total += latency;
+                    state->latency_count++;
+                    if (latency > state->latency_max) {
+                        state->latency_max = latency;
+                    }
+                    state->pending = false;
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t seconds = argc > 1 ? (uint32_t)atoi(argv[1]) : SIM_DEFAULT_SECONDS;
+    if (seconds == 0 || seconds > 4000) {
+        fprintf(stderr, "Usage: %s [SECONDS (1-4000)]\n", argv[0]);
+        return 2;
+    }
+    uint32_t duration_us = seconds * 1000000u;
+
+    sim_downlink_t immediate = { 0, 0 };
+    sim_downlink_t scheduled = { 0, 0 };
+    sim_field_state_t states[SIM_FIELD_COUNT];
+
+    run_immediate(duration_us, &immediate);
+    run_scheduled(duration_us, &scheduled, states);
+
+    printf("Simulated %u s of sensor traffic\n\n", seconds);
+    printf("%-12s %10s %10s\n", "mode", "frames/s", "bytes/s");
+    printf("%-12s %10.1f %10.1f\n", "immediate", (double)immediate.frames / seconds, (double)immediate.bytes / seconds);
+    printf("%-12s %10.1f %10.1f\n", "scheduled", (double)scheduled.frames / seconds, (double)scheduled.bytes / seconds);
+    printf("\nDownlink reduction: %.1f%%\n",
+           immediate.bytes ? 100.0 * (1.0 - (double)scheduled.bytes / (double)immediate.bytes) : 0.0);
+
+    printf("\nUpdate latency with the scheduler (immediate mode is 0 by construction)\n");
+    printf("%-12s %10s %10s %8s\n", "field", "avg ms", "max ms", "updates");
+    for (size_t i = 0; i < SIM_FIELD_COUNT; i++) {
+        const sim_field_state_t *state = &states[i];
+        double average = state->latency_count ? (double)state->latency_total / state->latency_count / 1000.0 : 0.0;
+        printf("%-12s %10.1f %10.1f %8u\n", sim_fields[i].name, average, state->latency_max / 1000.0,
+               state->latency_count);
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Host check of the RPM, temperature and FLVSS cell conversion.
+//
+// Usage: sensor_frames_verify
+//
+// Unpacks FLVSS values of known bit layout: first cell index, cell count
+// and two 12-bit voltages in 2 mV steps, up to a first index of 15. Then
+// converts S.PORT packets of each kind on the virtual clock and compares
+// the CRSF cells, RPM and temperature frames byte for byte with frames
+// written out by hand: an odd cell count, the 12 cell limit, a second cell
+// sensor that is ignored, negative RPM in 24 bits and negative
+// temperatures. Prints every failed check; exits with 1 if there was one.
+#include <stdio.h>
+#include <string.h>
+#include "telemetry_converter.h"
+#include "hal_host.h"
+
+static unsigned failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static bool same_frame(const crsf_packet_t *packet, const uint8_t *expected, size_t expected_length) {
+    return packet->length == expected_length && memcmp(packet->data, expected, expected_length) == 0;
+}
+
+// FLVSS value from its fields, voltages in mV
+static uint32_t flvss(uint8_t first, uint8_t count, uint16_t mv0, uint16_t mv1) {
+    return (uint32_t)first | ((uint32_t)count << 4) | ((uint32_t)(mv0 / 2) << 8) | ((uint32_t)(mv1 / 2) << 20);
+}
+
+// Convert one packet at a fresh time, returns whether a frame came out
+static bool convert(uint16_t data_id, uint32_t value, crsf_packet_t *packet) {
+    hal_host_advance_time(1000);
+    frsky_sport_packet_t frsky_packet = {
+        .frame_id = 0x10, .data_id = data_id, .value = value, .valid = true, .timestamp_us = hal_time_us()
+    };
+    return convert_frsky_to_crsf(&frsky_packet, packet);
+}
+
+static void start_converter(void) {
+    hal_host_set_virtual_clock(true);
+    hal_host_set_time(1000);
+    telemetry_converter_init();
+}
+
+static void verify_cells_unpack(void) {
+    uint8_t first, count;
+    uint16_t mv[2];
+    frsky_cells_unpack(0x80180230, &first, &count, mv);
+    check(first == 0 && count == 3 && mv[0] == 4100 && mv[1] == 4098, "cells 1 and 2 of 3");
+    frsky_cells_unpack(0x0006D732, &first, &count, mv);
+    check(first == 2 && count == 3 && mv[0] == 3502 && mv[1] == 0, "odd last cell, empty second half");
+    frsky_cells_unpack(0xFFFFFFFF, &first, &count, mv);
+    check(first == 15 && count == 15 && mv[0] == 8190 && mv[1] == 8190, "all bits set");
+    frsky_cells_unpack(0x001000F0, &first, &count, mv);
+    check(first == 0 && count == 15 && mv[0] == 0 && mv[1] == 2, "voltage fields do not overlap");
+}
+
+// 4.100, 4.098 and 3.502 V; the second sensor's cells stay out
+static void verify_cells_frame(void) {
+    static const uint8_t expected[] = {
+        0xC8, 0x09, 0x0E, 0x00, 0x10, 0x04, 0x10, 0x02, 0x0D, 0xAE, 0x02
+    };
+    crsf_packet_t packet;
+    start_converter();
+    check(convert(FRSKY_ID_CELLS, flvss(0, 3, 4100, 4098), &packet), "first cell pair converted");
+    check(convert(FRSKY_ID_CELLS + 1, flvss(0, 3, 3000, 3000), &packet), "second sensor still gives a frame");
+    check(convert(FRSKY_ID_CELLS, flvss(2, 3, 3502, 0), &packet), "last cell converted");
+    check(same_frame(&packet, expected, sizeof(expected)), "cells frame bytes");
+
+    // 15 cells reported, the frame stops at 12
+    start_converter();
+    for (uint8_t first = 0; first < 15; first += 2) {
+        convert(FRSKY_ID_CELLS, flvss(first, 15, 3000 + first * 10, 3010 + first * 10), &packet);
+    }
+    check(packet.length == 4 + 1 + 2 * TELEMETRY_MAX_CELLS && packet.data[1] == 2 + 1 + 2 * TELEMETRY_MAX_CELLS,
+          "cells frame holds at most 12 cells");
+    check(packet.data[4] == 0x0B && packet.data[5] == 0xB8 && packet.data[26] == 0x0C && packet.data[27] == 0x26,
+          "first and twelfth cell");
+}
+
+// 12000 RPM and -5 RPM from two sensors, in the order first seen
+static void verify_rpm_frame(void) {
+    static const uint8_t expected[] = {
+        0xC8, 0x09, 0x0C, 0x00, 0x00, 0x2E, 0xE0, 0xFF, 0xFF, 0xFB, 0x00
+    };
+    crsf_packet_t packet;
+    start_converter();
+    convert(FRSKY_ID_RPM, 12000, &packet);
+    check(convert(FRSKY_ID_RPM + 1, (uint32_t)-5, &packet), "second RPM sensor converted");
+    check(same_frame(&packet, expected, sizeof(expected)), "RPM frame bytes");
+}
+
+// 25 and -7 degrees from TEMP1 and TEMP2, in deci-degrees on the wire
+static void verify_temperature_frame(void) {
+    static const uint8_t expected[] = {
+        0xC8, 0x07, 0x0D, 0x00, 0x00, 0xFA, 0xFF, 0xBA, 0x3C
+    };
+    crsf_packet_t packet;
+    start_converter();
+    convert(FRSKY_ID_TEMP1, 25, &packet);
+    check(convert(FRSKY_ID_TEMP2, (uint32_t)-7, &packet), "TEMP2 converted");
+    check(same_frame(&packet, expected, sizeof(expected)), "temperature frame bytes");
+}
+
+int main(void) {
+    verify_cells_unpack();
+    verify_cells_frame();
+    verify_rpm_frame();
+    verify_temperature_frame();
+    hal_host_set_virtual_clock(false);
+    printf("Sensor frame checks: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,447 @@
+// Soak test of the full pipeline on the host HAL with a virtual clock.
+//
+// Usage: pipeline_soak [--trace DUMP] [--rx-stats SNAPSHOT] [--mirror STREAM] [--receiver HZ] [HOURS]
+//
+// A synthetic sensor mix is injected as S.PORT bytes into bus 0 and the
+// pipeline runs exactly as on core1, one poll per virtual millisecond. The
+// GPS sensor drops out halfway through so the telemetry timeout is
+// exercised. Reports heartbeat cadence, LED toggles, downlink load, update
+// latency per frame type as seen on the wire and as recorded by the
+// pipeline's own histograms, how long GPS frames outlive their sensor and
+// when its loss is reported, and a checksum of the CRSF stream; the same run always gives the same output.
+// --trace writes the stage profiler ring at the end of the run in the same
+// format as the target, for tools/trace_decode.c; it only holds events when
+// the library was built with FRSKY_TRACE. --rx-stats writes the receive
+// accounting snapshot of the run, for tools/rx_stats_decode.c. --mirror
+// writes the binary telemetry mirror of the run, for tools/mirror_monitor.c.
+// --receiver
+// adds a CRSF receiver sending RC frames at HZ, link statistics every
+// 100 ms and one device ping, so the downlink is paced to it.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal_host.h"
+#include "pipeline.h"
+#include "crsf.h"
+#include "telemetry_converter.h"
+#include "trace.h"
+#include "rx_stats.h"
+#include "boot_phases.h"
+#include "units.h"
+#include "telemetry_mirror.h"
+#include "deferred_log.h"
+
+#define SOAK_STEP_US 1000u
+#define SOAK_DEFAULT_HOURS 1.0
+#define SOAK_MAX_RECEIVER_HZ 500u
+#define SOAK_LINK_STATS_US 100000u
+#define SOAK_PING_US 1000000u
+
+typedef struct {
+    uint16_t data_id;
+    uint8_t crsf_type;
+    uint8_t sensor_id;
+    uint32_t period_us;
+    uint8_t change_percent;
+    bool drops_out;
+    uint32_t value_range;     // Values wrap below this, inside the unit conversion's range
+} soak_sensor_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t latency_total;
+    uint64_t latency_max;
+    uint64_t latency_count;
+    bool pending;
+    uint64_t pending_since;
+    uint64_t last_frame;
+} soak_frame_stats_t;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t transfers;
+    uint32_t checksum;
+    uint64_t heartbeats;
+    uint64_t last_heartbeat;
+    uint64_t heartbeat_min;
+    uint64_t heartbeat_max;
+    soak_frame_stats_t types[256];
+} soak_downlink_t;
+
+static const soak_sensor_t soak_sensors[] = {
+    { FRSKY_ID_GPS_LONG_LATI, CRSF_FRAMETYPE_GPS, 0x83, 125000, 90, true, 0x10000000 },
+    { FRSKY_ID_GPS_ALT, CRSF_FRAMETYPE_GPS, 0x83, 250000, 50, true, UNITS_ALTITUDE_INPUT_MAX + 1 },
+    { FRSKY_ID_GPS_SPEED, CRSF_FRAMETYPE_GPS, 0x83, 250000, 60, true, UNITS_GPS_SPEED_INPUT_MAX + 1 },
+    { FRSKY_ID_VFAS, CRSF_FRAMETYPE_BATTERY_SENSOR, 0x22, 100000, 30, false, 656 },
+    { FRSKY_ID_CURR, CRSF_FRAMETYPE_BATTERY_SENSOR, 0x22, 100000, 50, false, 656 },
+    { FRSKY_ID_ALT, CRSF_FRAMETYPE_BARO_ALT, 0x00, 50000, 40, false, 1000000 },
+    { FRSKY_ID_VSPD, CRSF_FRAMETYPE_VARIO, 0x00, 50000, 60, false, 32768 },
+};
+
+#define SOAK_SENSOR_COUNT (sizeof(soak_sensors) / sizeof(soak_sensors[0]))
+
+static uint32_t soak_rng_state = 0x5EED;
+static soak_downlink_t downlink;
+
+static uint32_t soak_rand(void) {
+    uint32_t x = soak_rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    soak_rng_state = x;
+    return x;
+}
+
+// One byte-stuffed S.PORT frame, returns its length
+static size_t encode_sport_frame(uint8_t *out, uint8_t sensor_id, uint16_t data_id, uint32_t value) {
+    uint8_t raw[FRSKY_SPORT_PACKET_SIZE] = {
+        sensor_id, 0x10, (uint8_t)data_id, (uint8_t)(data_id >> 8),
+        (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24), 0
+    };
+    raw[FRSKY_SPORT_PACKET_SIZE - 1] = frsky_sport_crc(raw, FRSKY_SPORT_PACKET_SIZE - 1);
+
+    size_t length = 0;
+    out[length++] = FRSKY_SPORT_START_BYTE;
+    for (size_t i = 0; i < FRSKY_SPORT_PACKET_SIZE; i++) {
+        if (raw[i] == FRSKY_SPORT_START_BYTE || raw[i] == FRSKY_SPORT_STUFF_BYTE) {
+            out[length++] = FRSKY_SPORT_STUFF_BYTE;
+            out[length++] = raw[i] ^ 0x20;
+        } else {
+            out[length++] = raw[i];
+        }
+    }
+    return length;
+}
+
+// Uplink frames from the emulated receiver
+static void inject_receiver_frame(uint8_t type, const uint8_t *payload, uint8_t length) {
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    crsf_writer_t writer;
+    crsf_writer_begin(&writer, frame, sizeof(frame), type);
+    for (uint8_t i = 0; i < length; i++) {
+        crsf_writer_put_u8(&writer, payload[i]);
+    }
+    uint8_t frame_length = crsf_writer_finish(&writer);
+    hal_host_uart_inject(HAL_UART_CRSF, frame, frame_length);
+}
+
+static void run_receiver(uint64_t now, uint32_t receiver_hz) {
+    uint32_t interval_us = 1000000u / receiver_hz;
+    if (now % interval_us == 0) {
+        uint8_t channels[22];
+        for (size_t i = 0; i < sizeof(channels); i++) {
+            channels[i] = (uint8_t)soak_rand();
+        }
+        inject_receiver_frame(CRSF_FRAMETYPE_RC_CHANNELS_PACKED, channels, sizeof(channels));
+    }
+    if (now % SOAK_LINK_STATS_US == 0) {
+        const uint8_t link[10] = { 60, 62, 100, 9, 0, 5, 2, 70, 100, 8 };
+        inject_receiver_frame(CRSF_FRAMETYPE_LINK_STATISTICS, link, sizeof(link));
+    }
+    if (now == SOAK_PING_US) {
+        const uint8_t ping[2] = { CRSF_ADDRESS_BROADCAST, CRSF_ADDRESS_RADIO_TRANSMITTER };
+        inject_receiver_frame(CRSF_FRAMETYPE_DEVICE_PING, ping, sizeof(ping));
+    }
+}
+
+// Time the pipeline reported the GPS sensor lost
+static uint64_t gps_lost_us;
+
+static void on_sensor_lost(void *context, uint8_t frame_type, uint8_t source) {
+    (void)context;
+    DLOG3(LOG_SENSOR_LOST, frame_type, source, TELEMETRY_TIMEOUT_US / 1000);
+    if (frame_type == CRSF_FRAMETYPE_GPS) {
+        gps_lost_us = hal_host_time_us64();
+    }
+}
+
+// Downlink observer: the TX handler sees whole transfers, split them back
+// into frames by their length byte
+static void on_crsf_tx(void *context, const uint8_t *data, size_t length, uint32_t now) {
+    (void)context;
+    (void)now;
+    uint64_t time_us = hal_host_time_us64();
+    downlink.bytes += length;
+    downlink.transfers++;
+
+    size_t offset = 0;
+    while (offset + 2 < length) {
+        size_t frame_length = (size_t)data[offset + 1] + 2;
+        uint8_t type = data[offset + 2];
+        soak_frame_stats_t *stats = &downlink.types[type];
+        stats->frames++;
+        stats->last_frame = time_us;
+        if (stats->pending) {
+            uint64_t latency = time_us - stats->pending_since;
+            stats->latency_total += latency;
+            stats->latency_count++;
+            if (latency > stats->latency_max) {
+                stats->latency_max = latency;
+            }
+            stats->pending = false;
+        }
+
+        if (type == CRSF_FRAMETYPE_HEARTBEAT) {
+            if (downlink.heartbeats > 0) {
+                uint64_t interval = time_us - downlink.last_heartbeat;
+                if (downlink.heartbeats == 1 || interval < downlink.heartbeat_min) {
+                    downlink.heartbeat_min = interval;
+                }
+                if (interval > downlink.heartbeat_max) {
+                    downlink.heartbeat_max = interval;
+                }
+            }
+            downlink.heartbeats++;
+            downlink.last_heartbeat = time_us;
+        }
+
+        for (size_t i = 0; i < frame_length && offset + i < length; i++) {
+            downlink.checksum = (downlink.checksum ^ data[offset + i]) * 16777619u;
+        }
+        offset += frame_length;
+    }
+}
+
+// Telemetry mirror of the run, written as the target would send it
+static FILE *mirror_file;
+static telemetry_mirror_writer_t mirror_writer;
+
+static void write_mirror_record(const uint8_t *record, size_t length) {
+    fwrite(record, 1, length, mirror_file);
+}
+
+static void on_frsky_packet(void *context, const frsky_sport_packet_t *packet) {
+    (void)context;
+    uint8_t record[TELEMETRY_MIRROR_ENCODED_MAX];
+    write_mirror_record(record, telemetry_mirror_write_sport(&mirror_writer, record, sizeof(record), packet));
+}
+
+static void on_crsf_frame(void *context, const uint8_t *frame, uint8_t length) {
+    (void)context;
+    uint8_t record[TELEMETRY_MIRROR_ENCODED_MAX];
+    write_mirror_record(record, telemetry_mirror_write_crsf(&mirror_writer, record, sizeof(record), hal_time_us(),
+                                                            frame, length));
+}
+
+// Core0's log task: into the mirror when one is written
+static telemetry_mirror_writer_t log_writer;
+
+static void log_task(void *context, uint32_t now) {
+    (void)context;
+    (void)now;
+    log_record_t record;
+    while (deferred_log_pop(&record)) {
+        if (mirror_file) {
+            uint8_t out[TELEMETRY_MIRROR_ENCODED_MAX];
+            write_mirror_record(out, telemetry_mirror_write_log(&log_writer, out, sizeof(out), &record));
+        }
+    }
+}
+
+static void write_trace(void *context, const uint8_t *data, size_t length) {
+    fwrite(data, 1, length, context);
+}
+
+int main(int argc, char **argv) {
+    double hours = SOAK_DEFAULT_HOURS;
+    const char *trace_path = NULL;
+    const char *rx_stats_path = NULL;
+    const char *mirror_path = NULL;
+    uint32_t receiver_hz = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--rx-stats") == 0 && i + 1 < argc) {
+            rx_stats_path = argv[++i];
+        } else if (strcmp(argv[i], "--mirror") == 0 && i + 1 < argc) {
+            mirror_path = argv[++i];
+        } else if (strcmp(argv[i], "--receiver") == 0 && i + 1 < argc) {
+            receiver_hz = (uint32_t)atoi(argv[++i]);
+            if (receiver_hz == 0 || receiver_hz > SOAK_MAX_RECEIVER_HZ) {
+                hours = 0.0;
+                break;
+            }
+        } else {
+            hours = atof(argv[i]);
+        }
+    }
+    if (hours <= 0.0 || hours > 1000.0) {
+        fprintf(stderr, "Usage: %s [--trace DUMP] [--rx-stats SNAPSHOT] [--mirror STREAM] "
+                "[--receiver HZ (up to %u)] [HOURS (up to 1000)]\n", argv[0], SOAK_MAX_RECEIVER_HZ);
+        return 2;
+    }
+    uint64_t duration_us = (uint64_t)(hours * 3600.0 * 1e6);
+    uint64_t dropout_us = duration_us / 2;
+
+    hal_host_reset();
+    hal_host_set_virtual_clock(true);
+    hal_cycle_counter_init();
+    trace_init();
+    deferred_log_init();
+    downlink.checksum = 2166136261u;
+
+    hal_uart_config_t frsky = { FRSKY_BAUD_RATE, FRSKY_TX_PIN, FRSKY_RX_PIN };
+    hal_uart_config_t crsf = { CRSF_BAUD_RATE, CRSF_TX_PIN, CRSF_RX_PIN };
+    boot_phases_reset();
+    hal_uart_init(HAL_UART_CRSF, &crsf);
+    boot_phase_mark(BOOT_PHASE_CRSF_READY);
+    hal_uart_init(HAL_UART_SPORT(0), &frsky);
+    hal_host_uart_set_tx_handler(HAL_UART_CRSF, on_crsf_tx, NULL);
+
+    pipeline_t pipeline;
+    pipeline_hooks_t hooks = { .sensor_lost = on_sensor_lost };
+    if (mirror_path) {
+        mirror_file = fopen(mirror_path, "wb");
+        if (!mirror_file) {
+            fprintf(stderr, "Cannot write %s\n", mirror_path);
+            return 1;
+        }
+        uint8_t record[TELEMETRY_MIRROR_ENCODED_MAX];
+        telemetry_mirror_writer_init(&mirror_writer);
+        telemetry_mirror_writer_init(&log_writer);
+        write_mirror_record(record, telemetry_mirror_write_start(&mirror_writer, record, sizeof(record), hal_time_us()));
+        hooks.frsky_packet = on_frsky_packet;
+        hooks.crsf_frame = on_crsf_frame;
+    }
+    pipeline_init(&pipeline, &hooks, HEARTBEAT_INTERVAL_US, FRSKY_BAUD_RATE);
+    status_led_t led;
+    status_led_init(&led, LED_PIN, LED_BLINK_INTERVAL_US);
+    task_scheduler_t core0_tasks;
+    task_scheduler_init(&core0_tasks, 0);
+    task_scheduler_add(&core0_tasks, status_led_task, &led, led.interval_us, led.interval_us);
+    task_scheduler_add(&core0_tasks, log_task, NULL, DEFERRED_LOG_DRAIN_INTERVAL_US, 0);
+
+    uint32_t values[SOAK_SENSOR_COUNT] = { 0 };
+    uint64_t next_update[SOAK_SENSOR_COUNT] = { 0 };
+    uint64_t last_gps_packet = 0;
+    uint64_t sport_bytes = 0;
+
+    for (uint64_t now = 0; now < duration_us; now += SOAK_STEP_US) {
+        hal_host_set_time(now);
+
+        for (size_t i = 0; i < SOAK_SENSOR_COUNT; i++) {
+            const soak_sensor_t *sensor = &soak_sensors[i];
+            if (now < next_update[i] || (sensor->drops_out && now >= dropout_us)) {
+                continue;
+            }
+            next_update[i] += sensor->period_us;
+
+            // Latency runs from the injection of a changed value to the
+            // start of the transfer carrying it
+            if (soak_rand() % 100 < sensor->change_percent) {
+                values[i] += 100 * (1 + soak_rand() % 7);
+                soak_frame_stats_t *stats = &downlink.types[sensor->crsf_type];
+                if (!stats->pending) {
+                    stats->pending = true;
+                    stats->pending_since = now;
+                }
+            }
+            uint32_t value = values[i] % sensor->value_range;
+            if (sensor->data_id == FRSKY_ID_GPS_LONG_LATI && (next_update[i] / sensor->period_us) % 2) {
+                value |= 0x80000000;
+            }
+
+            uint8_t frame[2 * FRSKY_SPORT_PACKET_SIZE + 1];
+            size_t length = encode_sport_frame(frame, sensor->sensor_id, sensor->data_id, value);
+            hal_host_uart_inject(HAL_UART_SPORT(0), frame, length);
+            sport_bytes += length;
+            if (sensor->drops_out) {
+                last_gps_packet = now;
+            }
+        }
+
+        if (receiver_hz) {
+            run_receiver(now, receiver_hz);
+        }
+        pipeline_poll(&pipeline, (uint32_t)now);
+        task_scheduler_run(&core0_tasks);
+    }
+
+    double seconds = (double)duration_us / 1e6;
+    printf("Simulated %.2f h of flight (%.0f s), GPS lost at %.0f s\n\n", hours, seconds, (double)dropout_us / 1e6);
+    printf("S.PORT in: %llu bytes, %u packets decoded\n", (unsigned long long)sport_bytes,
+           pipeline.frsky_packets_valid);
+    printf("S.PORT receive:");
+    for (int cause = 0; cause < RX_STATS_CAUSE_COUNT; cause++) {
+        printf(" %s %u", rx_stats_cause_name((rx_stats_cause_t)cause), rx_stats_total((rx_stats_cause_t)cause));
+    }
+    printf("\n");
+    printf("Boot: first CRSF frame at %.1f ms, first sensor frame at %.1f ms\n",
+           boot_phase_time_us(BOOT_PHASE_FIRST_FRAME) / 1e3, boot_phase_time_us(BOOT_PHASE_FIRST_SENSOR_FRAME) / 1e3);
+    printf("CRSF out: %llu bytes in %llu transfers, %.1f bytes/s (%.1f%% of the line)\n",
+           (unsigned long long)downlink.bytes, (unsigned long long)downlink.transfers, downlink.bytes / seconds,
+           100.0 * downlink.bytes * 10.0 / seconds / CRSF_BAUD_RATE);
+    if (receiver_hz) {
+        const crsf_link_t *link = &pipeline.link;
+        printf("CRSF from receiver: %u frames, %u CRC errors, interval %u us; pacing: %u frames paced, "
+               "%u deferred, %u updates dropped\n", link->rx.frames, link->rx.crc_errors, link->interval_us,
+               link->pacing.paced, link->pacing.deferred, link->pacing.dropped);
+    }
+    printf("CRSF TX queue: %u dropped, high water %u/%u\n", pipeline.tx_queue.stats.frames_dropped,
+           pipeline.tx_queue.stats.high_water, CRSF_TX_QUEUE_DEPTH);
+    const task_t *heartbeat = &pipeline.tasks.tasks[pipeline.heartbeat_task];
+    printf("Heartbeat: %llu frames, interval %.1f..%.1f ms (configured %.1f ms), task late avg %.1f max %u us\n",
+           (unsigned long long)downlink.heartbeats, downlink.heartbeat_min / 1000.0, downlink.heartbeat_max / 1000.0,
+           HEARTBEAT_INTERVAL_US / 1000.0,
+           heartbeat->runs ? (double)heartbeat->late_total_us / heartbeat->runs : 0.0, heartbeat->late_max_us);
+    printf("LED: %u toggles (expected about %.0f)\n", hal_host_gpio_toggles(LED_PIN),
+           seconds * 1e6 / LED_BLINK_INTERVAL_US);
+
+    const soak_frame_stats_t *gps = &downlink.types[CRSF_FRAMETYPE_GPS];
+    printf("GPS frames stopped %.1f s after the last GPS packet (timeout %.1f s)\n",
+           gps->last_frame > last_gps_packet ? (gps->last_frame - last_gps_packet) / 1e6 : 0.0,
+           TELEMETRY_TIMEOUT_US / 1e6);
+    printf("Sensors lost: %u, GPS reported lost %.1f s after the last GPS packet\n", pipeline.sensors_lost,
+           gps_lost_us > last_gps_packet ? (gps_lost_us - last_gps_packet) / 1e6 : 0.0);
+
+    printf("\n%-6s %10s %10s %12s %12s\n", "type", "frames", "frames/s", "avg lat ms", "max lat ms");
+    for (int type = 0; type < 256; type++) {
+        const soak_frame_stats_t *stats = &downlink.types[type];
+        if (stats->frames > 0) {
+            printf("0x%02X   %10llu %10.1f %12.2f %12.2f\n", type, (unsigned long long)stats->frames,
+                   stats->frames / seconds,
+                   stats->latency_count ? (double)stats->latency_total / (double)stats->latency_count / 1000.0 : 0.0,
+                   stats->latency_max / 1000.0);
+        }
+    }
+
+    printf("\nPipeline latency, S.PORT start byte to CRSF sent (us)\n");
+    printf("%-6s %10s %10s %10s %10s\n", "type", "frames", "p50", "p99", "max");
+    for (int i = 0; i < pipeline.latency_count; i++) {
+        const latency_histogram_t *histogram = &pipeline.latency[i].histogram;
+        printf("0x%02X   %10u %10u %10u %10u\n", pipeline.latency[i].frame_type, histogram->count,
+               latency_histogram_percentile(histogram, 50), latency_histogram_percentile(histogram, 99),
+               histogram->max_us);
+    }
+    printf("\nCRSF stream checksum: %08x\n", downlink.checksum);
+
+    if (rx_stats_path) {
+        static uint8_t snapshot[RX_STATS_SNAPSHOT_MAX_SIZE];
+        size_t size = rx_stats_write_snapshot(snapshot, sizeof(snapshot), hal_time_us());
+        FILE *file = fopen(rx_stats_path, "wb");
+        if (!file) {
+            fprintf(stderr, "Cannot write %s\n", rx_stats_path);
+            return 1;
+        }
+        fwrite(snapshot, 1, size, file);
+        fclose(file);
+    }
+
+    if (trace_path) {
+        FILE *file = fopen(trace_path, "wb");
+        if (!file) {
+            fprintf(stderr, "Cannot write %s\n", trace_path);
+            return 1;
+        }
+        size_t size = trace_dump(write_trace, file);
+        fclose(file);
+        printf("Trace: %zu bytes written to %s\n", size, trace_path);
+    }
+    if (mirror_file) {
+        uint8_t record[TELEMETRY_MIRROR_ENCODED_MAX];
+        write_mirror_record(record, telemetry_mirror_write_end(&mirror_writer, record, sizeof(record), hal_time_us()));
+        printf("Mirror: %ld bytes written to %s\n", ftell(mirror_file), mirror_path);
+        fclose(mirror_file);
+    }
+    return 0;
+}
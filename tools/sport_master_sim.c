@@ -0,0 +1,170 @@
+// Adaptive S.PORT polling against a fake sensor bus on the host HAL.
+//
+// Usage: sport_master_sim [SECONDS]
+//
+// The pipeline runs in master mode on a virtual clock. Its polls go out on
+// bus 0, where a few fake sensors answer their physical ID after a short
+// turnaround, some of them not every time, and one is plugged in only
+// after a while. Reports polls and achieved update rate per ID next to the
+// rate a receiver polling all 28 IDs in turn would give, and how long the
+// late sensor took to be found. Exits with 1 if a sensor that always
+// answers got fewer updates than plain round-robin polling would give it.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal_host.h"
+#include "pipeline.h"
+#include "sport_master.h"
+
+#define SIM_STEP_US 100u
+#define SIM_TURNAROUND_US 1000u
+#define SIM_DEFAULT_SECONDS 60.0
+
+typedef struct {
+    uint8_t physical_id;
+    uint16_t data_ids[2];
+    uint8_t answer_percent;
+    uint32_t present_from_us;
+} sim_sensor_t;
+
+typedef struct {
+    bool pending;
+    uint64_t due_us;
+    uint8_t length;
+    uint8_t data[2 * FRSKY_SPORT_PACKET_SIZE];
+} sim_answer_t;
+
+static const sim_sensor_t sim_sensors[] = {
+    { 0, { FRSKY_ID_ALT, FRSKY_ID_VSPD }, 100, 0 },
+    { 2, { FRSKY_ID_VFAS, FRSKY_ID_CURR }, 100, 0 },
+    { 3, { FRSKY_ID_GPS_LONG_LATI, FRSKY_ID_GPS_ALT }, 90, 0 },
+    { 9, { FRSKY_ID_TEMP1, FRSKY_ID_TEMP1 }, 50, 0 },
+    { 17, { FRSKY_ID_RPM, FRSKY_ID_RPM }, 100, 20000000 },
+};
+
+#define SIM_SENSOR_COUNT (sizeof(sim_sensors) / sizeof(sim_sensors[0]))
+
+static uint32_t sim_rng_state = 0xBEEF;
+static sim_answer_t answer;
+static uint32_t answers_sent[SIM_SENSOR_COUNT];
+static uint64_t first_answer_us[SIM_SENSOR_COUNT];
+
+static uint32_t sim_rand(void) {
+    uint32_t x = sim_rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim_rng_state = x;
+    return x;
+}
+
+// One byte-stuffed S.PORT frame, returns its length
+static size_t encode_sport_frame(uint8_t *out, uint8_t sensor_id, uint16_t data_id, uint32_t value) {
+    uint8_t raw[FRSKY_SPORT_PACKET_SIZE] = {
+        sensor_id, 0x10, (uint8_t)data_id, (uint8_t)(data_id >> 8),
+        (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24), 0
+    };
+    raw[FRSKY_SPORT_PACKET_SIZE - 1] = frsky_sport_crc(raw, FRSKY_SPORT_PACKET_SIZE - 1);
+
+    size_t length = 0;
+    out[length++] = FRSKY_SPORT_START_BYTE;
+    for (size_t i = 0; i < FRSKY_SPORT_PACKET_SIZE; i++) {
+        if (raw[i] == FRSKY_SPORT_START_BYTE || raw[i] == FRSKY_SPORT_STUFF_BYTE) {
+            out[length++] = FRSKY_SPORT_STUFF_BYTE;
+            out[length++] = raw[i] ^ 0x20;
+        } else {
+            out[length++] = raw[i];
+        }
+    }
+    return length;
+}
+
+// The half-duplex line: the poll comes straight back as an echo, then the
+// sensor with that ID, if fitted, answers the rest of the frame after its
+// turnaround time
+static void on_sport_tx(void *context, const uint8_t *data, size_t length, uint32_t now) {
+    (void)context;
+    hal_host_uart_inject(HAL_UART_SPORT(0), data, length);
+    if (length != SPORT_MASTER_POLL_SIZE) {
+        return;
+    }
+
+    for (size_t i = 0; i < SIM_SENSOR_COUNT; i++) {
+        const sim_sensor_t *sensor = &sim_sensors[i];
+        if (sport_master_id_byte(sensor->physical_id) != data[1] || now < sensor->present_from_us ||
+            sim_rand() % 100 >= sensor->answer_percent) {
+            continue;
+        }
+        uint8_t frame[2 * FRSKY_SPORT_PACKET_SIZE + 1];
+        uint16_t data_id = sensor->data_ids[answers_sent[i] % 2];
+        size_t frame_length = encode_sport_frame(frame, data[1], data_id, sim_rand() & 0xFFFF);
+        answer.pending = true;
+        answer.due_us = hal_host_time_us64() + length * 10u * 1000000u / FRSKY_BAUD_RATE + SIM_TURNAROUND_US;
+        answer.length = (uint8_t)(frame_length - 2);
+        memcpy(answer.data, &frame[2], answer.length);
+        if (answers_sent[i]++ == 0) {
+            first_answer_us[i] = hal_host_time_us64();
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : SIM_DEFAULT_SECONDS;
+    if (argc > 2 || seconds <= 0.0 || seconds > 86400.0) {
+        fprintf(stderr, "Usage: %s [SECONDS]\n", argv[0]);
+        return 2;
+    }
+    uint64_t duration_us = (uint64_t)(seconds * 1e6);
+
+    hal_host_reset();
+    hal_host_set_virtual_clock(true);
+    hal_uart_config_t frsky = { FRSKY_BAUD_RATE, FRSKY_TX_PIN, FRSKY_RX_PIN };
+    hal_uart_config_t crsf = { CRSF_BAUD_RATE, CRSF_TX_PIN, CRSF_RX_PIN };
+    hal_uart_init(HAL_UART_CRSF, &crsf);
+    hal_uart_init(HAL_UART_SPORT(0), &frsky);
+    hal_host_uart_set_tx_handler(HAL_UART_SPORT(0), on_sport_tx, NULL);
+
+    static pipeline_t pipeline;
+    pipeline_init(&pipeline, NULL, HEARTBEAT_INTERVAL_US, FRSKY_BAUD_RATE);
+    pipeline_set_sport_master(&pipeline, true, 0);
+
+    for (uint64_t now = 0; now < duration_us; now += SIM_STEP_US) {
+        hal_host_set_time(now);
+        if (answer.pending && now >= answer.due_us) {
+            hal_host_uart_inject(HAL_UART_SPORT(0), answer.data, answer.length);
+            answer.pending = false;
+        }
+        pipeline_poll(&pipeline, (uint32_t)now);
+    }
+
+    const sport_master_t *master = &pipeline.master;
+    double round_robin_hz = 1e6 / ((double)SPORT_MASTER_IDS * SPORT_MASTER_SLOT_US);
+    printf("Simulated %.0f s, %u polls in %u us slots (%u probes of silent IDs)\n", seconds, master->polls,
+           SPORT_MASTER_SLOT_US, master->probes);
+    printf("Round-robin polling of all %d IDs: %.2f updates/s per sensor\n\n", SPORT_MASTER_IDS, round_robin_hz);
+    printf("%-4s %8s %8s %8s %12s %12s %10s\n", "id", "answers", "polls", "answer%", "updates/s", "last window",
+           "found ms");
+
+    int failures = 0;
+    for (size_t i = 0; i < SIM_SENSOR_COUNT; i++) {
+        const sim_sensor_t *sensor = &sim_sensors[i];
+        const sport_master_sensor_t *state = &master->sensors[sensor->physical_id];
+        double present_s = (double)(duration_us - sensor->present_from_us) / 1e6;
+        double rate = present_s > 0.0 ? state->answers / present_s : 0.0;
+        printf("%-4u %8u %8u %8u %12.2f %12.2f %10.1f\n", sensor->physical_id, state->answers, state->polls,
+               sensor->answer_percent, rate, state->rate_hz,
+               answers_sent[i] ? (double)(first_answer_us[i] - sensor->present_from_us) / 1e3 : -1.0);
+        if (sensor->answer_percent == 100 && rate < round_robin_hz) {
+            failures++;
+        }
+    }
+
+    uint32_t silent_polls = 0;
+    for (uint8_t id = 0; id < SPORT_MASTER_IDS; id++) {
+        silent_polls += master->sensors[id].answers ? 0 : master->sensors[id].polls;
+    }
+    printf("\nPolls of IDs that never answered: %u (%.1f%%)\n", silent_polls,
+           master->polls ? 100.0 * silent_polls / master->polls : 0.0);
+    printf("Sensors below the round-robin rate: %d: %s\n", failures, failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+// Replay a raw S.PORT capture through the parser and converter.
+//
+// Usage: sport_replay [--speed FACTOR] [--immediate] CAPTURE CRSF_OUT [LATENCY_CSV]
+//
+// Each recorded run is fed to the decoder of its bus at its capture time on
+// a virtual clock. The produced CRSF frames are written to CRSF_OUT back to
+// back, and one line per frame to LATENCY_CSV:
+//
+//   time_us,type,length,latency_us,wall_ns
+//
+// latency_us is the virtual time from the first change of a frame's data to
+// the frame being produced (empty for keepalive frames). wall_ns is the host
+// time from feeding the run to producing the frame. Without --speed the
+// capture is replayed as fast as possible; --speed 1 is real time, 2 twice
+// as fast. --immediate uses one CRSF frame per FrSky packet instead of the
+// frame scheduler.
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "frsky_sport.h"
+#include "crsf.h"
+#include "telemetry_converter.h"
+#include "sport_capture.h"
+
+#define REPLAY_MAX_BUSES 8
+#define REPLAY_POLL_STEP_US 1000u
+
+typedef struct {
+    bool pending;
+    uint64_t since;
+} replay_pending_t;
+
+typedef struct {
+    double speed;
+    bool immediate;
+    FILE *crsf_out;
+    FILE *latency_out;
+} replay_options_t;
+
+typedef struct {
+    uint64_t runs;
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t frames;
+    uint64_t frame_bytes;
+    uint64_t skipped_runs;
+    uint64_t latency_total;
+    uint64_t latency_max;
+    uint64_t latency_count;
+} replay_totals_t;
+
+static frsky_sport_decoder_t decoders[REPLAY_MAX_BUSES];
+static replay_pending_t pending[256];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint8_t *load_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = size > 0 ? malloc((size_t)size) : NULL;
+    *length = data ? fread(data, 1, (size_t)size, file) : 0;
+    fclose(file);
+    return data;
+}
+
+// Sleep until the scaled capture time of a run has been reached
+static void pace(const replay_options_t *options, uint64_t wall_start, uint64_t capture_us) {
+    uint64_t target = wall_start + (uint64_t)((double)capture_us * 1000.0 / options->speed);
+    uint64_t now = now_ns();
+    if (target > now) {
+        uint64_t wait = target - now;
+        struct timespec ts = { (time_t)(wait / 1000000000ull), (long)(wait % 1000000000ull) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void emit_frame(const replay_options_t *options, replay_totals_t *totals, uint64_t time_us,
+                       const uint8_t *frame, uint8_t length, uint64_t wall_start) {
+    uint8_t type = frame[2];
+    uint64_t wall = now_ns() - wall_start;
+
+    fwrite(frame, 1, length, options->crsf_out);
+    totals->frames++;
+    totals->frame_bytes += length;
+
+    if (pending[type].pending) {
+        uint64_t latency = time_us - pending[type].since;
+        pending[type].pending = false;
+        totals->latency_total += latency;
+        totals->latency_count++;
+        if (latency > totals->latency_max) {
+            totals->latency_max = latency;
+        }
+        if (options->latency_out) {
+            fprintf(options->latency_out, "%llu,0x%02X,%u,%llu,%llu\n", (unsigned long long)time_us, type, length,
+                    (unsigned long long)latency, (unsigned long long)wall);
+        }
+    } else if (options->latency_out) {
+        fprintf(options->latency_out, "%llu,0x%02X,%u,,%llu\n", (unsigned long long)time_us, type, length,
+                (unsigned long long)wall);
+    }
+}
+
+static void poll_frames(const replay_options_t *options, replay_totals_t *totals, uint64_t time_us,
+                        uint64_t wall_start) {
+    uint8_t frame[CRSF_MAX_PACKET_SIZE];
+    uint8_t length;
+    while ((length = telemetry_converter_poll_frame((uint32_t)time_us, frame, sizeof(frame))) > 0) {
+        emit_frame(options, totals, time_us, frame, length, wall_start);
+    }
+}
+
+static void convert_packets(const replay_options_t *options, replay_totals_t *totals, frsky_sport_decoder_t *decoder,
+                            uint64_t time_us, uint64_t wall_start) {
+    frsky_sport_packet_t packets[FRSKY_SPORT_QUEUE_SIZE];
+    size_t count = frsky_sport_decoder_get_packets(decoder, packets, FRSKY_SPORT_QUEUE_SIZE);
+
+    for (size_t i = 0; i < count; i++) {
+        totals->packets++;
+        if (options->immediate) {
+            crsf_packet_t crsf_packet;
+            if (convert_frsky_to_crsf(&packets[i], &crsf_packet)) {
+                pending[crsf_packet.data[2]].pending = true;
+                pending[crsf_packet.data[2]].since = time_us;
+                emit_frame(options, totals, time_us, crsf_packet.data, crsf_packet.length, wall_start);
+            }
+            continue;
+        }
+
+        uint8_t type = telemetry_converter_update(&packets[i], (uint32_t)time_us);
+        if (type != 0 && !pending[type].pending) {
+            pending[type].pending = true;
+            pending[type].since = time_us;
+        }
+    }
+}
+
+static void replay(const replay_options_t *options, sport_capture_reader_t *reader, replay_totals_t *totals) {
+    sport_capture_run_t run;
+    uint64_t poll_time = 0;
+    uint64_t wall_origin = now_ns();
+
+    for (uint8_t bus = 0; bus < REPLAY_MAX_BUSES; bus++) {
+        frsky_sport_decoder_init(&decoders[bus], bus);
+    }
+    telemetry_converter_init();
+
+    while (sport_capture_next(reader, &run)) {
+        if (run.bus >= REPLAY_MAX_BUSES) {
+            totals->skipped_runs++;
+            continue;
+        }
+        if (options->speed > 0.0) {
+            pace(options, wall_origin, run.time_us);
+        }
+
+        // Keepalives due between runs are produced at their own time
+        if (!options->immediate) {
+            for (; poll_time + REPLAY_POLL_STEP_US < run.time_us; poll_time += REPLAY_POLL_STEP_US) {
+                poll_frames(options, totals, poll_time, now_ns());
+            }
+        }
+
+        uint64_t wall_start = now_ns();
+        frsky_sport_decoder_process_buffer_at(&decoders[run.bus], run.data, run.length, (uint32_t)run.time_us);
+        convert_packets(options, totals, &decoders[run.bus], run.time_us, wall_start);
+        if (!options->immediate) {
+            poll_frames(options, totals, run.time_us, wall_start);
+            poll_time = run.time_us;
+        }
+        totals->runs++;
+        totals->bytes += run.length;
+    }
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--speed FACTOR] [--immediate] CAPTURE CRSF_OUT [LATENCY_CSV]\n", program);
+}
+
+int main(int argc, char **argv) {
+    replay_options_t options = { 0.0, false, NULL, NULL };
+    const char *paths[3] = { NULL, NULL, NULL };
+    int path_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            options.speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--immediate") == 0) {
+            options.immediate = true;
+        } else if (argv[i][0] != '-' && path_count < 3) {
+            paths[path_count++] = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path_count < 2 || options.speed < 0.0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    size_t length = 0;
+    uint8_t *data = load_file(paths[0], &length);
+    sport_capture_reader_t reader;
+    if (!data || !sport_capture_reader_init(&reader, data, length)) {
+        fprintf(stderr, "%s: not an S.PORT capture\n", paths[0]);
+        return 1;
+    }
+
+    options.crsf_out = fopen(paths[1], "wb");
+    if (!options.crsf_out) {
+        fprintf(stderr, "Cannot write %s\n", paths[1]);
+        return 1;
+    }
+    if (paths[2]) {
+        options.latency_out = fopen(paths[2], "w");
+        if (!options.latency_out) {
+            fprintf(stderr, "Cannot write %s\n", paths[2]);
+            return 1;
+        }
+        fprintf(options.latency_out, "time_us,type,length,latency_us,wall_ns\n");
+    }
+
+    replay_totals_t totals;
+    memset(&totals, 0, sizeof(totals));
+    uint64_t start = now_ns();
+    replay(&options, &reader, &totals);
+    double elapsed_s = (double)(now_ns() - start) / 1e9;
+
+    double capture_s = (double)reader.time_us / 1e6;
+    printf("Capture: %.1f s, %llu runs, %llu bytes, %llu packets",
+           capture_s, (unsigned long long)totals.runs, (unsigned long long)totals.bytes,
+           (unsigned long long)totals.packets);
+    if (totals.skipped_runs) {
+        printf(", %llu runs on unknown buses skipped", (unsigned long long)totals.skipped_runs);
+    }
+    printf("\n");
+    printf("CRSF (%s): %llu frames, %llu bytes\n", options.immediate ? "immediate" : "scheduled",
+           (unsigned long long)totals.frames, (unsigned long long)totals.frame_bytes);
+    printf("Replay: %.3f s, %.1f MB/s, %.0f packets/s\n", elapsed_s,
+           elapsed_s > 0.0 ? (double)totals.bytes / elapsed_s / 1e6 : 0.0,
+           elapsed_s > 0.0 ? (double)totals.packets / elapsed_s : 0.0);
+    printf("Update latency: avg %.1f ms, max %.1f ms over %llu frames\n",
+           totals.latency_count ? (double)totals.latency_total / (double)totals.latency_count / 1000.0 : 0.0,
+           (double)totals.latency_max / 1000.0, (unsigned long long)totals.latency_count);
+
+    fclose(options.crsf_out);
+    if (options.latency_out) {
+        fclose(options.latency_out);
+    }
+    free(data);
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Stress test of the core-to-core SPSC queue with host threads.
+//
+// Usage: spsc_queue_stress [MESSAGES]
+//
+// One producer and one consumer thread pass numbered messages through a
+// small queue, each message's words all derived from its number. In the
+// first pass the producer retries a refused push, so every message must
+// arrive, in order and whole, and every refusal must show in the drop
+// count. In the second pass refused messages are given up, so the numbers
+// received must still rise, and the messages received and the drop count
+// must add up to the messages sent. Before both the queue is filled from
+// one thread to check that it takes exactly its capacity. Both threads
+// yield while they wait, so a single CPU host gets through too. Exits with
+// 1 on any failure. Build with -fsanitize=thread to have the memory model
+// checked as well.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include "spsc_queue.h"
+
+#define STRESS_DEFAULT_MESSAGES 2000000u
+#define STRESS_QUEUE_CAPACITY 64u
+#define STRESS_MESSAGE_WORDS 4
+
+typedef struct {
+    uint32_t number;
+    uint32_t words[STRESS_MESSAGE_WORDS];
+} stress_message_t;
+
+typedef struct {
+    bool retry;
+    uint32_t messages;
+    uint64_t refused;
+} stress_producer_t;
+
+typedef struct {
+    uint64_t received;
+    uint64_t gaps;
+    uint64_t out_of_order;
+    uint64_t torn;
+} stress_consumer_t;
+
+static spsc_queue_t queue;
+static stress_message_t storage[STRESS_QUEUE_CAPACITY];
+static atomic_bool producer_done;
+static unsigned failures;
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static uint32_t word_for(uint32_t number, unsigned word) {
+    return (number * 2654435761u) ^ (word * 0x01010101u);
+}
+
+static stress_message_t make_message(uint32_t number) {
+    stress_message_t message = { .number = number };
+    for (unsigned i = 0; i < STRESS_MESSAGE_WORDS; i++) {
+        message.words[i] = word_for(number, i);
+    }
+    return message;
+}
+
+static void *producer_thread(void *argument) {
+    stress_producer_t *producer = argument;
+    for (uint32_t number = 1; number <= producer->messages; number++) {
+        stress_message_t message = make_message(number);
+        while (!spsc_queue_push(&queue, &message)) {
+            producer->refused++;
+            sched_yield();
+            if (!producer->retry) {
+                break;
+            }
+        }
+    }
+    atomic_store_explicit(&producer_done, true, memory_order_release);
+    return NULL;
+}
+
+static void *consumer_thread(void *argument) {
+    stress_consumer_t *consumer = argument;
+    uint32_t last = 0;
+    stress_message_t message;
+    for (;;) {
+        bool done = atomic_load_explicit(&producer_done, memory_order_acquire);
+        if (!spsc_queue_pop(&queue, &message)) {
+            if (done) {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        consumer->received++;
+        if (message.number <= last) {
+            consumer->out_of_order++;
+        } else {
+            consumer->gaps += message.number - last - 1;
+        }
+        last = message.number;
+        for (unsigned i = 0; i < STRESS_MESSAGE_WORDS; i++) {
+            if (message.words[i] != word_for(message.number, i)) {
+                consumer->torn++;
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+// One producer and one consumer through a fresh queue
+static void run_pass(bool retry, uint32_t messages, stress_producer_t *producer, stress_consumer_t *consumer) {
+    spsc_queue_init(&queue, storage, sizeof(stress_message_t), STRESS_QUEUE_CAPACITY);
+    atomic_store(&producer_done, false);
+    *producer = (stress_producer_t){ .retry = retry, .messages = messages };
+    *consumer = (stress_consumer_t){ 0 };
+
+    pthread_t producer_id;
+    pthread_t consumer_id;
+    pthread_create(&consumer_id, NULL, consumer_thread, consumer);
+    pthread_create(&producer_id, NULL, producer_thread, producer);
+    pthread_join(producer_id, NULL);
+    pthread_join(consumer_id, NULL);
+}
+
+// Single thread: exactly the capacity fits, the next push is dropped
+static void verify_capacity(void) {
+    spsc_queue_t small;
+    stress_message_t slots[4];
+    check(!spsc_queue_init(&small, slots, sizeof(stress_message_t), 3), "init rejects a capacity of 3");
+    check(spsc_queue_init(&small, slots, sizeof(stress_message_t), 4), "init accepts a capacity of 4");
+
+    for (uint32_t number = 1; number <= 4; number++) {
+        stress_message_t message = make_message(number);
+        check(spsc_queue_push(&small, &message), "pushes up to the capacity succeed");
+    }
+    stress_message_t message = make_message(5);
+    check(!spsc_queue_push(&small, &message), "a push into a full queue fails");
+    check(small.dropped == 1 && spsc_queue_count(&small) == 4, "the failed push is counted dropped");
+    check(spsc_queue_pop(&small, &message) && message.number == 1, "the oldest message pops first");
+    message = make_message(6);
+    check(spsc_queue_push(&small, &message), "a pop makes room again");
+}
+
+int main(int argc, char **argv) {
+    uint32_t messages = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : STRESS_DEFAULT_MESSAGES;
+    if (argc > 2 || messages == 0) {
+        fprintf(stderr, "Usage: %s [MESSAGES]\n", argv[0]);
+        return 2;
+    }
+
+    verify_capacity();
+
+    stress_producer_t producer;
+    stress_consumer_t consumer;
+    run_pass(true, messages, &producer, &consumer);
+    printf("Retrying producer: %u messages through %u slots, %llu pushes refused\n", messages,
+           STRESS_QUEUE_CAPACITY, (unsigned long long)producer.refused);
+    check(consumer.received == messages && consumer.gaps == 0, "no message lost while retrying");
+    check(consumer.out_of_order == 0, "messages arrive in order");
+    check(consumer.torn == 0, "messages arrive whole");
+    check(queue.dropped == producer.refused, "every refused push is counted dropped");
+
+    run_pass(false, messages, &producer, &consumer);
+    printf("Dropping producer: %llu received, %llu dropped\n", (unsigned long long)consumer.received,
+           (unsigned long long)queue.dropped);
+    check(consumer.out_of_order == 0, "messages still arrive in order");
+    check(consumer.torn == 0, "messages still arrive whole");
+    check(queue.dropped == producer.refused, "the drop count matches the refused pushes");
+    check(consumer.gaps <= queue.dropped, "every gap is a counted drop");
+    check(consumer.received + queue.dropped == messages, "received and dropped add up to the messages sent");
+
+    printf("SPSC queue checks: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
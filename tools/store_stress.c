@@ -0,0 +1,116 @@
+// Torn-read stress test of the telemetry store with host threads.
+//
+// Usage: store_stress [SECONDS] [READERS]
+//
+// One writer thread publishes records to every group as fast as it can,
+// each record's words all derived from one counter. Reader threads copy
+// groups concurrently and check that every word of a copy belongs to the
+// same record and that versions never go backwards. Reports publishes,
+// reads and torn copies; exits with 1 if any copy was torn or out of order. Build with -fsanitize=thread to have the memory
+// model checked as well.
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "telemetry_store.h"
+
+#define STRESS_DEFAULT_SECONDS 5.0
+#define STRESS_DEFAULT_READERS 3
+#define STRESS_MAX_READERS 16
+
+typedef struct {
+    unsigned index;
+    uint64_t reads;
+    uint64_t torn;
+    uint64_t backwards;
+} stress_reader_t;
+
+static telemetry_store_t store;
+static atomic_bool stop;
+static uint64_t writes;
+
+static uint32_t word_for(uint32_t record, unsigned group, unsigned word) {
+    return (record * 2654435761u) ^ (group << 24) ^ (word * 0x01010101u);
+}
+
+static void *writer_thread(void *argument) {
+    (void)argument;
+    uint32_t words[TELEMETRY_STORE_GROUP_WORDS];
+    for (uint32_t record = 1; !atomic_load_explicit(&stop, memory_order_relaxed); record++) {
+        unsigned group = record % TELEMETRY_STORE_GROUPS;
+        for (unsigned i = 0; i < TELEMETRY_STORE_GROUP_WORDS; i++) {
+            words[i] = i == 0 ? record : word_for(record, group, i);
+        }
+        telemetry_store_publish(&store, (uint8_t)group, words, sizeof(words));
+        writes++;
+    }
+    return NULL;
+}
+
+static void *reader_thread(void *argument) {
+    stress_reader_t *reader = argument;
+    uint32_t last_version[TELEMETRY_STORE_GROUPS] = { 0 };
+    uint32_t words[TELEMETRY_STORE_GROUP_WORDS];
+
+    for (unsigned n = reader->index; !atomic_load_explicit(&stop, memory_order_relaxed); n++) {
+        unsigned group = n % TELEMETRY_STORE_GROUPS;
+        uint32_t version = telemetry_store_read(&store, (uint8_t)group, words, sizeof(words));
+        reader->reads++;
+        if (version < last_version[group]) {
+            reader->backwards++;
+        }
+        last_version[group] = version;
+        if (version == 0) {
+            continue;
+        }
+        for (unsigned i = 1; i < TELEMETRY_STORE_GROUP_WORDS; i++) {
+            if (words[i] != word_for(words[0], group, i)) {
+                reader->torn++;
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : STRESS_DEFAULT_SECONDS;
+    int reader_count = argc > 2 ? atoi(argv[2]) : STRESS_DEFAULT_READERS;
+    if (argc > 3 || seconds <= 0.0 || reader_count < 1 || reader_count > STRESS_MAX_READERS) {
+        fprintf(stderr, "Usage: %s [SECONDS] [READERS (1 to %d)]\n", argv[0], STRESS_MAX_READERS);
+        return 2;
+    }
+
+    telemetry_store_init(&store);
+    static stress_reader_t readers[STRESS_MAX_READERS];
+    pthread_t reader_threads[STRESS_MAX_READERS];
+    pthread_t writer;
+    pthread_create(&writer, NULL, writer_thread, NULL);
+    for (int i = 0; i < reader_count; i++) {
+        readers[i].index = (unsigned)i;
+        pthread_create(&reader_threads[i], NULL, reader_thread, &readers[i]);
+    }
+
+    struct timespec duration = { (time_t)seconds, (long)((seconds - (double)(time_t)seconds) * 1e9) };
+    nanosleep(&duration, NULL);
+    atomic_store(&stop, true);
+    pthread_join(writer, NULL);
+
+    uint64_t reads = 0, torn = 0, backwards = 0;
+    for (int i = 0; i < reader_count; i++) {
+        pthread_join(reader_threads[i], NULL);
+        reads += readers[i].reads;
+        torn += readers[i].torn;
+        backwards += readers[i].backwards;
+    }
+
+    printf("%.1f s, 1 writer, %d readers, %d groups of %d words\n", seconds, reader_count, TELEMETRY_STORE_GROUPS,
+           TELEMETRY_STORE_GROUP_WORDS);
+    printf("Publishes: %llu\n", (unsigned long long)writes);
+    printf("Reads: %llu, torn: %llu, version went back: %llu: %s\n", (unsigned long long)reads,
+           (unsigned long long)torn, (unsigned long long)backwards, torn || backwards ? "FAIL" : "ok");
+    return torn || backwards ? 1 : 0;
+}
@@ -0,0 +1,175 @@
+// Task scheduler of an event-driven core loop on the host HAL.
+//
+// Usage: task_sched_sim [SECONDS]
+//
+// A core loop runs on the virtual clock with the tasks of core1 (heartbeat,
+// sensor expiry, statistics) and core0 (LED), each costing a fixed time,
+// while S.PORT packets arrive at random and take a random time to process.
+// Packets wake the idle core through hal_host_post_event, like the receive
+// interrupt on the target. The same event sequence then runs through the
+// old busy loop, which compared the time since the last heartbeat on every
+// pass. Reports per task how late it ran behind its deadline, the heartbeat
+// interval spread and drift of both loops and the idle time of the
+// scheduled one.
+// Exits with 1 if a task ran later than the longest packet plus the other
+// tasks' runs, the bound of a cooperative scheduler, or skipped a period.
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal_host.h"
+#include "task_scheduler.h"
+
+#define SIM_DEFAULT_SECONDS 600.0
+#define SIM_IDLE_LIMIT_US 250u
+#define SIM_PACKET_GAP_MIN_US 500u
+#define SIM_PACKET_GAP_SPREAD_US 12000u
+#define SIM_PACKET_COST_MIN_US 20u
+#define SIM_PACKET_COST_SPREAD_US 280u
+#define SIM_POLL_PASS_US 5u
+
+typedef struct {
+    const char *name;
+    uint32_t interval_us;
+    uint32_t cost_us;
+} sim_task_t;
+
+static const sim_task_t sim_tasks[] = {
+    { "heartbeat", HEARTBEAT_INTERVAL_US, 15 },
+    { "sensor expiry", FRESHNESS_TICK_US, 10 },
+    { "statistics", PIPELINE_STATS_INTERVAL_US, 120 },
+    { "LED", LED_BLINK_INTERVAL_US, 2 },
+};
+
+#define SIM_TASK_COUNT (sizeof(sim_tasks) / sizeof(sim_tasks[0]))
+
+typedef struct {
+    uint64_t last_us;
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+} sim_interval_t;
+
+static uint32_t sim_rng_state;
+static uint64_t next_packet_us;
+static uint64_t packets;
+static sim_interval_t heartbeat_intervals;
+
+static uint32_t sim_rand(void) {
+    uint32_t x = sim_rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim_rng_state = x;
+    return x;
+}
+
+static void interval_seen(sim_interval_t *intervals, uint64_t now) {
+    if (intervals->count > 0) {
+        uint32_t interval = (uint32_t)(now - intervals->last_us);
+        if (intervals->count == 1 || interval < intervals->min_us) {
+            intervals->min_us = interval;
+        }
+        if (interval > intervals->max_us) {
+            intervals->max_us = interval;
+        }
+    }
+    intervals->count++;
+    intervals->last_us = now;
+}
+
+static void run_task(void *context, uint32_t now) {
+    const sim_task_t *task = context;
+    (void)now;
+    if (task == &sim_tasks[0]) {
+        interval_seen(&heartbeat_intervals, hal_host_time_us64());
+    }
+    hal_host_advance_time(task->cost_us);
+}
+
+// Process the packets that have arrived, each one busy for its cost, and
+// arm the wakeup of the next
+static void receive_packets(void) {
+    while (hal_host_time_us64() >= next_packet_us) {
+        hal_host_advance_time(SIM_PACKET_COST_MIN_US + sim_rand() % SIM_PACKET_COST_SPREAD_US);
+        next_packet_us += SIM_PACKET_GAP_MIN_US + sim_rand() % SIM_PACKET_GAP_SPREAD_US;
+        packets++;
+    }
+    hal_host_post_event(next_packet_us);
+}
+
+static void start_run(void) {
+    hal_host_reset();
+    hal_host_set_virtual_clock(true);
+    sim_rng_state = 0x2545F491;
+    next_packet_us = SIM_PACKET_GAP_MIN_US;
+    packets = 0;
+    heartbeat_intervals = (sim_interval_t){ 0 };
+}
+
+// Interval spread, and how far the last heartbeat is behind where the
+// configured rate puts it
+static void print_intervals(const char *loop) {
+    uint64_t nominal = (uint64_t)(heartbeat_intervals.count - 1) * HEARTBEAT_INTERVAL_US;
+    printf("%s loop: %u heartbeats, interval %.3f..%.3f ms, %.1f ms behind the configured rate\n", loop,
+           heartbeat_intervals.count, heartbeat_intervals.min_us / 1000.0, heartbeat_intervals.max_us / 1000.0,
+           (double)(heartbeat_intervals.last_us - nominal) / 1000.0);
+}
+
+int main(int argc, char **argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : SIM_DEFAULT_SECONDS;
+    if (argc > 2 || seconds <= 0.0 || seconds > 86400.0) {
+        fprintf(stderr, "Usage: %s [SECONDS]\n", argv[0]);
+        return 2;
+    }
+    uint64_t duration_us = (uint64_t)(seconds * 1e6);
+
+    // Scheduled: run what is due, then sleep until the next deadline or
+    // packet
+    start_run();
+    static task_scheduler_t scheduler;
+    task_scheduler_init(&scheduler, 0);
+    uint32_t task_costs = 0;
+    for (size_t i = 0; i < SIM_TASK_COUNT; i++) {
+        task_scheduler_add(&scheduler, run_task, (void *)&sim_tasks[i], sim_tasks[i].interval_us, 0);
+        task_costs += sim_tasks[i].cost_us;
+    }
+    while (hal_host_time_us64() < duration_us) {
+        task_scheduler_run(&scheduler);
+        receive_packets();
+        task_scheduler_idle(&scheduler, SIM_IDLE_LIMIT_US);
+    }
+
+    printf("Simulated %.0f s, %llu packets of %u..%u us\n\n", seconds, (unsigned long long)packets,
+           SIM_PACKET_COST_MIN_US, SIM_PACKET_COST_MIN_US + SIM_PACKET_COST_SPREAD_US - 1);
+    uint32_t bound = SIM_PACKET_COST_MIN_US + SIM_PACKET_COST_SPREAD_US - 1 + task_costs;
+    bool failed = false;
+    printf("%-14s %10s %10s %12s %12s %8s\n", "task", "interval", "runs", "avg late us", "max late us", "skipped");
+    for (size_t i = 0; i < SIM_TASK_COUNT; i++) {
+        const task_t *task = &scheduler.tasks[i];
+        printf("%-14s %8.1fms %10u %12.1f %12u %8u\n", sim_tasks[i].name, sim_tasks[i].interval_us / 1000.0,
+               task->runs, task->runs ? (double)task->late_total_us / task->runs : 0.0, task->late_max_us,
+               task->overruns);
+        failed |= task->late_max_us > bound || task->overruns > 0;
+    }
+    printf("\n");
+    print_intervals("Scheduled");
+    printf("Idle %.1f%%, %u wakeups\n", task_scheduler_idle_percent(&scheduler), scheduler.wakeups);
+
+    // Polled: the loop never sleeps, each pass costs a little, and the
+    // heartbeat goes out once more than an interval has passed since the
+    // last one
+    start_run();
+    uint64_t last_heartbeat = 0;
+    while (hal_host_time_us64() < duration_us) {
+        receive_packets();
+        uint64_t now = hal_host_time_us64();
+        if (now - last_heartbeat > HEARTBEAT_INTERVAL_US) {
+            run_task((void *)&sim_tasks[0], (uint32_t)now);
+            last_heartbeat = now;
+        }
+        hal_host_advance_time(SIM_POLL_PASS_US);
+    }
+    print_intervals("Polled");
+
+    printf("\nLatest run within %u us of its deadline: %s\n", bound, failed ? "FAIL" : "ok");
+    return failed ? 1 : 0;
+}
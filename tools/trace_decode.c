@@ -0,0 +1,182 @@
+// Decode a stage profiler dump into a cost breakdown and a Chrome trace.
+//
+// Usage: trace_decode DUMP [TRACE_JSON]
+//
+// DUMP is the output of the 'd' command of the configuration menu (the USB
+// log around it is skipped) or of pipeline_soak --trace; both use the format
+// in src/trace.h. Prints calls, total, average, maximum and self time per
+// stage, where self time excludes stages nested inside. TRACE_JSON gets one
+// complete event per stage call, to be opened in chrome://tracing or
+// Perfetto; each core is a thread with time starting at its first event.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#define DECODE_MAX_DEPTH 16
+
+typedef struct {
+    uint8_t stage;
+    uint64_t begin;
+    uint64_t children;
+} decode_frame_t;
+
+typedef struct {
+    uint64_t calls;
+    uint64_t total;
+    uint64_t self;
+    uint64_t max;
+} decode_stage_t;
+
+typedef struct {
+    bool started;
+    uint32_t last_cycles;
+    uint64_t now;
+    decode_frame_t stack[DECODE_MAX_DEPTH];
+    int depth;
+} decode_core_t;
+
+static decode_stage_t stages[TRACE_STAGE_COUNT];
+static decode_core_t cores[256];
+
+static uint8_t *load_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = size > 0 ? malloc((size_t)size) : NULL;
+    *length = data ? fread(data, 1, (size_t)size, file) : 0;
+    fclose(file);
+    return data;
+}
+
+// Offset of the first valid header, or length if there is none
+static size_t find_header(const uint8_t *data, size_t length, trace_header_t *header) {
+    for (size_t i = 0; i + TRACE_HEADER_SIZE <= length; i++) {
+        if (data[i] == TRACE_MAGIC[0] && trace_parse_header(&data[i], length - i, header)) {
+            return i;
+        }
+    }
+    return length;
+}
+
+static void write_span(FILE *json, bool *first, uint8_t core, uint8_t stage, uint64_t begin, uint64_t duration,
+                       double cycles_per_us) {
+    if (!json) {
+        return;
+    }
+    fprintf(json, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            *first ? "" : ",", trace_stage_name(stage), core, (double)begin / cycles_per_us,
+            (double)duration / cycles_per_us);
+    *first = false;
+}
+
+// Counters wrap, so time advances by the difference modulo the counter
+// width; gaps longer than one wrap cannot be seen
+static void decode_event(const trace_event_t *event, uint32_t counter_mask, FILE *json, bool *first,
+                         double cycles_per_us) {
+    decode_core_t *core = &cores[event->core];
+    if (core->started) {
+        core->now += (event->cycles - core->last_cycles) & counter_mask;
+    }
+    core->started = true;
+    core->last_cycles = event->cycles;
+    if (event->stage >= TRACE_STAGE_COUNT) {
+        return;
+    }
+
+    if (event->phase == TRACE_PHASE_BEGIN) {
+        if (core->depth < DECODE_MAX_DEPTH) {
+            core->stack[core->depth++] = (decode_frame_t){ event->stage, core->now, 0 };
+        }
+        return;
+    }
+
+    // An end without its begin was cut off by the ring, drop it
+    if (core->depth == 0 || core->stack[core->depth - 1].stage != event->stage) {
+        return;
+    }
+    const decode_frame_t *frame = &core->stack[--core->depth];
+    uint64_t duration = core->now - frame->begin;
+    decode_stage_t *stage = &stages[event->stage];
+    stage->calls++;
+    stage->total += duration;
+    stage->self += duration - frame->children;
+    if (duration > stage->max) {
+        stage->max = duration;
+    }
+    if (core->depth > 0) {
+        core->stack[core->depth - 1].children += duration;
+    }
+    write_span(json, first, event->core, event->stage, frame->begin, duration, cycles_per_us);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s DUMP [TRACE_JSON]\n", argv[0]);
+        return 2;
+    }
+
+    size_t length = 0;
+    uint8_t *data = load_file(argv[1], &length);
+    if (!data) {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return 1;
+    }
+    trace_header_t header;
+    size_t offset = find_header(data, length, &header);
+    if (offset == length) {
+        fprintf(stderr, "No trace dump found in %s\n", argv[1]);
+        return 1;
+    }
+    offset += TRACE_HEADER_SIZE;
+    uint32_t available = (uint32_t)((length - offset) / TRACE_EVENT_SIZE);
+    if (available < header.event_count) {
+        fprintf(stderr, "Dump truncated: %u of %u events\n", available, header.event_count);
+        header.event_count = available;
+    }
+
+    FILE *json = NULL;
+    if (argc > 2) {
+        json = fopen(argv[2], "w");
+        if (!json) {
+            fprintf(stderr, "Cannot write %s\n", argv[2]);
+            return 1;
+        }
+        fprintf(json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    }
+
+    uint32_t counter_mask = header.counter_bits >= 32 ? 0xFFFFFFFFu : (1u << header.counter_bits) - 1;
+    double cycles_per_us = header.counter_hz / 1e6;
+    bool first = true;
+    for (uint32_t i = 0; i < header.event_count; i++) {
+        trace_event_t event;
+        trace_parse_event(&data[offset + (size_t)i * TRACE_EVENT_SIZE], &event);
+        decode_event(&event, counter_mask, json, &first, cycles_per_us);
+    }
+
+    if (json) {
+        fprintf(json, "\n]}\n");
+        fclose(json);
+    }
+
+    printf("%u events, %u bit counter at %.1f MHz\n\n", header.event_count, header.counter_bits,
+           header.counter_hz / 1e6);
+    printf("%-18s %10s %12s %10s %10s %12s %8s\n", "stage", "calls", "total us", "avg us", "max us",
+           "self us", "cyc/call");
+    for (int i = 0; i < TRACE_STAGE_COUNT; i++) {
+        const decode_stage_t *stage = &stages[i];
+        if (stage->calls == 0) {
+            continue;
+        }
+        printf("%-18s %10llu %12.1f %10.3f %10.3f %12.1f %8llu\n", trace_stage_name((uint8_t)i),
+               (unsigned long long)stage->calls, stage->total / cycles_per_us,
+               stage->total / cycles_per_us / (double)stage->calls, stage->max / cycles_per_us,
+               stage->self / cycles_per_us, (unsigned long long)(stage->total / stage->calls));
+    }
+    free(data);
+    return 0;
+}
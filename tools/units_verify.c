@@ -0,0 +1,119 @@
+// Exhaustive check of the unit conversion kernels in units.h.
+//
+// Usage: units_verify
+//
+// Runs every kernel over its whole 32-bit input domain, or the 30 bits of a
+// GPS coordinate, and compares it with the conversion done in 64-bit
+// arithmetic with division, saturated the same way. Reports the inputs
+// checked and the first mismatch per kernel; exits with 1 if there was one.
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "units.h"
+
+typedef struct {
+    const char *name;
+    uint64_t domain;
+    int64_t (*kernel)(uint32_t input);
+    int64_t (*reference)(uint32_t input);
+} verify_case_t;
+
+static int64_t saturate(int64_t value, int64_t min, int64_t max) {
+    return value < min ? min : value > max ? max : value;
+}
+
+static int64_t kernel_gps_to_decimal(uint32_t input) {
+    return units_gps_to_decimal(input);
+}
+
+static int64_t reference_gps_to_decimal(uint32_t input) {
+    int64_t degrees = input / 1000000;
+    int64_t minutes = (input % 1000000) / 10000;
+    int64_t minutes_frac = input % 10000;
+    int64_t decimal = degrees * 10000000 + (minutes * 10000000) / 60 + (minutes_frac * 1000) / 60;
+    return saturate(decimal, 0, UNITS_GPS_COORD_MAX);
+}
+
+static int64_t kernel_gps_speed(uint32_t input) {
+    return units_gps_speed(input);
+}
+
+static int64_t reference_gps_speed(uint32_t input) {
+    return saturate(((int64_t)input * 1852) / 10000, 0, 0xFFFF);
+}
+
+static int64_t kernel_gps_heading(uint32_t input) {
+    return units_gps_heading(input);
+}
+
+static int64_t reference_gps_heading(uint32_t input) {
+    return saturate(input / 100, 0, 0xFFFF);
+}
+
+static int64_t kernel_altitude_to_meters(uint32_t input) {
+    return units_altitude_to_meters(input);
+}
+
+static int64_t reference_altitude_to_meters(uint32_t input) {
+    return saturate(input / 10, 0, 0xFFFF);
+}
+
+static int64_t kernel_div10_signed(uint32_t input) {
+    return units_div10_signed((int32_t)input);
+}
+
+static int64_t reference_div10_signed(uint32_t input) {
+    return (int64_t)(int32_t)input / 10;
+}
+
+static int64_t kernel_scale_u16(uint32_t input) {
+    return units_scale_u16(input, 100);
+}
+
+static int64_t reference_scale_u16(uint32_t input) {
+    return saturate((int64_t)input * 100, 0, 0xFFFF);
+}
+
+static int64_t kernel_saturate_s16(uint32_t input) {
+    return units_saturate_s16(input);
+}
+
+static int64_t reference_saturate_s16(uint32_t input) {
+    return saturate((int32_t)input, INT16_MIN, INT16_MAX);
+}
+
+static const verify_case_t verify_cases[] = {
+    { "gps_to_decimal", 1ull << 30, kernel_gps_to_decimal, reference_gps_to_decimal },
+    { "gps_speed", 1ull << 32, kernel_gps_speed, reference_gps_speed },
+    { "gps_heading", 1ull << 32, kernel_gps_heading, reference_gps_heading },
+    { "altitude_to_meters", 1ull << 32, kernel_altitude_to_meters, reference_altitude_to_meters },
+    { "div10_signed", 1ull << 32, kernel_div10_signed, reference_div10_signed },
+    { "scale_u16 x100", 1ull << 32, kernel_scale_u16, reference_scale_u16 },
+    { "saturate_s16", 1ull << 32, kernel_saturate_s16, reference_saturate_s16 },
+};
+
+#define VERIFY_CASE_COUNT (sizeof(verify_cases) / sizeof(verify_cases[0]))
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        fprintf(stderr, "Usage: %s\n", argv[0]);
+        return 2;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < VERIFY_CASE_COUNT; i++) {
+        const verify_case_t *c = &verify_cases[i];
+        uint64_t mismatches = 0;
+        for (uint64_t n = 0; n < c->domain; n++) {
+            int64_t got = c->kernel((uint32_t)n);
+            int64_t expected = c->reference((uint32_t)n);
+            if (got != expected && mismatches++ == 0) {
+                printf("%-20s input %" PRIu64 ": got %" PRId64 ", expected %" PRId64 "\n", c->name, n, got,
+                       expected);
+            }
+        }
+        printf("%-20s %12" PRIu64 " inputs  %s\n", c->name, c->domain, mismatches ? "FAIL" : "ok");
+        failures += mismatches ? 1 : 0;
+    }
+    return failures ? 1 : 0;
+}